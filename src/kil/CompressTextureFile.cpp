@@ -0,0 +1,578 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "CompressTextureFile.h"
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define KIL_USE_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define KIL_USE_NEON 1
+#endif
+
+#include <stb/stb_image.h>
+
+namespace kil
+{
+    typedef unsigned char u8;
+
+    int GetBlockCompressionBytesPerBlock(int format)
+    {
+        return (format == BLOCK_COMPRESSION_BC1) ? 8 : 16;
+    }
+
+    // Gathers a 4x4 block as 64 bytes of RGBA. Edge blocks repeat the last row/column.
+    static void LoadBlock(u8 px[64], const u8* rgba, int width, int height, int bx, int by)
+    {
+        for (int y = 0; y < 4; y++)
+        {
+            int sy = std::min<int>(by * 4 + y, height - 1);
+            for (int x = 0; x < 4; x++)
+            {
+                int sx = std::min<int>(bx * 4 + x, width - 1);
+                memcpy(px + (y * 4 + x) * 4, rgba + ((size_t)sy * width + sx) * 4, 4);
+            }
+        }
+    }
+
+    static void GetBlockMinMax(const u8 px[64], u8 mn[4], u8 mx[4])
+    {
+#if defined(KIL_USE_SSE2)
+        __m128i a = _mm_loadu_si128((const __m128i*)(px + 0));
+        __m128i b = _mm_loadu_si128((const __m128i*)(px + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*)(px + 32));
+        __m128i d = _mm_loadu_si128((const __m128i*)(px + 48));
+        __m128i lo = _mm_min_epu8(_mm_min_epu8(a, b), _mm_min_epu8(c, d));
+        __m128i hi = _mm_max_epu8(_mm_max_epu8(a, b), _mm_max_epu8(c, d));
+        lo = _mm_min_epu8(lo, _mm_srli_si128(lo, 8));
+        hi = _mm_max_epu8(hi, _mm_srli_si128(hi, 8));
+        lo = _mm_min_epu8(lo, _mm_srli_si128(lo, 4));
+        hi = _mm_max_epu8(hi, _mm_srli_si128(hi, 4));
+        int l = _mm_cvtsi128_si32(lo);
+        int h = _mm_cvtsi128_si32(hi);
+        memcpy(mn, &l, 4);
+        memcpy(mx, &h, 4);
+#elif defined(KIL_USE_NEON)
+        uint8x16_t a = vld1q_u8(px + 0);
+        uint8x16_t b = vld1q_u8(px + 16);
+        uint8x16_t c = vld1q_u8(px + 32);
+        uint8x16_t d = vld1q_u8(px + 48);
+        uint8x16_t lo = vminq_u8(vminq_u8(a, b), vminq_u8(c, d));
+        uint8x16_t hi = vmaxq_u8(vmaxq_u8(a, b), vmaxq_u8(c, d));
+        uint8x8_t l = vmin_u8(vget_low_u8(lo), vget_high_u8(lo));
+        uint8x8_t h = vmax_u8(vget_low_u8(hi), vget_high_u8(hi));
+        l = vmin_u8(l, vext_u8(l, l, 4));
+        h = vmax_u8(h, vext_u8(h, h, 4));
+        u8 tl[8], th[8];
+        vst1_u8(tl, l);
+        vst1_u8(th, h);
+        memcpy(mn, tl, 4);
+        memcpy(mx, th, 4);
+#else
+        for (int c = 0; c < 4; c++)
+        {
+            mn[c] = 255;
+            mx[c] = 0;
+        }
+        for (int i = 0; i < 16; i++)
+        {
+            for (int c = 0; c < 4; c++)
+            {
+                mn[c] = std::min<u8>(mn[c], px[i * 4 + c]);
+                mx[c] = std::max<u8>(mx[c], px[i * 4 + c]);
+            }
+        }
+#endif
+    }
+
+    // Picks the bounding box diagonal that follows the block's color trend.
+    // Channels that correlate negatively with 'ref' get their min/max swapped.
+    static void SelectDiagonal(const u8 px[64], u8 e0[4], u8 e1[4], int nchannels, int ref)
+    {
+        int center[4];
+        for (int c = 0; c < 4; c++)
+        {
+            center[c] = (e0[c] + e1[c]) >> 1;
+        }
+        for (int c = 0; c < nchannels; c++)
+        {
+            if (c == ref)
+            {
+                continue;
+            }
+            int cov = 0;
+            for (int i = 0; i < 16; i++)
+            {
+                cov += (px[i * 4 + c] - center[c]) * (px[i * 4 + ref] - center[ref]);
+            }
+            if (cov < 0)
+            {
+                std::swap(e0[c], e1[c]);
+            }
+        }
+    }
+
+    static void InsetBounds(u8 mn[4], u8 mx[4], int nchannels)
+    {
+        for (int c = 0; c < nchannels; c++)
+        {
+            int inset = (mx[c] - mn[c]) >> 4;
+            mn[c] = (u8)(mn[c] + inset);
+            mx[c] = (u8)(mx[c] - inset);
+        }
+    }
+
+    static void WriteU16(u8* dst, unsigned int v)
+    {
+        dst[0] = (u8)(v & 0xFF);
+        dst[1] = (u8)((v >> 8) & 0xFF);
+    }
+
+    static void WriteU32(u8* dst, unsigned int v)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            dst[i] = (u8)((v >> (8 * i)) & 0xFF);
+        }
+    }
+
+    //-----------------------------------------------------------------------------
+    // BC1
+
+    static unsigned int To565(const u8 c[4])
+    {
+        return ((unsigned int)(c[0] >> 3) << 11) | ((unsigned int)(c[1] >> 2) << 5) | (unsigned int)(c[2] >> 3);
+    }
+
+    static void From565(u8 c[4], unsigned int v)
+    {
+        int r = (v >> 11) & 31;
+        int g = (v >> 5) & 63;
+        int b = v & 31;
+        c[0] = (u8)((r << 3) | (r >> 2));
+        c[1] = (u8)((g << 2) | (g >> 4));
+        c[2] = (u8)((b << 3) | (b >> 2));
+        c[3] = 255;
+    }
+
+    static void EncodeBC1Block(u8* dst, const u8 px[64])
+    {
+        u8 mn[4], mx[4];
+        GetBlockMinMax(px, mn, mx);
+        InsetBounds(mn, mx, 3);
+        SelectDiagonal(px, mx, mn, 3, 1);
+
+        unsigned int c0 = To565(mx);
+        unsigned int c1 = To565(mn);
+        if (c0 < c1)
+        {
+            std::swap(c0, c1);
+        }
+        WriteU16(dst + 0, c0);
+        WriteU16(dst + 2, c1);
+        if (c0 == c1)
+        {
+            WriteU32(dst + 4, 0);
+            return;
+        }
+
+        // Project onto the endpoint axis; linear positions 0..3 map to BC1 codes 0, 2, 3, 1.
+        static const unsigned int kOrder[4] = {0, 2, 3, 1};
+        u8 p0[4], p1[4];
+        From565(p0, c0);
+        From565(p1, c1);
+        int dir[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+        int len2 = dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2];
+        unsigned int indices = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            const u8* p = px + i * 4;
+            int d = (p[0] - p0[0]) * dir[0] + (p[1] - p0[1]) * dir[1] + (p[2] - p0[2]) * dir[2];
+            int t = (d * 6 + len2) / (2 * len2);
+            t = std::max<int>(0, std::min<int>(3, t));
+            indices |= kOrder[t] << (2 * i);
+        }
+        WriteU32(dst + 4, indices);
+    }
+
+    //-----------------------------------------------------------------------------
+    // BC4 (BC3 alpha, BC5 channels)
+
+    static void EncodeBC4Block(u8* dst, const u8 px[64], int channel)
+    {
+        int a0 = 0;
+        int a1 = 255;
+        for (int i = 0; i < 16; i++)
+        {
+            a0 = std::max<int>(a0, px[i * 4 + channel]);
+            a1 = std::min<int>(a1, px[i * 4 + channel]);
+        }
+        dst[0] = (u8)a0;
+        dst[1] = (u8)a1;
+        memset(dst + 2, 0, 6);
+        if (a0 == a1)
+        {
+            return;
+        }
+
+        // a0 > a1 selects the 8 value mode. Linear positions 0..7 map to codes 0, 2..7, 1.
+        static const unsigned int kOrder[8] = {0, 2, 3, 4, 5, 6, 7, 1};
+        int range = a0 - a1;
+        unsigned long long bits = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            int t = ((a0 - px[i * 4 + channel]) * 14 + range) / (2 * range);
+            t = std::max<int>(0, std::min<int>(7, t));
+            bits |= (unsigned long long)kOrder[t] << (3 * i);
+        }
+        for (int i = 0; i < 6; i++)
+        {
+            dst[2 + i] = (u8)((bits >> (8 * i)) & 0xFF);
+        }
+    }
+
+    static void EncodeBC3Block(u8* dst, const u8 px[64])
+    {
+        EncodeBC4Block(dst, px, 3);
+        EncodeBC1Block(dst + 8, px);
+    }
+
+    static void EncodeBC5Block(u8* dst, const u8 px[64])
+    {
+        EncodeBC4Block(dst, px, 0);
+        EncodeBC4Block(dst + 8, px, 1);
+    }
+
+    //-----------------------------------------------------------------------------
+    // BC7 (mode 6 only: one subset, RGBA 7.7.7.7 endpoints with a p-bit each, 4 bit indices)
+
+    static void WriteBits(u8* dst, int& pos, unsigned int value, int count)
+    {
+        for (int i = 0; i < count; i++, pos++)
+        {
+            if ((value >> i) & 1)
+            {
+                dst[pos >> 3] |= (u8)(1 << (pos & 7));
+            }
+        }
+    }
+
+    static void QuantizeMode6Endpoint(const u8 e[4], int q[4], int& pbit)
+    {
+        int best_err = -1;
+        for (int p = 0; p < 2; p++)
+        {
+            int err = 0;
+            int tq[4];
+            for (int c = 0; c < 4; c++)
+            {
+                tq[c] = std::max<int>(0, std::min<int>(127, (e[c] - p + 1) >> 1));
+                int r = (tq[c] << 1) | p;
+                err += (r - e[c]) * (r - e[c]);
+            }
+            if (best_err < 0 || err < best_err)
+            {
+                best_err = err;
+                pbit = p;
+                memcpy(q, tq, sizeof(tq));
+            }
+        }
+    }
+
+    static void EncodeBC7Block(u8* dst, const u8 px[64])
+    {
+        static const int kWeights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+        u8 mn[4], mx[4];
+        GetBlockMinMax(px, mn, mx);
+        InsetBounds(mn, mx, 4);
+        SelectDiagonal(px, mn, mx, 4, 1);
+
+        int q0[4], q1[4];
+        int p0 = 0, p1 = 0;
+        QuantizeMode6Endpoint(mn, q0, p0);
+        QuantizeMode6Endpoint(mx, q1, p1);
+
+        int e0[4], e1[4];
+        for (int c = 0; c < 4; c++)
+        {
+            e0[c] = (q0[c] << 1) | p0;
+            e1[c] = (q1[c] << 1) | p1;
+        }
+
+        // Nearest weight for every projected position 0..64.
+        int nearest[65];
+        for (int t = 0; t <= 64; t++)
+        {
+            int best = 0;
+            for (int k = 1; k < 16; k++)
+            {
+                if (abs(kWeights[k] - t) < abs(kWeights[best] - t))
+                {
+                    best = k;
+                }
+            }
+            nearest[t] = best;
+        }
+
+        int dir[4] = {e1[0] - e0[0], e1[1] - e0[1], e1[2] - e0[2], e1[3] - e0[3]};
+        int len2 = dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2] + dir[3] * dir[3];
+        int indices[16];
+        for (int i = 0; i < 16; i++)
+        {
+            if (len2 == 0)
+            {
+                indices[i] = 0;
+                continue;
+            }
+            const u8* p = px + i * 4;
+            int d = 0;
+            for (int c = 0; c < 4; c++)
+            {
+                d += (p[c] - e0[c]) * dir[c];
+            }
+            int t = (d * 128 + len2) / (2 * len2);
+            indices[i] = nearest[std::max<int>(0, std::min<int>(64, t))];
+        }
+
+        // The anchor index is stored with 3 bits, so its top bit must be zero.
+        if (indices[0] & 8)
+        {
+            std::swap(q0, q1);
+            std::swap(p0, p1);
+            for (int i = 0; i < 16; i++)
+            {
+                indices[i] = 15 - indices[i];
+            }
+        }
+
+        memset(dst, 0, 16);
+        int pos = 0;
+        WriteBits(dst, pos, 1 << 6, 7);
+        for (int c = 0; c < 4; c++)
+        {
+            WriteBits(dst, pos, q0[c], 7);
+            WriteBits(dst, pos, q1[c], 7);
+        }
+        WriteBits(dst, pos, p0, 1);
+        WriteBits(dst, pos, p1, 1);
+        WriteBits(dst, pos, indices[0], 3);
+        for (int i = 1; i < 16; i++)
+        {
+            WriteBits(dst, pos, indices[i], 4);
+        }
+    }
+
+    //-----------------------------------------------------------------------------
+
+    bool CompressImageBC(std::vector<unsigned char>& blocks, const unsigned char* rgba, int width, int height, int format)
+    {
+        if (rgba == NULL || width <= 0 || height <= 0)
+        {
+            return false;
+        }
+        void (*encode)(u8*, const u8*) = NULL;
+        switch (format)
+        {
+        case BLOCK_COMPRESSION_BC1:
+            encode = EncodeBC1Block;
+            break;
+        case BLOCK_COMPRESSION_BC3:
+            encode = EncodeBC3Block;
+            break;
+        case BLOCK_COMPRESSION_BC5:
+            encode = EncodeBC5Block;
+            break;
+        case BLOCK_COMPRESSION_BC7:
+            encode = EncodeBC7Block;
+            break;
+        default:
+            return false;
+        }
+
+        int bw = (width + 3) / 4;
+        int bh = (height + 3) / 4;
+        int bsize = GetBlockCompressionBytesPerBlock(format);
+        blocks.resize((size_t)bw * bh * bsize);
+        u8* out = &blocks[0];
+        ParallelFor(0, bh, [&](int by) {
+            u8 px[64];
+            for (int bx = 0; bx < bw; bx++)
+            {
+                LoadBlock(px, rgba, width, height, bx, by);
+                encode(out + ((size_t)by * bw + bx) * bsize, px);
+            }
+        });
+        return true;
+    }
+
+    //-----------------------------------------------------------------------------
+    // KTX2
+
+    static void GetKTX2FormatInfo(int format, bool is_srgb, unsigned int& vk_format, unsigned int& color_model)
+    {
+        switch (format)
+        {
+        case BLOCK_COMPRESSION_BC1:
+            vk_format = is_srgb ? 132 : 131; // VK_FORMAT_BC1_RGB_SRGB_BLOCK / UNORM
+            color_model = 128;               // KHR_DF_MODEL_BC1A
+            break;
+        case BLOCK_COMPRESSION_BC3:
+            vk_format = is_srgb ? 138 : 137; // VK_FORMAT_BC3_SRGB_BLOCK / UNORM
+            color_model = 130;               // KHR_DF_MODEL_BC3
+            break;
+        case BLOCK_COMPRESSION_BC5:
+            vk_format = 141; // VK_FORMAT_BC5_UNORM_BLOCK
+            color_model = 132; // KHR_DF_MODEL_BC5
+            break;
+        default:
+            vk_format = is_srgb ? 146 : 145; // VK_FORMAT_BC7_SRGB_BLOCK / UNORM
+            color_model = 134;               // KHR_DF_MODEL_BC7
+            break;
+        }
+    }
+
+    static void PushU32(std::vector<u8>& v, unsigned int x)
+    {
+        u8 b[4];
+        WriteU32(b, x);
+        v.insert(v.end(), b, b + 4);
+    }
+
+    static void PushU64(std::vector<u8>& v, unsigned long long x)
+    {
+        PushU32(v, (unsigned int)(x & 0xFFFFFFFF));
+        PushU32(v, (unsigned int)(x >> 32));
+    }
+
+    static void PushSample(std::vector<u8>& v, int bit_offset, int bit_length, int channel)
+    {
+        PushU32(v, (unsigned int)bit_offset | ((unsigned int)(bit_length - 1) << 16) | ((unsigned int)channel << 24));
+        PushU32(v, 0);          // sample position
+        PushU32(v, 0);          // lower
+        PushU32(v, 0xFFFFFFFF); // upper
+    }
+
+    bool WriteKTX2File(const std::string& dst_path, const std::vector<unsigned char>& blocks, int width, int height, int format, bool is_srgb)
+    {
+        if (blocks.empty())
+        {
+            return false;
+        }
+        bool srgb = is_srgb && format != BLOCK_COMPRESSION_BC5;
+        unsigned int vk_format = 0;
+        unsigned int color_model = 0;
+        GetKTX2FormatInfo(format, srgb, vk_format, color_model);
+        int bsize = GetBlockCompressionBytesPerBlock(format);
+
+        // Data Format Descriptor: one basic block.
+        std::vector<u8> dfd;
+        {
+            int nsamples = (format == BLOCK_COMPRESSION_BC3 || format == BLOCK_COMPRESSION_BC5) ? 2 : 1;
+            unsigned int block_size = 24 + 16 * nsamples;
+            PushU32(dfd, 4 + block_size);
+            PushU32(dfd, 0);                       // vendorId, descriptorType
+            PushU32(dfd, 2 | (block_size << 16));  // versionNumber, descriptorBlockSize
+            PushU32(dfd, color_model | (1 << 8) | ((srgb ? 2u : 1u) << 16)); // BT709 primaries, transfer, straight alpha
+            PushU32(dfd, 3 | (3 << 8));            // 4x4x1x1 texel block
+            PushU32(dfd, (unsigned int)bsize);     // bytesPlane0
+            PushU32(dfd, 0);
+            if (format == BLOCK_COMPRESSION_BC3)
+            {
+                PushSample(dfd, 0, 64, 15);  // alpha
+                PushSample(dfd, 64, 64, 0);  // color
+            }
+            else if (format == BLOCK_COMPRESSION_BC5)
+            {
+                PushSample(dfd, 0, 64, 0);   // red
+                PushSample(dfd, 64, 64, 1);  // green
+            }
+            else
+            {
+                PushSample(dfd, 0, bsize * 8, 0);
+            }
+        }
+
+        std::vector<u8> kvd;
+        {
+            const char key[] = "KTXwriter";
+            const char value[] = "kil";
+            PushU32(kvd, (unsigned int)(sizeof(key) + sizeof(value)));
+            kvd.insert(kvd.end(), key, key + sizeof(key));
+            kvd.insert(kvd.end(), value, value + sizeof(value));
+            while (kvd.size() % 4)
+            {
+                kvd.push_back(0);
+            }
+        }
+
+        const size_t header_size = 12 + 9 * 4 + 4 * 4 + 2 * 8 + 3 * 8; // identifier, header, index, one level
+        size_t dfd_offset = header_size;
+        size_t kvd_offset = dfd_offset + dfd.size();
+        size_t data_offset = kvd_offset + kvd.size();
+        while (data_offset % bsize)
+        {
+            data_offset++;
+        }
+
+        std::vector<u8> head;
+        static const u8 kIdentifier[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+        head.insert(head.end(), kIdentifier, kIdentifier + 12);
+        PushU32(head, vk_format);
+        PushU32(head, 1); // typeSize
+        PushU32(head, (unsigned int)width);
+        PushU32(head, (unsigned int)height);
+        PushU32(head, 0); // pixelDepth
+        PushU32(head, 0); // layerCount
+        PushU32(head, 1); // faceCount
+        PushU32(head, 1); // levelCount
+        PushU32(head, 0); // supercompressionScheme
+        PushU32(head, (unsigned int)dfd_offset);
+        PushU32(head, (unsigned int)dfd.size());
+        PushU32(head, (unsigned int)kvd_offset);
+        PushU32(head, (unsigned int)kvd.size());
+        PushU64(head, 0); // sgd
+        PushU64(head, 0);
+        PushU64(head, data_offset);
+        PushU64(head, blocks.size());
+        PushU64(head, blocks.size());
+        head.insert(head.end(), dfd.begin(), dfd.end());
+        head.insert(head.end(), kvd.begin(), kvd.end());
+        head.resize(data_offset, 0);
+
+        FILE* fp = fopen(dst_path.c_str(), "wb");
+        if (!fp)
+        {
+            return false;
+        }
+        bool ret = fwrite(&head[0], 1, head.size(), fp) == head.size();
+        ret = ret && fwrite(&blocks[0], 1, blocks.size(), fp) == blocks.size();
+        fclose(fp);
+        return ret;
+    }
+
+    bool CompressTextureFile(const std::string& src_path, const std::string& dst_path, int format, bool is_srgb)
+    {
+        int width = 0;
+        int height = 0;
+        int channels = 0;
+        stbi_uc* buffer = stbi_load(src_path.c_str(), &width, &height, &channels, 4);
+        if (buffer == NULL)
+        {
+            return false;
+        }
+        std::vector<unsigned char> blocks;
+        bool ret = CompressImageBC(blocks, buffer, width, height, format);
+        stbi_image_free(buffer);
+        if (!ret)
+        {
+            return false;
+        }
+        return WriteKTX2File(dst_path, blocks, width, height, format, is_srgb);
+    }
+} // namespace kil
@@ -0,0 +1,25 @@
+#pragma once
+#ifndef _KIL_COMPRESS_TEXTURE_FILE_H_
+#define _KIL_COMPRESS_TEXTURE_FILE_H_
+
+#include <string>
+#include <vector>
+
+namespace kil
+{
+    enum BlockCompressionFormat
+    {
+        BLOCK_COMPRESSION_BC1 = 0, // RGB, 8 bytes per block
+        BLOCK_COMPRESSION_BC3,     // RGBA, 16 bytes per block
+        BLOCK_COMPRESSION_BC5,     // RG (normal maps), 16 bytes per block
+        BLOCK_COMPRESSION_BC7      // RGBA, 16 bytes per block
+    };
+
+    int GetBlockCompressionBytesPerBlock(int format);
+    // rgba is width * height * 4 bytes. blocks receives ceil(width/4) * ceil(height/4) blocks in row-major order.
+    bool CompressImageBC(std::vector<unsigned char>& blocks, const unsigned char* rgba, int width, int height, int format);
+    bool WriteKTX2File(const std::string& dst_path, const std::vector<unsigned char>& blocks, int width, int height, int format, bool is_srgb);
+    bool CompressTextureFile(const std::string& src_path, const std::string& dst_path, int format, bool is_srgb = true);
+}
+
+#endif
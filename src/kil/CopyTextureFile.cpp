@@ -94,7 +94,7 @@ namespace kil
             return false;
         }
 #else
-        if (copyfile(orgPath.c_str(), dstPath.c_str()))
+        if (copyfile(orgPath.c_str(), dstPath.c_str()) == 0)
         {
             return true;
         }
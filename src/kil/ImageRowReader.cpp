@@ -0,0 +1,750 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "ImageRowReader.h"
+
+#include <algorithm>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+namespace kil
+{
+    namespace
+    {
+        //-----------------------------------------------------------------------------
+        // Streaming inflate (RFC 1951) with a 32KB window. Bytes are produced on demand.
+
+        class ByteSource
+        {
+        public:
+            virtual ~ByteSource() {}
+            virtual int GetByte() = 0; // -1 at end
+        };
+
+        struct Huffman
+        {
+            unsigned short fast[1 << 9];
+            unsigned short firstcode[16];
+            int maxcode[17];
+            unsigned short firstsymbol[16];
+            unsigned char size[288];
+            unsigned short value[288];
+        };
+
+        static int BitReverse(int v, int bits)
+        {
+            int r = 0;
+            for (int i = 0; i < bits; i++)
+            {
+                r = (r << 1) | ((v >> i) & 1);
+            }
+            return r;
+        }
+
+        static bool BuildHuffman(Huffman& h, const unsigned char* sizelist, int num)
+        {
+            int sizes[17] = {};
+            int next_code[16] = {};
+            memset(h.fast, 0, sizeof(h.fast));
+            for (int i = 0; i < num; i++)
+            {
+                sizes[sizelist[i]]++;
+            }
+            sizes[0] = 0;
+            int code = 0;
+            int k = 0;
+            for (int i = 1; i < 16; i++)
+            {
+                next_code[i] = code;
+                h.firstcode[i] = (unsigned short)code;
+                h.firstsymbol[i] = (unsigned short)k;
+                code += sizes[i];
+                if (sizes[i] && code - 1 >= (1 << i))
+                {
+                    return false;
+                }
+                h.maxcode[i] = code << (16 - i);
+                code <<= 1;
+                k += sizes[i];
+            }
+            h.maxcode[16] = 0x10000;
+            for (int i = 0; i < num; i++)
+            {
+                int s = sizelist[i];
+                if (s)
+                {
+                    int c = next_code[s] - h.firstcode[s] + h.firstsymbol[s];
+                    h.size[c] = (unsigned char)s;
+                    h.value[c] = (unsigned short)i;
+                    if (s <= 9)
+                    {
+                        int j = BitReverse(next_code[s], s);
+                        while (j < (1 << 9))
+                        {
+                            h.fast[j] = (unsigned short)((s << 9) | i);
+                            j += (1 << s);
+                        }
+                    }
+                    next_code[s]++;
+                }
+            }
+            return true;
+        }
+
+        static const int kLengthBase[31] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258, 0, 0};
+        static const int kLengthExtra[31] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0, 0, 0};
+        static const int kDistBase[32] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577, 0, 0};
+        static const int kDistExtra[32] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13, 0, 0};
+
+        class Inflater
+        {
+        public:
+            explicit Inflater(ByteSource* src)
+                : src_(src), bits_(0), nbits_(0), eof_bytes_(0), state_(STATE_HEADER), final_(false),
+                  stored_left_(0), copy_left_(0), copy_dist_(0), window_(kWindowSize), wpos_(0), error_(false)
+            {
+            }
+
+            bool ReadZlibHeader()
+            {
+                int cmf = src_->GetByte();
+                int flg = src_->GetByte();
+                if (cmf < 0 || flg < 0 || ((cmf << 8) | flg) % 31 != 0 || (cmf & 15) != 8 || (flg & 32))
+                {
+                    return false;
+                }
+                return true;
+            }
+
+            // Fills dst with exactly n bytes. Returns false on corrupt or truncated data.
+            bool Read(unsigned char* dst, size_t n)
+            {
+                size_t i = 0;
+                while (i < n)
+                {
+                    if (error_)
+                    {
+                        return false;
+                    }
+                    if (copy_left_ > 0)
+                    {
+                        unsigned char c = window_[(wpos_ - copy_dist_) & (kWindowSize - 1)];
+                        Emit(dst[i++], c);
+                        copy_left_--;
+                        continue;
+                    }
+                    switch (state_)
+                    {
+                    case STATE_HEADER:
+                        if (final_ || !ReadBlockHeader())
+                        {
+                            return false;
+                        }
+                        break;
+                    case STATE_STORED:
+                        if (stored_left_ == 0)
+                        {
+                            state_ = STATE_HEADER;
+                            break;
+                        }
+                        Emit(dst[i++], (unsigned char)GetBits(8));
+                        stored_left_--;
+                        break;
+                    case STATE_HUFFMAN:
+                    {
+                        int sym = Decode(litlen_);
+                        if (sym < 0)
+                        {
+                            return false;
+                        }
+                        if (sym < 256)
+                        {
+                            Emit(dst[i++], (unsigned char)sym);
+                        }
+                        else if (sym == 256)
+                        {
+                            state_ = STATE_HEADER;
+                        }
+                        else
+                        {
+                            sym -= 257;
+                            if (sym >= 29)
+                            {
+                                return false;
+                            }
+                            int len = kLengthBase[sym] + (int)GetBits(kLengthExtra[sym]);
+                            int dsym = Decode(dist_);
+                            if (dsym < 0 || dsym >= 30)
+                            {
+                                return false;
+                            }
+                            copy_dist_ = kDistBase[dsym] + (int)GetBits(kDistExtra[dsym]);
+                            copy_left_ = len;
+                        }
+                        break;
+                    }
+                    }
+                }
+                return eof_bytes_ <= 4;
+            }
+
+        private:
+            enum
+            {
+                kWindowSize = 32768
+            };
+            enum State
+            {
+                STATE_HEADER,
+                STATE_STORED,
+                STATE_HUFFMAN
+            };
+
+            void Fill()
+            {
+                while (nbits_ <= 24)
+                {
+                    int c = src_->GetByte();
+                    if (c < 0)
+                    {
+                        c = 0;
+                        eof_bytes_++;
+                    }
+                    bits_ |= (unsigned int)c << nbits_;
+                    nbits_ += 8;
+                }
+            }
+
+            unsigned int GetBits(int n)
+            {
+                if (n == 0)
+                {
+                    return 0;
+                }
+                if (nbits_ < n)
+                {
+                    Fill();
+                }
+                unsigned int v = bits_ & ((1u << n) - 1);
+                bits_ >>= n;
+                nbits_ -= n;
+                return v;
+            }
+
+            int Decode(const Huffman& h)
+            {
+                if (nbits_ < 16)
+                {
+                    Fill();
+                }
+                int b = h.fast[bits_ & ((1 << 9) - 1)];
+                if (b)
+                {
+                    int s = b >> 9;
+                    bits_ >>= s;
+                    nbits_ -= s;
+                    return b & 511;
+                }
+                int k = BitReverse(bits_ & 0xFFFF, 16);
+                int s;
+                for (s = 10;; s++)
+                {
+                    if (k < h.maxcode[s])
+                    {
+                        break;
+                    }
+                }
+                if (s >= 16)
+                {
+                    error_ = true;
+                    return -1;
+                }
+                int c = (k >> (16 - s)) - h.firstcode[s] + h.firstsymbol[s];
+                if (c < 0 || c >= 288 || h.size[c] != s)
+                {
+                    error_ = true;
+                    return -1;
+                }
+                bits_ >>= s;
+                nbits_ -= s;
+                return h.value[c];
+            }
+
+            void Emit(unsigned char& out, unsigned char c)
+            {
+                out = c;
+                window_[wpos_ & (kWindowSize - 1)] = c;
+                wpos_++;
+            }
+
+            bool ReadBlockHeader()
+            {
+                final_ = GetBits(1) != 0;
+                int type = (int)GetBits(2);
+                if (type == 0)
+                {
+                    GetBits(nbits_ & 7);
+                    unsigned int len = GetBits(16);
+                    unsigned int nlen = GetBits(16);
+                    if ((len ^ 0xFFFF) != nlen)
+                    {
+                        return false;
+                    }
+                    stored_left_ = len;
+                    state_ = STATE_STORED;
+                    return true;
+                }
+                else if (type == 1)
+                {
+                    unsigned char sizes[288 + 32];
+                    int i = 0;
+                    for (; i <= 143; i++)
+                        sizes[i] = 8;
+                    for (; i <= 255; i++)
+                        sizes[i] = 9;
+                    for (; i <= 279; i++)
+                        sizes[i] = 7;
+                    for (; i <= 287; i++)
+                        sizes[i] = 8;
+                    for (i = 0; i < 32; i++)
+                        sizes[288 + i] = 5;
+                    if (!BuildHuffman(litlen_, sizes, 288) || !BuildHuffman(dist_, sizes + 288, 32))
+                    {
+                        return false;
+                    }
+                    state_ = STATE_HUFFMAN;
+                    return true;
+                }
+                else if (type == 2)
+                {
+                    static const unsigned char kOrder[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+                    int hlit = (int)GetBits(5) + 257;
+                    int hdist = (int)GetBits(5) + 1;
+                    int hclen = (int)GetBits(4) + 4;
+                    if (hlit > 286 || hdist > 30)
+                    {
+                        return false;
+                    }
+                    unsigned char clsizes[19] = {};
+                    for (int i = 0; i < hclen; i++)
+                    {
+                        clsizes[kOrder[i]] = (unsigned char)GetBits(3);
+                    }
+                    Huffman cl;
+                    if (!BuildHuffman(cl, clsizes, 19))
+                    {
+                        return false;
+                    }
+                    unsigned char sizes[288 + 32] = {};
+                    int n = 0;
+                    while (n < hlit + hdist)
+                    {
+                        int c = Decode(cl);
+                        if (c < 0)
+                        {
+                            return false;
+                        }
+                        if (c < 16)
+                        {
+                            sizes[n++] = (unsigned char)c;
+                            continue;
+                        }
+                        int rep = 0;
+                        unsigned char fill = 0;
+                        if (c == 16)
+                        {
+                            if (n == 0)
+                            {
+                                return false;
+                            }
+                            rep = 3 + (int)GetBits(2);
+                            fill = sizes[n - 1];
+                        }
+                        else if (c == 17)
+                        {
+                            rep = 3 + (int)GetBits(3);
+                        }
+                        else
+                        {
+                            rep = 11 + (int)GetBits(7);
+                        }
+                        if (n + rep > hlit + hdist)
+                        {
+                            return false;
+                        }
+                        memset(sizes + n, fill, rep);
+                        n += rep;
+                    }
+                    if (!BuildHuffman(litlen_, sizes, hlit) || !BuildHuffman(dist_, sizes + hlit, hdist))
+                    {
+                        return false;
+                    }
+                    state_ = STATE_HUFFMAN;
+                    return true;
+                }
+                return false;
+            }
+
+        private:
+            ByteSource* src_;
+            unsigned int bits_;
+            int nbits_;
+            int eof_bytes_;
+            State state_;
+            bool final_;
+            unsigned int stored_left_;
+            int copy_left_;
+            int copy_dist_;
+            std::vector<unsigned char> window_;
+            size_t wpos_;
+            bool error_;
+            Huffman litlen_;
+            Huffman dist_;
+        };
+
+        //-----------------------------------------------------------------------------
+        // PNG
+
+        static unsigned int ReadBE32(const unsigned char* p)
+        {
+            return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | (unsigned int)p[3];
+        }
+
+        class PngRowReader : public ImageRowReader, public ByteSource
+        {
+        public:
+            PngRowReader() : fp_(NULL), width_(0), height_(0), depth_(0), color_type_(0), src_channels_(0), channels_(0), bpp_(0), palette_entries_(0), row_bytes_(0), chunk_left_(0), in_idat_(false), row_(0), inflater_(this) {}
+            ~PngRowReader()
+            {
+                if (fp_)
+                {
+                    fclose(fp_);
+                }
+            }
+
+            bool Open(const std::string& path)
+            {
+                fp_ = fopen(path.c_str(), "rb");
+                if (!fp_)
+                {
+                    return false;
+                }
+                static const unsigned char kSignature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+                unsigned char sig[8];
+                if (fread(sig, 1, 8, fp_) != 8 || memcmp(sig, kSignature, 8) != 0)
+                {
+                    return false;
+                }
+
+                bool has_trns = false;
+                while (true)
+                {
+                    unsigned int length = 0;
+                    char type[5] = {};
+                    if (!ReadChunkHeader(length, type))
+                    {
+                        return false;
+                    }
+                    if (strcmp(type, "IHDR") == 0)
+                    {
+                        unsigned char h[13];
+                        if (length != 13 || fread(h, 1, 13, fp_) != 13)
+                        {
+                            return false;
+                        }
+                        width_ = (int)ReadBE32(h);
+                        height_ = (int)ReadBE32(h + 4);
+                        depth_ = h[8];
+                        color_type_ = h[9];
+                        if (h[10] != 0 || h[11] != 0 || h[12] != 0) // compression, filter, interlace
+                        {
+                            return false;
+                        }
+                        fseek(fp_, 4, SEEK_CUR);
+                    }
+                    else if (strcmp(type, "PLTE") == 0)
+                    {
+                        palette_.resize(256 * 4, 255);
+                        std::vector<unsigned char> p(length);
+                        if (length > 256 * 3 || (length && fread(&p[0], 1, length, fp_) != length))
+                        {
+                            return false;
+                        }
+                        palette_entries_ = length / 3;
+                        for (unsigned int i = 0; i < palette_entries_; i++)
+                        {
+                            memcpy(&palette_[i * 4], &p[i * 3], 3);
+                        }
+                        fseek(fp_, 4, SEEK_CUR);
+                    }
+                    else if (strcmp(type, "tRNS") == 0)
+                    {
+                        // Color key transparency on non palette images is left to the full decoder.
+                        if (color_type_ != 3 || palette_.empty() || length > palette_entries_)
+                        {
+                            return false;
+                        }
+                        std::vector<unsigned char> a(length);
+                        if (length && fread(&a[0], 1, length, fp_) != length)
+                        {
+                            return false;
+                        }
+                        for (unsigned int i = 0; i < length; i++)
+                        {
+                            palette_[i * 4 + 3] = a[i];
+                        }
+                        has_trns = true;
+                        fseek(fp_, 4, SEEK_CUR);
+                    }
+                    else if (strcmp(type, "IDAT") == 0)
+                    {
+                        chunk_left_ = length;
+                        in_idat_ = true;
+                        break;
+                    }
+                    else if (strcmp(type, "IEND") == 0)
+                    {
+                        return false;
+                    }
+                    else
+                    {
+                        fseek(fp_, (long)length + 4, SEEK_CUR);
+                    }
+                }
+
+                switch (color_type_)
+                {
+                case 0:
+                    src_channels_ = 1;
+                    break;
+                case 2:
+                    src_channels_ = 3;
+                    break;
+                case 3:
+                    src_channels_ = 1;
+                    break;
+                case 4:
+                    src_channels_ = 2;
+                    break;
+                case 6:
+                    src_channels_ = 4;
+                    break;
+                default:
+                    return false;
+                }
+                if (width_ <= 0 || height_ <= 0 || (depth_ != 1 && depth_ != 2 && depth_ != 4 && depth_ != 8 && depth_ != 16))
+                {
+                    return false;
+                }
+                if (color_type_ == 3)
+                {
+                    if (palette_.empty() || depth_ == 16)
+                    {
+                        return false;
+                    }
+                    channels_ = has_trns ? 4 : 3;
+                }
+                else
+                {
+                    channels_ = src_channels_;
+                }
+
+                bpp_ = std::max<int>(1, src_channels_ * depth_ / 8);
+                row_bytes_ = ((size_t)width_ * src_channels_ * depth_ + 7) / 8;
+                cur_.resize(row_bytes_ + 1);
+                prev_.assign(row_bytes_, 0);
+                return inflater_.ReadZlibHeader();
+            }
+
+            int GetWidth() const { return width_; }
+            int GetHeight() const { return height_; }
+            int GetChannels() const { return channels_; }
+
+            bool ReadRow(unsigned char* row)
+            {
+                if (row_ >= height_ || !inflater_.Read(&cur_[0], cur_.size()))
+                {
+                    return false;
+                }
+                row_++;
+                if (!Unfilter(cur_[0], &cur_[1]))
+                {
+                    return false;
+                }
+                Expand(row, &cur_[1]);
+                memcpy(&prev_[0], &cur_[1], row_bytes_);
+                return true;
+            }
+
+            int GetByte()
+            {
+                while (chunk_left_ == 0)
+                {
+                    if (!in_idat_)
+                    {
+                        return -1;
+                    }
+                    fseek(fp_, 4, SEEK_CUR); // crc
+                    unsigned int length = 0;
+                    char type[5] = {};
+                    if (!ReadChunkHeader(length, type) || strcmp(type, "IDAT") != 0)
+                    {
+                        in_idat_ = false;
+                        return -1;
+                    }
+                    chunk_left_ = length;
+                }
+                chunk_left_--;
+                int c = fgetc(fp_);
+                return (c == EOF) ? -1 : c;
+            }
+
+        private:
+            bool ReadChunkHeader(unsigned int& length, char type[5])
+            {
+                unsigned char h[8];
+                if (fread(h, 1, 8, fp_) != 8)
+                {
+                    return false;
+                }
+                length = ReadBE32(h);
+                memcpy(type, h + 4, 4);
+                type[4] = 0;
+                return true;
+            }
+
+            static int Paeth(int a, int b, int c)
+            {
+                int p = a + b - c;
+                int pa = abs(p - a);
+                int pb = abs(p - b);
+                int pc = abs(p - c);
+                if (pa <= pb && pa <= pc)
+                    return a;
+                if (pb <= pc)
+                    return b;
+                return c;
+            }
+
+            bool Unfilter(int filter, unsigned char* cur)
+            {
+                const unsigned char* prev = &prev_[0];
+                size_t n = row_bytes_;
+                switch (filter)
+                {
+                case 0:
+                    break;
+                case 1:
+                    for (size_t i = bpp_; i < n; i++)
+                        cur[i] = (unsigned char)(cur[i] + cur[i - bpp_]);
+                    break;
+                case 2:
+                    for (size_t i = 0; i < n; i++)
+                        cur[i] = (unsigned char)(cur[i] + prev[i]);
+                    break;
+                case 3:
+                    for (size_t i = 0; i < n; i++)
+                    {
+                        int left = (i >= (size_t)bpp_) ? cur[i - bpp_] : 0;
+                        cur[i] = (unsigned char)(cur[i] + ((left + prev[i]) >> 1));
+                    }
+                    break;
+                case 4:
+                    for (size_t i = 0; i < n; i++)
+                    {
+                        int left = (i >= (size_t)bpp_) ? cur[i - bpp_] : 0;
+                        int upleft = (i >= (size_t)bpp_) ? prev[i - bpp_] : 0;
+                        cur[i] = (unsigned char)(cur[i] + Paeth(left, prev[i], upleft));
+                    }
+                    break;
+                default:
+                    return false;
+                }
+                return true;
+            }
+
+            // Converts one unfiltered row to 8 bits per channel, the same layout stbi_load(..., 0) returns.
+            void Expand(unsigned char* out, const unsigned char* in) const
+            {
+                if (depth_ == 8 && color_type_ != 3)
+                {
+                    memcpy(out, in, (size_t)width_ * channels_);
+                    return;
+                }
+                if (depth_ == 16)
+                {
+                    for (size_t i = 0; i < (size_t)width_ * channels_; i++)
+                    {
+                        out[i] = in[i * 2];
+                    }
+                    return;
+                }
+                int mask = (1 << depth_) - 1;
+                int scale = (color_type_ == 3) ? 1 : 255 / mask;
+                for (int x = 0; x < width_; x++)
+                {
+                    int v;
+                    if (depth_ == 8)
+                    {
+                        v = in[x];
+                    }
+                    else
+                    {
+                        int bit = x * depth_;
+                        v = (in[bit >> 3] >> (8 - depth_ - (bit & 7))) & mask;
+                    }
+                    if (color_type_ == 3)
+                    {
+                        memcpy(out + x * channels_, &palette_[v * 4], channels_);
+                    }
+                    else
+                    {
+                        out[x] = (unsigned char)(v * scale);
+                    }
+                }
+            }
+
+        private:
+            FILE* fp_;
+            int width_;
+            int height_;
+            int depth_;
+            int color_type_;
+            int src_channels_;
+            int channels_;
+            int bpp_;
+            unsigned int palette_entries_;
+            size_t row_bytes_;
+            unsigned int chunk_left_;
+            bool in_idat_;
+            int row_;
+            std::vector<unsigned char> palette_;
+            std::vector<unsigned char> cur_;
+            std::vector<unsigned char> prev_;
+            Inflater inflater_;
+        };
+    }
+
+    static std::string GetExt(const std::string& filepath)
+    {
+        if (filepath.find_last_of(".") != std::string::npos)
+            return filepath.substr(filepath.find_last_of("."));
+        return "";
+    }
+
+    std::shared_ptr<ImageRowReader> OpenImageRowReader(const std::string& path)
+    {
+        std::string ext = GetExt(path);
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        if (ext == ".png")
+        {
+            std::shared_ptr<PngRowReader> reader(new PngRowReader());
+            if (reader->Open(path))
+            {
+                return reader;
+            }
+        }
+        return std::shared_ptr<ImageRowReader>();
+    }
+} // namespace kil
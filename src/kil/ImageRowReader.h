@@ -0,0 +1,25 @@
+#pragma once
+#ifndef _KIL_IMAGE_ROW_READER_H_
+#define _KIL_IMAGE_ROW_READER_H_
+
+#include <memory>
+#include <string>
+
+namespace kil
+{
+    // Decodes an image one 8 bit row at a time, top to bottom, without holding the whole image.
+    class ImageRowReader
+    {
+    public:
+        virtual ~ImageRowReader() {}
+        virtual int GetWidth() const = 0;
+        virtual int GetHeight() const = 0;
+        virtual int GetChannels() const = 0;
+        virtual bool ReadRow(unsigned char* row) = 0;
+    };
+
+    // Returns NULL when the file cannot be streamed (currently non-interlaced PNG only).
+    std::shared_ptr<ImageRowReader> OpenImageRowReader(const std::string& path);
+}
+
+#endif
@@ -0,0 +1,106 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "PackORMTextureFile.h"
+#include "ParallelFor.h"
+#include "ResizeImage.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <stb/stb_image.h>
+#include <stb/stb_image_write.h>
+
+namespace kil
+{
+    static std::string GetExt(const std::string& filepath)
+    {
+        if (filepath.find_last_of(".") != std::string::npos)
+            return filepath.substr(filepath.find_last_of("."));
+        return "";
+    }
+
+    bool PackORMTextureFile(const std::string& occlusion_path, const std::string& roughness_path, const std::string& metallic_path, const std::string& dst_path, float quality)
+    {
+        const std::string* paths[3] = {&occlusion_path, &roughness_path, &metallic_path};
+        stbi_uc* buffers[3] = {NULL, NULL, NULL};
+        int widths[3] = {0, 0, 0};
+        int heights[3] = {0, 0, 0};
+
+        ParallelFor(0, 3, [&](int i) {
+            if (!paths[i]->empty())
+            {
+                int c = 0;
+                buffers[i] = stbi_load(paths[i]->c_str(), &widths[i], &heights[i], &c, 1);
+            }
+        });
+
+        int width = 0;
+        int height = 0;
+        bool ok = true;
+        for (int i = 0; i < 3; i++)
+        {
+            if (!paths[i]->empty() && buffers[i] == NULL)
+            {
+                ok = false;
+            }
+            width = std::max<int>(width, widths[i]);
+            height = std::max<int>(height, heights[i]);
+        }
+
+        std::vector<unsigned char> orm;
+        if (ok && width > 0 && height > 0)
+        {
+            orm.resize((size_t)width * height * 3, 255);
+            std::vector<unsigned char> resized;
+            for (int i = 0; i < 3 && ok; i++)
+            {
+                if (buffers[i] == NULL)
+                {
+                    continue;
+                }
+                const unsigned char* src = buffers[i];
+                if (widths[i] != width || heights[i] != height)
+                {
+                    resized.resize((size_t)width * height);
+                    ok = ResizeImage(buffers[i], widths[i], heights[i], &resized[0], width, height, 1, false);
+                    src = &resized[0];
+                }
+                for (size_t j = 0, n = (size_t)width * height; ok && j < n; j++)
+                {
+                    orm[j * 3 + i] = src[j];
+                }
+            }
+        }
+        else
+        {
+            ok = false;
+        }
+
+        for (int i = 0; i < 3; i++)
+        {
+            if (buffers[i])
+            {
+                stbi_image_free(buffers[i]);
+            }
+        }
+        if (!ok)
+        {
+            return false;
+        }
+
+        std::string ext = GetExt(dst_path);
+        if (ext == ".jpg" || ext == ".jpeg")
+        {
+            int q = std::max<int>(0, std::min<int>(int(quality * 100), 100));
+            return stbi_write_jpg(dst_path.c_str(), width, height, 3, &orm[0], q) != 0;
+        }
+        else if (ext == ".png")
+        {
+            return stbi_write_png(dst_path.c_str(), width, height, 3, &orm[0], 0) != 0;
+        }
+        else if (ext == ".bmp")
+        {
+            return stbi_write_bmp(dst_path.c_str(), width, height, 3, &orm[0]) != 0;
+        }
+        return false;
+    }
+}
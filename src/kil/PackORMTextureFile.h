@@ -0,0 +1,15 @@
+#pragma once
+#ifndef _KIL_PACK_ORM_TEXTURE_FILE_H_
+#define _KIL_PACK_ORM_TEXTURE_FILE_H_
+
+#include <string>
+
+namespace kil
+{
+    // Writes occlusion, roughness and metallic into the R, G and B channels of one image, as glTF
+    // occlusionTexture and metallicRoughnessTexture expect. Each source is decoded once as a single
+    // channel; an empty path leaves its channel at 255. Sources of different sizes are resized to the largest.
+    bool PackORMTextureFile(const std::string& occlusion_path, const std::string& roughness_path, const std::string& metallic_path, const std::string& dst_path, float quality = 0.9);
+}
+
+#endif
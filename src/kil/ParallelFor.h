@@ -0,0 +1,80 @@
+#pragma once
+#ifndef _KIL_PARALLEL_FOR_H_
+#define _KIL_PARALLEL_FOR_H_
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace kil
+{
+    static inline int GetNumberOfThreads()
+    {
+        int n = (int)std::thread::hardware_concurrency();
+        return std::max<int>(1, n);
+    }
+
+    // True on threads that run ParallelFor work. Nested loops run serially there instead of
+    // spawning threads per outer item. Not static so every translation unit shares the flag.
+    inline bool& IsInParallelFor()
+    {
+        static thread_local bool flag = false;
+        return flag;
+    }
+
+    // Calls func(i) for i in [begin, end). Work is handed out in chunks of 'grain' so uneven rows balance out.
+    template <class F>
+    static inline void ParallelFor(int begin, int end, F func, int grain = 1)
+    {
+        int count = end - begin;
+        if (count <= 0)
+        {
+            return;
+        }
+        grain = std::max<int>(1, grain);
+        int nthreads = std::min<int>(GetNumberOfThreads(), (count + grain - 1) / grain);
+        if (nthreads <= 1 || IsInParallelFor())
+        {
+            for (int i = begin; i < end; i++)
+            {
+                func(i);
+            }
+            return;
+        }
+
+        std::atomic<int> next(begin);
+        auto worker = [&]() {
+            bool& nested = IsInParallelFor();
+            bool prev = nested;
+            nested = true;
+            while (true)
+            {
+                int i0 = next.fetch_add(grain);
+                if (i0 >= end)
+                {
+                    break;
+                }
+                int i1 = std::min<int>(end, i0 + grain);
+                for (int i = i0; i < i1; i++)
+                {
+                    func(i);
+                }
+            }
+            nested = prev;
+        };
+
+        std::vector<std::thread> threads;
+        for (int t = 1; t < nthreads; t++)
+        {
+            threads.push_back(std::thread(worker));
+        }
+        worker();
+        for (size_t t = 0; t < threads.size(); t++)
+        {
+            threads[t].join();
+        }
+    }
+} // namespace kil
+
+#endif
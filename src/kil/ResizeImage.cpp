@@ -0,0 +1,459 @@
+#include "ResizeImage.h"
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <math.h>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define KIL_USE_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define KIL_USE_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define KIL_USE_NEON 1
+#endif
+
+namespace kil
+{
+    namespace
+    {
+        // Weights of every destination pixel along one axis, stored flat.
+        struct FilterTable
+        {
+            std::vector<int> start;
+            std::vector<int> count;
+            std::vector<int> offset;
+            std::vector<float> weights;
+        };
+
+        struct PixelFormat
+        {
+            int channels;
+            int alpha; // index of the alpha channel, or -1
+            bool srgb;
+        };
+
+        const int kLinearToSRGBSize = 4096;
+
+        struct ColorTables
+        {
+            float srgb_to_linear[256];
+            float unorm_to_float[256];
+            unsigned char linear_to_srgb[kLinearToSRGBSize + 1];
+
+            ColorTables()
+            {
+                for (int i = 0; i < 256; i++)
+                {
+                    float c = i / 255.0f;
+                    srgb_to_linear[i] = (c <= 0.04045f) ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+                    unorm_to_float[i] = c;
+                }
+                for (int i = 0; i <= kLinearToSRGBSize; i++)
+                {
+                    float l = i / (float)kLinearToSRGBSize;
+                    float c = (l <= 0.0031308f) ? l * 12.92f : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+                    linear_to_srgb[i] = (unsigned char)std::max<int>(0, std::min<int>(255, (int)(c * 255.0f + 0.5f)));
+                }
+            }
+        };
+    }
+
+    static const ColorTables& GetColorTables()
+    {
+        static ColorTables tables;
+        return tables;
+    }
+
+    // Mitchell-Netravali, B = C = 1/3
+    static float MitchellFilter(float x)
+    {
+        const float B = 1.0f / 3.0f;
+        const float C = 1.0f / 3.0f;
+        x = fabsf(x);
+        if (x < 1.0f)
+        {
+            return ((12 - 9 * B - 6 * C) * x * x * x + (-18 + 12 * B + 6 * C) * x * x + (6 - 2 * B)) / 6.0f;
+        }
+        else if (x < 2.0f)
+        {
+            return ((-B - 6 * C) * x * x * x + (6 * B + 30 * C) * x * x + (-12 * B - 48 * C) * x + (8 * B + 24 * C)) / 6.0f;
+        }
+        return 0.0f;
+    }
+
+    static void BuildFilterTable(FilterTable& table, int src_size, int dst_size)
+    {
+        float scale = src_size / (float)dst_size;
+        float support = std::max<float>(scale, 1.0f);
+        float radius = 2.0f * support;
+
+        table.start.resize(dst_size);
+        table.count.resize(dst_size);
+        table.offset.resize(dst_size);
+        table.weights.clear();
+        for (int i = 0; i < dst_size; i++)
+        {
+            float center = (i + 0.5f) * scale - 0.5f;
+            int s = std::max<int>(0, (int)ceilf(center - radius));
+            int e = std::min<int>(src_size - 1, (int)floorf(center + radius));
+            if (e < s)
+            {
+                s = e = std::max<int>(0, std::min<int>(src_size - 1, (int)floorf(center + 0.5f)));
+            }
+
+            std::vector<float> w;
+            float total = 0.0f;
+            for (int j = s; j <= e; j++)
+            {
+                w.push_back(MitchellFilter((j - center) / support));
+                total += w.back();
+            }
+            if (total == 0.0f)
+            {
+                std::fill(w.begin(), w.end(), 1.0f);
+                total = (float)w.size();
+            }
+
+            // Trim zero taps at both ends.
+            size_t first = 0;
+            size_t last = w.size() - 1;
+            while (first < last && w[first] == 0.0f)
+            {
+                first++;
+            }
+            while (last > first && w[last] == 0.0f)
+            {
+                last--;
+            }
+            s += (int)first;
+            e = s + (int)(last - first);
+
+            table.offset[i] = (int)table.weights.size();
+            for (size_t k = first; k <= last; k++)
+            {
+                table.weights.push_back(w[k] / total);
+            }
+            table.start[i] = s;
+            table.count[i] = e - s + 1;
+        }
+    }
+
+    // 8 bit row -> float4 per pixel, linear and alpha premultiplied.
+    static void DecodeRow(float* out, const unsigned char* row, int width, const PixelFormat& fmt)
+    {
+        const ColorTables& tables = GetColorTables();
+        const float* lut[4];
+        for (int c = 0; c < 4; c++)
+        {
+            lut[c] = (c != fmt.alpha && fmt.srgb) ? tables.srgb_to_linear : tables.unorm_to_float;
+        }
+        if (fmt.channels == 4)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                const unsigned char* p = row + x * 4;
+                float* o = out + x * 4;
+                float a = tables.unorm_to_float[p[3]];
+                o[0] = lut[0][p[0]] * a;
+                o[1] = lut[1][p[1]] * a;
+                o[2] = lut[2][p[2]] * a;
+                o[3] = a;
+            }
+            return;
+        }
+        for (int x = 0; x < width; x++)
+        {
+            const unsigned char* p = row + x * fmt.channels;
+            float* o = out + x * 4;
+            o[0] = o[1] = o[2] = o[3] = 0.0f;
+            for (int c = 0; c < fmt.channels; c++)
+            {
+                o[c] = lut[c][p[c]];
+            }
+            if (fmt.alpha >= 0)
+            {
+                float a = o[fmt.alpha];
+                for (int c = 0; c < fmt.channels; c++)
+                {
+                    if (c != fmt.alpha)
+                    {
+                        o[c] *= a;
+                    }
+                }
+            }
+        }
+    }
+
+    static void EncodeRow(unsigned char* row, const float* in, int width, const PixelFormat& fmt)
+    {
+        const ColorTables& tables = GetColorTables();
+        for (int x = 0; x < width; x++)
+        {
+            const float* v = in + x * 4;
+            unsigned char* p = row + x * fmt.channels;
+            float inv_alpha = 1.0f;
+            if (fmt.alpha >= 0)
+            {
+                float a = std::max<float>(0.0f, std::min<float>(1.0f, v[fmt.alpha]));
+                inv_alpha = (a > 0.0f) ? 1.0f / a : 0.0f;
+            }
+            for (int c = 0; c < fmt.channels; c++)
+            {
+                float f = (c == fmt.alpha) ? v[c] : v[c] * inv_alpha;
+                f = std::max<float>(0.0f, std::min<float>(1.0f, f));
+                if (c != fmt.alpha && fmt.srgb)
+                {
+                    p[c] = tables.linear_to_srgb[(int)(f * kLinearToSRGBSize + 0.5f)];
+                }
+                else
+                {
+                    p[c] = (unsigned char)(f * 255.0f + 0.5f);
+                }
+            }
+        }
+    }
+
+    static void FilterRowHorizontal(float* out, const float* in, const FilterTable& table)
+    {
+        int width = (int)table.start.size();
+        for (int x = 0; x < width; x++)
+        {
+            const float* w = &table.weights[table.offset[x]];
+            const float* s = in + table.start[x] * 4;
+            int n = table.count[x];
+#if defined(KIL_USE_SSE2)
+            __m128 acc = _mm_setzero_ps();
+            for (int k = 0; k < n; k++)
+            {
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(w[k]), _mm_loadu_ps(s + k * 4)));
+            }
+            _mm_storeu_ps(out + x * 4, acc);
+#elif defined(KIL_USE_NEON)
+            float32x4_t acc = vdupq_n_f32(0.0f);
+            for (int k = 0; k < n; k++)
+            {
+                acc = vmlaq_n_f32(acc, vld1q_f32(s + k * 4), w[k]);
+            }
+            vst1q_f32(out + x * 4, acc);
+#else
+            float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+            for (int k = 0; k < n; k++)
+            {
+                for (int c = 0; c < 4; c++)
+                {
+                    acc[c] += w[k] * s[k * 4 + c];
+                }
+            }
+            for (int c = 0; c < 4; c++)
+            {
+                out[x * 4 + c] = acc[c];
+            }
+#endif
+        }
+    }
+
+    // out[i] = sum_k weights[k] * rows[k][i] for i in [0, size)
+    static void FilterRowsVertical(float* out, const float* const* rows, const float* weights, int count, int size)
+    {
+        int i = 0;
+#if defined(KIL_USE_AVX2)
+        for (; i + 8 <= size; i += 8)
+        {
+            __m256 acc = _mm256_setzero_ps();
+            for (int k = 0; k < count; k++)
+            {
+                acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(weights[k]), _mm256_loadu_ps(rows[k] + i)));
+            }
+            _mm256_storeu_ps(out + i, acc);
+        }
+#endif
+#if defined(KIL_USE_SSE2)
+        for (; i + 4 <= size; i += 4)
+        {
+            __m128 acc = _mm_setzero_ps();
+            for (int k = 0; k < count; k++)
+            {
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(rows[k] + i)));
+            }
+            _mm_storeu_ps(out + i, acc);
+        }
+#elif defined(KIL_USE_NEON)
+        for (; i + 4 <= size; i += 4)
+        {
+            float32x4_t acc = vdupq_n_f32(0.0f);
+            for (int k = 0; k < count; k++)
+            {
+                acc = vmlaq_n_f32(acc, vld1q_f32(rows[k] + i), weights[k]);
+            }
+            vst1q_f32(out + i, acc);
+        }
+#endif
+        for (; i < size; i++)
+        {
+            float acc = 0.0f;
+            for (int k = 0; k < count; k++)
+            {
+                acc += weights[k] * rows[k][i];
+            }
+            out[i] = acc;
+        }
+    }
+
+    static PixelFormat MakePixelFormat(int channels, bool is_srgb)
+    {
+        PixelFormat fmt;
+        fmt.channels = channels;
+        fmt.alpha = (channels == 2 || channels == 4) ? channels - 1 : -1;
+        fmt.srgb = is_srgb;
+        return fmt;
+    }
+
+    bool ResizeImage(const unsigned char* src, int src_width, int src_height, unsigned char* dst, int dst_width, int dst_height, int channels, bool is_srgb)
+    {
+        if (!src || !dst || src_width <= 0 || src_height <= 0 || dst_width <= 0 || dst_height <= 0 || channels < 1 || channels > 4)
+        {
+            return false;
+        }
+
+        PixelFormat fmt = MakePixelFormat(channels, is_srgb);
+        FilterTable htable;
+        FilterTable vtable;
+        BuildFilterTable(htable, src_width, dst_width);
+        BuildFilterTable(vtable, src_height, dst_height);
+
+        // Output rows are processed in bands. Each band filters only the source rows it needs, so
+        // the horizontal pass stays bounded per thread at the cost of a few duplicated rows at band edges.
+        const int kRowsPerBand = 32;
+        int nbands = (dst_height + kRowsPerBand - 1) / kRowsPerBand;
+        size_t src_stride = (size_t)src_width * channels;
+        size_t dst_stride = (size_t)dst_width * channels;
+        ParallelFor(0, nbands, [&](int band) {
+            int y0 = band * kRowsPerBand;
+            int y1 = std::min<int>(dst_height, y0 + kRowsPerBand);
+            int s0 = src_height;
+            int s1 = 0;
+            for (int y = y0; y < y1; y++)
+            {
+                s0 = std::min<int>(s0, vtable.start[y]);
+                s1 = std::max<int>(s1, vtable.start[y] + vtable.count[y]);
+            }
+
+            std::vector<float> decoded((size_t)src_width * 4);
+            std::vector<float> hrows((size_t)(s1 - s0) * dst_width * 4);
+            std::vector<float> out((size_t)dst_width * 4);
+            for (int sy = s0; sy < s1; sy++)
+            {
+                DecodeRow(&decoded[0], src + sy * src_stride, src_width, fmt);
+                FilterRowHorizontal(&hrows[(size_t)(sy - s0) * dst_width * 4], &decoded[0], htable);
+            }
+
+            std::vector<const float*> rows;
+            for (int y = y0; y < y1; y++)
+            {
+                rows.resize(vtable.count[y]);
+                for (int k = 0; k < vtable.count[y]; k++)
+                {
+                    rows[k] = &hrows[(size_t)(vtable.start[y] + k - s0) * dst_width * 4];
+                }
+                FilterRowsVertical(&out[0], &rows[0], &vtable.weights[vtable.offset[y]], vtable.count[y], dst_width * 4);
+                EncodeRow(dst + y * dst_stride, &out[0], dst_width, fmt);
+            }
+        });
+        return true;
+    }
+
+    //-----------------------------------------------------------------------------
+
+    struct ScanlineResizer::Impl
+    {
+        PixelFormat fmt;
+        int src_width;
+        int src_height;
+        int dst_width;
+        int dst_height;
+        FilterTable htable;
+        FilterTable vtable;
+        int capacity;
+        int pushed;
+        int next_row;
+        std::vector<float> decoded;
+        std::vector<float> ring;
+        std::vector<float> out;
+        std::vector<const float*> rows;
+    };
+
+    ScanlineResizer::ScanlineResizer(int src_width, int src_height, int dst_width, int dst_height, int channels, bool is_srgb)
+        : impl_(new Impl())
+    {
+        Impl& m = *impl_;
+        m.fmt = MakePixelFormat(channels, is_srgb);
+        m.src_width = src_width;
+        m.src_height = src_height;
+        m.dst_width = dst_width;
+        m.dst_height = dst_height;
+        BuildFilterTable(m.htable, src_width, dst_width);
+        BuildFilterTable(m.vtable, src_height, dst_height);
+        m.capacity = 1;
+        for (int y = 0; y < dst_height; y++)
+        {
+            m.capacity = std::max<int>(m.capacity, m.vtable.count[y]);
+        }
+        m.pushed = 0;
+        m.next_row = 0;
+        m.decoded.resize((size_t)src_width * 4);
+        m.ring.resize((size_t)m.capacity * dst_width * 4);
+        m.out.resize((size_t)dst_width * 4);
+    }
+
+    ScanlineResizer::~ScanlineResizer()
+    {
+    }
+
+    bool ScanlineResizer::PushRow(const unsigned char* row)
+    {
+        Impl& m = *impl_;
+        if (m.pushed >= m.src_height)
+        {
+            return false;
+        }
+        // The slot about to be overwritten must not be needed by the next unfinished row.
+        if (m.next_row < m.dst_height && m.pushed - m.vtable.start[m.next_row] >= m.capacity)
+        {
+            return false;
+        }
+        DecodeRow(&m.decoded[0], row, m.src_width, m.fmt);
+        FilterRowHorizontal(&m.ring[(size_t)(m.pushed % m.capacity) * m.dst_width * 4], &m.decoded[0], m.htable);
+        m.pushed++;
+        return true;
+    }
+
+    bool ScanlineResizer::PopRow(unsigned char* row)
+    {
+        Impl& m = *impl_;
+        if (m.next_row >= m.dst_height)
+        {
+            return false;
+        }
+        int y = m.next_row;
+        int start = m.vtable.start[y];
+        int count = m.vtable.count[y];
+        if (start + count > m.pushed)
+        {
+            return false;
+        }
+        m.rows.resize(count);
+        for (int k = 0; k < count; k++)
+        {
+            m.rows[k] = &m.ring[(size_t)((start + k) % m.capacity) * m.dst_width * 4];
+        }
+        FilterRowsVertical(&m.out[0], &m.rows[0], &m.vtable.weights[m.vtable.offset[y]], count, m.dst_width * 4);
+        EncodeRow(row, &m.out[0], m.dst_width, m.fmt);
+        m.next_row++;
+        return true;
+    }
+} // namespace kil
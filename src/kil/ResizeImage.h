@@ -0,0 +1,34 @@
+#pragma once
+#ifndef _KIL_RESIZE_IMAGE_H_
+#define _KIL_RESIZE_IMAGE_H_
+
+#include <memory>
+
+namespace kil
+{
+    // Resizes 8 bit interleaved pixels (1 to 4 channels) with a separable filter.
+    // When is_srgb is true, color channels are filtered in linear light. Alpha is always linear and
+    // colors are weighted by alpha so transparent texels do not bleed into the result.
+    bool ResizeImage(const unsigned char* src, int src_width, int src_height, unsigned char* dst, int dst_width, int dst_height, int channels, bool is_srgb = true);
+
+    // Same filter as ResizeImage, fed one source row at a time. Only a ring of horizontally
+    // filtered rows is kept, so memory depends on the destination width and the filter support only.
+    //   for each source row: PushRow(row); while (PopRow(out)) { ... }
+    class ScanlineResizer
+    {
+    public:
+        ScanlineResizer(int src_width, int src_height, int dst_width, int dst_height, int channels, bool is_srgb = true);
+        ~ScanlineResizer();
+
+        // Source rows must be pushed top to bottom. Returns false if finished rows were not popped.
+        bool PushRow(const unsigned char* row);
+        // Writes the next finished destination row. Returns false when none is ready.
+        bool PopRow(unsigned char* row);
+
+    private:
+        struct Impl;
+        std::unique_ptr<Impl> impl_;
+    };
+}
+
+#endif
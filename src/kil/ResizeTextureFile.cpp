@@ -1,11 +1,14 @@
 #include "ResizeTextureFile.h"
 #include "CopyTextureFile.h"
+#include "ImageRowReader.h"
+#include "ResizeImage.h"
 
 #include <algorithm>
 #include <iostream>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <vector>
 
 #ifdef _WIN32
 #define NOMINMAX
@@ -77,17 +80,9 @@ namespace kil
         return x;
     }
 
-    bool ResizeTextureFile_STB(const std::string& orgPath, const std::string& dstPath, int maximum_size, int resize_size, bool is_poweroftwo, bool is_squared, float quality)
+    // Computes the destination size. Returns false when the image can be copied as is.
+    static bool GetResizedSize(int width, int height, int maximum_size, int resize_size, bool is_poweroftwo, bool is_squared, int& nw, int& nh)
     {
-        int width = 0;
-        int height = 0;
-        int channels = 1;
-        stbi_uc* buffer = stbi_load(orgPath.c_str(), &width, &height, &channels, 0);
-        if (buffer == NULL)
-        {
-            return false;
-        }
-
         bool resizeSize = false;
         bool resizePowerOfTwo = false;
         bool resizeSquared = false;
@@ -114,61 +109,35 @@ namespace kil
         }
 
         bool is_needed_to_resize = resizeSize | resizePowerOfTwo | resizeSquared;
-
         if (!is_needed_to_resize)
         {
-            if (buffer)
-            {
-                stbi_image_free(buffer);
-            }
-            return CopyTextureFile(orgPath, dstPath, quality);
+            return false;
         }
 
-        int nw = width;
-        int nh = height;
-        stbi_uc* nbuffer = NULL;
-        if (resizeSize && !is_poweroftwo && !is_squared)
+        nw = width;
+        nh = height;
+        if(resizeSize)
         {
             float factor = resize_size / ((float)std::max<int>(width, height));
             nw = (int)floor(width * factor);
             nh = (int)floor(height * factor);
-            nbuffer = (unsigned char*)malloc(sizeof(unsigned char) * nw * nh * channels);
         }
-        else
+        if(is_poweroftwo)
         {
-            if(resizeSize)
-            {
-                float factor = resize_size / ((float)std::max<int>(width, height));
-                nw = (int)floor(width * factor);
-                nh = (int)floor(height * factor);
-            }
-            if(is_poweroftwo)
-            {
-                nw = GetPowerOfTwo(nw);
-                nh = GetPowerOfTwo(nh);
-            }
-            if(is_squared)
-            {
-                int max_width = std::max<int>(nw, nh);
-                nw = max_width;
-                nh = max_width;
-            }
-            nbuffer = (unsigned char*)malloc(sizeof(unsigned char) * nw * nh * channels);
+            nw = GetPowerOfTwo(nw);
+            nh = GetPowerOfTwo(nh);
         }
-
-        if (!stbir_resize_uint8(buffer, width, height, 0, nbuffer, nw, nh, 0, channels))
+        if(is_squared)
         {
-            if (nbuffer)
-            {
-                free(nbuffer);
-            }
-            if (buffer)
-            {
-                stbi_image_free(buffer);
-            }
-            return false;
+            int max_width = std::max<int>(nw, nh);
+            nw = max_width;
+            nh = max_width;
         }
+        return true;
+    }
 
+    static bool WriteTextureFile(const std::string& dstPath, int nw, int nh, int channels, const unsigned char* nbuffer, float quality)
+    {
         std::string ext = GetExt(dstPath);
         if (ext == ".jpg" || ext == ".jpeg")
         {
@@ -185,28 +154,194 @@ namespace kil
         }
         else if (ext == ".gif")
         {
-            if (nbuffer)
+            return false;
+        }
+        return true;
+    }
+
+    // Sources whose decoded size exceeds this are resized row by row when the format allows it.
+    static const size_t kStreamingResizeThreshold = 64 * 1024 * 1024;
+
+    static bool ResizeImage_Streaming(ImageRowReader& reader, std::vector<unsigned char>& nbuffer, int nw, int nh, bool is_srgb)
+    {
+        int width = reader.GetWidth();
+        int height = reader.GetHeight();
+        int channels = reader.GetChannels();
+        std::vector<unsigned char> row((size_t)width * channels);
+        nbuffer.resize((size_t)nw * nh * channels);
+        ScanlineResizer resizer(width, height, nw, nh, channels, is_srgb);
+        int y = 0;
+        for (int sy = 0; sy < height; sy++)
+        {
+            if (!reader.ReadRow(&row[0]) || !resizer.PushRow(&row[0]))
             {
-                free(nbuffer);
+                return false;
             }
-
-            if (buffer)
+            while (y < nh && resizer.PopRow(&nbuffer[(size_t)y * nw * channels]))
             {
-                stbi_image_free(buffer);
+                y++;
             }
+        }
+        return y == nh;
+    }
+
+    static bool ResizeTextureFile_Streaming(ImageRowReader& reader, const std::string& dstPath, int nw, int nh, float quality, bool is_srgb)
+    {
+        std::vector<unsigned char> nbuffer;
+        if (!ResizeImage_Streaming(reader, nbuffer, nw, nh, is_srgb))
+        {
             return false;
         }
+        return WriteTextureFile(dstPath, nw, nh, reader.GetChannels(), &nbuffer[0], quality);
+    }
+
+    // Reduces the image by repeated halving, each level filtered from the previous one, and a final
+    // resize to fit preload_size.
+    static bool WritePreloadTextureFile(const std::string& dstPath, const unsigned char* pixels, int width, int height, int channels, int preload_size, float quality, bool is_srgb)
+    {
+        int pw = width;
+        int ph = height;
+        if (preload_size > 0 && std::max<int>(width, height) > preload_size)
+        {
+            float factor = preload_size / ((float)std::max<int>(width, height));
+            pw = std::max<int>(1, (int)floor(width * factor));
+            ph = std::max<int>(1, (int)floor(height * factor));
+        }
 
-        if (nbuffer)
+        std::vector<unsigned char> level;
+        std::vector<unsigned char> next;
+        const unsigned char* src = pixels;
+        while (width >= 2 * pw && height >= 2 * ph)
+        {
+            int nw = width / 2;
+            int nh = height / 2;
+            next.resize((size_t)nw * nh * channels);
+            if (!ResizeImage(src, width, height, &next[0], nw, nh, channels, is_srgb))
+            {
+                return false;
+            }
+            level.swap(next);
+            src = &level[0];
+            width = nw;
+            height = nh;
+        }
+        if (width != pw || height != ph)
         {
-            free(nbuffer);
+            next.resize((size_t)pw * ph * channels);
+            if (!ResizeImage(src, width, height, &next[0], pw, ph, channels, is_srgb))
+            {
+                return false;
+            }
+            level.swap(next);
+            src = &level[0];
         }
+        return WriteTextureFile(dstPath, pw, ph, channels, src, quality);
+    }
 
-        if (buffer)
+    bool ResizeTextureFile_STB(const std::string& orgPath, const std::string& dstPath, int maximum_size, int resize_size, bool is_poweroftwo, bool is_squared, float quality, bool is_srgb)
+    {
+        int width = 0;
+        int height = 0;
+        int channels = 1;
+        int nw = 0;
+        int nh = 0;
+
+        if (stbi_info(orgPath.c_str(), &width, &height, &channels) && (size_t)width * height * channels > kStreamingResizeThreshold)
+        {
+            if (!GetResizedSize(width, height, maximum_size, resize_size, is_poweroftwo, is_squared, nw, nh))
+            {
+                return CopyTextureFile(orgPath, dstPath, quality);
+            }
+            std::shared_ptr<ImageRowReader> reader = OpenImageRowReader(orgPath);
+            if (reader)
+            {
+                return ResizeTextureFile_Streaming(*reader, dstPath, nw, nh, quality, is_srgb);
+            }
+        }
+
+        stbi_uc* buffer = stbi_load(orgPath.c_str(), &width, &height, &channels, 0);
+        if (buffer == NULL)
+        {
+            return false;
+        }
+
+        if (!GetResizedSize(width, height, maximum_size, resize_size, is_poweroftwo, is_squared, nw, nh))
         {
             stbi_image_free(buffer);
+            return CopyTextureFile(orgPath, dstPath, quality);
         }
-        return true;
+
+        stbi_uc* nbuffer = (unsigned char*)malloc(sizeof(unsigned char) * nw * nh * channels);
+        bool bRet = ResizeImage(buffer, width, height, nbuffer, nw, nh, channels, is_srgb);
+        stbi_image_free(buffer);
+        if (bRet)
+        {
+            bRet = WriteTextureFile(dstPath, nw, nh, channels, nbuffer, quality);
+        }
+        free(nbuffer);
+        return bRet;
+    }
+
+    bool ResizeTextureFileWithPreload_STB(const std::string& orgPath, const std::string& dstPath, const std::string& preloadPath, int preload_size, int maximum_size, int resize_size, bool is_poweroftwo, bool is_squared, float quality, bool is_srgb)
+    {
+        int width = 0;
+        int height = 0;
+        int channels = 1;
+        int nw = 0;
+        int nh = 0;
+
+        std::vector<unsigned char> nbuffer;
+        if (stbi_info(orgPath.c_str(), &width, &height, &channels) && (size_t)width * height * channels > kStreamingResizeThreshold &&
+            GetResizedSize(width, height, maximum_size, resize_size, is_poweroftwo, is_squared, nw, nh))
+        {
+            std::shared_ptr<ImageRowReader> reader = OpenImageRowReader(orgPath);
+            if (reader)
+            {
+                if (!ResizeImage_Streaming(*reader, nbuffer, nw, nh, is_srgb))
+                {
+                    return false;
+                }
+                channels = reader->GetChannels();
+                return WriteTextureFile(dstPath, nw, nh, channels, &nbuffer[0], quality) &&
+                       WritePreloadTextureFile(preloadPath, &nbuffer[0], nw, nh, channels, preload_size, quality, is_srgb);
+            }
+        }
+
+        stbi_uc* buffer = stbi_load(orgPath.c_str(), &width, &height, &channels, 0);
+        if (buffer == NULL)
+        {
+            return false;
+        }
+
+        bool bRet = true;
+        const unsigned char* output = buffer;
+        if (GetResizedSize(width, height, maximum_size, resize_size, is_poweroftwo, is_squared, nw, nh))
+        {
+            nbuffer.resize((size_t)nw * nh * channels);
+            bRet = ResizeImage(buffer, width, height, &nbuffer[0], nw, nh, channels, is_srgb);
+            bRet = bRet && WriteTextureFile(dstPath, nw, nh, channels, &nbuffer[0], quality);
+            output = &nbuffer[0];
+        }
+        else
+        {
+            // Same format is a plain file copy, otherwise encode the pixels already decoded.
+            nw = width;
+            nh = height;
+            if (GetExt(orgPath) == GetExt(dstPath))
+            {
+                bRet = CopyTextureFile(orgPath, dstPath, quality);
+            }
+            else
+            {
+                bRet = WriteTextureFile(dstPath, nw, nh, channels, buffer, quality);
+            }
+        }
+        if (bRet)
+        {
+            bRet = WritePreloadTextureFile(preloadPath, output, nw, nh, channels, preload_size, quality, is_srgb);
+        }
+        stbi_image_free(buffer);
+        return bRet;
     }
 
     static std::string GetPngTempPath()
@@ -231,7 +366,27 @@ namespace kil
 #endif
     }
 
-    bool ResizeTextureFile(const std::string& orgPath, const std::string& dstPath, int maximum_size, int resize_size, bool is_poweroftwo, bool is_squared, float quality)
+    bool ResizeTextureFile(const std::string& orgPath, const std::string& dstPath, int maximum_size, int resize_size, bool is_poweroftwo, bool is_squared, float quality, bool is_srgb)
+    {
+        std::string ext = GetExt(orgPath);
+        if (ext == ".tiff" || ext == ".tif")
+        {
+            std::string tmpPath = GetPngTempPath();
+            bool bRet = true;
+            bRet = CopyTextureFile(orgPath, tmpPath, quality);
+            if (!bRet)
+                return bRet;
+            bRet = ResizeTextureFile_STB(tmpPath, dstPath, maximum_size, resize_size, is_poweroftwo, is_squared, quality, is_srgb);
+            RemoveFile(tmpPath);
+            return bRet;
+        }
+        else
+        {
+            return ResizeTextureFile_STB(orgPath, dstPath, maximum_size, resize_size, is_poweroftwo, is_squared, quality, is_srgb);
+        }
+    }
+
+    bool ResizeTextureFileWithPreload(const std::string& orgPath, const std::string& dstPath, const std::string& preloadPath, int preload_size, int maximum_size, int resize_size, bool is_poweroftwo, bool is_squared, float quality, bool is_srgb)
     {
         std::string ext = GetExt(orgPath);
         if (ext == ".tiff" || ext == ".tif")
@@ -241,13 +396,13 @@ namespace kil
             bRet = CopyTextureFile(orgPath, tmpPath, quality);
             if (!bRet)
                 return bRet;
-            bRet = ResizeTextureFile_STB(tmpPath, dstPath, maximum_size, resize_size, is_poweroftwo, is_squared, quality);
+            bRet = ResizeTextureFileWithPreload_STB(tmpPath, dstPath, preloadPath, preload_size, maximum_size, resize_size, is_poweroftwo, is_squared, quality, is_srgb);
             RemoveFile(tmpPath);
             return bRet;
         }
         else
         {
-            return ResizeTextureFile_STB(orgPath, dstPath, maximum_size, resize_size, is_poweroftwo, is_squared, quality);
+            return ResizeTextureFileWithPreload_STB(orgPath, dstPath, preloadPath, preload_size, maximum_size, resize_size, is_poweroftwo, is_squared, quality, is_srgb);
         }
     }
 } // namespace kil
@@ -6,7 +6,10 @@
 
 namespace kil
 {
-    bool ResizeTextureFile(const std::string& src_path, const std::string& dst_path, int maximum_size = 256, int resize_size = 256, bool is_poweroftwo = false, bool is_squared = false, float quality = 0.9);
+    bool ResizeTextureFile(const std::string& src_path, const std::string& dst_path, int maximum_size = 256, int resize_size = 256, bool is_poweroftwo = false, bool is_squared = false, float quality = 0.9, bool is_srgb = true);
+    // Writes the ResizeTextureFile output and a preload thumbnail fitting preload_size from a single decode.
+    // The thumbnail is reduced from the output by halving, so no second decode or full size filter pass is needed.
+    bool ResizeTextureFileWithPreload(const std::string& src_path, const std::string& dst_path, const std::string& preload_path, int preload_size = 128, int maximum_size = 256, int resize_size = 256, bool is_poweroftwo = false, bool is_squared = false, float quality = 0.9, bool is_srgb = true);
 }
 
 #endif
@@ -0,0 +1,215 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "TextureAtlas.h"
+#include "ParallelFor.h"
+#include "ResizeImage.h"
+
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+
+#include <stb/stb_image.h>
+#include <stb/stb_image_write.h>
+
+namespace kil
+{
+    static std::string GetExt(const std::string& filepath)
+    {
+        if (filepath.find_last_of(".") != std::string::npos)
+            return filepath.substr(filepath.find_last_of("."));
+        return "";
+    }
+
+    SkylinePacker::SkylinePacker(int width, int height)
+        : width_(width), height_(height)
+    {
+        Segment s = {0, 0, width};
+        skyline_.push_back(s);
+    }
+
+    bool SkylinePacker::Fits(size_t index, int width, int height, int& y) const
+    {
+        int x = skyline_[index].x;
+        if (x + width > width_)
+        {
+            return false;
+        }
+        y = skyline_[index].y;
+        int left = width;
+        size_t i = index;
+        while (left > 0)
+        {
+            y = std::max<int>(y, skyline_[i].y);
+            if (y + height > height_)
+            {
+                return false;
+            }
+            left -= skyline_[i].width;
+            i++;
+        }
+        return true;
+    }
+
+    bool SkylinePacker::Insert(int width, int height, TextureAtlasRect& rect)
+    {
+        int best_bottom = height_ + 1;
+        int best_width = width_ + 1;
+        size_t best_index = skyline_.size();
+        for (size_t i = 0; i < skyline_.size(); i++)
+        {
+            int y = 0;
+            if (Fits(i, width, height, y))
+            {
+                if (y + height < best_bottom || (y + height == best_bottom && skyline_[i].width < best_width))
+                {
+                    best_bottom = y + height;
+                    best_width = skyline_[i].width;
+                    best_index = i;
+                    rect.x = skyline_[i].x;
+                    rect.y = y;
+                }
+            }
+        }
+        if (best_index == skyline_.size())
+        {
+            return false;
+        }
+        rect.width = width;
+        rect.height = height;
+
+        Segment s = {rect.x, rect.y + height, width};
+        skyline_.insert(skyline_.begin() + best_index, s);
+        for (size_t i = best_index + 1; i < skyline_.size();)
+        {
+            int end = skyline_[i - 1].x + skyline_[i - 1].width;
+            if (skyline_[i].x >= end)
+            {
+                break;
+            }
+            int shrink = end - skyline_[i].x;
+            skyline_[i].x += shrink;
+            skyline_[i].width -= shrink;
+            if (skyline_[i].width <= 0)
+            {
+                skyline_.erase(skyline_.begin() + i);
+            }
+            else
+            {
+                break;
+            }
+        }
+        for (size_t i = 0; i + 1 < skyline_.size();)
+        {
+            if (skyline_[i].y == skyline_[i + 1].y)
+            {
+                skyline_[i].width += skyline_[i + 1].width;
+                skyline_.erase(skyline_.begin() + i + 1);
+            }
+            else
+            {
+                i++;
+            }
+        }
+        return true;
+    }
+
+    bool GetTextureFileInfo(const std::string& path, int& width, int& height, int& channels)
+    {
+        return stbi_info(path.c_str(), &width, &height, &channels) != 0;
+    }
+
+    bool WriteTextureAtlas(const std::string& dst_path, int width, int height, int padding, const std::vector<TextureAtlasEntry>& entries, float quality)
+    {
+        if (width <= 0 || height <= 0)
+        {
+            return false;
+        }
+        std::vector<unsigned char> atlas((size_t)width * height * 4, 0);
+        std::vector<int> results(entries.size(), 0);
+        std::vector<int> alphas(entries.size(), 0);
+
+        // Entries own disjoint rects (padding included), so they can be drawn concurrently.
+        ParallelFor(0, (int)entries.size(), [&](int i) {
+            const TextureAtlasEntry& e = entries[i];
+            int w = 0;
+            int h = 0;
+            int c = 0;
+            stbi_uc* buffer = stbi_load(e.path.c_str(), &w, &h, &c, 4);
+            if (buffer == NULL)
+            {
+                return;
+            }
+            const unsigned char* src = buffer;
+            std::vector<unsigned char> resized;
+            if (w != e.rect.width || h != e.rect.height)
+            {
+                resized.resize((size_t)e.rect.width * e.rect.height * 4);
+                if (!ResizeImage(buffer, w, h, &resized[0], e.rect.width, e.rect.height, 4, e.is_srgb))
+                {
+                    stbi_image_free(buffer);
+                    return;
+                }
+                src = &resized[0];
+                w = e.rect.width;
+                h = e.rect.height;
+            }
+            for (int y = -padding; y < h + padding; y++)
+            {
+                int dy = e.rect.y + y;
+                if (dy < 0 || dy >= height)
+                {
+                    continue;
+                }
+                int sy = std::max<int>(0, std::min<int>(h - 1, y));
+                for (int x = -padding; x < w + padding; x++)
+                {
+                    int dx = e.rect.x + x;
+                    if (dx < 0 || dx >= width)
+                    {
+                        continue;
+                    }
+                    int sx = std::max<int>(0, std::min<int>(w - 1, x));
+                    memcpy(&atlas[((size_t)dy * width + dx) * 4], src + ((size_t)sy * w + sx) * 4, 4);
+                }
+            }
+            alphas[i] = (c == 2 || c == 4) ? 1 : 0;
+            results[i] = 1;
+            stbi_image_free(buffer);
+        });
+
+        bool has_alpha = false;
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            if (!results[i])
+            {
+                return false;
+            }
+            has_alpha |= alphas[i] != 0;
+        }
+
+        int channels = 4;
+        if (!has_alpha)
+        {
+            for (size_t i = 0; i < (size_t)width * height; i++)
+            {
+                memmove(&atlas[i * 3], &atlas[i * 4], 3);
+            }
+            channels = 3;
+        }
+
+        std::string ext = GetExt(dst_path);
+        if (ext == ".jpg" || ext == ".jpeg")
+        {
+            int q = std::max<int>(0, std::min<int>(int(quality * 100), 100));
+            return stbi_write_jpg(dst_path.c_str(), width, height, channels, &atlas[0], q) != 0;
+        }
+        else if (ext == ".png")
+        {
+            return stbi_write_png(dst_path.c_str(), width, height, channels, &atlas[0], 0) != 0;
+        }
+        else if (ext == ".bmp")
+        {
+            return stbi_write_bmp(dst_path.c_str(), width, height, channels, &atlas[0]) != 0;
+        }
+        return false;
+    }
+} // namespace kil
@@ -0,0 +1,52 @@
+#pragma once
+#ifndef _KIL_TEXTURE_ATLAS_H_
+#define _KIL_TEXTURE_ATLAS_H_
+
+#include <string>
+#include <vector>
+
+namespace kil
+{
+    struct TextureAtlasRect
+    {
+        int x;
+        int y;
+        int width;
+        int height;
+    };
+
+    // Skyline bottom-left rectangle packer.
+    class SkylinePacker
+    {
+    public:
+        SkylinePacker(int width, int height);
+        bool Insert(int width, int height, TextureAtlasRect& rect);
+
+    private:
+        struct Segment
+        {
+            int x;
+            int y;
+            int width;
+        };
+        bool Fits(size_t index, int width, int height, int& y) const;
+
+        int width_;
+        int height_;
+        std::vector<Segment> skyline_;
+    };
+
+    struct TextureAtlasEntry
+    {
+        std::string path;      // source image
+        TextureAtlasRect rect; // placement inside the atlas, without padding
+        bool is_srgb;
+    };
+
+    bool GetTextureFileInfo(const std::string& path, int& width, int& height, int& channels);
+    // Draws every entry into its rect (resizing when the sizes differ) and extends the edge texels
+    // 'padding' pixels outwards so filtering and mipmapping do not bleed between neighbors.
+    bool WriteTextureAtlas(const std::string& dst_path, int width, int height, int padding, const std::vector<TextureAtlasEntry>& entries, float quality = 0.9);
+}
+
+#endif
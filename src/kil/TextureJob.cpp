@@ -0,0 +1,165 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "TextureJob.h"
+#include "CompressTextureFile.h"
+#include "CopyTextureFile.h"
+#include "ParallelFor.h"
+#include "ResizeTextureFile.h"
+#include "TextureAtlas.h"
+
+#include <algorithm>
+#include <math.h>
+#include <sstream>
+
+namespace kil
+{
+    TextureJob::TextureJob()
+        : type(TEXTURE_JOB_COPY),
+          maximum_size(256),
+          resize_size(256),
+          is_poweroftwo(false),
+          is_squared(false),
+          quality(0.9f),
+          is_srgb(true),
+          compression_format(BLOCK_COMPRESSION_BC7),
+          preload_size(128),
+          result(false),
+          width(0),
+          height(0)
+    {
+    }
+
+    static bool RunTextureJob(TextureJob& job)
+    {
+        int channels = 0;
+        if (!GetTextureFileInfo(job.src_path, job.width, job.height, channels))
+        {
+            job.width = 0;
+            job.height = 0;
+        }
+        if (!job.preload_path.empty() && (job.type == TEXTURE_JOB_COPY || job.type == TEXTURE_JOB_RESIZE))
+        {
+            // maximum_size 0 disables the size limit, so a copy only converts the format
+            int maximum_size = job.type == TEXTURE_JOB_COPY ? 0 : job.maximum_size;
+            bool is_poweroftwo = job.type == TEXTURE_JOB_COPY ? false : job.is_poweroftwo;
+            bool is_squared = job.type == TEXTURE_JOB_COPY ? false : job.is_squared;
+            return ResizeTextureFileWithPreload(job.src_path, job.dst_path, job.preload_path, job.preload_size, maximum_size, job.resize_size, is_poweroftwo, is_squared, job.quality, job.is_srgb);
+        }
+        switch (job.type)
+        {
+        case TEXTURE_JOB_COPY:
+            return CopyTextureFile(job.src_path, job.dst_path, job.quality);
+        case TEXTURE_JOB_RESIZE:
+            return ResizeTextureFile(job.src_path, job.dst_path, job.maximum_size, job.resize_size, job.is_poweroftwo, job.is_squared, job.quality, job.is_srgb);
+        case TEXTURE_JOB_COMPRESS:
+            return CompressTextureFile(job.src_path, job.dst_path, job.compression_format, job.is_srgb);
+        }
+        return false;
+    }
+
+    bool RunTextureJobs(std::vector<TextureJob>& jobs)
+    {
+        // One job per thread; the filters inside a job run serially while jobs are in flight.
+        ParallelFor(0, (int)jobs.size(), [&](int i) {
+            jobs[i].result = RunTextureJob(jobs[i]);
+        });
+        bool ret = true;
+        for (size_t i = 0; i < jobs.size(); i++)
+        {
+            ret &= jobs[i].result;
+        }
+        return ret;
+    }
+
+    std::string MakeUDIMPath(const std::string& path, int udim_id)
+    {
+        std::string ret = path;
+        std::stringstream ss;
+        ss << udim_id;
+        const std::string udim_str = "<UDIM>";
+        size_t p = ret.find(udim_str);
+        if (p != std::string::npos)
+        {
+            ret.replace(p, udim_str.size(), ss.str());
+        }
+        return ret;
+    }
+
+    void MakeUDIMTextureJobs(std::vector<TextureJob>& jobs, const TextureJob& job, const std::vector<int>& udim_ids)
+    {
+        for (size_t i = 0; i < udim_ids.size(); i++)
+        {
+            TextureJob tile = job;
+            tile.src_path = MakeUDIMPath(job.src_path, udim_ids[i]);
+            tile.dst_path = MakeUDIMPath(job.dst_path, udim_ids[i]);
+            tile.preload_path = MakeUDIMPath(job.preload_path, udim_ids[i]);
+            jobs.push_back(tile);
+        }
+    }
+
+    void MakeUDIMAtlasLayout(UDIMAtlasLayout& layout, const std::vector<int>& udim_ids, int tile_size, int padding)
+    {
+        layout.udim_ids = udim_ids;
+        std::sort(layout.udim_ids.begin(), layout.udim_ids.end());
+        layout.udim_ids.erase(std::unique(layout.udim_ids.begin(), layout.udim_ids.end()), layout.udim_ids.end());
+
+        int count = (int)layout.udim_ids.size();
+        int columns = std::max<int>(1, (int)ceil(sqrt((double)count)));
+        int rows = std::max<int>(1, (count + columns - 1) / columns);
+        layout.tile_size = tile_size;
+        layout.padding = std::max<int>(0, std::min<int>(padding, (tile_size - 1) / 2));
+        layout.width = columns * tile_size;
+        layout.height = rows * tile_size;
+        layout.columns.resize(count);
+        layout.rows.resize(count);
+        for (int i = 0; i < count; i++)
+        {
+            layout.columns[i] = i % columns;
+            layout.rows[i] = i / columns;
+        }
+    }
+
+    bool BakeUDIMAtlas(const std::string& udim_path, const std::string& dst_path, const UDIMAtlasLayout& layout, bool is_srgb, float quality)
+    {
+        int inner = layout.tile_size - 2 * layout.padding;
+        std::vector<TextureAtlasEntry> entries(layout.udim_ids.size());
+        for (size_t i = 0; i < layout.udim_ids.size(); i++)
+        {
+            entries[i].path = MakeUDIMPath(udim_path, layout.udim_ids[i]);
+            entries[i].rect.x = layout.columns[i] * layout.tile_size + layout.padding;
+            entries[i].rect.y = layout.rows[i] * layout.tile_size + layout.padding;
+            entries[i].rect.width = inner;
+            entries[i].rect.height = inner;
+            entries[i].is_srgb = is_srgb;
+        }
+        return WriteTextureAtlas(dst_path, layout.width, layout.height, layout.padding, entries, quality);
+    }
+
+    int GetUDIMTileID(float u, float v)
+    {
+        int column = (int)floor(u);
+        int row = (int)floor(1.0f - v);
+        if (column < 0 || column >= 10 || row < 0)
+        {
+            return -1;
+        }
+        return 1001 + column + 10 * row;
+    }
+
+    bool RemapUDIMTexcoord(const UDIMAtlasLayout& layout, int udim_id, float& u, float& v)
+    {
+        std::vector<int>::const_iterator it = std::lower_bound(layout.udim_ids.begin(), layout.udim_ids.end(), udim_id);
+        if (it == layout.udim_ids.end() || *it != udim_id)
+        {
+            return false;
+        }
+        size_t i = it - layout.udim_ids.begin();
+        int column = (udim_id - 1001) % 10;
+        int row = (udim_id - 1001) / 10;
+        float lu = std::max<float>(0.0f, std::min<float>(1.0f, u - column));
+        float lv = std::max<float>(0.0f, std::min<float>(1.0f, (1.0f - v) - row)); // v up inside the tile
+        float inner = (float)(layout.tile_size - 2 * layout.padding);
+        u = (layout.columns[i] * layout.tile_size + layout.padding + lu * inner) / layout.width;
+        v = (layout.rows[i] * layout.tile_size + layout.padding + (1.0f - lv) * inner) / layout.height;
+        return true;
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+#ifndef _KIL_TEXTURE_JOB_H_
+#define _KIL_TEXTURE_JOB_H_
+
+#include <string>
+#include <vector>
+
+namespace kil
+{
+    enum TextureJobType
+    {
+        TEXTURE_JOB_COPY = 0, // CopyTextureFile (format conversion by extension)
+        TEXTURE_JOB_RESIZE,   // ResizeTextureFile
+        TEXTURE_JOB_COMPRESS  // CompressTextureFile
+    };
+
+    struct TextureJob
+    {
+        TextureJob();
+
+        int type;
+        std::string src_path;
+        std::string dst_path;
+        int maximum_size;
+        int resize_size;
+        bool is_poweroftwo;
+        bool is_squared;
+        float quality;
+        bool is_srgb;
+        int compression_format;
+        std::string preload_path; // COPY and RESIZE also write a thumbnail here when set
+        int preload_size;
+
+        // Filled by RunTextureJobs
+        bool result;
+        int width;  // source size, 0 if the source could not be probed
+        int height;
+    };
+
+    // Runs the jobs concurrently. Returns false if any job failed; see TextureJob::result.
+    bool RunTextureJobs(std::vector<TextureJob>& jobs);
+
+    // Replaces "<UDIM>" in path with the tile number.
+    std::string MakeUDIMPath(const std::string& path, int udim_id);
+    // Appends one job per tile of a job whose src_path and dst_path contain "<UDIM>".
+    void MakeUDIMTextureJobs(std::vector<TextureJob>& jobs, const TextureJob& job, const std::vector<int>& udim_ids);
+
+    // Placement of UDIM tiles in a baked atlas. Tile 1001 + u + 10 * v covers UV [u, u+1] x [v, v+1] (v up).
+    struct UDIMAtlasLayout
+    {
+        int width;
+        int height;
+        int tile_size; // cell size, the tile itself is tile_size - 2 * padding
+        int padding;
+        std::vector<int> udim_ids;
+        std::vector<int> columns; // cell of udim_ids[i]
+        std::vector<int> rows;
+    };
+
+    // Arranges the tiles in a near square grid.
+    void MakeUDIMAtlasLayout(UDIMAtlasLayout& layout, const std::vector<int>& udim_ids, int tile_size, int padding);
+    // Bakes the tiles of udim_path ("<UDIM>" pattern) into one image, tiles decoded concurrently.
+    bool BakeUDIMAtlas(const std::string& udim_path, const std::string& dst_path, const UDIMAtlasLayout& layout, bool is_srgb = true, float quality = 0.9);
+    // Tile of a texcoord in glTF orientation (v down). Use a face center, corners lie on tile borders.
+    int GetUDIMTileID(float u, float v);
+    // Maps a texcoord of the given tile into the atlas. Returns false if the tile is not in the layout.
+    bool RemapUDIMTexcoord(const UDIMAtlasLayout& layout, int udim_id, float& u, float& v);
+}
+
+#endif
@@ -82,6 +82,16 @@ namespace kml
                 return std::shared_ptr<AnimationCurve>();
             }
         }
+        std::vector<std::string> GetCurveKeys() const
+        {
+            typedef std::map<std::string, std::shared_ptr<AnimationCurve> > MapType;
+            std::vector<std::string> keys;
+            for (MapType::const_iterator it = curves.begin(); it != curves.end(); ++it)
+            {
+                keys.push_back(it->first);
+            }
+            return keys;
+        }
 
     protected:
         std::string path_type;
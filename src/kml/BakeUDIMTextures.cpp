@@ -0,0 +1,255 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "BakeUDIMTextures.h"
+#include "TextureBakeUtil.h"
+
+#include <kil/TextureJob.h>
+
+#include <map>
+#include <set>
+#include <stdio.h>
+
+namespace kml
+{
+    static std::string GetUDIMBaseName(const std::string& path)
+    {
+        std::string name = path;
+        size_t i = name.find_last_of("/\\");
+        if (i != std::string::npos)
+        {
+            name = name.substr(i + 1);
+        }
+        i = name.find_last_of(".");
+        if (i != std::string::npos)
+        {
+            name = name.substr(0, i);
+        }
+        const std::string udim_str = "<UDIM>";
+        i = name.find(udim_str);
+        if (i != std::string::npos)
+        {
+            name.replace(i, udim_str.size(), "udim");
+        }
+        return name;
+    }
+
+    static void RemapTexcoords(std::shared_ptr<Node>& node, const std::map<const Material*, kil::UDIMAtlasLayout>& layouts)
+    {
+        std::shared_ptr<Mesh>& mesh = node->GetMesh();
+        if (mesh->texcoords.empty() || mesh->tex_indices.size() != mesh->pos_indices.size())
+        {
+            return;
+        }
+        const std::vector<glm::vec2> original = mesh->texcoords;
+        // A texcoord is remapped in place for the first (material, tile) that uses it, unless faces without a UDIM
+        // layout use it too; those keep the original and the UDIM faces get a copy, as do later (material, tile) users.
+        std::vector<unsigned char> shared(original.size(), 0);
+        size_t offset = 0;
+        for (size_t i = 0; i < mesh->facenums.size(); i++)
+        {
+            int facenum = mesh->facenums[i];
+            if (!layouts.count(GetFaceMaterial(node, mesh, i).get()))
+            {
+                for (int j = 0; j < facenum; j++)
+                {
+                    int t = mesh->tex_indices[offset + j];
+                    if (0 <= t && t < (int)original.size())
+                    {
+                        shared[t] = 1;
+                    }
+                }
+            }
+            offset += facenum;
+        }
+        std::vector<std::pair<const Material*, int> > owner(original.size(), std::make_pair((const Material*)NULL, -1));
+        std::map<std::pair<int, std::pair<const Material*, int> >, int> duplicated;
+
+        offset = 0;
+        for (size_t i = 0; i < mesh->facenums.size(); i++)
+        {
+            int facenum = mesh->facenums[i];
+            std::shared_ptr<Material> mat = GetFaceMaterial(node, mesh, i);
+            std::map<const Material*, kil::UDIMAtlasLayout>::const_iterator it = layouts.find(mat.get());
+            if (it == layouts.end())
+            {
+                offset += facenum;
+                continue;
+            }
+
+            float cu = 0.0f;
+            float cv = 0.0f;
+            int count = 0;
+            for (int j = 0; j < facenum; j++)
+            {
+                int t = mesh->tex_indices[offset + j];
+                if (0 <= t && t < (int)original.size())
+                {
+                    cu += original[t][0];
+                    cv += original[t][1];
+                    count++;
+                }
+            }
+            if (count == 0)
+            {
+                offset += facenum;
+                continue;
+            }
+            int udim_id = kil::GetUDIMTileID(cu / count, cv / count);
+            std::pair<const Material*, int> key(mat.get(), udim_id);
+
+            for (int j = 0; j < facenum; j++)
+            {
+                int t = mesh->tex_indices[offset + j];
+                if (t < 0 || t >= (int)original.size())
+                {
+                    continue;
+                }
+                float u = original[t][0];
+                float v = original[t][1];
+                if (!kil::RemapUDIMTexcoord(it->second, udim_id, u, v))
+                {
+                    u = 0.0f;
+                    v = 0.0f;
+                }
+                if (owner[t].first == NULL && !shared[t])
+                {
+                    owner[t] = key;
+                    mesh->texcoords[t] = glm::vec2(u, v);
+                }
+                else if (owner[t] != key || shared[t])
+                {
+                    std::pair<int, std::pair<const Material*, int> > dkey(t, key);
+                    std::map<std::pair<int, std::pair<const Material*, int> >, int>::iterator dit = duplicated.find(dkey);
+                    if (dit == duplicated.end())
+                    {
+                        dit = duplicated.insert(std::make_pair(dkey, (int)mesh->texcoords.size())).first;
+                        mesh->texcoords.push_back(glm::vec2(u, v));
+                    }
+                    mesh->tex_indices[offset + j] = dit->second;
+                }
+            }
+            offset += facenum;
+        }
+    }
+
+    bool BakeUDIMTextures(std::shared_ptr<Node>& node, const std::string& base_dir_, const std::shared_ptr<Options>& opts)
+    {
+        int tile_size = opts->GetInt("udim_tile_size", 1024);
+        int padding = opts->GetInt("udim_padding", 4);
+        std::string ext = opts->GetString("udim_texture_ext", ".png");
+
+        std::string base_dir = base_dir_;
+        if (!base_dir.empty() && base_dir[base_dir.size() - 1] != '/' && base_dir[base_dir.size() - 1] != '\\')
+        {
+            base_dir += "/";
+        }
+
+        std::vector<std::shared_ptr<Node> > nodes;
+        GetShapeNodes(nodes, node);
+
+        typedef std::pair<Texture*, std::vector<int> > BakeKey;
+        std::map<BakeKey, std::shared_ptr<Texture> > baked;
+        std::map<const Material*, kil::UDIMAtlasLayout> layouts;
+        std::set<std::string> names;
+        bool ret = true;
+        for (size_t n = 0; n < nodes.size(); n++)
+        {
+            const std::vector<std::shared_ptr<Material> >& materials = nodes[n]->GetMaterials();
+            for (size_t m = 0; m < materials.size(); m++)
+            {
+                const std::shared_ptr<Material>& mat = materials[m];
+                if (!mat.get() || layouts.count(mat.get()))
+                {
+                    continue;
+                }
+                std::vector<std::string> keys = mat->GetTextureKeys();
+                std::vector<std::string> udim_keys;
+                std::vector<int> udim_ids;
+                for (size_t k = 0; k < keys.size(); k++)
+                {
+                    std::shared_ptr<Texture> tex = mat->GetTexture(keys[k]);
+                    if (tex.get() && tex->GetUDIMMode() && !tex->GetUDIM_IDs().empty())
+                    {
+                        udim_keys.push_back(keys[k]);
+                        std::vector<int> ids = tex->GetUDIM_IDs();
+                        udim_ids.insert(udim_ids.end(), ids.begin(), ids.end());
+                    }
+                }
+                if (udim_keys.empty())
+                {
+                    continue;
+                }
+
+                kil::UDIMAtlasLayout layout;
+                kil::MakeUDIMAtlasLayout(layout, udim_ids, tile_size, padding);
+
+                bool ok = true;
+                std::vector<std::shared_ptr<Texture> > textures;
+                for (size_t k = 0; k < udim_keys.size() && ok; k++)
+                {
+                    std::shared_ptr<Texture> tex = mat->GetTexture(udim_keys[k]);
+                    BakeKey key(tex.get(), layout.udim_ids);
+                    std::map<BakeKey, std::shared_ptr<Texture> >::iterator it = baked.find(key);
+                    if (it == baked.end())
+                    {
+                        std::string udim_path = tex->GetUDIMFilePath();
+                        if (!FileExists(kil::MakeUDIMPath(udim_path, layout.udim_ids[0])))
+                        {
+                            udim_path = base_dir + udim_path;
+                        }
+
+                        std::string name = GetUDIMBaseName(tex->GetUDIMFilePath());
+                        for (int i = 1; !names.insert(name + ext).second; i++)
+                        {
+                            char buffer[16] = {};
+                            sprintf(buffer, "%d", i);
+                            name = GetUDIMBaseName(tex->GetUDIMFilePath()) + buffer;
+                        }
+                        name += ext;
+
+                        std::shared_ptr<Texture> atlas;
+                        if (kil::BakeUDIMAtlas(udim_path, base_dir + name, layout, tex->GetColorSpace() == "sRGB"))
+                        {
+                            atlas.reset(tex->clone());
+                            atlas->SetFilePath(name);
+                            atlas->SetCacheFilePath(name);
+                            atlas->SetCompressedFilePath("");
+                            atlas->SetUDIMFilePath("");
+                            atlas->SetUDIMMode(false);
+                            atlas->ClearUDIM_ID();
+                            atlas->SetRepeat(1.0f, 1.0f);
+                            atlas->SetOffset(0.0f, 0.0f);
+                            atlas->SetWrap(false, false);
+                            atlas->SetFileExists(true);
+                        }
+                        it = baked.insert(std::make_pair(key, atlas)).first;
+                    }
+                    ok = it->second.get() != NULL;
+                    textures.push_back(it->second);
+                }
+                if (!ok)
+                {
+                    ret = false;
+                    continue;
+                }
+                for (size_t k = 0; k < udim_keys.size(); k++)
+                {
+                    mat->SetTexture(udim_keys[k], textures[k]);
+                }
+                layouts[mat.get()] = layout;
+            }
+        }
+
+        if (!layouts.empty())
+        {
+            std::set<const Mesh*> remapped; // a mesh shared by several nodes is remapped once
+            for (size_t n = 0; n < nodes.size(); n++)
+            {
+                if (remapped.insert(nodes[n]->GetMesh().get()).second)
+                {
+                    RemapTexcoords(nodes[n], layouts);
+                }
+            }
+        }
+        return ret;
+    }
+} // namespace kml
@@ -0,0 +1,22 @@
+#pragma once
+#ifndef _KML_BAKE_UDIM_TEXTURES_H_
+#define _KML_BAKE_UDIM_TEXTURES_H_
+
+#include "Node.h"
+#include "Options.h"
+#include <memory>
+#include <string>
+
+namespace kml
+{
+    // Bakes the tiles of every UDIM texture under 'node' into one atlas per texture, written to base_dir,
+    // and remaps texcoords of the faces using them. All UDIM textures of a material share one layout.
+    // Run before FlatIndicesMesh.
+    // Options:
+    //   udim_tile_size   : atlas cell size of one tile (1024)
+    //   udim_padding     : gutter pixels inside every cell (4)
+    //   udim_texture_ext : extension of the baked images (".png")
+    bool BakeUDIMTextures(std::shared_ptr<Node>& node, const std::string& base_dir, const std::shared_ptr<Options>& opts);
+} // namespace kml
+
+#endif
@@ -2,12 +2,17 @@
 #define NOMINMAX
 #endif
 #include "CalculateBound.h"
+
+#include <kil/ParallelFor.h>
+
 #include <algorithm>
 #include <limits>
 #include <vector>
 
 namespace kml
 {
+    static const int POSITION_GRAIN = 65536;
+
     static glm::vec3 Transform(const glm::mat4& mat, const glm::vec3& v)
     {
         glm::vec4 t = mat * glm::vec4(v, 1.0f);
@@ -17,22 +22,138 @@ namespace kml
         return glm::vec3(t[0], t[1], t[2]);
     }
 
-    std::shared_ptr<Bound> CalculateBound(const std::shared_ptr<Mesh>& mesh, const glm::mat4& mat)
+    // mat * (v, 1) without the divide, for matrices whose bottom row is (0, 0, 0, 1).
+    static glm::vec3 TransformAffine(const glm::mat4& mat, const glm::vec3& v)
+    {
+        return glm::vec3(mat[0]) * v.x + glm::vec3(mat[1]) * v.y + glm::vec3(mat[2]) * v.z + glm::vec3(mat[3]);
+    }
+
+    static bool IsAffine(const glm::mat4& mat)
+    {
+        return mat[0][3] == 0.0f && mat[1][3] == 0.0f && mat[2][3] == 0.0f && mat[3][3] == 1.0f;
+    }
+
+    // Scale and translation only, so the transformed bound is that of the two transformed corners.
+    static bool IsAxisAligned(const glm::mat4& mat)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            for (int r = 0; r < 3; r++)
+            {
+                if (c != r && mat[c][r] != 0.0f)
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    enum
+    {
+        TRANSFORM_NONE,
+        TRANSFORM_AFFINE,
+        TRANSFORM_PROJECTIVE
+    };
+
+    // Min and max of the transformed positions, a chunk of positions per task joined at the end.
+    static void GetMinMax(const std::vector<glm::vec3>& positions, const glm::mat4& mat, int type, glm::vec3& m0, glm::vec3& m1)
     {
         static float MIN_ = -std::numeric_limits<float>::max();
         static float MAX_ = +std::numeric_limits<float>::max();
-        glm::vec3 m0(MAX_, MAX_, MAX_);
-        glm::vec3 m1(MIN_, MIN_, MIN_);
-        for (size_t i = 0; i < mesh->positions.size(); i++)
+        size_t npositions = positions.size();
+        int nchunks = (int)((npositions + POSITION_GRAIN - 1) / POSITION_GRAIN);
+        std::vector<glm::vec3> mins(nchunks, glm::vec3(MAX_, MAX_, MAX_));
+        std::vector<glm::vec3> maxs(nchunks, glm::vec3(MIN_, MIN_, MIN_));
+        kil::ParallelFor(0, nchunks, [&](int chunk) {
+            glm::vec3 c0 = mins[chunk];
+            glm::vec3 c1 = maxs[chunk];
+            size_t i1 = std::min<size_t>(npositions, (size_t)(chunk + 1) * POSITION_GRAIN);
+            for (size_t i = (size_t)chunk * POSITION_GRAIN; i < i1; i++)
+            {
+                glm::vec3 p = positions[i];
+                if (type == TRANSFORM_AFFINE)
+                {
+                    p = TransformAffine(mat, p);
+                }
+                else if (type == TRANSFORM_PROJECTIVE)
+                {
+                    p = Transform(mat, p);
+                }
+                for (int j = 0; j < 3; j++)
+                {
+                    c0[j] = std::min(c0[j], p[j]);
+                    c1[j] = std::max(c1[j], p[j]);
+                }
+            }
+            mins[chunk] = c0;
+            maxs[chunk] = c1;
+        });
+        m0 = glm::vec3(MAX_, MAX_, MAX_);
+        m1 = glm::vec3(MIN_, MIN_, MIN_);
+        for (int c = 0; c < nchunks; c++)
         {
-            glm::vec3 p = mesh->positions[i];
-            p = Transform(mat, p);
             for (int j = 0; j < 3; j++)
             {
-                m0[j] = std::min(m0[j], p[j]);
-                m1[j] = std::max(m1[j], p[j]);
+                m0[j] = std::min(m0[j], mins[c][j]);
+                m1[j] = std::max(m1[j], maxs[c][j]);
+            }
+        }
+    }
+
+    std::shared_ptr<Bound> CalculateBound(const std::shared_ptr<Mesh>& mesh, const glm::mat4& mat)
+    {
+        glm::vec3 m0;
+        glm::vec3 m1;
+        if (!IsAffine(mat))
+        {
+            GetMinMax(mesh->positions, mat, TRANSFORM_PROJECTIVE, m0, m1);
+        }
+        else if (!IsAxisAligned(mat))
+        {
+            GetMinMax(mesh->positions, mat, TRANSFORM_AFFINE, m0, m1);
+        }
+        else
+        {
+            GetMinMax(mesh->positions, mat, TRANSFORM_NONE, m0, m1);
+            if (!mesh->positions.empty())
+            {
+                glm::vec3 t0 = TransformAffine(mat, m0);
+                glm::vec3 t1 = TransformAffine(mat, m1);
+                m0 = glm::min(t0, t1);
+                m1 = glm::max(t0, t1);
             }
         }
         return std::shared_ptr<Bound>(new Bound(m0, m1));
     }
+
+    std::shared_ptr<Bound> CalculateWorldBounds(const std::shared_ptr<Node>& node, const glm::mat4& mat)
+    {
+        glm::mat4 world = mat * node->GetTransform()->GetMatrix();
+        std::shared_ptr<Bound> bound;
+        const std::shared_ptr<Mesh>& mesh = node->GetMesh();
+        if (mesh.get() && !mesh->positions.empty())
+        {
+            bound = CalculateBound(mesh, world);
+        }
+        const std::vector<std::shared_ptr<Node> >& children = node->GetChildren();
+        for (size_t i = 0; i < children.size(); i++)
+        {
+            std::shared_ptr<Bound> child = CalculateWorldBounds(children[i], world);
+            if (!child.get())
+            {
+                continue;
+            }
+            if (!bound.get())
+            {
+                bound = child;
+            }
+            else
+            {
+                bound.reset(new Bound(glm::min(bound->GetMin(), child->GetMin()), glm::max(bound->GetMax(), child->GetMax())));
+            }
+        }
+        node->SetWorldBound(bound);
+        return bound;
+    }
 } // namespace kml
@@ -4,6 +4,7 @@
 
 #include "Bound.h"
 #include "Mesh.h"
+#include "Node.h"
 
 #include <memory>
 
@@ -11,6 +12,11 @@ namespace kml
 {
 
     std::shared_ptr<Bound> CalculateBound(const std::shared_ptr<Mesh>& mesh, const glm::mat4& mat = glm::mat4(1.0f));
+
+    // Sets the world bound of node and of every node below it, bottom-up in one pass: the bound of its own mesh
+    // under the accumulated transform joined with those of its children. mat is the transform above node.
+    // Nodes with no mesh below them get a NULL world bound, which is also returned.
+    std::shared_ptr<Bound> CalculateWorldBounds(const std::shared_ptr<Node>& node, const glm::mat4& mat = glm::mat4(1.0f));
 }
 
 #endif
@@ -1,4 +1,11 @@
 #include "CalculateNormalsMesh.h"
+#include "MeshAdjacency.h"
+
+#include <kil/ParallelFor.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
 
 #include <glm/glm.hpp> // vec3 normalize cross
 
@@ -64,204 +71,260 @@ namespace kml
         return false;
     }
 
-    static bool IsFaceVaryingNormal(const std::shared_ptr<Mesh>& mesh, float E)
-    {
-        if (mesh->normals.size() != 0)
-        {
-            std::vector<glm::vec3> nf(mesh->facenums.size());
-            {
-                int offset = 0;
-                for (size_t i = 0; i < nf.size(); i++)
-                {
-                    int facenum = mesh->facenums[i];
-                    int i0 = mesh->pos_indices[offset + 0];
-                    int i1 = mesh->pos_indices[offset + 1];
-                    int i2 = mesh->pos_indices[offset + 2];
-                    glm::vec3 p0 = mesh->positions[i0];
-                    glm::vec3 p1 = mesh->positions[i1];
-                    glm::vec3 p2 = mesh->positions[i2];
-
-                    glm::vec3 e1 = p1 - p0;
-                    glm::vec3 e2 = p2 - p0;
+    static const int FACE_GRAIN = 4096;
+    static const int VERTEX_GRAIN = 4096;
 
-                    glm::vec3 nn = glm::cross(e1, e2);
-                    float len = glm::length(nn);
-                    assert(1e-5f < len);
-                    nn = glm::normalize(nn);
-                    nf[i] = nn;
-                    offset += facenum;
-                }
-            }
-
-            {
-                int offset = 0;
-                for (size_t i = 0; i < nf.size(); i++)
-                {
-                    int facenum = mesh->facenums[i];
-                    for (size_t j = 0; j < facenum; j++)
-                    {
-                        int i0 = mesh->nor_indices[offset + j];
-                        glm::vec3 n = mesh->normals[i0];
-                        float d = glm::dot(nf[i], n);
-                        if (d < E)
-                        {
-                            return true;
-                        }
-                    }
-                    offset += facenum;
-                }
-            }
-            return false;
-        }
-        else
+    static void GetFaceOffsets(const std::shared_ptr<Mesh>& mesh, std::vector<int>& offsets)
+    {
+        offsets.resize(mesh->facenums.size() + 1);
+        int offset = 0;
+        for (size_t i = 0; i < mesh->facenums.size(); i++)
         {
-            return true;
+            offsets[i] = offset;
+            offset += mesh->facenums[i];
         }
-        return false;
+        offsets[mesh->facenums.size()] = offset;
     }
 
-    static bool CalculateNormalsMeshFaceVaring(std::shared_ptr<Mesh>& mesh, float E)
+    // Area weighted normal of each face, from its first three corners. Runs in parallel over blocks of faces.
+    static void CalculateFaceNormals(const std::shared_ptr<Mesh>& mesh, const std::vector<int>& offsets, std::vector<glm::vec3>& nf)
     {
-        std::vector<glm::vec3> nf(mesh->facenums.size());
-        for (size_t i = 0; i < nf.size(); i++)
+        int nfaces = (int)mesh->facenums.size();
+        nf.resize(nfaces);
+        if (nfaces == 0)
         {
-            nf[i] = glm::vec3(0, 0, 0);
-        }
-        std::vector<glm::vec3> nv(mesh->positions.size());
-        for (size_t i = 0; i < nv.size(); i++)
-        {
-            nv[i] = glm::vec3(0, 0, 0);
+            return;
         }
+        const glm::vec3* positions = &mesh->positions[0];
+        const int* indices = &mesh->pos_indices[0];
+        kil::ParallelFor(0, nfaces, [&](int i) {
+            const int* face = indices + offsets[i];
+            glm::vec3 p0 = positions[face[0]];
+            nf[i] = glm::cross(positions[face[1]] - p0, positions[face[2]] - p0);
+        }, FACE_GRAIN);
+    }
 
+    // Sums the area weighted normals of the faces around each vertex.
+    // Without an adjacency and with one thread the sums are scattered face by face, which adds in the same order as the rows.
+    static void CalculateVertexNormals(const std::shared_ptr<Mesh>& mesh, const std::vector<int>& offsets, const std::vector<glm::vec3>& nf,
+                                       const MeshAdjacency* adj, std::vector<glm::vec3>& nv)
+    {
+        int nverts = (int)mesh->positions.size();
+        nv.assign(nverts, glm::vec3(0, 0, 0));
+        if (adj == NULL && (kil::GetNumberOfThreads() <= 1 || kil::IsInParallelFor() || nverts <= VERTEX_GRAIN))
         {
-            size_t offset = 0;
-            for (size_t i = 0; i < mesh->facenums.size(); i++)
+            for (size_t i = 0; i < nf.size(); i++)
             {
-                int fsz = mesh->facenums[i];
+                for (int j = offsets[i]; j < offsets[i + 1]; j++)
                 {
-                    int i0 = mesh->pos_indices[offset + 0];
-                    int i1 = mesh->pos_indices[offset + 1];
-                    int i2 = mesh->pos_indices[offset + 2];
-                    glm::vec3 p0 = mesh->positions[i0];
-                    glm::vec3 p1 = mesh->positions[i1];
-                    glm::vec3 p2 = mesh->positions[i2];
-                    glm::vec3 e1 = p1 - p0;
-                    glm::vec3 e2 = p2 - p0;
-                    glm::vec3 n = glm::cross(e1, e2);
-                    nf[i] = glm::normalize(n);
-
-                    nv[i0] += n;
-                    nv[i1] += n;
-                    nv[i2] += n;
+                    nv[mesh->pos_indices[j]] += nf[i];
                 }
-                offset += fsz;
             }
         }
-
-        for (size_t i = 0; i < nv.size(); i++)
+        else
         {
-            if (glm::length(nv[i]) > 1e-5f)
+            MeshAdjacency local;
+            if (adj == NULL)
             {
-                nv[i] = glm::normalize(nv[i]);
+                local.Build(*mesh);
+                adj = &local;
             }
-            else
-            {
-                nv[i] = glm::vec3(0, 0, 0);
-            }
-        }
-
-        std::vector<glm::vec3> normals(mesh->pos_indices.size());
-        std::vector<int> nor_indices = mesh->pos_indices;
-
-        bool bFaceVarying = false;
-        {
-            size_t offset = 0;
-            for (size_t i = 0; i < mesh->facenums.size(); i++)
-            {
-                int fsz = mesh->facenums[i];
-                for (int j = 0; j < fsz; j++)
+            kil::ParallelFor(0, nverts, [&](int v) {
+                glm::vec3 n(0, 0, 0);
+                for (int k = adj->GetVertexBegin(v); k < adj->GetVertexEnd(v); k++)
                 {
-                    int i0 = mesh->pos_indices[offset + j];
-                    float d = glm::dot(nf[i], nv[i0]);
-                    if (d < E)
-                    {
-                        normals[offset + j] = nf[i];
-                        bFaceVarying = true;
-                    }
-                    else
-                    {
-                        normals[offset + j] = nv[i0];
-                    }
-
-                    nor_indices[offset + j] = offset + j;
+                    n += nf[adj->GetCornerFace(adj->GetVertexCorner(k))];
                 }
-                offset += fsz;
-            }
+                nv[v] = n;
+            }, VERTEX_GRAIN);
         }
 
-        if (bFaceVarying)
+        kil::ParallelFor(0, nverts, [&](int v) {
+            float len = glm::length(nv[v]);
+            nv[v] = (len > 1e-6f) ? nv[v] / len : glm::vec3(0, 1, 0);
+        }, VERTEX_GRAIN);
+    }
+
+    static bool CalculateNormalsMeshVertexVaring(std::shared_ptr<Mesh>& mesh, const MeshAdjacency* adj)
+    {
+        std::vector<int> offsets;
+        std::vector<glm::vec3> nf;
+        std::vector<glm::vec3> normals;
+        if (adj)
         {
-            mesh->normals.swap(normals);
-            mesh->nor_indices.swap(nor_indices);
+            offsets = adj->GetFaceOffsets();
         }
         else
         {
-            nor_indices = mesh->pos_indices;
-            mesh->normals.swap(nv);
-            mesh->nor_indices.swap(nor_indices);
+            GetFaceOffsets(mesh, offsets);
         }
+        CalculateFaceNormals(mesh, offsets, nf);
+        CalculateVertexNormals(mesh, offsets, nf, adj, normals);
+
+        std::vector<int> nor_indices = mesh->pos_indices;
+
+        mesh->normals.swap(normals);
+        mesh->nor_indices.swap(nor_indices);
 
         return true;
     }
 
-    static bool CalculateNormalsMeshVertexVaring(std::shared_ptr<Mesh>& mesh)
+    enum NormalWeight
     {
-        if (!NeedRecalc(mesh))
+        WEIGHT_AREA,
+        WEIGHT_ANGLE,
+        WEIGHT_AREA_ANGLE
+    };
+
+    static float GetCornerAngle(const std::shared_ptr<Mesh>& mesh, const MeshAdjacency& adj, int corner)
+    {
+        int face = adj.GetCornerFace(corner);
+        int begin = adj.GetFaceBegin(face);
+        int end = adj.GetFaceEnd(face);
+        int prev = (corner == begin) ? end - 1 : corner - 1;
+        int next = (corner + 1 == end) ? begin : corner + 1;
+        glm::vec3 p = mesh->positions[mesh->pos_indices[corner]];
+        glm::vec3 e1 = mesh->positions[mesh->pos_indices[prev]] - p;
+        glm::vec3 e2 = mesh->positions[mesh->pos_indices[next]] - p;
+        float l = glm::length(e1) * glm::length(e2);
+        if (l <= 0.0f)
         {
-            return true;
+            return 0.0f;
         }
+        return std::acos(std::min<float>(1.0f, std::max<float>(-1.0f, glm::dot(e1, e2) / l)));
+    }
 
-        std::vector<glm::vec3> normals(mesh->positions.size());
-        for (size_t i = 0; i < normals.size(); i++)
+    static int FindGroup(std::vector<int>& parents, int k)
+    {
+        while (parents[k] != k)
         {
-            normals[i] = glm::vec3(0, 0, 0);
+            parents[k] = parents[parents[k]];
+            k = parents[k];
         }
+        return k;
+    }
 
-        size_t offset = 0;
-        for (size_t i = 0; i < mesh->facenums.size(); i++)
-        {
-            int fsz = mesh->facenums[i];
-            {
-                int i0 = mesh->pos_indices[offset + 0];
-                int i1 = mesh->pos_indices[offset + 1];
-                int i2 = mesh->pos_indices[offset + 2];
-                glm::vec3 p0 = mesh->positions[i0];
-                glm::vec3 p1 = mesh->positions[i1];
-                glm::vec3 p2 = mesh->positions[i2];
-                glm::vec3 e1 = p1 - p0;
-                glm::vec3 e2 = p2 - p0;
-                glm::vec3 n = glm::cross(e1, e2);
+    struct SmoothingScratch
+    {
+        std::vector<std::pair<int, int> > edges;
+        std::vector<int> parents;
+        std::vector<glm::vec3> sums;
+    };
 
-                normals[i0] += n;
-                normals[i1] += n;
-                normals[i2] += n;
-            }
-            offset += fsz;
+    // Splits the corners at vertex v into smoothing groups. Faces sharing an edge at v join the same group when
+    // their normals are within the crease angle. Writes 0-based group numbers to groups and returns their count.
+    static int GetSmoothingGroups(const std::shared_ptr<Mesh>& mesh, const MeshAdjacency& adj, const std::vector<glm::vec3>& nfn, int v,
+                                  float cos_crease, std::vector<int>& groups, SmoothingScratch& scratch)
+    {
+        int begin = adj.GetVertexBegin(v);
+        int n = adj.GetVertexEnd(v) - begin;
+        std::vector<std::pair<int, int> >& edges = scratch.edges;
+        std::vector<int>& parents = scratch.parents;
+        edges.clear();
+        parents.resize(n);
+        for (int k = 0; k < n; k++)
+        {
+            int corner = adj.GetVertexCorner(begin + k);
+            int face = adj.GetCornerFace(corner);
+            int fbegin = adj.GetFaceBegin(face);
+            int fend = adj.GetFaceEnd(face);
+            int prev = (corner == fbegin) ? fend - 1 : corner - 1;
+            int next = (corner + 1 == fend) ? fbegin : corner + 1;
+            edges.push_back(std::make_pair(mesh->pos_indices[prev], k));
+            edges.push_back(std::make_pair(mesh->pos_indices[next], k));
+            parents[k] = k;
         }
-
-        for (size_t i = 0; i < normals.size(); i++)
+        std::sort(edges.begin(), edges.end());
+        for (size_t i = 0; i < edges.size(); i++)
         {
-            if (glm::length(normals[i]) > 1e-6f)
+            for (size_t j = i + 1; j < edges.size() && edges[j].first == edges[i].first; j++)
             {
-                normals[i] = glm::normalize(normals[i]);
+                int a = edges[i].second;
+                int b = edges[j].second;
+                int fa = adj.GetCornerFace(adj.GetVertexCorner(begin + a));
+                int fb = adj.GetCornerFace(adj.GetVertexCorner(begin + b));
+                if (glm::dot(nfn[fa], nfn[fb]) >= cos_crease)
+                {
+                    int ra = FindGroup(parents, a);
+                    int rb = FindGroup(parents, b);
+                    parents[std::max(ra, rb)] = std::min(ra, rb);
+                }
             }
-            else
+        }
+        // roots are the smallest member, so they are numbered before the rest of their group
+        int ngroups = 0;
+        for (int k = 0; k < n; k++)
+        {
+            int root = FindGroup(parents, k);
+            groups[k] = (root == k) ? ngroups++ : groups[root];
+        }
+        return ngroups;
+    }
+
+    static bool CalculateNormalsMeshSmoothingGroups(std::shared_ptr<Mesh>& mesh, const MeshAdjacency& adj, float crease_angle, NormalWeight weight)
+    {
+        int nverts = adj.GetVertexCount();
+        int ncorners = (int)mesh->pos_indices.size();
+        std::vector<glm::vec3> nf;
+        CalculateFaceNormals(mesh, adj.GetFaceOffsets(), nf);
+        std::vector<glm::vec3> nfn(nf.size());
+        kil::ParallelFor(0, (int)nf.size(), [&](int i) {
+            float len = glm::length(nf[i]);
+            nfn[i] = (len > 0.0f) ? nf[i] / len : glm::vec3(0, 0, 0);
+        }, FACE_GRAIN);
+        float cos_crease = (crease_angle >= 180.0f) ? -2.0f : std::cos(glm::radians(crease_angle));
+
+        // groups of each corner, numbered per vertex, then offset by the groups of the vertices before
+        std::vector<int> corner_groups(ncorners);
+        std::vector<int> offsets(nverts + 1, 0);
+        int nchunks = (nverts + VERTEX_GRAIN - 1) / VERTEX_GRAIN;
+        kil::ParallelFor(0, nchunks, [&](int c) {
+            SmoothingScratch scratch;
+            std::vector<int> groups;
+            int v1 = std::min<int>(nverts, (c + 1) * VERTEX_GRAIN);
+            for (int v = c * VERTEX_GRAIN; v < v1; v++)
             {
-                normals[i] = glm::vec3(0, 1, 0);
+                int begin = adj.GetVertexBegin(v);
+                groups.resize(adj.GetVertexEnd(v) - begin);
+                offsets[v + 1] = GetSmoothingGroups(mesh, adj, nfn, v, cos_crease, groups, scratch);
+                for (size_t k = 0; k < groups.size(); k++)
+                {
+                    corner_groups[adj.GetVertexCorner(begin + (int)k)] = groups[k];
+                }
             }
+        });
+        for (int v = 0; v < nverts; v++)
+        {
+            offsets[v + 1] += offsets[v];
         }
 
-        std::vector<int> nor_indices = mesh->pos_indices;
+        std::vector<glm::vec3> normals(offsets[nverts]);
+        std::vector<int> nor_indices(ncorners, -1);
+        kil::ParallelFor(0, nchunks, [&](int c) {
+            std::vector<glm::vec3> sums;
+            int v1 = std::min<int>(nverts, (c + 1) * VERTEX_GRAIN);
+            for (int v = c * VERTEX_GRAIN; v < v1; v++)
+            {
+                sums.assign(offsets[v + 1] - offsets[v], glm::vec3(0, 0, 0));
+                for (int k = adj.GetVertexBegin(v); k < adj.GetVertexEnd(v); k++)
+                {
+                    int corner = adj.GetVertexCorner(k);
+                    int face = adj.GetCornerFace(corner);
+                    glm::vec3 n = (weight == WEIGHT_ANGLE) ? nfn[face] : nf[face];
+                    if (weight != WEIGHT_AREA)
+                    {
+                        n *= GetCornerAngle(mesh, adj, corner);
+                    }
+                    sums[corner_groups[corner]] += n;
+                    nor_indices[corner] = offsets[v] + corner_groups[corner];
+                }
+                for (size_t g = 0; g < sums.size(); g++)
+                {
+                    float len = glm::length(sums[g]);
+                    normals[offsets[v] + g] = (len > 1e-6f) ? sums[g] / len : glm::vec3(0, 1, 0);
+                }
+            }
+        });
 
         mesh->normals.swap(normals);
         mesh->nor_indices.swap(nor_indices);
@@ -271,15 +334,49 @@ namespace kml
 
     bool CalculateNormalsMesh(std::shared_ptr<Mesh>& mesh)
     {
-        //static const float E = std::cos(glm::radians(30.0f));
+        if (!NeedRecalc(mesh))
+        {
+            return true;
+        }
+        return CalculateNormalsMeshVertexVaring(mesh, NULL);
+    }
+
+    bool CalculateNormalsMesh(std::shared_ptr<Mesh>& mesh, const std::shared_ptr<Options>& opts)
+    {
+        if (!NeedRecalc(mesh))
+        {
+            return true;
+        }
+        float crease_angle = opts->GetFloat("normal_crease_angle", 180.0f);
+        if (crease_angle >= 180.0f && opts->GetString("normal_weight", "area") == "area")
+        {
+            return CalculateNormalsMeshVertexVaring(mesh, NULL);
+        }
+        MeshAdjacency adj(*mesh);
+        return CalculateNormalsMesh(mesh, adj, opts);
+    }
 
-        //if (IsFaceVaryingNormal(mesh, E))
-        //{
-        //	return CalculateNormalsMeshFaceVaring(mesh, E);
-        //}
-        //else
+    bool CalculateNormalsMesh(std::shared_ptr<Mesh>& mesh, const MeshAdjacency& adj, const std::shared_ptr<Options>& opts)
+    {
+        if (!NeedRecalc(mesh))
+        {
+            return true;
+        }
+        float crease_angle = opts->GetFloat("normal_crease_angle", 180.0f);
+        std::string weight = opts->GetString("normal_weight", "area");
+        if (crease_angle >= 180.0f && weight == "area")
+        {
+            return CalculateNormalsMeshVertexVaring(mesh, &adj);
+        }
+        NormalWeight w = WEIGHT_AREA;
+        if (weight == "angle")
+        {
+            w = WEIGHT_ANGLE;
+        }
+        else if (weight == "area_angle")
         {
-            return CalculateNormalsMeshVertexVaring(mesh);
+            w = WEIGHT_AREA_ANGLE;
         }
+        return CalculateNormalsMeshSmoothingGroups(mesh, adj, crease_angle, w);
     }
 } // namespace kml
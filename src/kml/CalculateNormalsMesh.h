@@ -3,12 +3,19 @@
 #define _KML_CALCULATE_NORMALS_MESH_H
 
 #include "Mesh.h"
+#include "MeshAdjacency.h"
+#include "Options.h"
 #include <memory>
 
 namespace kml
 {
     bool RemoveNoAreaMesh(std::shared_ptr<Mesh>& mesh);
     bool CalculateNormalsMesh(std::shared_ptr<Mesh>& mesh);
+    // Options:
+    //   normal_crease_angle : faces meeting at more than this many degrees get separate normals (float, 180 smooths everything)
+    //   normal_weight       : weighting of the face normals around a vertex, "area", "angle" or "area_angle" (area)
+    bool CalculateNormalsMesh(std::shared_ptr<Mesh>& mesh, const std::shared_ptr<Options>& opts);
+    bool CalculateNormalsMesh(std::shared_ptr<Mesh>& mesh, const MeshAdjacency& adj, const std::shared_ptr<Options>& opts);
 } // namespace kml
 
 #endif
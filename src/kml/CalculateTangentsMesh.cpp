@@ -0,0 +1,122 @@
+#include "CalculateTangentsMesh.h"
+
+#include <kil/ParallelFor.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace kml
+{
+    static const int FACE_GRAIN = 4096;
+    static const int VERTEX_GRAIN = 4096;
+
+    static bool IsFlatIndices(const std::shared_ptr<Mesh>& mesh)
+    {
+        size_t nverts = mesh->positions.size();
+        if (mesh->normals.size() != nverts || mesh->texcoords.size() != nverts || mesh->nor_indices.size() != mesh->pos_indices.size() ||
+            mesh->tex_indices.size() != mesh->pos_indices.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < mesh->pos_indices.size(); i++)
+        {
+            int idx = mesh->pos_indices[i];
+            if (idx < 0 || idx >= (int)nverts || mesh->nor_indices[i] != idx || mesh->tex_indices[i] != idx)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static glm::vec3 GetOrthogonal(const glm::vec3& n)
+    {
+        glm::vec3 a = (std::fabs(n.x) < 0.9f) ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+        glm::vec3 t = a - n * glm::dot(n, a);
+        return t / glm::length(t);
+    }
+
+    bool CalculateTangentsMesh(std::shared_ptr<Mesh>& mesh)
+    {
+        if (!IsFlatIndices(mesh))
+        {
+            return false;
+        }
+        MeshAdjacency adj(*mesh);
+        return CalculateTangentsMesh(mesh, adj);
+    }
+
+    // Like MikkTSpace, each corner adds the face tangent projected onto the vertex normal plane, weighted by
+    // the corner angle, and the handedness follows the sign of the face's UV area. Vertices are not split
+    // when their corners disagree on handedness; FlatIndicesMesh already splits them at UV seams.
+    bool CalculateTangentsMesh(std::shared_ptr<Mesh>& mesh, const MeshAdjacency& adj)
+    {
+        if (!IsFlatIndices(mesh) || adj.GetVertexCount() != (int)mesh->positions.size())
+        {
+            return false;
+        }
+        const std::vector<glm::vec3>& positions = mesh->positions;
+        const std::vector<glm::vec3>& normals = mesh->normals;
+        const std::vector<glm::vec2>& texcoords = mesh->texcoords;
+        const std::vector<int>& indices = mesh->pos_indices;
+
+        // unnormalized tangent and UV orientation of each face, from its first three corners
+        int nfaces = adj.GetFaceCount();
+        std::vector<glm::vec3> face_tangents(nfaces);
+        std::vector<float> face_signs(nfaces);
+        kil::ParallelFor(0, nfaces, [&](int f) {
+            const int* face = &indices[adj.GetFaceBegin(f)];
+            glm::vec3 e1 = positions[face[1]] - positions[face[0]];
+            glm::vec3 e2 = positions[face[2]] - positions[face[0]];
+            glm::vec2 d1 = texcoords[face[1]] - texcoords[face[0]];
+            glm::vec2 d2 = texcoords[face[2]] - texcoords[face[0]];
+            float area = d1.x * d2.y - d1.y * d2.x;
+            glm::vec3 t = e1 * d2.y - e2 * d1.y;
+            face_tangents[f] = (area != 0.0f) ? t / area : glm::vec3(0, 0, 0);
+            face_signs[f] = (area < 0.0f) ? -1.0f : 1.0f;
+        }, FACE_GRAIN);
+
+        int nverts = adj.GetVertexCount();
+        std::vector<glm::vec4> tangents(nverts);
+        kil::ParallelFor(0, nverts, [&](int v) {
+            const glm::vec3& n = normals[v];
+            glm::vec3 sum(0, 0, 0);
+            float sign = 0.0f;
+            for (int k = adj.GetVertexBegin(v); k < adj.GetVertexEnd(v); k++)
+            {
+                int corner = adj.GetVertexCorner(k);
+                int face = adj.GetCornerFace(corner);
+                int begin = adj.GetFaceBegin(face);
+                int end = adj.GetFaceEnd(face);
+                int prev = indices[(corner == begin) ? end - 1 : corner - 1];
+                int next = indices[(corner + 1 == end) ? begin : corner + 1];
+
+                // corner angle measured in the tangent plane, as MikkTSpace does
+                glm::vec3 e1 = positions[prev] - positions[v];
+                glm::vec3 e2 = positions[next] - positions[v];
+                e1 -= n * glm::dot(n, e1);
+                e2 -= n * glm::dot(n, e2);
+                float l = glm::length(e1) * glm::length(e2);
+                float angle = (l > 0.0f) ? std::acos(std::min<float>(1.0f, std::max<float>(-1.0f, glm::dot(e1, e2) / l))) : 0.0f;
+
+                glm::vec3 t = face_tangents[face] - n * glm::dot(n, face_tangents[face]);
+                float tl = glm::length(t);
+                if (tl > 0.0f)
+                {
+                    sum += t * (angle / tl);
+                }
+                sign += face_signs[face] * angle;
+            }
+            sum -= n * glm::dot(n, sum);
+            float len = glm::length(sum);
+            glm::vec3 t = (len > 1e-6f) ? sum / len : GetOrthogonal(n);
+            tangents[v] = glm::vec4(t.x, t.y, t.z, (sign < 0.0f) ? -1.0f : 1.0f);
+        }, VERTEX_GRAIN);
+
+        mesh->tangents.swap(tangents);
+        return true;
+    }
+} // namespace kml
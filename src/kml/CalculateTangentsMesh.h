@@ -0,0 +1,18 @@
+#pragma once
+#ifndef _KML_CALCULATE_TANGENTS_MESH_H
+#define _KML_CALCULATE_TANGENTS_MESH_H
+
+#include "Mesh.h"
+#include "MeshAdjacency.h"
+#include <memory>
+
+namespace kml
+{
+    // Fills Mesh::tangents with MikkTSpace style tangents, xyz along +u and w the sign of the bitangent
+    // (bitangent = cross(normal, xyz) * w). Run it after FlatIndicesMesh, it needs one normal and texcoord per position.
+    // Returns false if the mesh has no texcoords or its indices are not flat.
+    bool CalculateTangentsMesh(std::shared_ptr<Mesh>& mesh);
+    bool CalculateTangentsMesh(std::shared_ptr<Mesh>& mesh, const MeshAdjacency& adj);
+} // namespace kml
+
+#endif
@@ -0,0 +1,175 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "ExportCache.h"
+
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <direct.h>
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+namespace kml
+{
+    static const unsigned long long FNV_OFFSET_BASIS = 14695981039346656037ULL;
+    static const unsigned long long FNV_PRIME = 1099511628211ULL;
+
+    ContentHash::ContentHash()
+        : value_(FNV_OFFSET_BASIS)
+    {
+    }
+
+    void ContentHash::Add(const void* data, size_t size)
+    {
+        const unsigned char* p = (const unsigned char*)data;
+        unsigned long long h = value_;
+        for (size_t i = 0; i < size; i++)
+        {
+            h ^= p[i];
+            h *= FNV_PRIME;
+        }
+        value_ = h;
+    }
+
+    void ContentHash::Add(const std::string& str)
+    {
+        Add((int)str.size());
+        Add(str.c_str(), str.size());
+    }
+
+    void ContentHash::Add(int val)
+    {
+        Add(&val, sizeof(int));
+    }
+
+    void ContentHash::Add(float val)
+    {
+        Add(&val, sizeof(float));
+    }
+
+    std::string ContentHash::ToString() const
+    {
+        char buffer[32] = {};
+        sprintf(buffer, "%016llx", value_);
+        return buffer;
+    }
+
+    static bool ReadFileBytes(const std::string& path, std::vector<unsigned char>& bytes)
+    {
+        FILE* fp = fopen(path.c_str(), "rb");
+        if (!fp)
+        {
+            return false;
+        }
+        fseek(fp, 0, SEEK_END);
+        long size = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+        bool ret = size >= 0;
+        if (ret)
+        {
+            bytes.resize((size_t)size);
+            ret = size == 0 || fread(&bytes[0], 1, (size_t)size, fp) == (size_t)size;
+        }
+        fclose(fp);
+        return ret;
+    }
+
+    static bool WriteFileBytes(const std::string& path, const std::vector<unsigned char>& bytes)
+    {
+        FILE* fp = fopen(path.c_str(), "wb");
+        if (!fp)
+        {
+            return false;
+        }
+        bool ret = bytes.empty() || fwrite(&bytes[0], 1, bytes.size(), fp) == bytes.size();
+        ret &= fclose(fp) == 0;
+        return ret;
+    }
+
+    static bool ReplaceFile(const std::string& src, const std::string& dst)
+    {
+#ifdef _WIN32
+        return ::MoveFileExA(src.c_str(), dst.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+        return rename(src.c_str(), dst.c_str()) == 0;
+#endif
+    }
+
+    static void MakeDirectory(const std::string& path)
+    {
+#ifdef _WIN32
+        _mkdir(path.c_str());
+#else
+        mkdir(path.c_str(), 0777);
+#endif
+    }
+
+    static std::string GetTemporarySuffix()
+    {
+        static std::atomic<int> counter(0);
+        char buffer[64] = {};
+#ifdef _WIN32
+        sprintf(buffer, ".%lu.%d.tmp", (unsigned long)::GetCurrentProcessId(), (int)counter++);
+#else
+        sprintf(buffer, ".%lu.%d.tmp", (unsigned long)getpid(), (int)counter++);
+#endif
+        return buffer;
+    }
+
+    ExportCache::ExportCache(const std::string& dir)
+        : dir_(dir)
+    {
+        if (!dir_.empty() && dir_[dir_.size() - 1] != '/' && dir_[dir_.size() - 1] != '\\')
+        {
+            dir_ += "/";
+        }
+        MakeDirectory(dir_);
+    }
+
+    std::string ExportCache::GetEntryPath(const std::string& key) const
+    {
+        return dir_ + key + ".bin";
+    }
+
+    bool ExportCache::Load(const std::string& key, std::vector<unsigned char>& bytes) const
+    {
+        return ReadFileBytes(GetEntryPath(key), bytes);
+    }
+
+    bool ExportCache::Store(const std::string& key, const std::vector<unsigned char>& bytes) const
+    {
+        std::string path = GetEntryPath(key);
+        std::string tmp = path + GetTemporarySuffix();
+        if (!WriteFileBytes(tmp, bytes) || !ReplaceFile(tmp, path))
+        {
+            remove(tmp.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    std::shared_ptr<ExportCache> ExportCache::Open(const std::string& base_dir, const std::shared_ptr<Options>& opts)
+    {
+        if (opts->GetInt("export_cache", 0) <= 0)
+        {
+            return std::shared_ptr<ExportCache>();
+        }
+        std::string dir = opts->GetString("export_cache_dir");
+        if (dir.empty())
+        {
+            dir = base_dir;
+            if (!dir.empty() && dir[dir.size() - 1] != '/' && dir[dir.size() - 1] != '\\')
+            {
+                dir += "/";
+            }
+            dir += ".kml_cache";
+        }
+        return std::shared_ptr<ExportCache>(new ExportCache(dir));
+    }
+} // namespace kml
@@ -0,0 +1,63 @@
+#pragma once
+#ifndef _KML_EXPORT_CACHE_H_
+#define _KML_EXPORT_CACHE_H_
+
+#include "Options.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace kml
+{
+    // Bump when the layout of cached entries changes.
+    static const int EXPORT_CACHE_VERSION = 2;
+
+    // 64 bit FNV-1a over everything that affects a cached result.
+    class ContentHash
+    {
+    public:
+        ContentHash();
+        void Add(const void* data, size_t size);
+        void Add(const std::string& str);
+        void Add(int val);
+        void Add(float val);
+        template <class T>
+        void AddVector(const std::vector<T>& vec)
+        {
+            Add((int)vec.size());
+            if (!vec.empty())
+            {
+                Add(&vec[0], sizeof(T) * vec.size());
+            }
+        }
+
+        unsigned long long GetValue() const { return value_; }
+        std::string ToString() const;
+
+    private:
+        unsigned long long value_;
+    };
+
+    // Results of previous exports, one file per entry under a directory. Entries are written to a
+    // temporary file and renamed, so an interrupted export never leaves a truncated entry behind.
+    class ExportCache
+    {
+    public:
+        ExportCache(const std::string& dir);
+
+        bool Load(const std::string& key, std::vector<unsigned char>& bytes) const;
+        bool Store(const std::string& key, const std::vector<unsigned char>& bytes) const;
+
+        const std::string& GetDirectory() const { return dir_; }
+
+        // Returns NULL unless "export_cache" is set. The directory is "export_cache_dir" or base_dir + ".kml_cache".
+        static std::shared_ptr<ExportCache> Open(const std::string& base_dir, const std::shared_ptr<Options>& opts);
+
+    private:
+        std::string GetEntryPath(const std::string& key) const;
+
+        std::string dir_;
+    };
+} // namespace kml
+
+#endif
@@ -458,6 +458,7 @@ namespace kml
         mesh->positions.swap(positions);
         mesh->texcoords.swap(texcoords);
         mesh->normals.swap(normals);
+        mesh->tangents.clear();
 
         if (mesh->skin_weight.get())
         {
@@ -3,18 +3,26 @@
 #endif
 
 #include "GLTF2GLB.h"
+#include "MappedFile.h"
+#include "OutputSink.h"
+#include <algorithm>
 #include <cstdint>
-#include <fstream>
 #include <iostream>
+#include <memory>
 #include <vector>
 
 #include <stdio.h>
+#include <string.h>
+#ifndef _WIN32
+#include <sys/types.h>
+#endif
 
 #include <picojson/picojson.h>
 
 namespace kml
 {
     typedef std::uint32_t uint32;
+    typedef std::uint64_t uint64;
     typedef std::uint8_t uchar;
 
     using namespace picojson;
@@ -37,57 +45,153 @@ namespace kml
         struct BufferProperty
         {
             std::string path;
-            uint32 length;
+            std::shared_ptr<MappedFile> mapped; // path mapped into memory, NULL when mapping failed
+            const uchar* bytes;                 // used instead of path when not NULL
+            FILE* fp;                           // used instead of path when not NULL, read from the current position
+            uint64 length;
         };
 
-        static int Get4BytesAlign(int x)
+        static uint64 Get4BytesAlign(uint64 x)
         {
-            if ((x % 4) == 0)
-            {
-                return x;
-            }
-            else
-            {
-                return ((x / 4) + 1) * 4;
-            }
+            return (x + 3) & ~(uint64)3;
+        }
+
+        static bool GetFileSize(FILE* fp, uint64& size)
+        {
+#ifdef _WIN32
+            if (_fseeki64(fp, 0, SEEK_END) != 0)
+                return false;
+            __int64 pos = _ftelli64(fp);
+#else
+            if (fseeko(fp, 0, SEEK_END) != 0)
+                return false;
+            off_t pos = ftello(fp);
+#endif
+            if (pos < 0)
+                return false;
+            size = (uint64)pos;
+            return true;
         }
 
         class BufferManager
         {
         public:
-            uint32 Add(const std::string& path)
+            // Files are mapped, so their bytes reach the sink without read calls or copies.
+            uint64 Add(const std::string& path)
             {
-                FILE* fp = fopen(path.c_str(), "rb");
-                if (fp)
+                std::shared_ptr<MappedFile> mapped(new MappedFile(path));
+                uint64 sz = 0;
+                if (mapped->IsOpen())
+                {
+                    sz = mapped->GetSize();
+                }
+                else
                 {
-                    fseek(fp, 0, SEEK_END);
-                    uint32 sz = (uint32)ftell(fp);
+                    mapped.reset();
+                    FILE* fp = fopen(path.c_str(), "rb");
+                    if (!fp)
+                    {
+                        return 0;
+                    }
+                    bool bRet = GetFileSize(fp, sz);
                     fclose(fp);
-                    BufferProperty prop;
-                    prop.path = path;
-                    prop.length = sz;
-                    props.push_back(prop);
-                    return sz;
+                    if (!bRet)
+                    {
+                        return 0;
+                    }
+                }
+                BufferProperty prop;
+                prop.path = path;
+                prop.mapped = mapped;
+                prop.bytes = NULL;
+                prop.fp = NULL;
+                prop.length = sz;
+                props.push_back(prop);
+                return sz;
+            }
+            uint64 Add(const uchar* bytes, uint64 length)
+            {
+                BufferProperty prop;
+                prop.bytes = bytes;
+                prop.fp = NULL;
+                prop.length = length;
+                props.push_back(prop);
+                return length;
+            }
+            uint64 Add(FILE* fp, uint64 length)
+            {
+                BufferProperty prop;
+                prop.bytes = NULL;
+                prop.fp = fp;
+                prop.length = length;
+                props.push_back(prop);
+                return length;
+            }
+            // Pads with zeros so the next part starts 4 byte aligned. Returns the new length.
+            uint64 Align()
+            {
+                static const uchar zeros[4] = {};
+                uint64 len = GetLength();
+                uint64 byte4 = Get4BytesAlign(len);
+                if (byte4 != len)
+                {
+                    Add(zeros, byte4 - len);
                 }
-                return 0;
+                return byte4;
             }
-            uint32 GetLength() const
+            uint64 GetLength() const
             {
-                uint32 length = 0;
+                uint64 length = 0;
                 for (size_t i = 0; i < props.size(); i++)
                 {
                     length += props[i].length;
                 }
                 return length;
             }
-            bool WriteBinary(FILE* wp)
+            // Writes head followed by the parts. Memory and mapped parts are gathered into as few sink calls
+            // as possible, only streams and unmappable files are copied through a buffer.
+            bool WriteBinary(OutputSink& sink, const std::vector<OutputRange>& head)
             {
+                static const uchar zeros[4] = {};
+                std::vector<OutputRange> ranges(head);
                 for (size_t i = 0; i < props.size(); i++)
                 {
-                    FILE* rp = fopen(props[i].path.c_str(), "rb");
+                    const BufferProperty& prop = props[i];
+                    if (prop.bytes || prop.mapped)
+                    {
+                        const uchar* p = prop.bytes ? prop.bytes : prop.mapped->GetData();
+                        uint64 length = prop.length;
+                        while (length > 0)
+                        {
+                            // ranges are size_t, keep them small enough for 32 bit builds
+                            size_t n = (size_t)std::min<uint64>(length, (uint64)1 << 30);
+                            OutputRange r = {p, n};
+                            ranges.push_back(r);
+                            p += n;
+                            length -= n;
+                        }
+                        continue;
+                    }
+                    if (!ranges.empty())
+                    {
+                        if (!sink.WriteGather(&ranges[0], ranges.size()))
+                        {
+                            return false;
+                        }
+                        ranges.clear();
+                    }
+                    if (prop.fp)
+                    {
+                        if (!this->Transfer(prop.fp, prop.length, sink))
+                        {
+                            return false;
+                        }
+                        continue;
+                    }
+                    FILE* rp = fopen(prop.path.c_str(), "rb");
                     if (rp)
                     {
-                        bool bRet = this->Transfer(rp, wp);
+                        bool bRet = this->Transfer(rp, prop.length, sink);
                         fclose(rp);
                         if (!bRet)
                         {
@@ -100,31 +204,34 @@ namespace kml
                     }
                 }
 
-                uint32 len = GetLength();
-                uint32 byte4 = Get4BytesAlign(len);
+                uint64 len = GetLength();
+                uint64 byte4 = Get4BytesAlign(len);
                 if (byte4 != len)
                 {
-                    uint32 rem = byte4 - len;
-                    for (int i = 0; i < rem; i++)
-                    {
-                        fputc(0, wp);
-                    }
+                    OutputRange r = {zeros, (size_t)(byte4 - len)};
+                    ranges.push_back(r);
                 }
 
-                return true;
+                return ranges.empty() || sink.WriteGather(&ranges[0], ranges.size());
             }
 
         private:
-            static bool Transfer(FILE* rp, FILE* wp)
+            // Copies exactly length bytes, so the chunk layout matches the sizes in the JSON.
+            static bool Transfer(FILE* rp, uint64 length, OutputSink& sink)
             {
-                char buffer[1024] = {};
-                while (feof(rp) == 0)
+                char buffer[65536];
+                while (length > 0)
                 {
-                    uint32 num = fread(buffer, 1, 1024, rp);
-                    if (num)
+                    size_t num = fread(buffer, 1, (size_t)std::min<uint64>(sizeof(buffer), length), rp);
+                    if (num == 0)
+                    {
+                        return false;
+                    }
+                    if (!sink.Write(buffer, num))
                     {
-                        fwrite(buffer, 1, num, wp);
+                        return false;
                     }
+                    length -= num;
                 }
                 return true;
             }
@@ -179,14 +286,27 @@ namespace kml
         {
             return "image/bmp";
         }
+        else if (strExt == ".ktx2")
+        {
+            return "image/ktx2";
+        }
         return "image/jpeg";
     }
 
-    static bool GLTF2GLB_(object& root, FILE* fp, const std::string& dir_path)
+    struct BinSource
+    {
+        const std::vector<unsigned char>* bytes;
+        FILE* fp;
+        size_t size;
+    };
+
+    static bool GLTF2GLB_(object& root, OutputSink& sink, const std::string& dir_path, const BinSource* bin)
     {
         BufferManager bm;
 
-        uint32 bufferOffset = 0;
+        // Every buffer goes into the single BIN chunk. Buffers after the first are appended
+        // 4 byte aligned and their bufferViews rebased.
+        uint64 bufferOffset = 0;
         {
             auto& buff_val = root["buffers"];
             if (!buff_val.is<picojson::array>())
@@ -194,19 +314,65 @@ namespace kml
             auto& buff_array = buff_val.get<picojson::array>();
             if (buff_array.size() == 0)
                 return false;
-            if (!buff_array[0].is<picojson::object>())
-                return false;
-            auto& buff_obj = buff_array[0].get<object>();
-            std::string uri = dir_path + buff_obj["uri"].get<std::string>();
+
+            std::vector<uint64> bases(buff_array.size(), 0);
+            for (size_t i = 0; i < buff_array.size(); i++)
+            {
+                if (!buff_array[i].is<picojson::object>())
+                    return false;
+                auto& buff_obj = buff_array[i].get<object>();
+                if (buff_obj.find("uri") == buff_obj.end() || !buff_obj["uri"].is<std::string>())
+                    return false;
+                std::string uri = dir_path + buff_obj["uri"].get<std::string>();
+
+                bases[i] = bm.Align();
+                uint64 sz = 0;
+                if (i != 0 || !bin)
+                {
+                    sz = bm.Add(uri);
+                }
+                else if (bin->fp)
+                {
+                    sz = bm.Add(bin->fp, bin->size);
+                }
+                else
+                {
+                    sz = bm.Add(bin->bytes->empty() ? NULL : &(*bin->bytes)[0], bin->bytes->size());
+                }
+                if (buff_obj.find("byteLength") != buff_obj.end() && buff_obj["byteLength"].is<double>() &&
+                    (uint64)buff_obj["byteLength"].get<double>() > sz)
+                {
+                    std::cerr << "GLTF2GLB : buffer is shorter than its byteLength : " << uri << std::endl;
+                    return false;
+                }
+            }
+            bufferOffset = bm.GetLength();
+
+            if (buff_array.size() > 1 && root.find("bufferViews") != root.end() && root["bufferViews"].is<picojson::array>())
             {
-                const auto iter = buff_obj.find("uri");
-                if (iter != buff_obj.end())
+                auto& buffer_views = root["bufferViews"].get<picojson::array>();
+                for (size_t i = 0; i < buffer_views.size(); i++)
                 {
-                    buff_obj.erase(iter);
+                    auto& bv = buffer_views[i].get<picojson::object>();
+                    size_t index = (size_t)bv["buffer"].get<double>();
+                    if (index >= bases.size())
+                        return false;
+                    double offset = 0;
+                    if (bv.find("byteOffset") != bv.end())
+                    {
+                        offset = bv["byteOffset"].get<double>();
+                    }
+                    bv["buffer"] = value((double)0);
+                    bv["byteOffset"] = value((double)(offset + (double)bases[index]));
                 }
             }
-            uint32 sz = bm.Add(uri);
-            bufferOffset = sz;
+            buff_array.resize(1);
+            auto& buff_obj = buff_array[0].get<object>();
+            const auto iter = buff_obj.find("uri");
+            if (iter != buff_obj.end())
+            {
+                buff_obj.erase(iter);
+            }
         }
 
         {
@@ -221,11 +387,11 @@ namespace kml
                 {
                     auto& img = imgs_array[i].get<picojson::object>();
                     std::string uri = dir_path + img["uri"].get<std::string>();
-                    uint32 sz = bm.Add(uri);
+                    uint64 sz = bm.Add(uri);
                     if (sz)
                     {
                         std::string mimeType = GetMimeType(uri);
-                        uint32 index = (uint32)buffer_views.size();
+                        size_t index = buffer_views.size();
                         img["bufferView"] = value((double)index);
                         img["mimeType"] = value(mimeType);
                         {
@@ -250,52 +416,56 @@ namespace kml
         }
 
         {
-            auto& buff_val = root["buffers"];
-            if (!buff_val.is<picojson::array>())
-                return false;
-            auto& buff_array = buff_val.get<picojson::array>();
-            if (buff_array.size() == 0)
-                return false;
-            if (!buff_array[0].is<picojson::object>())
-                return false;
+            auto& buff_array = root["buffers"].get<picojson::array>();
             auto& buff_obj = buff_array[0].get<object>();
             buff_obj["byteLength"] = value((double)bufferOffset);
         }
 
         //images
         std::string json_str = value(root).serialize(false);
-        std::vector<uchar> json_buffer(Get4BytesAlign(json_str.size()));
+        std::vector<uchar> json_buffer((size_t)Get4BytesAlign(json_str.size()));
         memset(&json_buffer[0], ' ', sizeof(uchar) * json_buffer.size());
         memcpy(&json_buffer[0], json_str.c_str(), sizeof(uchar) * json_str.size());
 
+        // GLB stores every length in 32 bits, larger scenes have to stay .gltf with split buffers.
+        uint64 bin_length = Get4BytesAlign(bm.GetLength());
+        uint64 total_length = sizeof(GLBHeader) + (16 * sizeof(uchar)) + json_buffer.size() + bin_length;
+        if (total_length > 0xFFFFFFFFull)
+        {
+            std::cerr << "GLTF2GLB : output exceeds the 4GB limit of GLB (" << total_length << " bytes)" << std::endl;
+            return false;
+        }
+
         GLBChunk chunk0;
-        chunk0.chunkLength = json_buffer.size() * sizeof(uchar);
+        chunk0.chunkLength = (uint32)(json_buffer.size() * sizeof(uchar));
         chunk0.chunkType = (uint32)0x4E4F534A; //ASCII
 
         GLBChunk chunk1;
-        chunk1.chunkLength = Get4BytesAlign(bm.GetLength()) * sizeof(uchar);
+        chunk1.chunkLength = (uint32)bin_length;
         chunk1.chunkType = (uint32)0x004E4942; //BIN
 
         GLBHeader header;
         header.magic = (uint32)0x46546C67; //"glTF"
         header.version = 2;                //
-        header.length = sizeof(GLBHeader) + (16 * sizeof(uchar)) + chunk0.chunkLength + chunk1.chunkLength;
-
-        //header
-        fwrite(&header, sizeof(GLBHeader), 1, fp);
+        header.length = (uint32)total_length;
 
-        //chunk0
-        fwrite(&chunk0, sizeof(GLBChunk), 1, fp);
-        fwrite(&json_buffer[0], sizeof(uchar), json_buffer.size(), fp);
-
-        //chunk1
-        fwrite(&chunk1, sizeof(GLBChunk), 1, fp);
-        if (!bm.WriteBinary(fp))
+        std::vector<OutputRange> head;
         {
-            return false;
+            //header
+            OutputRange r0 = {&header, sizeof(GLBHeader)};
+            head.push_back(r0);
+
+            //chunk0
+            OutputRange r1 = {&chunk0, sizeof(GLBChunk)};
+            OutputRange r2 = {&json_buffer[0], sizeof(uchar) * json_buffer.size()};
+            head.push_back(r1);
+            head.push_back(r2);
+
+            //chunk1
+            OutputRange r3 = {&chunk1, sizeof(GLBChunk)};
+            head.push_back(r3);
         }
-
-        return true;
+        return bm.WriteBinary(sink, head);
     }
 
     bool GLTF2GLB(const std::string& src, const std::string& dst)
@@ -303,13 +473,15 @@ namespace kml
         bool bRet = true;
         picojson::value root_value;
         {
-            std::ifstream ifs(src);
-            if (!ifs)
+            MappedFile json(src);
+            if (!json.IsOpen())
             {
                 return false;
             }
 
-            std::string err = picojson::parse(root_value, ifs);
+            std::string err;
+            const char* begin = (const char*)json.GetData();
+            picojson::parse(root_value, begin, begin + json.GetSize(), &err);
             if (!err.empty())
             {
                 return false;
@@ -321,19 +493,44 @@ namespace kml
             return false;
         }
 
-        FILE* fp = fopen(dst.c_str(), "wb");
-        if (!fp)
+        FileOutputSink sink(dst);
+        if (!sink.IsOpen())
         {
             return false;
         }
 
         std::string dir_path = GetDirectoryPath(src);
-        bRet = GLTF2GLB_(root_value.get<object>(), fp, dir_path);
+        bRet = GLTF2GLB_(root_value.get<object>(), sink, dir_path, NULL);
 
+        return bRet;
+    }
+
+    bool GLTF2GLB(picojson::value& root, const std::string& dir_path, OutputSink& sink)
+    {
+        if (!root.is<object>())
         {
-            fclose(fp);
+            return false;
         }
+        return GLTF2GLB_(root.get<object>(), sink, dir_path, NULL);
+    }
 
-        return bRet;
+    bool GLTF2GLB(picojson::value& root, const std::vector<unsigned char>& bin, const std::string& image_dir, OutputSink& sink)
+    {
+        if (!root.is<object>())
+        {
+            return false;
+        }
+        BinSource source = {&bin, NULL, bin.size()};
+        return GLTF2GLB_(root.get<object>(), sink, image_dir, &source);
+    }
+
+    bool GLTF2GLB(picojson::value& root, FILE* bin, size_t bin_size, const std::string& image_dir, OutputSink& sink)
+    {
+        if (!root.is<object>())
+        {
+            return false;
+        }
+        BinSource source = {NULL, bin, bin_size};
+        return GLTF2GLB_(root.get<object>(), sink, image_dir, &source);
     }
 } // namespace kml
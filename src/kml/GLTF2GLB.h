@@ -2,11 +2,27 @@
 #ifndef _KML_GLTF2GLB_H_
 #define _KML_GLTF2GLB_H_
 
+#include <stdio.h>
 #include <string>
+#include <vector>
+
+namespace picojson
+{
+    class value;
+}
 
 namespace kml
 {
+    class OutputSink;
+
     bool GLTF2GLB(const std::string& src, const std::string& dst);
+    // Packs a parsed glTF document, buffer and image uris are resolved against dir_path. root is modified.
+    bool GLTF2GLB(picojson::value& root, const std::string& dir_path, OutputSink& sink);
+    // Packs a glTF document held in memory. bin replaces the file of the first buffer, images are
+    // read from image_dir and embedded. root is modified.
+    bool GLTF2GLB(picojson::value& root, const std::vector<unsigned char>& bin, const std::string& image_dir, OutputSink& sink);
+    // Same, with the binary buffer read from bin (bin_size bytes from its current position).
+    bool GLTF2GLB(picojson::value& root, FILE* bin, size_t bin_size, const std::string& image_dir, OutputSink& sink);
 }
 
 #endif
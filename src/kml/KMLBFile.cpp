@@ -0,0 +1,1019 @@
+#ifdef _WIN32
+#define _CRT_SECURE_NO_WARNINGS 1
+#endif
+
+#include "KMLBFile.h"
+#include "OutputSink.h"
+
+#include <cstdint>
+#include <map>
+#include <string.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/mat4x4.hpp>
+
+namespace kml
+{
+    typedef std::uint32_t uint32;
+    typedef std::uint64_t uint64;
+
+    namespace
+    {
+        // Layout (version 3, which moved meshes into a table; version 2 added mesh tangents):
+        //   header   : "KMLB", version, endian mark, reserved
+        //   sections : textures, materials, skin weights, meshes, nodes (pre-order), skins, animations
+        //   trailer  : "KMLE"
+        // Objects refer to each other by table index, -1 for none, so a mesh shared by several nodes
+        // is stored once. Before version 3 each node held its mesh inline. Arrays are a uint64 count
+        // followed by the elements, starting on a 16 byte boundary.
+        static const char KMLB_MAGIC[4] = {'K', 'M', 'L', 'B'};
+        static const char KMLB_TRAILER[4] = {'K', 'M', 'L', 'E'};
+        static const uint32 KMLB_VERSION = 3;
+        static const uint32 KMLB_ENDIAN = 0x01020304;
+        static const size_t KMLB_ALIGN = 16;
+
+        enum
+        {
+            KMLB_TRANSFORM_NONE = 0,
+            KMLB_TRANSFORM_MATRIX,
+            KMLB_TRANSFORM_TRS
+        };
+
+        class KMLBWriter
+        {
+        public:
+            KMLBWriter(OutputSink& sink)
+                : sink_(sink), offset_(0), good_(true)
+            {
+            }
+            void Write(const void* data, size_t size)
+            {
+                if (good_ && size > 0)
+                {
+                    good_ = sink_.Write(data, size);
+                }
+                offset_ += size;
+            }
+            void WriteU32(uint32 v) { Write(&v, sizeof(v)); }
+            void WriteI32(int v) { Write(&v, sizeof(v)); }
+            void WriteF32(float v) { Write(&v, sizeof(v)); }
+            void WriteString(const std::string& s)
+            {
+                WriteU32((uint32)s.size());
+                Write(s.c_str(), s.size());
+            }
+            template <class T>
+            void WriteArray(const std::vector<T>& v)
+            {
+                uint64 count = v.size();
+                Write(&count, sizeof(count));
+                Pad();
+                if (!v.empty())
+                {
+                    Write(&v[0], sizeof(T) * v.size());
+                }
+            }
+            bool IsGood() const { return good_; }
+
+        private:
+            void Pad()
+            {
+                static const unsigned char zeros[KMLB_ALIGN] = {};
+                size_t r = (size_t)(offset_ % KMLB_ALIGN);
+                if (r != 0)
+                {
+                    Write(zeros, KMLB_ALIGN - r);
+                }
+            }
+
+        private:
+            OutputSink& sink_;
+            uint64 offset_;
+            bool good_;
+        };
+
+        // Every read is bounds checked, a damaged file turns the reader bad instead of reading past the end.
+        class KMLBReader
+        {
+        public:
+            KMLBReader(const unsigned char* data, size_t size)
+                : data_(data), size_(size), offset_(0), good_(true), version_(KMLB_VERSION)
+            {
+            }
+            bool Read(void* p, size_t size)
+            {
+                if (!good_ || size_ - offset_ < size)
+                {
+                    good_ = false;
+                    memset(p, 0, size);
+                    return false;
+                }
+                memcpy(p, data_ + offset_, size);
+                offset_ += size;
+                return true;
+            }
+            uint32 ReadU32()
+            {
+                uint32 v = 0;
+                Read(&v, sizeof(v));
+                return v;
+            }
+            int ReadI32()
+            {
+                int v = 0;
+                Read(&v, sizeof(v));
+                return v;
+            }
+            float ReadF32()
+            {
+                float v = 0;
+                Read(&v, sizeof(v));
+                return v;
+            }
+            std::string ReadString()
+            {
+                uint32 len = ReadU32();
+                if (!good_ || size_ - offset_ < len)
+                {
+                    good_ = false;
+                    return std::string();
+                }
+                std::string s((const char*)data_ + offset_, len);
+                offset_ += len;
+                return s;
+            }
+            template <class T>
+            KMLBArrayView<T> ReadArray()
+            {
+                KMLBArrayView<T> view;
+                uint64 count = 0;
+                Read(&count, sizeof(count));
+                size_t aligned = (offset_ + KMLB_ALIGN - 1) & ~(KMLB_ALIGN - 1);
+                if (!good_ || aligned > size_ || count > (size_ - aligned) / sizeof(T))
+                {
+                    good_ = false;
+                    return view;
+                }
+                view.data = (const T*)(data_ + aligned);
+                view.size = (size_t)count;
+                offset_ = aligned + sizeof(T) * view.size;
+                return view;
+            }
+            template <class T>
+            void ReadVector(std::vector<T>& v)
+            {
+                KMLBArrayView<T> view = ReadArray<T>();
+                v.assign(view.data, view.data + view.size);
+            }
+            // Array whose elements are table indices, checked against the table size.
+            std::vector<int> ReadIndices(size_t table_size)
+            {
+                std::vector<int> v;
+                ReadVector(v);
+                for (size_t i = 0; i < v.size(); i++)
+                {
+                    if (v[i] < -1 || v[i] >= (int)table_size)
+                    {
+                        good_ = false;
+                        v.clear();
+                        break;
+                    }
+                }
+                return v;
+            }
+            int ReadIndex(size_t table_size)
+            {
+                int v = ReadI32();
+                if (v < -1 || v >= (int)table_size)
+                {
+                    good_ = false;
+                    return -1;
+                }
+                return v;
+            }
+            bool IsGood() const { return good_; }
+            // version of the file being read, older layouts are still accepted
+            uint32 GetVersion() const { return version_; }
+            void SetVersion(uint32 version) { version_ = version; }
+
+        private:
+            const unsigned char* data_;
+            size_t size_;
+            size_t offset_;
+            bool good_;
+            uint32 version_;
+        };
+
+        template <class T>
+        class KMLBTable
+        {
+        public:
+            int Add(const std::shared_ptr<T>& p)
+            {
+                if (!p)
+                {
+                    return -1;
+                }
+                typename std::map<const T*, int>::const_iterator it = indices.find(p.get());
+                if (it != indices.end())
+                {
+                    return it->second;
+                }
+                int index = (int)items.size();
+                indices[p.get()] = index;
+                items.push_back(p);
+                return index;
+            }
+            int Find(const std::shared_ptr<T>& p) const
+            {
+                typename std::map<const T*, int>::const_iterator it = indices.find(p.get());
+                return (it != indices.end()) ? it->second : -1;
+            }
+
+        public:
+            std::vector<std::shared_ptr<T> > items;
+            std::map<const T*, int> indices;
+        };
+
+        struct KMLBScene
+        {
+            KMLBTable<Texture> textures;
+            KMLBTable<Material> materials;
+            KMLBTable<SkinWeight> skin_weights;
+            KMLBTable<Mesh> meshes;
+            KMLBTable<Node> nodes;
+            std::vector<int> parents;
+            KMLBTable<Skin> skins;
+            KMLBTable<Animation> animations;
+        };
+
+        static void CollectScene(KMLBScene& scene, const std::shared_ptr<Node>& node, int parent)
+        {
+            if (scene.nodes.Find(node) >= 0)
+            {
+                return; // a node linked twice is stored once
+            }
+            scene.nodes.Add(node);
+            scene.parents.push_back(parent);
+            int index = (int)scene.parents.size() - 1;
+
+            const std::vector<std::shared_ptr<Material> >& materials = node->GetMaterials();
+            for (size_t i = 0; i < materials.size(); i++)
+            {
+                if (scene.materials.Find(materials[i]) < 0 && materials[i])
+                {
+                    std::vector<std::string> keys = materials[i]->GetTextureKeys();
+                    for (size_t k = 0; k < keys.size(); k++)
+                    {
+                        scene.textures.Add(materials[i]->GetTexture(keys[k]));
+                    }
+                }
+                scene.materials.Add(materials[i]);
+            }
+            if (node->GetMesh())
+            {
+                scene.skin_weights.Add(node->GetMesh()->skin_weight);
+                scene.meshes.Add(node->GetMesh());
+            }
+            const std::vector<std::shared_ptr<Skin> >& skins = node->GetSkins();
+            for (size_t i = 0; i < skins.size(); i++)
+            {
+                if (!skins[i])
+                {
+                    continue;
+                }
+                const std::vector<std::shared_ptr<SkinWeight> >& weights = skins[i]->GetSkinWeights();
+                for (size_t j = 0; j < weights.size(); j++)
+                {
+                    scene.skin_weights.Add(weights[j]);
+                }
+                scene.skins.Add(skins[i]);
+            }
+            const std::vector<std::shared_ptr<Animation> >& animations = node->GetAnimations();
+            for (size_t i = 0; i < animations.size(); i++)
+            {
+                scene.animations.Add(animations[i]);
+            }
+
+            const std::vector<std::shared_ptr<Node> >& children = node->GetChildren();
+            for (size_t i = 0; i < children.size(); i++)
+            {
+                if (children[i])
+                {
+                    CollectScene(scene, children[i], index);
+                }
+            }
+        }
+
+        template <class T>
+        static std::vector<int> GetIndices(const KMLBTable<T>& table, const std::vector<std::shared_ptr<T> >& items)
+        {
+            std::vector<int> v;
+            for (size_t i = 0; i < items.size(); i++)
+            {
+                v.push_back(table.Find(items[i]));
+            }
+            return v;
+        }
+
+        static void WriteTexture(KMLBWriter& w, const Texture& tex)
+        {
+            w.WriteString(tex.GetFilePath());
+            w.WriteString(tex.GetCacheFilePath());
+            w.WriteString(tex.GetCompressedFilePath());
+            w.WriteString(tex.GetUDIMFilePath());
+            w.WriteString(tex.GetColorSpace());
+            w.WriteF32(tex.GetRepeatU());
+            w.WriteF32(tex.GetRepeatV());
+            w.WriteF32(tex.GetOffsetU());
+            w.WriteF32(tex.GetOffsetV());
+            w.WriteU32((uint32)tex.GetWrapTypeU());
+            w.WriteU32((uint32)tex.GetWrapTypeV());
+            w.WriteU32((uint32)tex.GetFilterTypeU());
+            w.WriteU32((uint32)tex.GetFilterTypeV());
+            w.WriteU32(tex.GetUDIMMode() ? 1 : 0);
+            w.WriteArray(tex.GetUDIM_IDs());
+            w.WriteU32(tex.FileExists() ? 1 : 0);
+        }
+
+        static std::shared_ptr<Texture> ReadTexture(KMLBReader& r)
+        {
+            std::shared_ptr<Texture> tex(new Texture());
+            tex->SetFilePath(r.ReadString());
+            tex->SetCacheFilePath(r.ReadString());
+            tex->SetCompressedFilePath(r.ReadString());
+            tex->SetUDIMFilePath(r.ReadString());
+            tex->SetColorSpace(r.ReadString());
+            float repeatU = r.ReadF32();
+            float repeatV = r.ReadF32();
+            tex->SetRepeat(repeatU, repeatV);
+            float offsetU = r.ReadF32();
+            float offsetV = r.ReadF32();
+            tex->SetOffset(offsetU, offsetV);
+            tex->SetWrapTypeU((Texture::WrapType)r.ReadU32());
+            tex->SetWrapTypeV((Texture::WrapType)r.ReadU32());
+            tex->SetFilterTypeU((Texture::FilterType)r.ReadU32());
+            tex->SetFilterTypeV((Texture::FilterType)r.ReadU32());
+            tex->SetUDIMMode(r.ReadU32() != 0);
+            std::vector<int> ids;
+            r.ReadVector(ids);
+            for (size_t i = 0; i < ids.size(); i++)
+            {
+                tex->AddUDIM_ID(ids[i]);
+            }
+            tex->SetFileExists(r.ReadU32() != 0);
+            return tex;
+        }
+
+        static void WriteMaterial(KMLBWriter& w, const KMLBScene& scene, const Material& mat)
+        {
+            w.WriteString(mat.GetName());
+            std::vector<std::string> keys = mat.GetIntegerKeys();
+            w.WriteU32((uint32)keys.size());
+            for (size_t i = 0; i < keys.size(); i++)
+            {
+                w.WriteString(keys[i]);
+                w.WriteI32(mat.GetInteger(keys[i]));
+            }
+            keys = mat.GetFloatKeys();
+            w.WriteU32((uint32)keys.size());
+            for (size_t i = 0; i < keys.size(); i++)
+            {
+                w.WriteString(keys[i]);
+                w.WriteF32(mat.GetFloat(keys[i]));
+            }
+            keys = mat.GetStringKeys();
+            w.WriteU32((uint32)keys.size());
+            for (size_t i = 0; i < keys.size(); i++)
+            {
+                w.WriteString(keys[i]);
+                w.WriteString(mat.GetString(keys[i]));
+            }
+            keys = mat.GetTextureKeys();
+            w.WriteU32((uint32)keys.size());
+            for (size_t i = 0; i < keys.size(); i++)
+            {
+                w.WriteString(keys[i]);
+                w.WriteI32(scene.textures.Find(mat.GetTexture(keys[i])));
+            }
+        }
+
+        static std::shared_ptr<Material> ReadMaterial(KMLBReader& r, const KMLBScene& scene)
+        {
+            std::shared_ptr<Material> mat(new Material());
+            mat->SetName(r.ReadString());
+            uint32 count = r.ReadU32();
+            for (uint32 i = 0; i < count && r.IsGood(); i++)
+            {
+                std::string key = r.ReadString();
+                mat->SetInteger(key, r.ReadI32());
+            }
+            count = r.ReadU32();
+            for (uint32 i = 0; i < count && r.IsGood(); i++)
+            {
+                std::string key = r.ReadString();
+                mat->SetFloat(key, r.ReadF32());
+            }
+            count = r.ReadU32();
+            for (uint32 i = 0; i < count && r.IsGood(); i++)
+            {
+                std::string key = r.ReadString();
+                mat->SetString(key, r.ReadString());
+            }
+            count = r.ReadU32();
+            for (uint32 i = 0; i < count && r.IsGood(); i++)
+            {
+                std::string key = r.ReadString();
+                int index = r.ReadIndex(scene.textures.items.size());
+                if (index >= 0)
+                {
+                    mat->SetTexture(key, scene.textures.items[index]);
+                }
+            }
+            return mat;
+        }
+
+        // Weights are stored as a name table and per vertex ranges of (name index, value).
+        static void WriteSkinWeight(KMLBWriter& w, const SkinWeight& sw)
+        {
+            w.WriteString(sw.name);
+            w.WriteU32((uint32)sw.joint_paths.size());
+            for (size_t i = 0; i < sw.joint_paths.size(); i++)
+            {
+                w.WriteString(sw.joint_paths[i]);
+            }
+            w.WriteArray(sw.joint_bind_matrices);
+
+            std::map<std::string, uint32> name_indices;
+            std::vector<std::string> names;
+            std::vector<uint32> offsets(1, 0);
+            std::vector<uint32> indices;
+            std::vector<float> values;
+            for (size_t i = 0; i < sw.weights.size(); i++)
+            {
+                const SkinWeight::WeightVertex& wv = sw.weights[i];
+                for (SkinWeight::WeightVertex::const_iterator it = wv.begin(); it != wv.end(); ++it)
+                {
+                    std::map<std::string, uint32>::iterator nit = name_indices.find(it->first);
+                    if (nit == name_indices.end())
+                    {
+                        nit = name_indices.insert(std::make_pair(it->first, (uint32)names.size())).first;
+                        names.push_back(it->first);
+                    }
+                    indices.push_back(nit->second);
+                    values.push_back(it->second);
+                }
+                offsets.push_back((uint32)indices.size());
+            }
+            w.WriteU32((uint32)names.size());
+            for (size_t i = 0; i < names.size(); i++)
+            {
+                w.WriteString(names[i]);
+            }
+            w.WriteArray(offsets);
+            w.WriteArray(indices);
+            w.WriteArray(values);
+        }
+
+        static std::shared_ptr<SkinWeight> ReadSkinWeight(KMLBReader& r)
+        {
+            std::shared_ptr<SkinWeight> sw(new SkinWeight());
+            sw->name = r.ReadString();
+            uint32 count = r.ReadU32();
+            for (uint32 i = 0; i < count && r.IsGood(); i++)
+            {
+                sw->joint_paths.push_back(r.ReadString());
+            }
+            r.ReadVector(sw->joint_bind_matrices);
+
+            std::vector<std::string> names;
+            count = r.ReadU32();
+            for (uint32 i = 0; i < count && r.IsGood(); i++)
+            {
+                names.push_back(r.ReadString());
+            }
+            KMLBArrayView<uint32> offsets = r.ReadArray<uint32>();
+            KMLBArrayView<uint32> indices = r.ReadArray<uint32>();
+            KMLBArrayView<float> values = r.ReadArray<float>();
+            if (!r.IsGood() || offsets.size == 0 || indices.size != values.size)
+            {
+                return sw;
+            }
+            sw->weights.resize(offsets.size - 1);
+            for (size_t i = 0; i + 1 < offsets.size; i++)
+            {
+                for (uint32 j = offsets[i]; j < offsets[i + 1] && j < indices.size; j++)
+                {
+                    if (indices[j] < names.size())
+                    {
+                        sw->weights[i][names[indices[j]]] = values[j];
+                    }
+                }
+            }
+            return sw;
+        }
+
+        static void WriteMesh(KMLBWriter& w, const KMLBScene& scene, const Mesh& mesh)
+        {
+            w.WriteString(mesh.name);
+            w.WriteArray(mesh.facenums);
+            w.WriteArray(mesh.pos_indices);
+            w.WriteArray(mesh.nor_indices);
+            w.WriteArray(mesh.tex_indices);
+            w.WriteArray(mesh.positions);
+            w.WriteArray(mesh.normals);
+            w.WriteArray(mesh.texcoords);
+            w.WriteArray(mesh.tangents);
+            w.WriteArray(mesh.materials);
+            w.WriteI32(mesh.skin_weight ? scene.skin_weights.Find(mesh.skin_weight) : -1);
+
+            const std::shared_ptr<MorphTargets>& morph = mesh.morph_targets;
+            w.WriteU32(morph ? 1 : 0);
+            if (morph)
+            {
+                w.WriteU32((uint32)morph->targets.size());
+                for (size_t i = 0; i < morph->targets.size(); i++)
+                {
+                    static const std::vector<glm::vec3> empty;
+                    const std::shared_ptr<MorphTarget>& target = morph->targets[i];
+                    w.WriteArray(target ? target->positions : empty);
+                    w.WriteArray(target ? target->normals : empty);
+                }
+                w.WriteArray(morph->weights);
+                w.WriteU32((uint32)morph->names.size());
+                for (size_t i = 0; i < morph->names.size(); i++)
+                {
+                    w.WriteString(morph->names[i]);
+                }
+            }
+        }
+
+        // With copy_arrays false only the views are filled, for KMLBFile::Open.
+        static std::shared_ptr<Mesh> ReadMesh(KMLBReader& r, const KMLBScene& scene, KMLBMeshView& view, bool copy_arrays)
+        {
+            std::shared_ptr<Mesh> mesh(new Mesh());
+            mesh->name = view.name = r.ReadString();
+            view.facenums = r.ReadArray<unsigned char>();
+            view.pos_indices = r.ReadArray<int>();
+            view.nor_indices = r.ReadArray<int>();
+            view.tex_indices = r.ReadArray<int>();
+            view.positions = r.ReadArray<glm::vec3>();
+            view.normals = r.ReadArray<glm::vec3>();
+            view.texcoords = r.ReadArray<glm::vec2>();
+            if (r.GetVersion() >= 2)
+            {
+                view.tangents = r.ReadArray<glm::vec4>();
+            }
+            view.materials = r.ReadArray<int>();
+            if (copy_arrays)
+            {
+                mesh->facenums = view.facenums.ToVector();
+                mesh->pos_indices = view.pos_indices.ToVector();
+                mesh->nor_indices = view.nor_indices.ToVector();
+                mesh->tex_indices = view.tex_indices.ToVector();
+                mesh->positions = view.positions.ToVector();
+                mesh->normals = view.normals.ToVector();
+                mesh->texcoords = view.texcoords.ToVector();
+                mesh->tangents = view.tangents.ToVector();
+                mesh->materials = view.materials.ToVector();
+            }
+            int skin_weight = r.ReadIndex(scene.skin_weights.items.size());
+            if (skin_weight >= 0)
+            {
+                mesh->skin_weight = scene.skin_weights.items[skin_weight];
+            }
+
+            if (r.ReadU32() != 0)
+            {
+                std::shared_ptr<MorphTargets> morph(new MorphTargets());
+                uint32 count = r.ReadU32();
+                for (uint32 i = 0; i < count && r.IsGood(); i++)
+                {
+                    std::shared_ptr<MorphTarget> target(new MorphTarget());
+                    r.ReadVector(target->positions);
+                    r.ReadVector(target->normals);
+                    morph->targets.push_back(target);
+                }
+                r.ReadVector(morph->weights);
+                count = r.ReadU32();
+                for (uint32 i = 0; i < count && r.IsGood(); i++)
+                {
+                    morph->names.push_back(r.ReadString());
+                }
+                mesh->morph_targets = morph;
+            }
+            return mesh;
+        }
+
+        static void WriteNode(KMLBWriter& w, const KMLBScene& scene, const Node& node, int parent)
+        {
+            w.WriteString(node.GetName());
+            w.WriteString(node.GetPath());
+            w.WriteString(node.GetOriginalPath());
+            w.WriteI32(parent);
+            w.WriteU32(node.GetVisibility() ? 1 : 0);
+
+            const std::shared_ptr<Transform>& trans = node.GetTransform();
+            if (!trans)
+            {
+                w.WriteU32(KMLB_TRANSFORM_NONE);
+            }
+            else if (trans->IsTRS())
+            {
+                w.WriteU32(KMLB_TRANSFORM_TRS);
+                glm::vec3 T = trans->GetT();
+                glm::quat R = trans->GetR();
+                glm::vec3 S = trans->GetS();
+                float trs[10] = {T.x, T.y, T.z, R.x, R.y, R.z, R.w, S.x, S.y, S.z};
+                w.Write(trs, sizeof(trs));
+            }
+            else
+            {
+                w.WriteU32(KMLB_TRANSFORM_MATRIX);
+                glm::mat4 m = trans->GetMatrix();
+                w.Write(&m, sizeof(m));
+            }
+
+            const std::shared_ptr<Bound>& bound = node.GetBound();
+            w.WriteU32(bound ? 1 : 0);
+            if (bound)
+            {
+                glm::vec3 bmin = bound->GetMin();
+                glm::vec3 bmax = bound->GetMax();
+                w.Write(&bmin, sizeof(bmin));
+                w.Write(&bmax, sizeof(bmax));
+            }
+
+            w.WriteArray(GetIndices(scene.materials, node.GetMaterials()));
+            w.WriteArray(GetIndices(scene.skins, node.GetSkins()));
+            w.WriteArray(GetIndices(scene.animations, node.GetAnimations()));
+            w.WriteI32(scene.meshes.Find(node.GetMesh()));
+        }
+
+        static void WriteSkin(KMLBWriter& w, const KMLBScene& scene, const Skin& skin)
+        {
+            w.WriteString(skin.GetName());
+            w.WriteArray(GetIndices(scene.skin_weights, skin.GetSkinWeights()));
+            w.WriteArray(GetIndices(scene.nodes, skin.GetJoints())); // joints outside the tree are -1
+            w.WriteArray(skin.GetJointBindMatrices());
+        }
+
+        static void WriteAnimation(KMLBWriter& w, const KMLBScene& scene, Animation& anim)
+        {
+            w.WriteString(anim.GetName());
+            const std::vector<std::shared_ptr<AnimationInstruction> >& instructions = anim.GetInstructions();
+            w.WriteU32((uint32)instructions.size());
+            for (size_t i = 0; i < instructions.size(); i++)
+            {
+                const std::vector<std::shared_ptr<AnimationPath> >& paths = instructions[i]->GetPaths();
+                w.WriteU32((uint32)paths.size());
+                for (size_t j = 0; j < paths.size(); j++)
+                {
+                    w.WriteString(paths[j]->GetPathType());
+                    std::vector<std::string> found = paths[j]->GetCurveKeys();
+                    w.WriteU32((uint32)found.size());
+                    for (size_t k = 0; k < found.size(); k++)
+                    {
+                        std::shared_ptr<AnimationCurve> curve = paths[j]->GetCurve(found[k]);
+                        w.WriteString(found[k]);
+                        w.WriteU32((uint32)curve->GetInterpolationType());
+                        w.WriteArray(curve->GetValues());
+                    }
+                }
+                w.WriteArray(GetIndices(scene.nodes, instructions[i]->GetTargets()));
+            }
+        }
+
+        static bool WriteScene(OutputSink& sink, const std::shared_ptr<Node>& node)
+        {
+            KMLBScene scene;
+            CollectScene(scene, node, -1);
+
+            KMLBWriter w(sink);
+            w.Write(KMLB_MAGIC, sizeof(KMLB_MAGIC));
+            w.WriteU32(KMLB_VERSION);
+            w.WriteU32(KMLB_ENDIAN);
+            w.WriteU32(0);
+
+            w.WriteU32((uint32)scene.textures.items.size());
+            for (size_t i = 0; i < scene.textures.items.size(); i++)
+            {
+                WriteTexture(w, *scene.textures.items[i]);
+            }
+            w.WriteU32((uint32)scene.materials.items.size());
+            for (size_t i = 0; i < scene.materials.items.size(); i++)
+            {
+                WriteMaterial(w, scene, *scene.materials.items[i]);
+            }
+            w.WriteU32((uint32)scene.skin_weights.items.size());
+            for (size_t i = 0; i < scene.skin_weights.items.size(); i++)
+            {
+                WriteSkinWeight(w, *scene.skin_weights.items[i]);
+            }
+            w.WriteU32((uint32)scene.meshes.items.size());
+            for (size_t i = 0; i < scene.meshes.items.size(); i++)
+            {
+                WriteMesh(w, scene, *scene.meshes.items[i]);
+            }
+            w.WriteU32((uint32)scene.nodes.items.size());
+            for (size_t i = 0; i < scene.nodes.items.size(); i++)
+            {
+                WriteNode(w, scene, *scene.nodes.items[i], scene.parents[i]);
+            }
+            w.WriteU32((uint32)scene.skins.items.size());
+            for (size_t i = 0; i < scene.skins.items.size(); i++)
+            {
+                WriteSkin(w, scene, *scene.skins.items[i]);
+            }
+            w.WriteU32((uint32)scene.animations.items.size());
+            for (size_t i = 0; i < scene.animations.items.size(); i++)
+            {
+                WriteAnimation(w, scene, *scene.animations.items[i]);
+            }
+            w.Write(KMLB_TRAILER, sizeof(KMLB_TRAILER));
+            return w.IsGood();
+        }
+
+        static std::shared_ptr<Node> ReadScene(const MappedFile& file, std::vector<KMLBMeshView>& meshes, bool copy_arrays)
+        {
+            KMLBReader r(file.GetData(), file.GetSize());
+            char magic[4] = {};
+            r.Read(magic, sizeof(magic));
+            uint32 version = r.ReadU32();
+            uint32 endian = r.ReadU32();
+            r.ReadU32();
+            if (!r.IsGood() || memcmp(magic, KMLB_MAGIC, sizeof(magic)) != 0 || version > KMLB_VERSION || endian != KMLB_ENDIAN)
+            {
+                return std::shared_ptr<Node>();
+            }
+            r.SetVersion(version);
+
+            KMLBScene scene;
+            uint32 count = r.ReadU32();
+            for (uint32 i = 0; i < count && r.IsGood(); i++)
+            {
+                scene.textures.Add(ReadTexture(r));
+            }
+            count = r.ReadU32();
+            for (uint32 i = 0; i < count && r.IsGood(); i++)
+            {
+                scene.materials.Add(ReadMaterial(r, scene));
+            }
+            count = r.ReadU32();
+            for (uint32 i = 0; i < count && r.IsGood(); i++)
+            {
+                scene.skin_weights.Add(ReadSkinWeight(r));
+            }
+            std::vector<KMLBMeshView> mesh_views;
+            if (version >= 3)
+            {
+                count = r.ReadU32();
+                for (uint32 i = 0; i < count && r.IsGood(); i++)
+                {
+                    KMLBMeshView view;
+                    view.node = -1;
+                    scene.meshes.Add(ReadMesh(r, scene, view, copy_arrays));
+                    mesh_views.push_back(view);
+                }
+            }
+
+            std::vector<std::vector<int> > node_skins;
+            std::vector<std::vector<int> > node_animations;
+            count = r.ReadU32();
+            for (uint32 i = 0; i < count && r.IsGood(); i++)
+            {
+                std::shared_ptr<Node> node(new Node());
+                node->SetName(r.ReadString());
+                node->SetPath(r.ReadString());
+                node->SetOriginalPath(r.ReadString());
+                int parent = r.ReadI32();
+                if (parent >= (int)i || (parent < 0 && i != 0) || (parent >= 0 && i == 0))
+                {
+                    return std::shared_ptr<Node>(); // parents precede their children, only the root has none
+                }
+                node->SetVisiblity(r.ReadU32() != 0);
+
+                uint32 type = r.ReadU32();
+                if (type == KMLB_TRANSFORM_TRS)
+                {
+                    float trs[10] = {};
+                    r.Read(trs, sizeof(trs));
+                    glm::quat R(trs[6], trs[3], trs[4], trs[5]);
+                    node->GetTransform()->SetTRS(glm::vec3(trs[0], trs[1], trs[2]), R, glm::vec3(trs[7], trs[8], trs[9]));
+                }
+                else if (type == KMLB_TRANSFORM_MATRIX)
+                {
+                    glm::mat4 m;
+                    r.Read(&m, sizeof(m));
+                    node->GetTransform()->SetMatrix(m);
+                }
+                // KMLB_TRANSFORM_NONE keeps the identity transform the node starts with
+
+                if (r.ReadU32() != 0)
+                {
+                    glm::vec3 bmin;
+                    glm::vec3 bmax;
+                    r.Read(&bmin, sizeof(bmin));
+                    r.Read(&bmax, sizeof(bmax));
+                    node->SetBound(std::shared_ptr<Bound>(new Bound(bmin, bmax)));
+                }
+
+                std::vector<int> materials = r.ReadIndices(scene.materials.items.size());
+                for (size_t j = 0; j < materials.size(); j++)
+                {
+                    node->AddMaterial(materials[j] >= 0 ? scene.materials.items[materials[j]] : std::shared_ptr<Material>());
+                }
+                std::vector<int> skins;
+                r.ReadVector(skins);
+                node_skins.push_back(skins);
+                std::vector<int> animations;
+                r.ReadVector(animations);
+                node_animations.push_back(animations);
+
+                if (version >= 3)
+                {
+                    int mesh = r.ReadIndex(scene.meshes.items.size());
+                    if (mesh >= 0)
+                    {
+                        node->SetMesh(scene.meshes.items[mesh]);
+                        if (mesh_views[mesh].node < 0)
+                        {
+                            mesh_views[mesh].node = (int)i;
+                        }
+                    }
+                }
+                else if (r.ReadU32() != 0)
+                {
+                    KMLBMeshView view;
+                    view.node = (int)i;
+                    node->SetMesh(ReadMesh(r, scene, view, copy_arrays));
+                    meshes.push_back(view);
+                }
+
+                if (parent >= 0)
+                {
+                    scene.nodes.items[parent]->AddChild(node);
+                }
+                scene.nodes.Add(node);
+            }
+            meshes.insert(meshes.end(), mesh_views.begin(), mesh_views.end());
+
+            count = r.ReadU32();
+            for (uint32 i = 0; i < count && r.IsGood(); i++)
+            {
+                std::shared_ptr<Skin> skin(new Skin());
+                skin->SetName(r.ReadString());
+                std::vector<int> weights = r.ReadIndices(scene.skin_weights.items.size());
+                for (size_t j = 0; j < weights.size(); j++)
+                {
+                    skin->AddSkinWeight(weights[j] >= 0 ? scene.skin_weights.items[weights[j]] : std::shared_ptr<SkinWeight>());
+                }
+                std::vector<int> joints = r.ReadIndices(scene.nodes.items.size());
+                for (size_t j = 0; j < joints.size(); j++)
+                {
+                    skin->AddJoint(joints[j] >= 0 ? scene.nodes.items[joints[j]] : std::shared_ptr<Node>());
+                }
+                std::vector<glm::mat4> matrices;
+                r.ReadVector(matrices);
+                skin->SetJointBindMatrices(matrices);
+                scene.skins.Add(skin);
+            }
+
+            count = r.ReadU32();
+            for (uint32 i = 0; i < count && r.IsGood(); i++)
+            {
+                std::shared_ptr<Animation> anim(new Animation());
+                anim->SetName(r.ReadString());
+                uint32 ninstructions = r.ReadU32();
+                for (uint32 j = 0; j < ninstructions && r.IsGood(); j++)
+                {
+                    std::shared_ptr<AnimationInstruction> ins(new AnimationInstruction());
+                    uint32 npaths = r.ReadU32();
+                    for (uint32 k = 0; k < npaths && r.IsGood(); k++)
+                    {
+                        std::shared_ptr<AnimationPath> path(new AnimationPath());
+                        path->SetPathType(r.ReadString());
+                        uint32 ncurves = r.ReadU32();
+                        for (uint32 c = 0; c < ncurves && r.IsGood(); c++)
+                        {
+                            std::string key = r.ReadString();
+                            std::shared_ptr<AnimationCurve> curve(new AnimationCurve());
+                            curve->SetInterpolationType((AnimationInterporationType)r.ReadU32());
+                            r.ReadVector(curve->GetValues());
+                            path->SetCurve(key, curve);
+                        }
+                        ins->AddPath(path);
+                    }
+                    std::vector<int> targets = r.ReadIndices(scene.nodes.items.size());
+                    std::vector<std::shared_ptr<Node> > nodes;
+                    for (size_t t = 0; t < targets.size(); t++)
+                    {
+                        nodes.push_back(targets[t] >= 0 ? scene.nodes.items[targets[t]] : std::shared_ptr<Node>());
+                    }
+                    ins->SetTargets(nodes);
+                    anim->AddInstruction(ins);
+                }
+                scene.animations.Add(anim);
+            }
+
+            char trailer[4] = {};
+            r.Read(trailer, sizeof(trailer));
+            if (!r.IsGood() || memcmp(trailer, KMLB_TRAILER, sizeof(trailer)) != 0 || scene.nodes.items.empty())
+            {
+                return std::shared_ptr<Node>();
+            }
+
+            for (size_t i = 0; i < scene.nodes.items.size(); i++)
+            {
+                for (size_t j = 0; j < node_skins[i].size(); j++)
+                {
+                    int index = node_skins[i][j];
+                    if (index >= 0 && index < (int)scene.skins.items.size())
+                    {
+                        scene.nodes.items[i]->AddSkin(scene.skins.items[index]);
+                    }
+                }
+                for (size_t j = 0; j < node_animations[i].size(); j++)
+                {
+                    int index = node_animations[i][j];
+                    if (index >= 0 && index < (int)scene.animations.items.size())
+                    {
+                        scene.nodes.items[i]->AddAnimation(scene.animations.items[index]);
+                    }
+                }
+            }
+            return scene.nodes.items[0];
+        }
+    } // namespace
+
+    bool SaveKMLB(const std::string& path, const std::shared_ptr<Node>& node)
+    {
+        if (!node)
+        {
+            return false;
+        }
+        bool bRet = false;
+        {
+            FileOutputSink sink(path);
+            if (!sink.IsOpen())
+            {
+                return false;
+            }
+            bRet = WriteScene(sink, node);
+        }
+        if (!bRet)
+        {
+            remove(path.c_str());
+        }
+        return bRet;
+    }
+
+    std::shared_ptr<Node> LoadKMLB(const std::string& path)
+    {
+        KMLBFile file;
+        if (!file.Open(path))
+        {
+            return std::shared_ptr<Node>();
+        }
+        return file.CreateNode();
+    }
+
+    KMLBFile::KMLBFile()
+    {
+    }
+
+    bool KMLBFile::Open(const std::string& path)
+    {
+        Close();
+        std::shared_ptr<MappedFile> file(new MappedFile(path));
+        if (!file->IsOpen())
+        {
+            return false;
+        }
+        std::vector<KMLBMeshView> meshes;
+        if (!ReadScene(*file, meshes, false))
+        {
+            return false;
+        }
+        file_ = file;
+        meshes_.swap(meshes);
+        return true;
+    }
+
+    void KMLBFile::Close()
+    {
+        meshes_.clear();
+        file_.reset();
+    }
+
+    std::shared_ptr<Node> KMLBFile::CreateNode() const
+    {
+        if (!file_)
+        {
+            return std::shared_ptr<Node>();
+        }
+        std::vector<KMLBMeshView> meshes;
+        return ReadScene(*file_, meshes, true);
+    }
+} // namespace kml
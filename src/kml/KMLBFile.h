@@ -0,0 +1,67 @@
+#pragma once
+#ifndef _KML_KMLB_FILE_H_
+#define _KML_KMLB_FILE_H_
+
+#include "MappedFile.h"
+#include "Node.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace kml
+{
+    // .kmlb : versioned binary snapshot of a Node tree with its meshes, materials, textures, skins,
+    // morph targets and animations. Little endian, arrays 16 byte aligned so they can be used in place.
+    bool SaveKMLB(const std::string& path, const std::shared_ptr<Node>& node);
+    // Returns NULL if the file is missing, truncated or of a newer version.
+    std::shared_ptr<Node> LoadKMLB(const std::string& path);
+
+    // Array stored in a mapped .kmlb, valid while the KMLBFile is open.
+    template <class T>
+    struct KMLBArrayView
+    {
+        KMLBArrayView()
+            : data(NULL), size(0)
+        {
+        }
+        const T* data;
+        size_t size;
+
+        const T& operator[](size_t i) const { return data[i]; }
+        std::vector<T> ToVector() const { return std::vector<T>(data, data + size); }
+    };
+
+    struct KMLBMeshView
+    {
+        std::string name;
+        int node; // pre-order index of the first node using the mesh
+        KMLBArrayView<unsigned char> facenums;
+        KMLBArrayView<int> pos_indices;
+        KMLBArrayView<int> nor_indices;
+        KMLBArrayView<int> tex_indices;
+        KMLBArrayView<glm::vec3> positions;
+        KMLBArrayView<glm::vec3> normals;
+        KMLBArrayView<glm::vec2> texcoords;
+        KMLBArrayView<glm::vec4> tangents; // empty in version 1 files
+        KMLBArrayView<int> materials;
+    };
+
+    // Maps a .kmlb and indexes its meshes without copying their arrays.
+    class KMLBFile
+    {
+    public:
+        KMLBFile();
+        bool Open(const std::string& path);
+        void Close();
+        bool IsOpen() const { return file_.get() != NULL; }
+        const std::vector<KMLBMeshView>& GetMeshes() const { return meshes_; }
+        // Builds the whole scene, copying the arrays out of the mapping.
+        std::shared_ptr<Node> CreateNode() const;
+
+    private:
+        std::shared_ptr<MappedFile> file_;
+        std::vector<KMLBMeshView> meshes_;
+    };
+} // namespace kml
+
+#endif
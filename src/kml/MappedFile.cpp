@@ -0,0 +1,113 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace kml
+{
+#ifdef _WIN32
+    MappedFile::MappedFile(const std::string& path)
+        : data_(NULL), size_(0), opened_(false), file_(INVALID_HANDLE_VALUE), mapping_(NULL)
+    {
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return;
+        }
+        file_ = file;
+        LARGE_INTEGER sz;
+        if (!GetFileSizeEx(file, &sz))
+        {
+            return;
+        }
+        if (sz.QuadPart == 0)
+        {
+            opened_ = true;
+            return;
+        }
+        if ((unsigned long long)sz.QuadPart > (unsigned long long)(size_t)-1)
+        {
+            return;
+        }
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping == NULL)
+        {
+            return;
+        }
+        mapping_ = mapping;
+        void* p = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (p == NULL)
+        {
+            return;
+        }
+        data_ = (const unsigned char*)p;
+        size_ = (size_t)sz.QuadPart;
+        opened_ = true;
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if (data_)
+        {
+            UnmapViewOfFile(data_);
+        }
+        if (mapping_)
+        {
+            CloseHandle((HANDLE)mapping_);
+        }
+        if (file_ != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle((HANDLE)file_);
+        }
+    }
+#else
+    MappedFile::MappedFile(const std::string& path)
+        : data_(NULL), size_(0), opened_(false)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+        {
+            close(fd);
+            return;
+        }
+        if (st.st_size == 0)
+        {
+            close(fd);
+            opened_ = true;
+            return;
+        }
+        void* p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd); // the mapping keeps the file referenced
+        if (p == MAP_FAILED)
+        {
+            return;
+        }
+#ifdef POSIX_MADV_SEQUENTIAL
+        posix_madvise(p, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+#endif
+        data_ = (const unsigned char*)p;
+        size_ = (size_t)st.st_size;
+        opened_ = true;
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if (data_)
+        {
+            munmap((void*)data_, size_);
+        }
+    }
+#endif
+} // namespace kml
@@ -0,0 +1,36 @@
+#pragma once
+#ifndef _KML_MAPPED_FILE_H_
+#define _KML_MAPPED_FILE_H_
+
+#include <stddef.h>
+#include <string>
+
+namespace kml
+{
+    // Read only view of a whole file mapped into memory. Check IsOpen().
+    class MappedFile
+    {
+    public:
+        MappedFile(const std::string& path);
+        ~MappedFile();
+        bool IsOpen() const { return opened_; }
+        // NULL for an empty file.
+        const unsigned char* GetData() const { return data_; }
+        size_t GetSize() const { return size_; }
+
+    private:
+        MappedFile(const MappedFile&);
+        MappedFile& operator=(const MappedFile&);
+
+    private:
+        const unsigned char* data_;
+        size_t size_;
+        bool opened_;
+#ifdef _WIN32
+        void* file_;
+        void* mapping_;
+#endif
+    };
+} // namespace kml
+
+#endif
@@ -35,6 +35,11 @@ namespace kml
         tmap[key] = tex;
     }
 
+    void Material::RemoveTexture(const std::string& key)
+    {
+        tmap.erase(key);
+    }
+
     int Material::GetInteger(const std::string& key) const
     {
         IntegerMapType::const_iterator it = imap.find(key);
@@ -77,6 +82,36 @@ namespace kml
             return it->second;
         }
     }
+    std::vector<std::string> Material::GetIntegerKeys() const
+    {
+        std::vector<std::string> ret;
+        for (IntegerMapType::const_iterator it = imap.begin(); it != imap.end(); it++)
+        {
+            ret.push_back(it->first);
+        }
+        return ret;
+    }
+
+    std::vector<std::string> Material::GetFloatKeys() const
+    {
+        std::vector<std::string> ret;
+        for (FloatMapType::const_iterator it = fmap.begin(); it != fmap.end(); it++)
+        {
+            ret.push_back(it->first);
+        }
+        return ret;
+    }
+
+    std::vector<std::string> Material::GetStringKeys() const
+    {
+        std::vector<std::string> ret;
+        for (StringMapType::const_iterator it = smap.begin(); it != smap.end(); it++)
+        {
+            ret.push_back(it->first);
+        }
+        return ret;
+    }
+
     std::vector<std::string> Material::GetTextureKeys() const
     {
         std::vector<std::string> ret;
@@ -19,11 +19,15 @@ namespace kml
         void SetFloat(const std::string& key, float val);
         void SetString(const std::string& key, const std::string& val);
         void SetTexture(const std::string& key, std::shared_ptr<Texture> tex);
+        void RemoveTexture(const std::string& key);
         int GetInteger(const std::string& key) const;
         float GetFloat(const std::string& key) const;
         std::string GetString(const std::string& key) const;
         std::shared_ptr<Texture> GetTexture(const std::string& key) const;
 
+        std::vector<std::string> GetIntegerKeys() const;
+        std::vector<std::string> GetFloatKeys() const;
+        std::vector<std::string> GetStringKeys() const;
         std::vector<std::string> GetTextureKeys() const;
 
     public:
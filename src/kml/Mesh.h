@@ -8,6 +8,7 @@
 #include <glm/glm.hpp>
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
 #include <memory>
 #include <string>
 #include <vector>
@@ -31,6 +32,7 @@ namespace kml
         std::vector<glm::vec3> positions;
         std::vector<glm::vec3> normals;
         std::vector<glm::vec2> texcoords;
+        std::vector<glm::vec4> tangents; // per position, filled by CalculateTangentsMesh
         std::vector<int> materials;
         std::shared_ptr<SkinWeight> skin_weight;
         std::shared_ptr<MorphTargets> morph_targets;
@@ -0,0 +1,55 @@
+#include "MeshAdjacency.h"
+
+namespace kml
+{
+    MeshAdjacency::MeshAdjacency()
+        : face_offsets_(1, 0), vertex_offsets_(1, 0)
+    {
+    }
+
+    MeshAdjacency::MeshAdjacency(const Mesh& mesh)
+    {
+        Build(mesh);
+    }
+
+    void MeshAdjacency::Build(const Mesh& mesh)
+    {
+        size_t nfaces = mesh.facenums.size();
+        size_t nverts = mesh.positions.size();
+
+        face_offsets_.resize(nfaces + 1);
+        int ncorners = 0;
+        for (size_t i = 0; i < nfaces; i++)
+        {
+            face_offsets_[i] = ncorners;
+            ncorners += mesh.facenums[i];
+        }
+        face_offsets_[nfaces] = ncorners;
+
+        corner_faces_.resize(ncorners);
+        for (size_t i = 0; i < nfaces; i++)
+        {
+            for (int j = face_offsets_[i]; j < face_offsets_[i + 1]; j++)
+            {
+                corner_faces_[j] = (int)i;
+            }
+        }
+
+        // counting sort of the corners by vertex keeps them in face order within a row
+        vertex_offsets_.assign(nverts + 1, 0);
+        for (int i = 0; i < ncorners; i++)
+        {
+            vertex_offsets_[mesh.pos_indices[i] + 1]++;
+        }
+        for (size_t i = 0; i < nverts; i++)
+        {
+            vertex_offsets_[i + 1] += vertex_offsets_[i];
+        }
+        std::vector<int> cursor(vertex_offsets_.begin(), vertex_offsets_.end() - 1);
+        vertex_corners_.resize(ncorners);
+        for (int i = 0; i < ncorners; i++)
+        {
+            vertex_corners_[cursor[mesh.pos_indices[i]]++] = i;
+        }
+    }
+} // namespace kml
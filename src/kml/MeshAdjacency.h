@@ -0,0 +1,42 @@
+#pragma once
+#ifndef _KML_MESH_ADJACENCY_H_
+#define _KML_MESH_ADJACENCY_H_
+
+#include "Mesh.h"
+#include <vector>
+
+namespace kml
+{
+    // Corners of each face and the corners around each vertex of a Mesh, as compressed rows.
+    // Build it once and pass it to the stages that walk vertex neighbourhoods.
+    class MeshAdjacency
+    {
+    public:
+        MeshAdjacency();
+        explicit MeshAdjacency(const Mesh& mesh);
+        void Build(const Mesh& mesh);
+
+        int GetFaceCount() const { return (int)face_offsets_.size() - 1; }
+        int GetVertexCount() const { return (int)vertex_offsets_.size() - 1; }
+
+        // Corners of face f are [GetFaceBegin(f), GetFaceEnd(f)) in pos_indices.
+        int GetFaceBegin(int f) const { return face_offsets_[f]; }
+        int GetFaceEnd(int f) const { return face_offsets_[f + 1]; }
+        int GetCornerFace(int corner) const { return corner_faces_[corner]; }
+
+        // Corners at vertex v are GetVertexCorner(k) for k in [GetVertexBegin(v), GetVertexEnd(v)), in face order.
+        int GetVertexBegin(int v) const { return vertex_offsets_[v]; }
+        int GetVertexEnd(int v) const { return vertex_offsets_[v + 1]; }
+        int GetVertexCorner(int k) const { return vertex_corners_[k]; }
+
+        const std::vector<int>& GetFaceOffsets() const { return face_offsets_; }
+
+    private:
+        std::vector<int> face_offsets_;
+        std::vector<int> corner_faces_;
+        std::vector<int> vertex_offsets_;
+        std::vector<int> vertex_corners_;
+    };
+} // namespace kml
+
+#endif
@@ -67,6 +67,11 @@ namespace kml
         return bound;
     }
 
+    const std::shared_ptr<Bound>& Node::GetWorldBound() const
+    {
+        return world_bound;
+    }
+
     const std::shared_ptr<Mesh>& Node::GetMesh() const
     {
         return this->mesh;
@@ -92,11 +97,21 @@ namespace kml
         this->bound = b;
     }
 
+    void Node::SetWorldBound(const std::shared_ptr<Bound>& b)
+    {
+        this->world_bound = b;
+    }
+
     void Node::AddMaterial(const std::shared_ptr<Material>& material)
     {
         this->materials.push_back(material);
     }
 
+    void Node::ClearMaterials()
+    {
+        this->materials.clear();
+    }
+
     void Node::AddChild(const std::shared_ptr<Node>& child)
     {
         this->children.push_back(child);
@@ -33,6 +33,7 @@ namespace kml
         const std::shared_ptr<Mesh>& GetMesh() const;
         std::shared_ptr<Bound>& GetBound();
         const std::shared_ptr<Bound>& GetBound() const;
+        const std::shared_ptr<Bound>& GetWorldBound() const; // filled by CalculateWorldBounds
 
         const std::vector<std::shared_ptr<Material> >& GetMaterials() const;
         const std::vector<std::shared_ptr<Animation> >& GetAnimations() const;
@@ -45,7 +46,9 @@ namespace kml
         void SetOriginalPath(const std::string& path);
         void SetMesh(const std::shared_ptr<Mesh>& mesh);
         void SetBound(const std::shared_ptr<Bound>& bound);
+        void SetWorldBound(const std::shared_ptr<Bound>& bound);
         void AddMaterial(const std::shared_ptr<Material>& material);
+        void ClearMaterials();
         void AddChild(const std::shared_ptr<Node>& child);
         void ClearChildren();
         void AddAnimation(const std::shared_ptr<Animation>& anim);
@@ -65,6 +68,7 @@ namespace kml
         std::vector<std::shared_ptr<Node> > children;
         std::shared_ptr<Transform> transform;
         std::shared_ptr<Bound> bound;
+        std::shared_ptr<Bound> world_bound;
         std::shared_ptr<Mesh> mesh;
         std::vector<std::shared_ptr<Material> > materials;
         std::vector<std::shared_ptr<Animation> > animations;
@@ -4,6 +4,7 @@ namespace kml
 {
     typedef typename Options::imap_type imap_type;
     typedef typename Options::smap_type smap_type;
+    typedef typename Options::fmap_type fmap_type;
 
     void Options::SetInt(const std::string& key, int val)
     {
@@ -20,6 +21,21 @@ namespace kml
         return def;
     }
 
+    void Options::SetFloat(const std::string& key, float val)
+    {
+        fmap_[key] = val;
+    }
+
+    float Options::GetFloat(const std::string& key, float def) const
+    {
+        fmap_type::const_iterator it = fmap_.find(key);
+        if (it != fmap_.end())
+        {
+            return it->second;
+        }
+        return def;
+    }
+
     void Options::SetString(const std::string& key, const std::string& val)
     {
         smap_[key] = val;
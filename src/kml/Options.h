@@ -14,11 +14,15 @@ namespace kml
     public:
         typedef std::map<std::string, int> imap_type;
         typedef std::map<std::string, std::string> smap_type;
+        typedef std::map<std::string, float> fmap_type;
 
     public:
         void SetInt(const std::string& key, int val);
         int GetInt(const std::string& key, int def = 0) const;
 
+        void SetFloat(const std::string& key, float val);
+        float GetFloat(const std::string& key, float def = 0.0f) const;
+
         void SetString(const std::string& key, const std::string& val);
         std::string GetString(const std::string& key, const std::string& def = "") const;
 
@@ -31,6 +35,7 @@ namespace kml
     private:
         imap_type imap_;
         smap_type smap_;
+        fmap_type fmap_;
     };
 } // namespace kml
 
@@ -0,0 +1,189 @@
+#ifdef _WIN32
+#define _CRT_SECURE_NO_WARNINGS 1
+#endif
+
+#include "OutputSink.h"
+
+#include <algorithm>
+#include <errno.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace kml
+{
+#ifndef _WIN32
+    static bool WriteGatherToFD(int fd, const OutputRange* ranges, size_t count)
+    {
+#ifdef IOV_MAX
+        const size_t max_iov = IOV_MAX;
+#else
+        const size_t max_iov = 16;
+#endif
+        std::vector<struct iovec> iov;
+        size_t i = 0;
+        size_t done = 0; // bytes of ranges[i] already written
+        while (i < count)
+        {
+            iov.clear();
+            for (size_t j = i; j < count && iov.size() < max_iov; j++)
+            {
+                size_t skip = (j == i) ? done : 0;
+                if (ranges[j].size > skip)
+                {
+                    struct iovec v;
+                    v.iov_base = (void*)((const char*)ranges[j].data + skip);
+                    v.iov_len = ranges[j].size - skip;
+                    iov.push_back(v);
+                }
+            }
+            if (iov.empty())
+            {
+                break;
+            }
+            ssize_t n = writev(fd, &iov[0], (int)iov.size());
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
+            }
+            // advance past what the kernel accepted, writes may be partial
+            size_t left = (size_t)n;
+            while (i < count && done + left >= ranges[i].size)
+            {
+                left -= ranges[i].size - done;
+                done = 0;
+                i++;
+            }
+            done += left;
+        }
+        return true;
+    }
+#endif
+
+    bool OutputSink::WriteGather(const OutputRange* ranges, size_t count)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            if (!this->Write(ranges[i].data, ranges[i].size))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    MemoryOutputSink::MemoryOutputSink(std::vector<unsigned char>& bytes)
+        : bytes_(bytes)
+    {
+    }
+
+    bool MemoryOutputSink::Write(const void* data, size_t size)
+    {
+        const unsigned char* p = (const unsigned char*)data;
+        bytes_.insert(bytes_.end(), p, p + size);
+        return true;
+    }
+
+    FileOutputSink::FileOutputSink(const std::string& path)
+        : fp_(fopen(path.c_str(), "wb")), owned_(true)
+    {
+    }
+
+    FileOutputSink::FileOutputSink(FILE* fp)
+        : fp_(fp), owned_(false)
+    {
+    }
+
+    FileOutputSink::~FileOutputSink()
+    {
+        if (fp_ && owned_)
+        {
+            fclose(fp_);
+        }
+    }
+
+    bool FileOutputSink::Write(const void* data, size_t size)
+    {
+        if (!fp_)
+        {
+            return false;
+        }
+        return size == 0 || fwrite(data, 1, size, fp_) == size;
+    }
+
+    bool FileOutputSink::WriteGather(const OutputRange* ranges, size_t count)
+    {
+#ifdef _WIN32
+        return OutputSink::WriteGather(ranges, count);
+#else
+        if (!fp_ || fflush(fp_) != 0)
+        {
+            return false;
+        }
+        if (!WriteGatherToFD(fileno(fp_), ranges, count))
+        {
+            return false;
+        }
+        // resync the stream with the descriptor offset before it is used again, fails harmlessly on pipes
+        fseeko(fp_, 0, SEEK_CUR);
+        return true;
+#endif
+    }
+
+    FileDescriptorOutputSink::FileDescriptorOutputSink(int fd)
+        : fd_(fd)
+    {
+    }
+
+    bool FileDescriptorOutputSink::Write(const void* data, size_t size)
+    {
+        const char* p = (const char*)data;
+        while (size > 0)
+        {
+#ifdef _WIN32
+            int n = _write(fd_, p, (unsigned int)std::min<size_t>(size, 1u << 30));
+#else
+            ssize_t n = write(fd_, p, size);
+#endif
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
+            }
+            p += n;
+            size -= (size_t)n;
+        }
+        return true;
+    }
+
+    bool FileDescriptorOutputSink::WriteGather(const OutputRange* ranges, size_t count)
+    {
+#ifdef _WIN32
+        return OutputSink::WriteGather(ranges, count);
+#else
+        return WriteGatherToFD(fd_, ranges, count);
+#endif
+    }
+
+    CallbackOutputSink::CallbackOutputSink(const CallbackType& callback)
+        : callback_(callback)
+    {
+    }
+
+    bool CallbackOutputSink::Write(const void* data, size_t size)
+    {
+        return callback_(data, size);
+    }
+} // namespace kml
@@ -0,0 +1,81 @@
+#pragma once
+#ifndef _KML_OUTPUT_SINK_H_
+#define _KML_OUTPUT_SINK_H_
+
+#include <functional>
+#include <memory>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace kml
+{
+    struct OutputRange
+    {
+        const void* data;
+        size_t size;
+    };
+
+    // Destination of exported bytes, written sequentially.
+    class OutputSink
+    {
+    public:
+        virtual ~OutputSink() {}
+        virtual bool Write(const void* data, size_t size) = 0;
+        // Writes the ranges in order. File sinks hand them to the OS in one scatter-gather call where possible.
+        virtual bool WriteGather(const OutputRange* ranges, size_t count);
+    };
+
+    // Appends to a caller owned vector.
+    class MemoryOutputSink : public OutputSink
+    {
+    public:
+        MemoryOutputSink(std::vector<unsigned char>& bytes);
+        virtual bool Write(const void* data, size_t size);
+
+    private:
+        std::vector<unsigned char>& bytes_;
+    };
+
+    class FileOutputSink : public OutputSink
+    {
+    public:
+        // Opens path for writing, check IsOpen().
+        FileOutputSink(const std::string& path);
+        // Writes to an open stream, which is not closed.
+        FileOutputSink(FILE* fp);
+        virtual ~FileOutputSink();
+        virtual bool Write(const void* data, size_t size);
+        virtual bool WriteGather(const OutputRange* ranges, size_t count);
+        bool IsOpen() const { return fp_ != NULL; }
+
+    private:
+        FILE* fp_;
+        bool owned_;
+    };
+
+    // Writes to a file descriptor (socket, pipe, ...), which is not closed.
+    class FileDescriptorOutputSink : public OutputSink
+    {
+    public:
+        FileDescriptorOutputSink(int fd);
+        virtual bool Write(const void* data, size_t size);
+        virtual bool WriteGather(const OutputRange* ranges, size_t count);
+
+    private:
+        int fd_;
+    };
+
+    class CallbackOutputSink : public OutputSink
+    {
+    public:
+        typedef std::function<bool(const void* data, size_t size)> CallbackType;
+        CallbackOutputSink(const CallbackType& callback);
+        virtual bool Write(const void* data, size_t size);
+
+    private:
+        CallbackType callback_;
+    };
+} // namespace kml
+
+#endif
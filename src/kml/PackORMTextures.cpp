@@ -0,0 +1,151 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "PackORMTextures.h"
+#include "TextureBakeUtil.h"
+
+#include <kil/PackORMTextureFile.h>
+
+#include <map>
+#include <set>
+#include <stdio.h>
+
+namespace kml
+{
+    static const char* const ORM_KEYS[3] = {"Occlusion", "Roughness", "Metallic"};
+
+    static void GetMaterials(std::vector<std::shared_ptr<Material> >& materials, std::set<Material*>& visited, const std::shared_ptr<Node>& node)
+    {
+        const std::vector<std::shared_ptr<Material> >& node_materials = node->GetMaterials();
+        for (size_t i = 0; i < node_materials.size(); i++)
+        {
+            if (node_materials[i].get() && visited.insert(node_materials[i].get()).second)
+            {
+                materials.push_back(node_materials[i]);
+            }
+        }
+        const std::vector<std::shared_ptr<Node> >& children = node->GetChildren();
+        for (size_t i = 0; i < children.size(); i++)
+        {
+            GetMaterials(materials, visited, children[i]);
+        }
+    }
+
+    static std::string GetBaseName(const std::string& path)
+    {
+        std::string name = path;
+        size_t i = name.find_last_of("/\\");
+        if (i != std::string::npos)
+        {
+            name = name.substr(i + 1);
+        }
+        i = name.find_last_of(".");
+        if (i != std::string::npos)
+        {
+            name = name.substr(0, i);
+        }
+        return name;
+    }
+
+    bool PackORMTextures(std::shared_ptr<Node>& node, const std::string& base_dir_, const std::shared_ptr<Options>& opts)
+    {
+        std::string ext = opts->GetString("orm_texture_ext", ".png");
+
+        std::string base_dir = base_dir_;
+        if (!base_dir.empty() && base_dir[base_dir.size() - 1] != '/' && base_dir[base_dir.size() - 1] != '\\')
+        {
+            base_dir += "/";
+        }
+
+        std::vector<std::shared_ptr<Material> > materials;
+        std::set<Material*> visited;
+        GetMaterials(materials, visited, node);
+
+        typedef std::vector<Texture*> SourceKey;
+        std::map<SourceKey, std::shared_ptr<Texture> > packed;
+        std::set<std::string> names;
+        bool ret = true;
+        for (size_t m = 0; m < materials.size(); m++)
+        {
+            const std::shared_ptr<Material>& mat = materials[m];
+            std::shared_ptr<Texture> sources[3];
+            SourceKey key(3, (Texture*)NULL);
+            int count = 0;
+            for (int i = 0; i < 3; i++)
+            {
+                sources[i] = mat->GetTexture(ORM_KEYS[i]);
+                if (sources[i].get() && sources[i]->FileExists() && !sources[i]->GetUDIMMode())
+                {
+                    key[i] = sources[i].get();
+                    count++;
+                }
+                else
+                {
+                    sources[i].reset();
+                }
+            }
+            if (count == 0)
+            {
+                continue;
+            }
+
+            std::map<SourceKey, std::shared_ptr<Texture> >::iterator it = packed.find(key);
+            if (it == packed.end())
+            {
+                std::string paths[3];
+                std::shared_ptr<Texture> first;
+                for (int i = 0; i < 3; i++)
+                {
+                    if (sources[i].get())
+                    {
+                        paths[i] = ResolvePath(base_dir, sources[i]->GetFilePath());
+                        if (!first.get())
+                        {
+                            first = sources[i];
+                        }
+                    }
+                }
+
+                std::string name = GetBaseName(first->GetFilePath()) + "_orm";
+                for (int n = 1; !names.insert(name + ext).second; n++)
+                {
+                    char buffer[16] = {};
+                    sprintf(buffer, "_orm%d", n);
+                    name = GetBaseName(first->GetFilePath()) + buffer;
+                }
+                name += ext;
+
+                std::shared_ptr<Texture> tex;
+                if (kil::PackORMTextureFile(paths[0], paths[1], paths[2], base_dir + name))
+                {
+                    tex.reset(first->clone());
+                    tex->SetFilePath(name);
+                    tex->SetCacheFilePath(name);
+                    tex->SetCompressedFilePath("");
+                    tex->SetColorSpace("Raw");
+                    tex->SetFileExists(true);
+                }
+                else
+                {
+                    ret = false;
+                }
+                it = packed.insert(std::make_pair(key, tex)).first;
+            }
+            if (!it->second.get())
+            {
+                continue;
+            }
+
+            mat->SetTexture("ORM", it->second);
+            // Channels without a source are white; only reference the ones that carry data.
+            mat->SetInteger("ORM.Occlusion", sources[0].get() ? 1 : 0);
+            mat->SetInteger("ORM.MetallicRoughness", (sources[1].get() || sources[2].get()) ? 1 : 0);
+            for (int i = 0; i < 3; i++)
+            {
+                if (sources[i].get())
+                {
+                    mat->RemoveTexture(ORM_KEYS[i]);
+                }
+            }
+        }
+        return ret;
+    }
+} // namespace kml
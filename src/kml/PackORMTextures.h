@@ -0,0 +1,20 @@
+#pragma once
+#ifndef _KML_PACK_ORM_TEXTURES_H_
+#define _KML_PACK_ORM_TEXTURES_H_
+
+#include "Node.h"
+#include "Options.h"
+#include <memory>
+#include <string>
+
+namespace kml
+{
+    // Replaces the "Occlusion", "Roughness" and "Metallic" textures of every material under 'node'
+    // with one "ORM" texture written to base_dir, which the exporter references from both
+    // occlusionTexture and metallicRoughnessTexture. Materials sharing the same sources share the image.
+    // Options:
+    //   orm_texture_ext : extension of the packed images (".png")
+    bool PackORMTextures(std::shared_ptr<Node>& node, const std::string& base_dir, const std::shared_ptr<Options>& opts);
+} // namespace kml
+
+#endif
@@ -0,0 +1,548 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "PackTextureAtlas.h"
+#include "TextureBakeUtil.h"
+
+#include <kil/TextureAtlas.h>
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <stdio.h>
+
+namespace kml
+{
+    namespace
+    {
+        struct AtlasSlot
+        {
+            std::vector<std::shared_ptr<Texture> > textures; // one per key of the group
+            int width;
+            int height;
+            kil::TextureAtlasRect rect;
+            int page;
+        };
+
+        struct AtlasGroup
+        {
+            std::vector<std::string> keys;
+            std::vector<AtlasSlot> slots;
+        };
+
+        struct UVTransform
+        {
+            float offset[2];
+            float scale[2];
+        };
+
+        struct SlotSorter
+        {
+            const std::vector<AtlasSlot>* slots;
+            bool operator()(int a, int b) const
+            {
+                const AtlasSlot& sa = (*slots)[a];
+                const AtlasSlot& sb = (*slots)[b];
+                if (sa.height != sb.height)
+                {
+                    return sa.height > sb.height;
+                }
+                return sa.width > sb.width;
+            }
+        };
+    } // namespace
+
+    static bool IsAtlasCandidate(const std::shared_ptr<Texture>& tex, const std::string& base_dir, int max_texture_size, int& width, int& height)
+    {
+        if (!tex.get() || !tex->FileExists() || tex->GetUDIMMode())
+        {
+            return false;
+        }
+        float ru = tex->GetRepeatU();
+        float rv = tex->GetRepeatV();
+        if ((ru != 0.0f && ru != 1.0f) || (rv != 0.0f && rv != 1.0f) || tex->GetOffsetU() != 0.0f || tex->GetOffsetV() != 0.0f)
+        {
+            return false;
+        }
+        int channels = 0;
+        if (!kil::GetTextureFileInfo(ResolvePath(base_dir, tex->GetFilePath()), width, height, channels))
+        {
+            return false;
+        }
+        return width <= max_texture_size && height <= max_texture_size;
+    }
+
+    // Marks materials whose faces use texcoords outside [0, 1]; those cannot share an atlas.
+    static void RejectWrappingMaterials(std::set<const Material*>& rejected, const std::vector<std::shared_ptr<Node> >& nodes)
+    {
+        const float eps = 1e-4f;
+        for (size_t n = 0; n < nodes.size(); n++)
+        {
+            const std::shared_ptr<Mesh>& mesh = nodes[n]->GetMesh();
+            bool has_uv = !mesh->texcoords.empty() && mesh->tex_indices.size() == mesh->pos_indices.size();
+            size_t offset = 0;
+            for (size_t i = 0; i < mesh->facenums.size(); i++)
+            {
+                int facenum = mesh->facenums[i];
+                std::shared_ptr<Material> mat = GetFaceMaterial(nodes[n], mesh, i);
+                if (mat.get() && rejected.find(mat.get()) == rejected.end())
+                {
+                    bool ok = has_uv;
+                    for (int j = 0; ok && j < facenum; j++)
+                    {
+                        int t = mesh->tex_indices[offset + j];
+                        if (t < 0 || t >= (int)mesh->texcoords.size())
+                        {
+                            ok = false;
+                            break;
+                        }
+                        const glm::vec2& uv = mesh->texcoords[t];
+                        ok = (-eps <= uv[0] && uv[0] <= 1.0f + eps && -eps <= uv[1] && uv[1] <= 1.0f + eps);
+                    }
+                    if (!ok)
+                    {
+                        rejected.insert(mat.get());
+                    }
+                }
+                offset += facenum;
+            }
+        }
+    }
+
+    static std::string JoinKeys(const std::vector<std::string>& keys)
+    {
+        std::string ret;
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            ret += keys[i] + "|";
+        }
+        return ret;
+    }
+
+    // Places every slot on a page. Each page is the smallest power of two that takes all remaining
+    // slots, or a full size page filled greedily when they do not fit.
+    static int PackSlots(std::vector<AtlasSlot>& slots, std::vector<std::pair<int, int> >& page_sizes, int max_size, int padding)
+    {
+        std::vector<int> remaining;
+        for (size_t i = 0; i < slots.size(); i++)
+        {
+            if (slots[i].width + 2 * padding <= max_size && slots[i].height + 2 * padding <= max_size)
+            {
+                remaining.push_back((int)i);
+            }
+        }
+        SlotSorter sorter;
+        sorter.slots = &slots;
+        std::sort(remaining.begin(), remaining.end(), sorter);
+
+        int npages = 0;
+        while (!remaining.empty())
+        {
+            size_t area = 0;
+            for (size_t i = 0; i < remaining.size(); i++)
+            {
+                const AtlasSlot& s = slots[remaining[i]];
+                area += (size_t)(s.width + 2 * padding) * (s.height + 2 * padding);
+            }
+            int size = 1;
+            while (size < max_size && (size_t)size * size < area)
+            {
+                size <<= 1;
+            }
+            size = std::min<int>(size, max_size);
+
+            std::vector<int> placed;
+            std::vector<int> rest;
+            while (true)
+            {
+                placed.clear();
+                rest.clear();
+                kil::SkylinePacker packer(size, size);
+                for (size_t i = 0; i < remaining.size(); i++)
+                {
+                    AtlasSlot& s = slots[remaining[i]];
+                    kil::TextureAtlasRect r;
+                    if (packer.Insert(s.width + 2 * padding, s.height + 2 * padding, r))
+                    {
+                        s.rect.x = r.x + padding;
+                        s.rect.y = r.y + padding;
+                        s.rect.width = s.width;
+                        s.rect.height = s.height;
+                        placed.push_back(remaining[i]);
+                    }
+                    else
+                    {
+                        rest.push_back(remaining[i]);
+                    }
+                }
+                if (rest.empty() || size >= max_size)
+                {
+                    break;
+                }
+                size <<= 1;
+            }
+
+            // A page with a single texture saves nothing.
+            if (placed.size() < 2)
+            {
+                break;
+            }
+            for (size_t i = 0; i < placed.size(); i++)
+            {
+                slots[placed[i]].page = (int)page_sizes.size();
+            }
+            page_sizes.push_back(std::make_pair(size, size));
+            npages++;
+            remaining.swap(rest);
+        }
+        return npages;
+    }
+
+    static void RemapTexcoords(std::shared_ptr<Node>& node, const std::map<const Material*, UVTransform>& transforms, std::map<const Material*, int>& material_ids)
+    {
+        std::shared_ptr<Mesh>& mesh = node->GetMesh();
+        if (mesh->texcoords.empty() || mesh->tex_indices.size() != mesh->pos_indices.size())
+        {
+            return;
+        }
+        const std::vector<glm::vec2> original = mesh->texcoords;
+        std::vector<int> owner(original.size(), -1);
+        std::map<std::pair<int, int>, int> duplicated;
+
+        size_t offset = 0;
+        for (size_t i = 0; i < mesh->facenums.size(); i++)
+        {
+            int facenum = mesh->facenums[i];
+            std::shared_ptr<Material> mat = GetFaceMaterial(node, mesh, i);
+            int mid = -2;
+            const UVTransform* xf = NULL;
+            if (mat.get())
+            {
+                std::map<const Material*, int>::iterator it = material_ids.find(mat.get());
+                if (it == material_ids.end())
+                {
+                    it = material_ids.insert(std::make_pair(mat.get(), (int)material_ids.size())).first;
+                }
+                mid = it->second;
+                std::map<const Material*, UVTransform>::const_iterator xit = transforms.find(mat.get());
+                if (xit != transforms.end())
+                {
+                    xf = &xit->second;
+                }
+            }
+            for (int j = 0; j < facenum; j++)
+            {
+                int t = mesh->tex_indices[offset + j];
+                if (t < 0 || t >= (int)original.size())
+                {
+                    continue;
+                }
+                glm::vec2 uv = original[t];
+                if (xf)
+                {
+                    for (int k = 0; k < 2; k++)
+                    {
+                        uv[k] = xf->offset[k] + std::max<float>(0.0f, std::min<float>(1.0f, uv[k])) * xf->scale[k];
+                    }
+                }
+                if (owner[t] == -1)
+                {
+                    owner[t] = mid;
+                    mesh->texcoords[t] = uv;
+                }
+                else if (owner[t] != mid)
+                {
+                    // The texcoord is shared with a face of another material: give this material its own copy.
+                    std::pair<int, int> key(t, mid);
+                    std::map<std::pair<int, int>, int>::iterator it = duplicated.find(key);
+                    if (it == duplicated.end())
+                    {
+                        it = duplicated.insert(std::make_pair(key, (int)mesh->texcoords.size())).first;
+                        mesh->texcoords.push_back(uv);
+                    }
+                    mesh->tex_indices[offset + j] = it->second;
+                }
+            }
+            offset += facenum;
+        }
+    }
+
+    bool PackTextureAtlas(std::shared_ptr<Node>& node, const std::string& base_dir_, const std::shared_ptr<Options>& opts)
+    {
+        int max_texture_size = opts->GetInt("atlas_max_texture_size", 256);
+        int max_size = opts->GetInt("atlas_max_size", 2048);
+        int padding = opts->GetInt("atlas_padding", 4);
+        bool merge_materials = opts->GetInt("atlas_merge_materials", 0) != 0;
+
+        std::string base_dir = base_dir_;
+        if (!base_dir.empty() && base_dir[base_dir.size() - 1] != '/' && base_dir[base_dir.size() - 1] != '\\')
+        {
+            base_dir += "/";
+        }
+
+        std::vector<std::shared_ptr<Node> > nodes;
+        GetShapeNodes(nodes, node);
+
+        std::set<const Material*> rejected;
+        RejectWrappingMaterials(rejected, nodes);
+
+        // Group candidate materials by their texture keys. Materials that reference the same textures share a slot.
+        std::map<std::string, AtlasGroup> groups;
+        std::map<const Material*, std::pair<std::string, int> > material_slots;
+        for (size_t n = 0; n < nodes.size(); n++)
+        {
+            const std::vector<std::shared_ptr<Material> >& materials = nodes[n]->GetMaterials();
+            for (size_t m = 0; m < materials.size(); m++)
+            {
+                const std::shared_ptr<Material>& mat = materials[m];
+                if (!mat.get() || rejected.count(mat.get()) || material_slots.count(mat.get()))
+                {
+                    continue;
+                }
+                std::vector<std::string> keys = mat->GetTextureKeys();
+                if (keys.empty())
+                {
+                    continue;
+                }
+                AtlasSlot slot;
+                slot.width = 0;
+                slot.height = 0;
+                slot.page = -1;
+                bool ok = true;
+                for (size_t k = 0; k < keys.size() && ok; k++)
+                {
+                    std::shared_ptr<Texture> tex = mat->GetTexture(keys[k]);
+                    int w = 0;
+                    int h = 0;
+                    ok = IsAtlasCandidate(tex, base_dir, max_texture_size, w, h);
+                    slot.width = std::max<int>(slot.width, w);
+                    slot.height = std::max<int>(slot.height, h);
+                    slot.textures.push_back(tex);
+                }
+                if (!ok)
+                {
+                    rejected.insert(mat.get());
+                    continue;
+                }
+
+                std::string gkey = JoinKeys(keys);
+                AtlasGroup& group = groups[gkey];
+                group.keys = keys;
+                int index = -1;
+                for (size_t s = 0; s < group.slots.size(); s++)
+                {
+                    if (group.slots[s].textures == slot.textures)
+                    {
+                        index = (int)s;
+                        break;
+                    }
+                }
+                if (index < 0)
+                {
+                    index = (int)group.slots.size();
+                    group.slots.push_back(slot);
+                }
+                material_slots[mat.get()] = std::make_pair(gkey, index);
+            }
+        }
+
+        // Pack and write the pages.
+        std::map<std::string, std::vector<std::vector<std::shared_ptr<Texture> > > > page_textures; // group -> page -> key
+        std::map<std::string, std::vector<std::pair<int, int> > > page_sizes;
+        int atlas_count = 0;
+        for (std::map<std::string, AtlasGroup>::iterator it = groups.begin(); it != groups.end(); it++)
+        {
+            AtlasGroup& group = it->second;
+            std::vector<std::pair<int, int> >& sizes = page_sizes[it->first];
+            int npages = PackSlots(group.slots, sizes, max_size, padding);
+            std::vector<std::vector<std::shared_ptr<Texture> > >& textures = page_textures[it->first];
+            textures.resize(npages);
+            for (int p = 0; p < npages; p++)
+            {
+                int index = atlas_count++;
+                bool ok = true;
+                for (size_t k = 0; k < group.keys.size() && ok; k++)
+                {
+                    std::vector<kil::TextureAtlasEntry> entries;
+                    std::shared_ptr<Texture> first;
+                    for (size_t s = 0; s < group.slots.size(); s++)
+                    {
+                        const AtlasSlot& slot = group.slots[s];
+                        if (slot.page != p)
+                        {
+                            continue;
+                        }
+                        kil::TextureAtlasEntry e;
+                        e.path = ResolvePath(base_dir, slot.textures[k]->GetFilePath());
+                        e.rect = slot.rect;
+                        e.is_srgb = slot.textures[k]->GetColorSpace() == "sRGB";
+                        entries.push_back(e);
+                        if (!first.get())
+                        {
+                            first = slot.textures[k];
+                        }
+                    }
+
+                    char buffer[32] = {};
+                    sprintf(buffer, "atlas%d_", index);
+                    std::string name = std::string(buffer) + group.keys[k] + ".png";
+                    ok = kil::WriteTextureAtlas(base_dir + name, sizes[p].first, sizes[p].second, padding, entries);
+
+                    std::shared_ptr<Texture> tex(first->clone());
+                    tex->SetFilePath(name);
+                    tex->SetCacheFilePath(name);
+                    tex->SetCompressedFilePath("");
+                    tex->SetRepeat(1.0f, 1.0f);
+                    tex->SetOffset(0.0f, 0.0f);
+                    tex->SetWrap(false, false);
+                    tex->SetFileExists(true);
+                    textures[p].push_back(tex);
+                }
+                if (!ok)
+                {
+                    textures[p].clear();
+                }
+            }
+        }
+
+        // Point the materials at the pages.
+        std::map<const Material*, UVTransform> transforms;
+        std::set<Material*> done;
+        for (size_t n = 0; n < nodes.size(); n++)
+        {
+            const std::vector<std::shared_ptr<Material> >& materials = nodes[n]->GetMaterials();
+            for (size_t m = 0; m < materials.size(); m++)
+            {
+                Material* mat = materials[m].get();
+                if (!mat || done.count(mat) || !material_slots.count(mat))
+                {
+                    continue;
+                }
+                done.insert(mat);
+                const std::pair<std::string, int>& ref = material_slots[mat];
+                const AtlasGroup& group = groups[ref.first];
+                const AtlasSlot& slot = group.slots[ref.second];
+                if (slot.page < 0 || page_textures[ref.first][slot.page].empty())
+                {
+                    continue;
+                }
+                const std::vector<std::shared_ptr<Texture> >& textures = page_textures[ref.first][slot.page];
+                for (size_t k = 0; k < group.keys.size(); k++)
+                {
+                    mat->SetTexture(group.keys[k], textures[k]);
+                }
+                const std::pair<int, int>& size = page_sizes[ref.first][slot.page];
+                UVTransform xf;
+                xf.offset[0] = slot.rect.x / (float)size.first;
+                xf.offset[1] = slot.rect.y / (float)size.second;
+                xf.scale[0] = slot.rect.width / (float)size.first;
+                xf.scale[1] = slot.rect.height / (float)size.second;
+                transforms[mat] = xf;
+            }
+        }
+
+        if (!transforms.empty())
+        {
+            std::map<const Material*, int> material_ids;
+            std::set<const Mesh*> remapped; // a mesh shared by several nodes is transformed once
+            for (size_t n = 0; n < nodes.size(); n++)
+            {
+                if (remapped.insert(nodes[n]->GetMesh().get()).second)
+                {
+                    RemapTexcoords(nodes[n], transforms, material_ids);
+                }
+            }
+        }
+
+        if (merge_materials)
+        {
+            for (size_t n = 0; n < nodes.size(); n++)
+            {
+                MergeEquivalentMaterials(nodes[n]);
+            }
+        }
+        return true;
+    }
+
+    static bool IsEquivalentMaterial(const Material& a, const Material& b)
+    {
+        if (a.GetIntegerKeys() != b.GetIntegerKeys() || a.GetFloatKeys() != b.GetFloatKeys() ||
+            a.GetStringKeys() != b.GetStringKeys() || a.GetTextureKeys() != b.GetTextureKeys())
+        {
+            return false;
+        }
+        std::vector<std::string> keys = a.GetIntegerKeys();
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            if (a.GetInteger(keys[i]) != b.GetInteger(keys[i]))
+                return false;
+        }
+        keys = a.GetFloatKeys();
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            if (a.GetFloat(keys[i]) != b.GetFloat(keys[i]))
+                return false;
+        }
+        keys = a.GetStringKeys();
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            if (a.GetString(keys[i]) != b.GetString(keys[i]))
+                return false;
+        }
+        keys = a.GetTextureKeys();
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            if (a.GetTexture(keys[i]) != b.GetTexture(keys[i]))
+                return false;
+        }
+        return true;
+    }
+
+    bool MergeEquivalentMaterials(std::shared_ptr<Node>& node)
+    {
+        const std::vector<std::shared_ptr<Material> > materials = node->GetMaterials();
+        std::shared_ptr<Mesh>& mesh = node->GetMesh();
+        if (materials.size() <= 1 || !mesh.get())
+        {
+            return true;
+        }
+
+        std::vector<std::shared_ptr<Material> > merged;
+        std::vector<int> remap(materials.size(), 0);
+        for (size_t i = 0; i < materials.size(); i++)
+        {
+            int index = -1;
+            for (size_t j = 0; j < merged.size(); j++)
+            {
+                if (merged[j] == materials[i] || (merged[j].get() && materials[i].get() && IsEquivalentMaterial(*merged[j], *materials[i])))
+                {
+                    index = (int)j;
+                    break;
+                }
+            }
+            if (index < 0)
+            {
+                index = (int)merged.size();
+                merged.push_back(materials[i]);
+            }
+            remap[i] = index;
+        }
+        if (merged.size() == materials.size())
+        {
+            return true;
+        }
+
+        for (size_t i = 0; i < mesh->materials.size(); i++)
+        {
+            int id = mesh->materials[i];
+            if (0 <= id && id < (int)remap.size())
+            {
+                mesh->materials[i] = remap[id];
+            }
+        }
+        node->ClearMaterials();
+        for (size_t i = 0; i < merged.size(); i++)
+        {
+            node->AddMaterial(merged[i]);
+        }
+        return true;
+    }
+} // namespace kml
@@ -0,0 +1,26 @@
+#pragma once
+#ifndef _KML_PACK_TEXTURE_ATLAS_H_
+#define _KML_PACK_TEXTURE_ATLAS_H_
+
+#include "Node.h"
+#include "Options.h"
+#include <memory>
+#include <string>
+
+namespace kml
+{
+    // Packs small textures of every node under 'node' into atlases written to base_dir, and rewrites
+    // texcoords and texture references of the affected materials. Run before FlatIndicesMesh.
+    // Options:
+    //   atlas_max_texture_size : textures up to this size are packed (256)
+    //   atlas_max_size         : atlas page size limit (2048)
+    //   atlas_padding          : gutter pixels around every texture (4)
+    //   atlas_merge_materials  : merge materials that became identical, see MergeEquivalentMaterials (0)
+    bool PackTextureAtlas(std::shared_ptr<Node>& node, const std::string& base_dir, const std::shared_ptr<Options>& opts);
+
+    // Merges materials of the node that have identical parameters and texture references,
+    // so that SplitNodeByMaterialID produces fewer meshes.
+    bool MergeEquivalentMaterials(std::shared_ptr<Node>& node);
+} // namespace kml
+
+#endif
@@ -0,0 +1,134 @@
+#include "PolygonTriangulation.h"
+
+#include <cmath>
+
+namespace kml
+{
+    glm::vec3 GetPolygonNormal(const std::vector<glm::vec3>& positions, const int* face, int n)
+    {
+        glm::vec3 normal(0, 0, 0);
+        for (int j = 0; j < n; j++)
+        {
+            const glm::vec3& a = positions[face[j]];
+            const glm::vec3& b = positions[face[(j + 1) % n]];
+            normal.x += (a.y - b.y) * (a.z + b.z);
+            normal.y += (a.z - b.z) * (a.x + b.x);
+            normal.z += (a.x - b.x) * (a.y + b.y);
+        }
+        return normal;
+    }
+
+    void FanPolygon(const int* corners, int n, int* out)
+    {
+        for (int j = 0; j < n - 2; j++)
+        {
+            out[3 * j + 0] = corners[0];
+            out[3 * j + 1] = corners[j + 1];
+            out[3 * j + 2] = corners[j + 2];
+        }
+    }
+
+    void TriangulateQuad(const std::vector<glm::vec3>& positions, const int* face, int* out)
+    {
+        const glm::vec3& p0 = positions[face[0]];
+        const glm::vec3& p1 = positions[face[1]];
+        const glm::vec3& p2 = positions[face[2]];
+        const glm::vec3& p3 = positions[face[3]];
+        glm::vec3 normal = GetPolygonNormal(positions, face, 4);
+        bool valid02 = glm::dot(glm::cross(p1 - p0, p2 - p0), normal) > 0.0f && glm::dot(glm::cross(p2 - p0, p3 - p0), normal) > 0.0f;
+        bool valid13 = glm::dot(glm::cross(p1 - p0, p3 - p0), normal) > 0.0f && glm::dot(glm::cross(p2 - p1, p3 - p1), normal) > 0.0f;
+        glm::vec3 d02 = p2 - p0;
+        glm::vec3 d13 = p3 - p1;
+        bool use02 = valid02 && (!valid13 || glm::dot(d02, d02) < glm::dot(d13, d13));
+        static const int TRIS02[6] = {0, 1, 2, 0, 2, 3};
+        static const int TRIS13[6] = {0, 1, 3, 1, 2, 3};
+        const int* tris = use02 ? TRIS02 : TRIS13;
+        for (int j = 0; j < 6; j++)
+        {
+            out[j] = tris[j];
+        }
+    }
+
+    static float Cross2(const glm::vec2& a, const glm::vec2& b, const glm::vec2& c)
+    {
+        return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    }
+
+    void TriangulatePolygon(const std::vector<glm::vec3>& positions, const int* face, int n, int* out,
+                            std::vector<int>& remain, std::vector<glm::vec2>& points)
+    {
+        remain.resize(n);
+        for (int j = 0; j < n; j++)
+        {
+            remain[j] = j;
+        }
+
+        glm::vec3 normal = GetPolygonNormal(positions, face, n);
+        float len = glm::length(normal);
+        if (!(len > 0.0f))
+        {
+            FanPolygon(&remain[0], n, out);
+            return;
+        }
+        normal = normal / len;
+        glm::vec3 axis = (std::fabs(normal.x) < 0.9f) ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+        glm::vec3 u = glm::normalize(glm::cross(axis, normal));
+        glm::vec3 v = glm::cross(normal, u);
+        points.resize(n);
+        for (int j = 0; j < n; j++)
+        {
+            const glm::vec3& p = positions[face[j]];
+            points[j] = glm::vec2(glm::dot(p, u), glm::dot(p, v));
+        }
+
+        // (u, v, normal) is right handed, so the polygon winds counter-clockwise in the plane
+        int ntris = 0;
+        int m = n;
+        int k = 0;
+        int misses = 0;
+        while (m > 3)
+        {
+            int a = remain[(k + m - 1) % m];
+            int b = remain[k];
+            int c = remain[(k + 1) % m];
+            bool ear = Cross2(points[a], points[b], points[c]) > 0.0f;
+            for (int j = 0; ear && j < m; j++)
+            {
+                int p = remain[j];
+                if (p == a || p == b || p == c)
+                {
+                    continue;
+                }
+                const glm::vec2& q = points[p];
+                if (q == points[a] || q == points[b] || q == points[c])
+                {
+                    continue;
+                }
+                ear = !(Cross2(points[a], points[b], q) >= 0.0f && Cross2(points[b], points[c], q) >= 0.0f && Cross2(points[c], points[a], q) >= 0.0f);
+            }
+            if (ear)
+            {
+                out[3 * ntris + 0] = a;
+                out[3 * ntris + 1] = b;
+                out[3 * ntris + 2] = c;
+                ntris++;
+                remain.erase(remain.begin() + k);
+                m--;
+                k = k % m;
+                misses = 0;
+            }
+            else if (++misses >= m)
+            {
+                FanPolygon(&remain[0], m, out + 3 * ntris);
+                return;
+            }
+            else
+            {
+                k = (k + 1) % m;
+            }
+        }
+        out[3 * ntris + 0] = remain[0];
+        out[3 * ntris + 1] = remain[1];
+        out[3 * ntris + 2] = remain[2];
+    }
+} // namespace kml
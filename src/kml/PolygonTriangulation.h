@@ -0,0 +1,31 @@
+#pragma once
+#ifndef _KML_POLYGON_TRIANGULATION_H_
+#define _KML_POLYGON_TRIANGULATION_H_
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace kml
+{
+    // Polygon helpers shared by TriangulateMesh, PrepareMesh and SplitNodeByMaterialID, so they all split
+    // and orient faces the same way. face holds the position indices of the n corners of a polygon.
+
+    // Newell's normal, robust for non-planar and concave polygons. Its length is twice the area.
+    glm::vec3 GetPolygonNormal(const std::vector<glm::vec3>& positions, const int* face, int n);
+
+    // Fan of n - 2 triangles around corners[0].
+    void FanPolygon(const int* corners, int n, int* out);
+
+    // Splits a quad along its shorter diagonal, unless that diagonal lies outside a concave quad.
+    // Writes 2 triangles of corner numbers.
+    void TriangulateQuad(const std::vector<glm::vec3>& positions, const int* face, int* out);
+
+    // Ear clipping on the polygon projected to the plane of its normal. Writes n - 2 triangles of corner
+    // numbers, keeping the winding of the polygon. Falls back to a fan when no ear is found (degenerate input).
+    // remain and points are scratch buffers, kept by the caller to reuse them across faces.
+    void TriangulatePolygon(const std::vector<glm::vec3>& positions, const int* face, int n, int* out,
+                            std::vector<int>& remain, std::vector<glm::vec2>& points);
+} // namespace kml
+
+#endif
@@ -0,0 +1,361 @@
+#define _CRT_SECURE_NO_WARNINGS 1
+
+#include "PrepareMesh.h"
+#include "CalculateBound.h"
+#include "PolygonTriangulation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace kml
+{
+    void PrepareMeshContext::Clear()
+    {
+        PrepareMeshContext empty;
+        std::swap(*this, empty);
+    }
+
+    // Triangulates every face and keeps the triangles RemoveNoAreaMesh would, as source corners.
+    // Faces of materials outside [0, nmaterials) are dropped unless there is a single bucket.
+    static void CollectTriangles(const Mesh& mesh, int nmaterials, PrepareMeshContext& ctx)
+    {
+        ctx.tri_corners.clear();
+        ctx.tri_materials.clear();
+        int offset = 0;
+        for (size_t i = 0; i < mesh.facenums.size(); i++)
+        {
+            int nf = mesh.facenums[i];
+            int material = mesh.materials[i];
+            if (nf >= 3 && (nmaterials <= 1 || (0 <= material && material < nmaterials)))
+            {
+                const int* face = &mesh.pos_indices[offset];
+                ctx.polygon_tris.resize(3 * (nf - 2));
+                int* tris = &ctx.polygon_tris[0];
+                if (nf == 3)
+                {
+                    tris[0] = 0;
+                    tris[1] = 1;
+                    tris[2] = 2;
+                }
+                else if (nf == 4)
+                {
+                    TriangulateQuad(mesh.positions, face, tris);
+                }
+                else
+                {
+                    TriangulatePolygon(mesh.positions, face, nf, tris, ctx.polygon, ctx.polygon_points);
+                }
+
+                for (int t = 0; t < nf - 2; t++)
+                {
+                    const glm::vec3& p0 = mesh.positions[face[tris[3 * t + 0]]];
+                    const glm::vec3& p1 = mesh.positions[face[tris[3 * t + 1]]];
+                    const glm::vec3& p2 = mesh.positions[face[tris[3 * t + 2]]];
+                    if (glm::length(glm::cross(p1 - p0, p2 - p0)) <= 1e-4f)
+                    {
+                        continue;
+                    }
+                    ctx.tri_corners.push_back(offset + tris[3 * t + 0]);
+                    ctx.tri_corners.push_back(offset + tris[3 * t + 1]);
+                    ctx.tri_corners.push_back(offset + tris[3 * t + 2]);
+                    ctx.tri_materials.push_back(material);
+                }
+            }
+            offset += nf;
+        }
+    }
+
+    // Counting sort of the kept triangles by bucket, stable so faces keep their order.
+    static void SortTriangles(int nbuckets, PrepareMeshContext& ctx)
+    {
+        int ntris = (int)ctx.tri_materials.size();
+        ctx.bucket_offsets.assign(nbuckets + 1, 0);
+        for (int t = 0; t < ntris; t++)
+        {
+            int b = (nbuckets == 1) ? 0 : ctx.tri_materials[t];
+            ctx.bucket_offsets[b + 1]++;
+        }
+        for (int b = 0; b < nbuckets; b++)
+        {
+            ctx.bucket_offsets[b + 1] += ctx.bucket_offsets[b];
+        }
+        ctx.tri_order.resize(ntris);
+        ctx.indices.assign(ctx.bucket_offsets.begin(), ctx.bucket_offsets.end() - 1);
+        for (int t = 0; t < ntris; t++)
+        {
+            int b = (nbuckets == 1) ? 0 : ctx.tri_materials[t];
+            ctx.tri_order[ctx.indices[b]++] = t;
+        }
+    }
+
+    // Only the kept corners count, as the check runs after RemoveNoAreaMesh in FlatIndicesMesh.
+    static bool NeedRecalcNormals(const Mesh& mesh, const PrepareMeshContext& ctx)
+    {
+        if (mesh.normals.empty() || mesh.nor_indices.size() != mesh.pos_indices.size())
+        {
+            return true;
+        }
+        for (size_t i = 0; i < ctx.tri_corners.size(); i++)
+        {
+            if (mesh.nor_indices[ctx.tri_corners[i]] < 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Smooth area weighted normals of the kept triangles, per position, as CalculateNormalsMesh gives.
+    static void CalculateNormals(const Mesh& mesh, PrepareMeshContext& ctx)
+    {
+        ctx.normals.assign(mesh.positions.size(), glm::vec3(0, 0, 0));
+        for (size_t i = 0; i < ctx.tri_corners.size(); i += 3)
+        {
+            int i0 = mesh.pos_indices[ctx.tri_corners[i + 0]];
+            int i1 = mesh.pos_indices[ctx.tri_corners[i + 1]];
+            int i2 = mesh.pos_indices[ctx.tri_corners[i + 2]];
+            const glm::vec3& p0 = mesh.positions[i0];
+            glm::vec3 n = glm::cross(mesh.positions[i1] - p0, mesh.positions[i2] - p0);
+            ctx.normals[i0] += n;
+            ctx.normals[i1] += n;
+            ctx.normals[i2] += n;
+        }
+    }
+
+    // Unit length and then scaled as ShortenNormal does.
+    static glm::vec3 ShortenNormal(const glm::vec3& n)
+    {
+        float len = glm::length(n);
+        return (len > 1e-6f) ? n * (0.95f / len) : glm::vec3(0, 0.95f, 0);
+    }
+
+    static unsigned int HashKey(int v, int n, int t)
+    {
+        unsigned int h = (unsigned int)v * 0x9E3779B1u;
+        h ^= (unsigned int)n * 0x85EBCA77u + (h << 6) + (h >> 2);
+        h ^= (unsigned int)t * 0xC2B2AE3Du + (h << 6) + (h >> 2);
+        return h ^ (h >> 15);
+    }
+
+    // Welds the corners of triangles [begin, end) of tri_order on (position, normal, texcoord) indices.
+    // Leaves one index per corner in ctx.indices and a source corner per vertex in ctx.vertex_corners.
+    static void WeldBucket(const Mesh& mesh, bool recalc_normals, bool has_texcoords, int begin, int end, PrepareMeshContext& ctx)
+    {
+        int ncorners = 3 * (end - begin);
+        size_t nslots = 16;
+        while (nslots < 2 * (size_t)ncorners)
+        {
+            nslots <<= 1;
+        }
+        size_t mask = nslots - 1;
+        ctx.slots.assign(nslots, -1);
+        ctx.vertex_corners.clear();
+        ctx.vertex_keys.clear();
+        ctx.indices.resize(ncorners);
+
+        int k = 0;
+        for (int i = begin; i < end; i++)
+        {
+            const int* corners = &ctx.tri_corners[3 * ctx.tri_order[i]];
+            for (int j = 0; j < 3; j++, k++)
+            {
+                int corner = corners[j];
+                int vidx = mesh.pos_indices[corner];
+                int nidx = recalc_normals ? vidx : mesh.nor_indices[corner];
+                int tidx = has_texcoords ? std::max<int>(-1, mesh.tex_indices[corner]) : -1;
+                size_t s = HashKey(vidx, nidx, tidx) & mask;
+                while (true)
+                {
+                    int index = ctx.slots[s];
+                    if (index < 0)
+                    {
+                        index = (int)ctx.vertex_corners.size();
+                        ctx.slots[s] = index;
+                        ctx.vertex_corners.push_back(corner);
+                        ctx.vertex_keys.push_back(vidx);
+                        ctx.vertex_keys.push_back(nidx);
+                        ctx.vertex_keys.push_back(tidx);
+                        ctx.indices[k] = index;
+                        break;
+                    }
+                    const int* key = &ctx.vertex_keys[3 * index];
+                    if (key[0] == vidx && key[1] == nidx && key[2] == tidx)
+                    {
+                        ctx.indices[k] = index;
+                        break;
+                    }
+                    s = (s + 1) & mask;
+                }
+            }
+        }
+    }
+
+    static std::shared_ptr<Mesh> CreateMesh(const Mesh& mesh, bool keep_materials, bool has_texcoords, int begin, int end, PrepareMeshContext& ctx)
+    {
+        int ntris = end - begin;
+        int nverts = (int)ctx.vertex_corners.size();
+        std::shared_ptr<Mesh> out(new Mesh());
+        out->name = mesh.name;
+        out->facenums.assign(ntris, 3);
+        out->materials.resize(ntris);
+        for (int i = 0; i < ntris; i++)
+        {
+            out->materials[i] = keep_materials ? ctx.tri_materials[ctx.tri_order[begin + i]] : 0;
+        }
+        out->pos_indices.assign(ctx.indices.begin(), ctx.indices.end());
+        out->nor_indices = out->pos_indices;
+        if (has_texcoords)
+        {
+            out->tex_indices = out->pos_indices;
+        }
+
+        const std::vector<int>& keys = ctx.vertex_keys;
+        bool has_tangents = mesh.tangents.size() == mesh.positions.size();
+        out->positions.resize(nverts);
+        out->normals.resize(nverts);
+        out->texcoords.resize(has_texcoords ? nverts : 0);
+        out->tangents.resize(has_tangents ? nverts : 0);
+        for (int i = 0; i < nverts; i++)
+        {
+            int vidx = keys[3 * i + 0];
+            int nidx = keys[3 * i + 1];
+            int tidx = keys[3 * i + 2];
+            out->positions[i] = mesh.positions[vidx];
+            out->normals[i] = ShortenNormal(ctx.normals.empty() ? mesh.normals[nidx] : ctx.normals[nidx]);
+            if (has_texcoords)
+            {
+                out->texcoords[i] = (tidx >= 0) ? mesh.texcoords[tidx] : glm::vec2(0, 0);
+            }
+            if (has_tangents)
+            {
+                out->tangents[i] = mesh.tangents[vidx];
+            }
+        }
+
+        if (mesh.skin_weight.get())
+        {
+            const SkinWeight& src = *mesh.skin_weight;
+            out->skin_weight = std::shared_ptr<SkinWeight>(new SkinWeight());
+            out->skin_weight->name = src.name;
+            out->skin_weight->joint_paths = src.joint_paths;
+            out->skin_weight->joint_bind_matrices = src.joint_bind_matrices;
+            out->skin_weight->weights.resize(nverts);
+            for (int i = 0; i < nverts; i++)
+            {
+                out->skin_weight->weights[i] = src.weights[keys[3 * i]];
+            }
+        }
+
+        if (mesh.morph_targets.get())
+        {
+            const MorphTargets& src = *mesh.morph_targets;
+            out->morph_targets = std::shared_ptr<MorphTargets>(new MorphTargets());
+            out->morph_targets->weights = src.weights;
+            out->morph_targets->names = src.names;
+            for (size_t j = 0; j < src.targets.size(); j++)
+            {
+                const MorphTarget& target = *src.targets[j];
+                std::shared_ptr<MorphTarget> dst(new MorphTarget());
+                dst->positions.resize(nverts);
+                dst->normals.resize(nverts);
+                for (int i = 0; i < nverts; i++)
+                {
+                    int vidx = keys[3 * i + 0];
+                    int nidx = keys[3 * i + 1];
+                    dst->positions[i] = target.positions[vidx];
+                    dst->normals[i] = (nidx < (int)target.normals.size()) ? target.normals[nidx] : glm::vec3(0, 0, 0);
+                }
+                out->morph_targets->targets.push_back(dst);
+            }
+        }
+
+        return out;
+    }
+
+    bool PrepareMesh(const std::shared_ptr<Mesh>& mesh, int nmaterials, std::vector<std::shared_ptr<Mesh> >& meshes, PrepareMeshContext& ctx)
+    {
+        if (!mesh.get())
+        {
+            return false;
+        }
+        int nbuckets = std::max<int>(1, nmaterials);
+        meshes.assign(nbuckets, std::shared_ptr<Mesh>());
+
+        CollectTriangles(*mesh, nmaterials, ctx);
+        SortTriangles(nbuckets, ctx);
+
+        bool recalc_normals = NeedRecalcNormals(*mesh, ctx);
+        if (recalc_normals)
+        {
+            CalculateNormals(*mesh, ctx);
+        }
+        else
+        {
+            ctx.normals.clear();
+        }
+        bool has_texcoords = !mesh->texcoords.empty() && mesh->tex_indices.size() == mesh->pos_indices.size();
+
+        for (int b = 0; b < nbuckets; b++)
+        {
+            int begin = ctx.bucket_offsets[b];
+            int end = ctx.bucket_offsets[b + 1];
+            if (begin == end && nbuckets > 1)
+            {
+                continue;
+            }
+            WeldBucket(*mesh, recalc_normals, has_texcoords, begin, end, ctx);
+            meshes[b] = CreateMesh(*mesh, nbuckets == 1, has_texcoords, begin, end, ctx);
+        }
+
+        return true;
+    }
+
+    std::vector<std::shared_ptr<Node> > PrepareNode(std::shared_ptr<Node>& node, PrepareMeshContext& ctx)
+    {
+        std::vector<std::shared_ptr<Node> > nodes;
+        const std::vector<std::shared_ptr<Material> >& materials = node->GetMaterials();
+        std::vector<std::shared_ptr<Mesh> > meshes;
+        if (!PrepareMesh(node->GetMesh(), (int)materials.size(), meshes, ctx))
+        {
+            return nodes;
+        }
+
+        if (materials.size() <= 1)
+        {
+            node->SetMesh(meshes[0]);
+            nodes.push_back(node);
+            return nodes;
+        }
+
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            if (!meshes[i].get())
+            {
+                continue;
+            }
+            std::shared_ptr<Node> tnode = std::shared_ptr<Node>(new Node());
+            tnode->SetMesh(meshes[i]);
+            tnode->AddMaterial(materials[i]);
+
+            int k = (int)nodes.size();
+            char buffer[32] = {};
+            sprintf(buffer, "%d", k + 1);
+            std::string number = buffer;
+
+            tnode->SetName(node->GetName() + "_" + number);
+            tnode->SetPath(node->GetPath() + "_" + number);
+            tnode->SetOriginalPath(node->GetPath());
+            tnode->SetVisiblity(node->GetVisibility());
+            tnode->GetTransform()->SetMatrix(node->GetTransform()->GetMatrix());
+            tnode->SetBound(CalculateBound(meshes[i]));
+
+            nodes.push_back(tnode);
+        }
+
+        return nodes;
+    }
+} // namespace kml
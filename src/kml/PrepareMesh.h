@@ -0,0 +1,45 @@
+#pragma once
+#ifndef _KML_PREPARE_MESH_H_
+#define _KML_PREPARE_MESH_H_
+
+#include "Mesh.h"
+#include "Node.h"
+#include <memory>
+#include <vector>
+
+namespace kml
+{
+    // Scratch buffers of PrepareMesh. Keep one per thread and pass it to every call, so the buffers grow
+    // to the largest mesh once instead of being reallocated by every stage of every mesh.
+    class PrepareMeshContext
+    {
+    public:
+        void Clear(); // releases the buffers
+
+    public:
+        std::vector<int> tri_corners;   // kept triangles, as corners of the source mesh
+        std::vector<int> tri_materials; // bucket of each kept triangle
+        std::vector<int> tri_order;     // kept triangles sorted by bucket
+        std::vector<int> bucket_offsets;
+        std::vector<int> polygon;
+        std::vector<int> polygon_tris;
+        std::vector<glm::vec2> polygon_points;
+        std::vector<glm::vec3> normals; // per position, when the normals are recalculated
+        std::vector<int> slots;         // weld hash table
+        std::vector<int> vertex_corners;
+        std::vector<int> vertex_keys;
+        std::vector<int> indices;
+    };
+
+    // TriangulateMesh, RemoveNoAreaMesh, FlatIndicesMesh and SplitNodeByMaterialID fused into one pass over the faces.
+    // meshes[m] receives the faces of material m with one index per vertex, or NULL if it has none. Vertices are
+    // numbered in order of first use and only the referenced ones are kept. With nmaterials <= 1 every face goes
+    // to meshes[0] and keeps its material ID, as SplitNodeByMaterialID leaves single material nodes untouched.
+    // Texcoords and per position tangents are carried over only when the source mesh has them.
+    bool PrepareMesh(const std::shared_ptr<Mesh>& mesh, int nmaterials, std::vector<std::shared_ptr<Mesh> >& meshes, PrepareMeshContext& ctx);
+
+    // PrepareMesh on the mesh of node, returning the nodes SplitNodeByMaterialID would.
+    std::vector<std::shared_ptr<Node> > PrepareNode(std::shared_ptr<Node>& node, PrepareMeshContext& ctx);
+} // namespace kml
+
+#endif
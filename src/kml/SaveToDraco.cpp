@@ -54,6 +54,19 @@ namespace kml
 
     } // namespace ns
 
+    std::vector<int> GetDracoEncoderSettings()
+    {
+        ns::Options options;
+        std::vector<int> settings;
+        settings.push_back(options.pos_quantization_bits);
+        settings.push_back(options.tex_coords_quantization_bits);
+        settings.push_back(options.normals_quantization_bits);
+        settings.push_back(options.color_quantization_bits);
+        settings.push_back(options.generic_quantization_bits);
+        settings.push_back(options.compression_level);
+        return settings;
+    }
+
 #ifdef ENABLE_BUILD_WITH_DRACO
 
     template <class T>
@@ -193,7 +206,7 @@ namespace kml
         return attId;
     }
 
-    bool SaveToDraco(std::vector<unsigned char>& bytes, const std::shared_ptr<gltf::Mesh>& mesh)
+    bool SaveToDraco(std::vector<unsigned char>& bytes, const std::shared_ptr<gltf::Primitive>& primitive)
     {
         std::unique_ptr<ns::Options> options(new ns::Options());
         int speed = 10 - options->compression_level;
@@ -211,7 +224,7 @@ namespace kml
         std::unique_ptr<draco::Mesh> dracoMesh(new draco::Mesh());
 
         {
-            std::shared_ptr<gltf::Accessor> accIndices = mesh->GetIndices();
+            std::shared_ptr<gltf::Accessor> accIndices = primitive->GetIndices();
             std::shared_ptr<gltf::DracoTemporaryBuffer> bufIndices = accIndices->GetDracoTemporaryBuffer();
             unsigned int* indices = (unsigned int*)(bufIndices->GetBytesPtr());
             size_t numFaces = accIndices->GetCount() / 3;
@@ -233,7 +246,7 @@ namespace kml
             int i = 0;
             while (ATTRS[i])
             {
-                std::shared_ptr<gltf::Accessor> acc = mesh->GetAccessor(ATTRS[i]);
+                std::shared_ptr<gltf::Accessor> acc = primitive->GetAccessor(ATTRS[i]);
                 int attId = 0;
                 if (acc.get())
                 {
@@ -266,7 +279,7 @@ namespace kml
                     }
 
                     int order = dracoMesh->attribute(attId)->unique_id();
-                    mesh->SetOrderInDraco(ATTRS[i], order);
+                    primitive->SetOrderInDraco(ATTRS[i], order);
                 }
                 i++;
             }
@@ -293,7 +306,7 @@ namespace kml
         return true;
     }
 #else
-    bool SaveToDraco(std::vector<unsigned char>& bytes, const std::shared_ptr<gltf::Mesh>& mesh)
+    bool SaveToDraco(std::vector<unsigned char>& bytes, const std::shared_ptr<gltf::Primitive>& primitive)
     {
         // Disable ENABLE_BUILD_WITH_DRACO option
         return false;
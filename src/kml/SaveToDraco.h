@@ -9,7 +9,9 @@
 
 namespace kml
 {
-    bool SaveToDraco(std::vector<unsigned char>& bytes, const std::shared_ptr<gltf::Mesh>& mesh);
+    bool SaveToDraco(std::vector<unsigned char>& bytes, const std::shared_ptr<gltf::Primitive>& primitive);
+    // Quantization bits and compression level the encoder runs with, for cache keys of encoded blobs.
+    std::vector<int> GetDracoEncoderSettings();
 }
 
 #endif
@@ -2,191 +2,420 @@
 
 #include "SplitNodeByMaterialID.h"
 #include "CalculateBound.h"
+#include "PolygonTriangulation.h"
+
+#include <kil/ParallelFor.h>
 
 #include <algorithm>
+#include <stdint.h>
 
 namespace kml
 {
-    std::vector<std::shared_ptr<kml::Node> > SplitNodeByFaceNormal(std::shared_ptr<kml::Node>& node)
-    {
-        std::vector<std::shared_ptr<kml::Node> > nodes;
-        auto& mesh = node->GetMesh();
+    static const int FACE_GRAIN = 4096;
 
-        std::vector<glm::vec3> nf(mesh->facenums.size());
+    static void GetFaceOffsets(const std::shared_ptr<Mesh>& mesh, std::vector<int>& offsets)
+    {
+        offsets.resize(mesh->facenums.size());
+        int offset = 0;
+        for (size_t i = 0; i < offsets.size(); i++)
         {
-            int offset = 0;
-            for (size_t i = 0; i < nf.size(); i++)
-            {
-                int facenum = mesh->facenums[i];
-                int i0 = mesh->pos_indices[offset + 0];
-                int i1 = mesh->pos_indices[offset + 1];
-                int i2 = mesh->pos_indices[offset + 2];
-                glm::vec3 p0 = mesh->positions[i0];
-                glm::vec3 p1 = mesh->positions[i1];
-                glm::vec3 p2 = mesh->positions[i2];
-
-                glm::vec3 e1 = p1 - p0;
-                glm::vec3 e2 = p2 - p0;
-
-                glm::vec3 nn = glm::cross(e1, e2);
-                float len = glm::length(nn);
-                assert(1e-5f < len);
-                nn = glm::normalize(nn);
-                nf[i] = nn;
-                offset += facenum;
-            }
+            offsets[i] = offset;
+            offset += mesh->facenums[i];
         }
+    }
 
-        std::vector<int> abnormal_faces;
+    // Index of a double-sided copy of material matID, added to the node on first use.
+    // A material shared by several nodes gets one copy, recorded in clones.
+    static int GetDoubleSidedMaterial(std::shared_ptr<kml::Node>& node, int matID, std::vector<int>& double_ids, DoubleSidedMaterialMap& clones)
+    {
+        if (matID < 0 || matID >= (int)double_ids.size())
+        {
+            return matID;
+        }
+        if (double_ids[matID] < 0)
         {
-            //static const float E = std::cos(glm::radians(35.0));
-            int offset = 0;
-            for (size_t i = 0; i < nf.size(); i++)
+            std::shared_ptr<Material> mat = node->GetMaterials()[matID];
+            if (!mat.get() || mat->GetInteger("DoubleSided"))
             {
-                int facenum = mesh->facenums[i];
-                for (size_t j = 0; j < facenum; j++)
+                double_ids[matID] = matID;
+            }
+            else
+            {
+                std::shared_ptr<Material>& dmat = clones[mat];
+                if (!dmat.get())
                 {
-                    int i0 = mesh->nor_indices[offset + j];
-                    glm::vec3 n = mesh->normals[i0];
-                    float d = glm::dot(nf[i], n);
-                    if (d < 0)
-                    {
-                        abnormal_faces.push_back(i);
-                    }
+                    dmat.reset(new Material(*mat));
+                    dmat->SetName(mat->GetName() + "_DoubleSided");
+                    dmat->SetInteger("DoubleSided", 1);
+                }
+                const std::vector<std::shared_ptr<Material> >& materials = node->GetMaterials();
+                std::vector<std::shared_ptr<Material> >::const_iterator it = std::find(materials.begin(), materials.end(), dmat);
+                if (it != materials.end())
+                {
+                    double_ids[matID] = (int)(it - materials.begin());
+                }
+                else
+                {
+                    double_ids[matID] = (int)materials.size();
+                    node->AddMaterial(dmat);
                 }
-                offset += facenum;
             }
         }
+        return double_ids[matID];
+    }
 
-        if (abnormal_faces.empty())
-        {
-            nodes.push_back(node);
-        }
-        else
-        {
-            //assert(0);
-            nodes.push_back(node);
-        }
-
-        return nodes;
+    std::vector<std::shared_ptr<kml::Node> > SplitNodeByFaceNormal(std::shared_ptr<kml::Node>& node)
+    {
+        DoubleSidedMaterialMap clones;
+        return SplitNodeByFaceNormal(node, clones);
     }
 
-    namespace
+    std::vector<std::shared_ptr<kml::Node> > SplitNodeByFaceNormal(std::shared_ptr<kml::Node>& node, DoubleSidedMaterialMap& clones)
     {
-        struct FaceIndices
+        std::vector<std::shared_ptr<kml::Node> > nodes;
+        nodes.push_back(node);
+        auto& mesh = node->GetMesh();
+        if (!mesh.get() || mesh->nor_indices.empty())
         {
-            int self_index;
-            int indices[3];
-        };
+            return nodes;
+        }
 
-        struct FaceSorter
-        {
-            bool operator()(const FaceIndices& a, const FaceIndices& b) const
+        std::vector<int> face_offsets;
+        GetFaceOffsets(mesh, face_offsets);
+        int nfaces = (int)face_offsets.size();
+
+        // a face whose corner normals mostly point away from its winding is meant to be seen from the back too;
+        // the threshold keeps normals smoothed across a sharp edge, nearly in the plane of the face, from counting
+        static const float BACK_FACING_COS = -0.1f;
+        std::vector<unsigned char> back_facing(nfaces, 0);
+        int nchunks = (nfaces + FACE_GRAIN - 1) / FACE_GRAIN;
+        kil::ParallelFor(0, nchunks, [&](int chunk) {
+            int i1 = std::min<int>(nfaces, (chunk + 1) * FACE_GRAIN);
+            for (int i = chunk * FACE_GRAIN; i < i1; i++)
             {
-                if (a.indices[0] == b.indices[0])
+                int facenum = mesh->facenums[i];
+                int offset = face_offsets[i];
+                if (facenum < 3)
                 {
-                    if (a.indices[1] == b.indices[1])
+                    continue;
+                }
+                glm::vec3 nn = GetPolygonNormal(mesh->positions, &mesh->pos_indices[offset], facenum);
+                float len = glm::length(nn);
+                if (!(len > 1e-5f))
+                {
+                    continue;
+                }
+                nn /= len;
+                int nback = 0;
+                for (int j = 0; j < facenum; j++)
+                {
+                    int n = mesh->nor_indices[offset + j];
+                    if (n < 0 || n >= (int)mesh->normals.size())
                     {
-                        return a.indices[2] < b.indices[2];
+                        continue;
                     }
-                    else
+                    const glm::vec3& normal = mesh->normals[n];
+                    if (glm::dot(nn, normal) < BACK_FACING_COS * glm::length(normal))
                     {
-                        return a.indices[1] < b.indices[1];
+                        nback++;
                     }
                 }
-                else
-                {
-                    return a.indices[0] < b.indices[0];
-                }
+                back_facing[i] = 2 * nback > facenum;
             }
-        };
+        });
 
-        bool operator==(const FaceIndices& a, const FaceIndices& b)
+        std::vector<int> double_ids(node->GetMaterials().size(), -1);
+        for (int i = 0; i < nfaces && i < (int)mesh->materials.size(); i++)
         {
-            return memcmp(&a, &b, sizeof(FaceIndices)) == 0;
+            if (back_facing[i])
+            {
+                mesh->materials[i] = GetDoubleSidedMaterial(node, mesh->materials[i], double_ids, clones);
+            }
         }
-    } // namespace
 
-    static void SortIndex(FaceIndices& fInd)
-    {
-        int* a = fInd.indices;
-        int* b = a + 3;
-        std::sort(a, b);
+        return nodes;
     }
 
-    static void RotateIndex(FaceIndices& fInd)
+    static uint64_t HashFace(uint32_t a, uint32_t b, uint32_t c)
     {
-        int min_ = 0;
-        if (fInd.indices[1] < fInd.indices[min_])
-            min_ = 1;
-        if (fInd.indices[2] < fInd.indices[min_])
-            min_ = 2;
-        int indices[3];
-        for (int i = 0; i < 3; i++)
-        {
-            indices[i] = fInd.indices[(min_ + i) % 3];
-        }
-        for (int i = 0; i < 3; i++)
-        {
-            fInd.indices[i] = indices[i];
-        }
+        uint64_t h = (((uint64_t)a << 32) | b) ^ ((uint64_t)c * 0x9E3779B97F4A7C15ULL);
+        h ^= h >> 30;
+        h *= 0xBF58476D1CE4E5B9ULL;
+        h ^= h >> 27;
+        h *= 0x94D049BB133111EBULL;
+        h ^= h >> 31;
+        return h;
     }
 
-    static bool HasDoubleSidedFace(const std::shared_ptr<Mesh>& mesh)
+    // Stable LSD radix sort of items by keys[item], skipping the bytes above max_key.
+    static void RadixSortByKey(std::vector<int>& items, const std::vector<uint64_t>& keys, uint64_t max_key)
     {
-        std::vector<FaceIndices> faces;
-        faces.reserve(mesh->facenums.size());
-        int offset = 0;
-        for (int i = 0; i < mesh->facenums.size(); i++)
+        std::vector<int> tmp(items.size());
+        for (int shift = 0; shift < 64 && (max_key >> shift) != 0; shift += 8)
         {
-            int facenum = mesh->facenums[i];
-            FaceIndices fInd;
-            for (int j = 0; j < 3; j++)
+            size_t counts[257] = {};
+            for (size_t i = 0; i < items.size(); i++)
             {
-                fInd.indices[j] = mesh->pos_indices[offset + j];
+                counts[((keys[items[i]] >> shift) & 0xFF) + 1]++;
             }
-            fInd.self_index = 0; //
-            faces.push_back(fInd);
-            offset += facenum;
+            for (int k = 0; k < 256; k++)
+            {
+                counts[k + 1] += counts[k];
+            }
+            for (size_t i = 0; i < items.size(); i++)
+            {
+                tmp[counts[(keys[items[i]] >> shift) & 0xFF]++] = items[i];
+            }
+            items.swap(tmp);
         }
-        for (int i = 0; i < faces.size(); i++)
+    }
+
+    // Whether the triangles f and g, on the same positions, also have the same texcoord at each position.
+    static bool HasSameTexcoords(const std::shared_ptr<Mesh>& mesh, const std::vector<int>& face_offsets, int f, int g)
+    {
+        if (mesh->tex_indices.empty())
         {
-            SortIndex(faces[i]);
+            return true;
         }
-        std::sort(faces.begin(), faces.end(), FaceSorter());
-        for (int i = 1; i < faces.size(); i++)
+        const int* fpos = &mesh->pos_indices[face_offsets[f]];
+        const int* gpos = &mesh->pos_indices[face_offsets[g]];
+        const int* ftex = &mesh->tex_indices[face_offsets[f]];
+        const int* gtex = &mesh->tex_indices[face_offsets[g]];
+        int ntexcoords = (int)mesh->texcoords.size();
+        for (int j = 0; j < 3; j++)
         {
-            if (faces[i - 1] == faces[i])
+            int k = (gpos[0] == fpos[j]) ? 0 : (gpos[1] == fpos[j]) ? 1 : 2;
+            int a = ftex[j];
+            int b = gtex[k];
+            if (a == b)
+            {
+                continue;
+            }
+            if (a < 0 || b < 0 || a >= ntexcoords || b >= ntexcoords || mesh->texcoords[a] != mesh->texcoords[b])
             {
-                return true;
+                return false;
             }
         }
-
-        return false;
+        return true;
     }
 
     std::vector<std::shared_ptr<kml::Node> > SplitNodeByFaceOrientation(std::shared_ptr<kml::Node>& node)
+    {
+        DoubleSidedMaterialMap clones;
+        return SplitNodeByFaceOrientation(node, clones);
+    }
+
+    std::vector<std::shared_ptr<kml::Node> > SplitNodeByFaceOrientation(std::shared_ptr<kml::Node>& node, DoubleSidedMaterialMap& clones)
     {
         std::vector<std::shared_ptr<kml::Node> > nodes;
+        nodes.push_back(node);
         auto& mesh = node->GetMesh();
-        if (HasDoubleSidedFace(mesh))
+        if (!mesh.get())
         {
-            nodes.push_back(node);
+            return nodes;
         }
-        else
+
+        std::vector<int> face_offsets;
+        GetFaceOffsets(mesh, face_offsets);
+        int nfaces = (int)face_offsets.size();
+        int nmaterials = (int)node->GetMaterials().size();
+
+        // the sorted corners of each triangle packed into one key, or hashed on very large meshes,
+        // with the parity of the sort telling the winding
+        int bits = 1;
+        while (bits < 32 && ((size_t)1 << bits) < mesh->positions.size())
         {
-            nodes.push_back(node);
+            bits++;
+        }
+        bool packed = 3 * bits <= 64;
+        std::vector<uint64_t> keys(nfaces);
+        std::vector<int> corners(3 * nfaces, -1);
+        std::vector<unsigned char> parities(nfaces);
+        int nchunks = (nfaces + FACE_GRAIN - 1) / FACE_GRAIN;
+        kil::ParallelFor(0, nchunks, [&](int chunk) {
+            int i1 = std::min<int>(nfaces, (chunk + 1) * FACE_GRAIN);
+            for (int i = chunk * FACE_GRAIN; i < i1; i++)
+            {
+                int matID = (i < (int)mesh->materials.size()) ? mesh->materials[i] : -1;
+                if (mesh->facenums[i] != 3 || matID < 0 || matID >= nmaterials)
+                {
+                    continue;
+                }
+                const int* face = &mesh->pos_indices[face_offsets[i]];
+                uint32_t a = face[0];
+                uint32_t b = face[1];
+                uint32_t c = face[2];
+                unsigned char parity = 0;
+                if (a > b)
+                {
+                    std::swap(a, b);
+                    parity ^= 1;
+                }
+                if (b > c)
+                {
+                    std::swap(b, c);
+                    parity ^= 1;
+                }
+                if (a > b)
+                {
+                    std::swap(a, b);
+                    parity ^= 1;
+                }
+                if (a == b || b == c)
+                {
+                    continue;
+                }
+                keys[i] = packed ? (((uint64_t)a << (2 * bits)) | ((uint64_t)b << bits) | c) : HashFace(a, b, c);
+                corners[3 * i + 0] = a;
+                corners[3 * i + 1] = b;
+                corners[3 * i + 2] = c;
+                parities[i] = parity;
+            }
+        });
+
+        std::vector<int> order;
+        order.reserve(nfaces);
+        uint64_t max_key = 0;
+        for (int i = 0; i < nfaces; i++)
+        {
+            if (corners[3 * i] >= 0)
+            {
+                order.push_back(i);
+                max_key |= keys[i];
+            }
+        }
+        RadixSortByKey(order, keys, max_key);
+
+        // pair each face with a face of the same corners, texcoords and material wound the other way;
+        // the first of the pair is kept with a double-sided material, the other dropped. Sides mapped
+        // to different parts of a texture are both kept.
+        enum
+        {
+            FACE_SINGLE,
+            FACE_DOUBLE,
+            FACE_DROPPED
+        };
+        std::vector<unsigned char> states(nfaces, FACE_SINGLE);
+        int npairs = 0;
+        for (size_t r0 = 0; r0 < order.size();)
+        {
+            size_t r1 = r0 + 1;
+            while (r1 < order.size() && keys[order[r1]] == keys[order[r0]])
+            {
+                r1++;
+            }
+            for (size_t p = r0; p < r1; p++)
+            {
+                int f = order[p];
+                if (states[f] != FACE_SINGLE)
+                {
+                    continue;
+                }
+                for (size_t q = p + 1; q < r1; q++)
+                {
+                    int g = order[q];
+                    if (states[g] == FACE_SINGLE && parities[f] != parities[g] && mesh->materials[f] == mesh->materials[g] &&
+                        std::equal(&corners[3 * f], &corners[3 * f] + 3, &corners[3 * g]) && HasSameTexcoords(mesh, face_offsets, f, g))
+                    {
+                        states[f] = FACE_DOUBLE;
+                        states[g] = FACE_DROPPED;
+                        npairs++;
+                        break;
+                    }
+                }
+            }
+            r0 = r1;
+        }
+        if (npairs == 0)
+        {
+            return nodes;
+        }
+
+        bool has_normals = !mesh->nor_indices.empty();
+        bool has_texcoords = !mesh->tex_indices.empty();
+        std::vector<unsigned char> facenums;
+        std::vector<int> materials;
+        std::vector<int> pos_indices;
+        std::vector<int> nor_indices;
+        std::vector<int> tex_indices;
+        facenums.reserve(nfaces - npairs);
+        materials.reserve(nfaces - npairs);
+        pos_indices.reserve(mesh->pos_indices.size() - 3 * npairs);
+        std::vector<int> double_ids(nmaterials, -1);
+        for (int i = 0; i < nfaces; i++)
+        {
+            if (states[i] == FACE_DROPPED)
+            {
+                continue;
+            }
+            int offset = face_offsets[i];
+            int facenum = mesh->facenums[i];
+            facenums.push_back(facenum);
+            if (i < (int)mesh->materials.size())
+            {
+                int matID = mesh->materials[i];
+                materials.push_back((states[i] == FACE_DOUBLE) ? GetDoubleSidedMaterial(node, matID, double_ids, clones) : matID);
+            }
+            pos_indices.insert(pos_indices.end(), mesh->pos_indices.begin() + offset, mesh->pos_indices.begin() + offset + facenum);
+            if (has_normals)
+            {
+                nor_indices.insert(nor_indices.end(), mesh->nor_indices.begin() + offset, mesh->nor_indices.begin() + offset + facenum);
+            }
+            if (has_texcoords)
+            {
+                tex_indices.insert(tex_indices.end(), mesh->tex_indices.begin() + offset, mesh->tex_indices.begin() + offset + facenum);
+            }
         }
+        mesh->facenums.swap(facenums);
+        mesh->materials.swap(materials);
+        mesh->pos_indices.swap(pos_indices);
+        mesh->nor_indices.swap(nor_indices);
+        mesh->tex_indices.swap(tex_indices);
 
         return nodes;
     }
 
-    static std::shared_ptr<MorphTarget> Clone(const std::shared_ptr<MorphTarget>& target)
+    namespace
+    {
+        // Renumbers the elements referenced by one submesh in order of first use. Entries of remap belong to the
+        // submesh whose id is in stamp, so one table serves every submesh without being cleared.
+        struct IndexRemap
+        {
+            std::vector<int> remap;
+            std::vector<int> stamp;
+            std::vector<int> used; // source element of each renumbered one
+
+            void Init(size_t size)
+            {
+                remap.assign(size, -1);
+                stamp.assign(size, -1);
+            }
+
+            int Map(int index, int id)
+            {
+                if (index < 0)
+                {
+                    return index;
+                }
+                if (stamp[index] != id)
+                {
+                    stamp[index] = id;
+                    remap[index] = (int)used.size();
+                    used.push_back(index);
+                }
+                return remap[index];
+            }
+        };
+    } // namespace
+
+    template <class T>
+    static void Gather(const std::vector<T>& src, const std::vector<int>& used, std::vector<T>& dst)
     {
-        std::shared_ptr<MorphTarget> ret(new MorphTarget());
-        ret->positions = target->positions;
-        ret->normals = target->normals;
-        return ret;
+        dst.resize(used.size());
+        for (size_t i = 0; i < used.size(); i++)
+        {
+            dst[i] = src[used[i]];
+        }
     }
 
     std::vector<std::shared_ptr<kml::Node> > SplitNodeByMaterialID(std::shared_ptr<kml::Node>& node)
@@ -200,68 +429,129 @@ namespace kml
         }
         else
         {
-            std::vector<std::shared_ptr<kml::Mesh> > meshes;
-            for (size_t i = 0; i < materials.size(); i++)
+            int nmaterials = (int)materials.size();
+            size_t nfaces = mesh->facenums.size();
+            bool has_normals = !mesh->nor_indices.empty();
+            bool has_texcoords = !mesh->tex_indices.empty();
+
+            // faces of each material in order, with the corner each starts at
+            std::vector<int> face_offsets(nfaces);
+            std::vector<int> material_offsets(nmaterials + 1, 0);
             {
-                meshes.push_back(std::shared_ptr<kml::Mesh>(new kml::Mesh()));
-                if (mesh->skin_weight.get())
+                int offset = 0;
+                for (size_t i = 0; i < nfaces; i++)
                 {
-                    meshes[i]->skin_weight = std::shared_ptr<kml::SkinWeight>(new kml::SkinWeight());
+                    face_offsets[i] = offset;
+                    offset += mesh->facenums[i];
+                    int matID = mesh->materials[i];
+                    if (0 <= matID && matID < nmaterials)
+                    {
+                        material_offsets[matID + 1]++;
+                    }
                 }
-                if (mesh->morph_targets.get())
+                for (int i = 0; i < nmaterials; i++)
                 {
-                    meshes[i]->morph_targets = std::shared_ptr<kml::MorphTargets>(new kml::MorphTargets());
+                    material_offsets[i + 1] += material_offsets[i];
                 }
             }
-
-            int offset = 0;
-            for (size_t i = 0; i < mesh->materials.size(); i++)
+            std::vector<int> material_faces(material_offsets[nmaterials]);
             {
-                int matID = mesh->materials[i];
-                int facenum = mesh->facenums[i];
-                if (0 <= matID && matID < meshes.size())
+                std::vector<int> cursors(material_offsets.begin(), material_offsets.end() - 1);
+                for (size_t i = 0; i < nfaces; i++)
                 {
-                    meshes[matID]->facenums.push_back(facenum);
-                    meshes[matID]->materials.push_back(0);
-                    for (int j = 0; j < facenum; j++)
+                    int matID = mesh->materials[i];
+                    if (0 <= matID && matID < nmaterials)
                     {
-                        meshes[matID]->pos_indices.push_back(mesh->pos_indices[offset + j]);
-                        meshes[matID]->tex_indices.push_back(mesh->tex_indices[offset + j]);
-                        meshes[matID]->nor_indices.push_back(mesh->nor_indices[offset + j]);
+                        material_faces[cursors[matID]++] = (int)i;
                     }
                 }
-
-                offset += facenum;
             }
-            for (int i = 0; i < materials.size(); i++)
+
+            IndexRemap pos_remap;
+            IndexRemap nor_remap;
+            IndexRemap tex_remap;
+            pos_remap.Init(mesh->positions.size());
+            nor_remap.Init(mesh->normals.size());
+            tex_remap.Init(mesh->texcoords.size());
+
+            for (int i = 0; i < nmaterials; i++)
             {
-                if (meshes[i]->facenums.empty())
+                int begin = material_offsets[i];
+                int end = material_offsets[i + 1];
+                if (begin == end)
                 {
                     continue;
                 }
-                meshes[i]->positions = mesh->positions;
-                meshes[i]->texcoords = mesh->texcoords;
-                meshes[i]->normals = mesh->normals;
-                meshes[i]->name = mesh->name;
+
+                std::shared_ptr<kml::Mesh> sub(new kml::Mesh());
+                sub->name = mesh->name;
+                sub->facenums.reserve(end - begin);
+                sub->materials.assign(end - begin, 0);
+                pos_remap.used.clear();
+                nor_remap.used.clear();
+                tex_remap.used.clear();
+                for (int k = begin; k < end; k++)
+                {
+                    int f = material_faces[k];
+                    int facenum = mesh->facenums[f];
+                    int offset = face_offsets[f];
+                    sub->facenums.push_back(facenum);
+                    for (int j = 0; j < facenum; j++)
+                    {
+                        sub->pos_indices.push_back(pos_remap.Map(mesh->pos_indices[offset + j], i));
+                        if (has_normals)
+                        {
+                            sub->nor_indices.push_back(nor_remap.Map(mesh->nor_indices[offset + j], i));
+                        }
+                        if (has_texcoords)
+                        {
+                            sub->tex_indices.push_back(tex_remap.Map(mesh->tex_indices[offset + j], i));
+                        }
+                    }
+                }
+
+                Gather(mesh->positions, pos_remap.used, sub->positions);
+                Gather(mesh->normals, nor_remap.used, sub->normals);
+                Gather(mesh->texcoords, tex_remap.used, sub->texcoords);
+                if (mesh->tangents.size() == mesh->positions.size())
+                {
+                    Gather(mesh->tangents, pos_remap.used, sub->tangents);
+                }
 
                 if (mesh->skin_weight.get())
                 {
-                    *(meshes[i]->skin_weight) = *(mesh->skin_weight);
+                    sub->skin_weight = std::shared_ptr<kml::SkinWeight>(new kml::SkinWeight());
+                    sub->skin_weight->name = mesh->skin_weight->name;
+                    sub->skin_weight->joint_paths = mesh->skin_weight->joint_paths;
+                    sub->skin_weight->joint_bind_matrices = mesh->skin_weight->joint_bind_matrices;
+                    Gather(mesh->skin_weight->weights, pos_remap.used, sub->skin_weight->weights);
                 }
 
                 if (mesh->morph_targets.get())
                 {
+                    sub->morph_targets = std::shared_ptr<kml::MorphTargets>(new kml::MorphTargets());
                     int tsz = mesh->morph_targets->targets.size();
                     for (int j = 0; j < tsz; j++)
                     {
-                        meshes[i]->morph_targets->targets.push_back(Clone(mesh->morph_targets->targets[j]));
+                        const std::shared_ptr<MorphTarget>& target = mesh->morph_targets->targets[j];
+                        std::shared_ptr<MorphTarget> ret(new MorphTarget());
+                        Gather(target->positions, pos_remap.used, ret->positions);
+                        if (target->normals.size() == mesh->normals.size())
+                        {
+                            Gather(target->normals, nor_remap.used, ret->normals);
+                        }
+                        else if (target->normals.size() == mesh->positions.size())
+                        {
+                            Gather(target->normals, pos_remap.used, ret->normals);
+                        }
+                        sub->morph_targets->targets.push_back(ret);
                     }
-                    meshes[i]->morph_targets->weights = mesh->morph_targets->weights;
-                    meshes[i]->morph_targets->names = mesh->morph_targets->names;
+                    sub->morph_targets->weights = mesh->morph_targets->weights;
+                    sub->morph_targets->names = mesh->morph_targets->names;
                 }
 
                 std::shared_ptr<kml::Node> tnode = std::shared_ptr<kml::Node>(new kml::Node());
-                tnode->SetMesh(meshes[i]);
+                tnode->SetMesh(sub);
                 tnode->AddMaterial(materials[i]);
 
                 int k = (int)nodes.size();
@@ -274,7 +564,7 @@ namespace kml
                 tnode->SetOriginalPath(node->GetPath());
                 tnode->SetVisiblity(node->GetVisibility());
                 tnode->GetTransform()->SetMatrix(node->GetTransform()->GetMatrix());
-                tnode->SetBound(kml::CalculateBound(mesh));
+                tnode->SetBound(kml::CalculateBound(sub));
 
                 nodes.push_back(tnode);
             }
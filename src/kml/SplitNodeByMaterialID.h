@@ -5,13 +5,25 @@
 #include "Compatibility.h"
 #include "Mesh.h"
 #include "Node.h"
+#include <map>
 #include <memory>
 #include <vector>
 
 namespace kml
 {
+    // Double-sided copies made so far, by source material.
+    typedef std::map<std::shared_ptr<Material>, std::shared_ptr<Material> > DoubleSidedMaterialMap;
+
+    // Moves the faces whose corner normals mostly point away from their winding, by more than about 96 degrees,
+    // to a copy of their material with the "DoubleSided" integer set. Windings are left as they are. Returns the node.
     std::vector<std::shared_ptr<kml::Node> > SplitNodeByFaceNormal(std::shared_ptr<kml::Node>& node);
+    // Same, reusing the copies in clones so that nodes sharing a material share its double-sided copy too.
+    std::vector<std::shared_ptr<kml::Node> > SplitNodeByFaceNormal(std::shared_ptr<kml::Node>& node, DoubleSidedMaterialMap& clones);
+    // Finds the pairs of triangles sharing corners, texcoords and material but wound the other way, keeps the first of each pair
+    // with a "DoubleSided" copy of its material and removes the other, so the remaining faces can be back-face culled.
+    // Returns the node; SplitNodeByMaterialID or the glTF exporter then put the double-sided faces in their own primitive.
     std::vector<std::shared_ptr<kml::Node> > SplitNodeByFaceOrientation(std::shared_ptr<kml::Node>& node);
+    std::vector<std::shared_ptr<kml::Node> > SplitNodeByFaceOrientation(std::shared_ptr<kml::Node>& node, DoubleSidedMaterialMap& clones);
     std::vector<std::shared_ptr<kml::Node> > SplitNodeByMaterialID(std::shared_ptr<kml::Node>& node);
 } // namespace kml
 
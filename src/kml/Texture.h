@@ -42,6 +42,7 @@ namespace kml
         {
             m_textureFilePath = rh.m_textureFilePath;
             m_cacheTextureFilePath = rh.m_cacheTextureFilePath;
+            m_compressedTextureFilePath = rh.m_compressedTextureFilePath;
             m_colorSpace = rh.m_colorSpace;
             m_repeatU = rh.m_repeatU;
             m_repeatV = rh.m_repeatV;
@@ -80,6 +81,17 @@ namespace kml
             return m_cacheTextureFilePath;
         }
 
+        // Block compressed (KTX2) version of the texture, written as KSK_texture_bc
+        void SetCompressedFilePath(const std::string& filePath)
+        {
+            m_compressedTextureFilePath = filePath;
+        }
+
+        std::string GetCompressedFilePath() const
+        {
+            return m_compressedTextureFilePath;
+        }
+
         void SetUDIMFilePath(const std::string& filePath)
         {
             m_udimTextureFilePath = filePath;
@@ -239,6 +251,7 @@ namespace kml
     protected:
         std::string m_textureFilePath;
         std::string m_cacheTextureFilePath;
+        std::string m_compressedTextureFilePath;
         std::string m_udimTextureFilePath;
         std::string m_colorSpace; // sRGB, Raw, ...
         float m_repeatU, m_repeatV;
@@ -0,0 +1,58 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "TextureBakeUtil.h"
+
+#include <stdio.h>
+
+namespace kml
+{
+    void GetShapeNodes(std::vector<std::shared_ptr<Node> >& nodes, const std::shared_ptr<Node>& node)
+    {
+        if (node->GetMesh().get())
+        {
+            nodes.push_back(node);
+        }
+        const std::vector<std::shared_ptr<Node> >& children = node->GetChildren();
+        for (size_t i = 0; i < children.size(); i++)
+        {
+            GetShapeNodes(nodes, children[i]);
+        }
+    }
+
+    std::shared_ptr<Material> GetFaceMaterial(const std::shared_ptr<Node>& node, const std::shared_ptr<Mesh>& mesh, size_t face)
+    {
+        const std::vector<std::shared_ptr<Material> >& materials = node->GetMaterials();
+        if (materials.size() == 1)
+        {
+            return materials[0];
+        }
+        if (face < mesh->materials.size())
+        {
+            int id = mesh->materials[face];
+            if (0 <= id && id < (int)materials.size())
+            {
+                return materials[id];
+            }
+        }
+        return std::shared_ptr<Material>();
+    }
+
+    bool FileExists(const std::string& path)
+    {
+        FILE* fp = fopen(path.c_str(), "rb");
+        if (fp)
+        {
+            fclose(fp);
+            return true;
+        }
+        return false;
+    }
+
+    std::string ResolvePath(const std::string& base_dir, const std::string& path)
+    {
+        if (FileExists(path))
+        {
+            return path;
+        }
+        return base_dir + path;
+    }
+} // namespace kml
@@ -0,0 +1,25 @@
+#pragma once
+#ifndef _KML_TEXTURE_BAKE_UTIL_H_
+#define _KML_TEXTURE_BAKE_UTIL_H_
+
+#include "Material.h"
+#include "Mesh.h"
+#include "Node.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace kml
+{
+    // Helpers shared by the texture passes (PackTextureAtlas, PackORMTextures, BakeUDIMTextures).
+
+    // Appends node and its descendants that have a mesh, in pre-order.
+    void GetShapeNodes(std::vector<std::shared_ptr<Node> >& nodes, const std::shared_ptr<Node>& node);
+    // Material of a face, NULL when its material ID is out of range. A single material covers every face.
+    std::shared_ptr<Material> GetFaceMaterial(const std::shared_ptr<Node>& node, const std::shared_ptr<Mesh>& mesh, size_t face);
+    bool FileExists(const std::string& path);
+    // path as it is when it exists, otherwise relative to base_dir.
+    std::string ResolvePath(const std::string& base_dir, const std::string& path);
+} // namespace kml
+
+#endif
@@ -1,7 +1,18 @@
 #include "TriangulateMesh.h"
+#include "PolygonTriangulation.h"
+
+#include <kil/ParallelFor.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <glm/glm.hpp>
 
 namespace kml
 {
+    static const int FACE_GRAIN = 4096;
+
     static bool HasQuadFace(const std::shared_ptr<Mesh>& mesh)
     {
         for (size_t i = 0; i < mesh->facenums.size(); i++)
@@ -20,102 +31,85 @@ namespace kml
         {
             return true;
         }
-        std::vector<int> pos_indices;
-        std::vector<int> nor_indices;
-        std::vector<int> tex_indices;
-        std::vector<unsigned char> facenums;
-        std::vector<int> materials;
-        size_t offset = 0;
+        size_t nfaces = mesh->facenums.size();
+        bool has_normals = mesh->nor_indices.size() > 0;
+        bool has_texcoords = mesh->tex_indices.size() > 0;
 
-        for (size_t i = 0; i < mesh->facenums.size(); i++)
+        // corners and triangles before each face, so faces can be written independently
+        std::vector<int> face_offsets(nfaces + 1);
+        std::vector<int> tri_offsets(nfaces + 1);
         {
-            int nf = mesh->facenums[i];
-            if (nf == 3)
+            int offset = 0;
+            int ntris = 0;
+            for (size_t i = 0; i < nfaces; i++)
             {
-                facenums.push_back(nf);
-                for (int j = 0; j < nf; j++)
-                {
-                    pos_indices.push_back(mesh->pos_indices[offset + j]);
-                    if(mesh->nor_indices.size() > 0)
-                    {
-                        nor_indices.push_back(mesh->nor_indices[offset + j]);
-                    }
-                    if(mesh->tex_indices.size() > 0)
-                    {
-                        tex_indices.push_back(mesh->tex_indices[offset + j]);
-                    }
-                }
-                materials.push_back(mesh->materials[i]);
+                face_offsets[i] = offset;
+                tri_offsets[i] = ntris;
+                offset += mesh->facenums[i];
+                ntris += std::max<int>(0, mesh->facenums[i] - 2);
             }
-            else if (nf == 4)
-            {
-                //assert(nf == 4);
-                facenums.push_back(3);
-                facenums.push_back(3);
-
-                //
-                pos_indices.push_back(mesh->pos_indices[offset + 0]);
-                pos_indices.push_back(mesh->pos_indices[offset + 1]);
-                pos_indices.push_back(mesh->pos_indices[offset + 3]);
+            face_offsets[nfaces] = offset;
+            tri_offsets[nfaces] = ntris;
+        }
 
-                pos_indices.push_back(mesh->pos_indices[offset + 1]);
-                pos_indices.push_back(mesh->pos_indices[offset + 2]);
-                pos_indices.push_back(mesh->pos_indices[offset + 3]);
+        int ntris = tri_offsets[nfaces];
+        std::vector<unsigned char> facenums(ntris, 3);
+        std::vector<int> materials(ntris);
+        std::vector<int> pos_indices(3 * ntris);
+        std::vector<int> nor_indices(has_normals ? 3 * ntris : 0);
+        std::vector<int> tex_indices(has_texcoords ? 3 * ntris : 0);
 
-                //
-                if(mesh->nor_indices.size() > 0)
+        int nchunks = (int)((nfaces + FACE_GRAIN - 1) / FACE_GRAIN);
+        kil::ParallelFor(0, nchunks, [&](int chunk) {
+            std::vector<int> remain;
+            std::vector<glm::vec2> points;
+            std::vector<int> tris;
+            size_t i1 = std::min<size_t>(nfaces, (size_t)(chunk + 1) * FACE_GRAIN);
+            for (size_t i = (size_t)chunk * FACE_GRAIN; i < i1; i++)
+            {
+                int nf = mesh->facenums[i];
+                if (nf < 3)
                 {
-                    nor_indices.push_back(mesh->nor_indices[offset + 0]);
-                    nor_indices.push_back(mesh->nor_indices[offset + 1]);
-                    nor_indices.push_back(mesh->nor_indices[offset + 3]);
-
-                    nor_indices.push_back(mesh->nor_indices[offset + 1]);
-                    nor_indices.push_back(mesh->nor_indices[offset + 2]);
-                    nor_indices.push_back(mesh->nor_indices[offset + 3]);
+                    continue;
                 }
-                //
-                if(mesh->tex_indices.size() > 0)
+                int offset = face_offsets[i];
+                const int* face = &mesh->pos_indices[offset];
+                tris.resize(3 * (nf - 2));
+                if (nf == 3)
                 {
-                    tex_indices.push_back(mesh->tex_indices[offset + 0]);
-                    tex_indices.push_back(mesh->tex_indices[offset + 1]);
-                    tex_indices.push_back(mesh->tex_indices[offset + 3]);
-
-                    tex_indices.push_back(mesh->tex_indices[offset + 1]);
-                    tex_indices.push_back(mesh->tex_indices[offset + 2]);
-                    tex_indices.push_back(mesh->tex_indices[offset + 3]);
+                    tris[0] = 0;
+                    tris[1] = 1;
+                    tris[2] = 2;
                 }
-
-                materials.push_back(mesh->materials[i]);
-                materials.push_back(mesh->materials[i]);
-            }
-            else
-            {
-                int nn = nf - 2;
-                for (int j = 0; j < nn; j++)
+                else if (nf == 4)
+                {
+                    TriangulateQuad(mesh->positions, face, &tris[0]);
+                }
+                else
                 {
-                    facenums.push_back(3);
-                    materials.push_back(mesh->materials[i]);
-                    pos_indices.push_back(mesh->pos_indices[offset + 0]);
-                    pos_indices.push_back(mesh->pos_indices[offset + j + 1]);
-                    pos_indices.push_back(mesh->pos_indices[offset + j + 2]);
+                    TriangulatePolygon(mesh->positions, face, nf, &tris[0], remain, points);
+                }
 
-                    if(mesh->nor_indices.size() > 0)
+                int dst = 3 * tri_offsets[i];
+                for (size_t j = 0; j < tris.size(); j++)
+                {
+                    pos_indices[dst + j] = mesh->pos_indices[offset + tris[j]];
+                    if (has_normals)
                     {
-                        nor_indices.push_back(mesh->nor_indices[offset + 0]);
-                        nor_indices.push_back(mesh->nor_indices[offset + j + 1]);
-                        nor_indices.push_back(mesh->nor_indices[offset + j + 2]);
+                        nor_indices[dst + j] = mesh->nor_indices[offset + tris[j]];
                     }
-
-                    if(mesh->tex_indices.size() > 0)
+                    if (has_texcoords)
                     {
-                        tex_indices.push_back(mesh->tex_indices[offset + 0]);
-                        tex_indices.push_back(mesh->tex_indices[offset + j + 1]);
-                        tex_indices.push_back(mesh->tex_indices[offset + j + 2]);
+                        tex_indices[dst + j] = mesh->tex_indices[offset + tris[j]];
                     }
                 }
+                for (int j = tri_offsets[i]; j < tri_offsets[i + 1]; j++)
+                {
+                    materials[j] = mesh->materials[i];
+                }
             }
-            offset += nf;
-        }
+        });
+
         mesh->facenums.swap(facenums);
         mesh->pos_indices.swap(pos_indices);
         mesh->nor_indices.swap(nor_indices);
@@ -0,0 +1,277 @@
+#include "WeldMesh.h"
+
+#include <kil/ParallelFor.h>
+
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+namespace kml
+{
+    static const int GRAIN = 4096;
+
+    static uint64_t HashCell(const int64_t* cell, int dims)
+    {
+        static const uint64_t PRIMES[3] = {0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL, 0x165667B19E3779F9ULL};
+        uint64_t h = 0;
+        for (int k = 0; k < dims; k++)
+        {
+            h ^= (uint64_t)cell[k] * PRIMES[k];
+        }
+        h ^= h >> 31;
+        h *= 0xBF58476D1CE4E5B9ULL;
+        h ^= h >> 29;
+        return h;
+    }
+
+    // Cell of p in a grid of cells twice the tolerance wide, and for each axis the side of the cell p is nearer to;
+    // a point within the tolerance is in this cell or one beyond those sides. Returns false for points out of the grid.
+    template <class V>
+    static bool GetCell(const V& p, int dims, double inv_cell, int64_t* cell, int* sides)
+    {
+        for (int k = 0; k < dims; k++)
+        {
+            double x = (double)p[k] * inv_cell;
+            double c = std::floor(x);
+            if (!(std::fabs(c) < 1e18))
+            {
+                return false;
+            }
+            cell[k] = (int64_t)c;
+            sides[k] = (x - c < 0.5) ? -1 : 1;
+        }
+        return true;
+    }
+
+    namespace
+    {
+        // Open addressing table from the hash of a cell to its run of points sorted by cell.
+        struct CellTable
+        {
+            std::vector<uint64_t> keys;
+            std::vector<int> offsets; // points of cell c are [offsets[c], offsets[c + 1])
+            std::vector<int> slots;
+            size_t mask;
+
+            void Build(const std::vector<std::pair<uint64_t, int> >& sorted)
+            {
+                keys.clear();
+                offsets.clear();
+                for (size_t i = 0; i < sorted.size(); i++)
+                {
+                    if (i == 0 || sorted[i].first != sorted[i - 1].first)
+                    {
+                        keys.push_back(sorted[i].first);
+                        offsets.push_back((int)i);
+                    }
+                }
+                offsets.push_back((int)sorted.size());
+                size_t size = 16;
+                while (size < 2 * keys.size())
+                {
+                    size *= 2;
+                }
+                mask = size - 1;
+                slots.assign(size, -1);
+                for (size_t c = 0; c < keys.size(); c++)
+                {
+                    size_t s = keys[c] & mask;
+                    while (slots[s] >= 0)
+                    {
+                        s = (s + 1) & mask;
+                    }
+                    slots[s] = (int)c;
+                }
+            }
+
+            int Find(uint64_t key) const
+            {
+                for (size_t s = key & mask; slots[s] >= 0; s = (s + 1) & mask)
+                {
+                    if (keys[slots[s]] == key)
+                    {
+                        return slots[s];
+                    }
+                }
+                return -1;
+            }
+        };
+    } // namespace
+
+    // Points are taken in order, each merging into the lowest numbered earlier representative within the tolerance
+    // or becoming a representative itself, so every point stays within the tolerance of the point it merges into.
+    // used receives the source of each welded point, remap the welded point of each source one.
+    // Returns false when nothing merges.
+    template <class V>
+    static bool WeldPoints(const std::vector<V>& points, int dims, float tolerance, std::vector<int>& remap, std::vector<int>& used)
+    {
+        int npoints = (int)points.size();
+        if (!(tolerance > 0.0f) || npoints < 2)
+        {
+            return false;
+        }
+        double inv_cell = 0.5 / tolerance;
+        float tolerance2 = tolerance * tolerance;
+        int nchunks = (npoints + GRAIN - 1) / GRAIN;
+
+        std::vector<std::pair<uint64_t, int> > cells(npoints);
+        std::vector<unsigned char> gridded(npoints);
+        kil::ParallelFor(0, nchunks, [&](int chunk) {
+            int i1 = std::min<int>(npoints, (chunk + 1) * GRAIN);
+            for (int i = chunk * GRAIN; i < i1; i++)
+            {
+                int64_t cell[3];
+                int sides[3];
+                gridded[i] = GetCell(points[i], dims, inv_cell, cell, sides);
+                cells[i] = std::make_pair(gridded[i] ? HashCell(cell, dims) : ~(uint64_t)0, i);
+            }
+        });
+        std::sort(cells.begin(), cells.end());
+        CellTable table;
+        table.Build(cells);
+
+        // the representatives of cell c so far are reps[offsets[c]...], there are never more than points in it;
+        // being further apart than the tolerance, only a few fit in a cell
+        std::vector<int> point_cells(npoints);
+        for (size_t c = 0; c + 1 < table.offsets.size(); c++)
+        {
+            for (int j = table.offsets[c]; j < table.offsets[c + 1]; j++)
+            {
+                point_cells[cells[j].second] = (int)c;
+            }
+        }
+        std::vector<int> reps(npoints);
+        std::vector<int> nreps(table.keys.size(), 0);
+
+        remap.resize(npoints);
+        used.clear();
+        int nneighbors = 1 << dims;
+        for (int i = 0; i < npoints; i++)
+        {
+            int target = -1;
+            int64_t cell[3];
+            int sides[3];
+            if (gridded[i] && GetCell(points[i], dims, inv_cell, cell, sides))
+            {
+                for (int o = 0; o < nneighbors; o++)
+                {
+                    int64_t neighbor[3];
+                    for (int k = 0; k < dims; k++)
+                    {
+                        neighbor[k] = cell[k] + (((o >> k) & 1) ? sides[k] : 0);
+                    }
+                    // hash collisions only cost distance tests
+                    int c = table.Find(HashCell(neighbor, dims));
+                    if (c < 0)
+                    {
+                        continue;
+                    }
+                    for (int k = table.offsets[c]; k < table.offsets[c] + nreps[c]; k++)
+                    {
+                        int j = reps[k];
+                        if (target >= 0 && j > target)
+                        {
+                            break;
+                        }
+                        const V& q = points[j];
+                        float d2 = 0.0f;
+                        for (int m = 0; m < dims; m++)
+                        {
+                            float d = q[m] - points[i][m];
+                            d2 += d * d;
+                        }
+                        if (d2 <= tolerance2)
+                        {
+                            target = j;
+                            break;
+                        }
+                    }
+                }
+            }
+            if (target >= 0)
+            {
+                remap[i] = remap[target];
+            }
+            else
+            {
+                if (gridded[i])
+                {
+                    int c = point_cells[i];
+                    reps[table.offsets[c] + nreps[c]++] = i;
+                }
+                remap[i] = (int)used.size();
+                used.push_back(i);
+            }
+        }
+        return (int)used.size() < npoints;
+    }
+
+    template <class T>
+    static void Gather(std::vector<T>& values, const std::vector<int>& used)
+    {
+        std::vector<T> tmp(used.size());
+        for (size_t i = 0; i < used.size(); i++)
+        {
+            tmp[i] = values[used[i]];
+        }
+        values.swap(tmp);
+    }
+
+    static void RemapIndices(std::vector<int>& indices, const std::vector<int>& remap)
+    {
+        int nindices = (int)indices.size();
+        int nchunks = (nindices + GRAIN - 1) / GRAIN;
+        kil::ParallelFor(0, nchunks, [&](int chunk) {
+            int i1 = std::min<int>(nindices, (chunk + 1) * GRAIN);
+            for (int i = chunk * GRAIN; i < i1; i++)
+            {
+                int index = indices[i];
+                if (0 <= index && index < (int)remap.size())
+                {
+                    indices[i] = remap[index];
+                }
+            }
+        });
+    }
+
+    bool WeldMesh(std::shared_ptr<Mesh>& mesh, float tolerance, float normal_tolerance, float texcoord_tolerance)
+    {
+        std::vector<int> remap;
+        std::vector<int> used;
+        bool deformed = mesh->skin_weight.get() || mesh->morph_targets.get();
+        if (!deformed && WeldPoints(mesh->positions, 3, tolerance, remap, used))
+        {
+            if (mesh->tangents.size() == mesh->positions.size())
+            {
+                Gather(mesh->tangents, used);
+            }
+            Gather(mesh->positions, used);
+            RemapIndices(mesh->pos_indices, remap);
+        }
+        if (!mesh->nor_indices.empty() && WeldPoints(mesh->normals, 3, normal_tolerance, remap, used))
+        {
+            Gather(mesh->normals, used);
+            RemapIndices(mesh->nor_indices, remap);
+        }
+        if (!mesh->tex_indices.empty() && WeldPoints(mesh->texcoords, 2, texcoord_tolerance, remap, used))
+        {
+            Gather(mesh->texcoords, used);
+            RemapIndices(mesh->tex_indices, remap);
+        }
+        return true;
+    }
+
+    bool WeldMesh(std::shared_ptr<Mesh>& mesh, const std::shared_ptr<Options>& opts)
+    {
+        float tolerance = opts->GetFloat("weld_tolerance", 0.0f);
+        if (!(tolerance > 0.0f))
+        {
+            return true;
+        }
+        float normal_tolerance = opts->GetFloat("weld_normal_tolerance", 0.001f);
+        float texcoord_tolerance = opts->GetFloat("weld_texcoord_tolerance", 0.00001f);
+        return WeldMesh(mesh, tolerance, normal_tolerance, texcoord_tolerance);
+    }
+} // namespace kml
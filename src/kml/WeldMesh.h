@@ -0,0 +1,25 @@
+#pragma once
+#ifndef _KML_WELD_MESH_H_
+#define _KML_WELD_MESH_H_
+
+#include "Mesh.h"
+#include "Options.h"
+#include <memory>
+
+namespace kml
+{
+    // Merges positions, normals and texcoords that lie within the tolerance of one another, for scanned or tessellated
+    // meshes full of near-duplicates. Run before FlatIndicesMesh to shrink its vertex count. Each array is welded on
+    // its own, so corners on a UV or normal seam keep their own texcoord or normal and still split there.
+    // Each point merges into the first kept point within the tolerance, never further along a chain of merges.
+    // A tolerance of 0 leaves that array as it is. Positions of skinned or morphed meshes are never merged.
+    // Faces that collapse are left for RemoveNoAreaMesh.
+    bool WeldMesh(std::shared_ptr<Mesh>& mesh, float tolerance, float normal_tolerance, float texcoord_tolerance);
+    // Options:
+    //   weld_tolerance          : positions closer than this are merged (float, 0 disables welding)
+    //   weld_normal_tolerance   : normals closer than this are merged (float, 0.001)
+    //   weld_texcoord_tolerance : texcoords closer than this are merged (float, 0.00001)
+    bool WeldMesh(std::shared_ptr<Mesh>& mesh, const std::shared_ptr<Options>& opts);
+} // namespace kml
+
+#endif
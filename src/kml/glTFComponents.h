@@ -12,6 +12,7 @@
 
 #include <glm/glm.hpp>
 
+#include "OutputSink.h"
 #include "glTFConstants.h"
 
 #include <glm/glm.hpp>
@@ -29,8 +30,22 @@ namespace kml
         {
         public:
             Buffer(const std::string& name, int index)
-                : name_(name), index_(index)
+                : name_(name), index_(index), size_(0), good_(true)
+            {
+            }
+            // Bytes added after this go straight to the sink instead of memory.
+            void SetSink(const std::shared_ptr<OutputSink>& sink)
+            {
+                sink_ = sink;
+            }
+            bool IsStreaming() const
+            {
+                return sink_.get() != NULL;
+            }
+            // False if writing to the sink failed.
+            bool IsGood() const
             {
+                return good_;
             }
             const std::string& GetName() const
             {
@@ -46,13 +61,21 @@ namespace kml
             }
             void AddBytes(const unsigned char bytes[], size_t sz)
             {
-                size_t offset = bytes_.size();
-                bytes_.resize(offset + sz);
-                memcpy(&bytes_[offset], bytes, sz);
+                if (sink_.get())
+                {
+                    good_ = good_ && sink_->Write(bytes, sz);
+                }
+                else
+                {
+                    size_t offset = bytes_.size();
+                    bytes_.resize(offset + sz);
+                    memcpy(&bytes_[offset], bytes, sz);
+                }
+                size_ += sz;
             }
             size_t GetSize() const
             {
-                return bytes_.size();
+                return size_;
             }
             size_t GetByteLength() const
             {
@@ -66,7 +89,10 @@ namespace kml
         protected:
             std::string name_;
             int index_;
+            size_t size_;
+            bool good_;
             std::vector<unsigned char> bytes_;
+            std::shared_ptr<OutputSink> sink_;
         };
 
         class BufferView
@@ -161,7 +187,7 @@ namespace kml
             }
             void ClearBytes()
             {
-                bytes_.clear();
+                std::vector<unsigned char>().swap(bytes_);
             }
             const unsigned char* GetBytesPtr() const
             {
@@ -383,17 +409,16 @@ namespace kml
             std::map<std::string, std::shared_ptr<Accessor> > accessors_;
         };
 
-        class Mesh
+        // One draw of a mesh: its material, index accessor and vertex attributes. Primitives of a mesh
+        // written without Draco share the attribute accessors and differ only in their index ranges.
+        class Primitive
         {
         public:
-            Mesh(const std::string& name, int index)
-                : name_(name), index_(index)
+            Primitive(int index)
+                : index_(index)
             {
                 mode_ = GLTF_MODE_TRIANGLES;
-            }
-            const std::string& GetName() const
-            {
-                return name_;
+                materialID_ = 0;
             }
             int GetIndex() const
             {
@@ -407,7 +432,7 @@ namespace kml
             {
                 materialID_ = id;
             }
-            int GetMaterialID()
+            int GetMaterialID() const
             {
                 return materialID_;
             }
@@ -451,14 +476,6 @@ namespace kml
                     return std::shared_ptr<BufferView>();
                 }
             }
-            void AddTarget(const std::shared_ptr<MorphTarget>& target)
-            {
-                morph_targets.push_back(target);
-            }
-            const std::vector<std::shared_ptr<MorphTarget> > GetTargets() const
-            {
-                return morph_targets;
-            }
             void SetOrderInDraco(const std::string& name, int order)
             {
                 orderInDraco_[name] = order;
@@ -479,16 +496,53 @@ namespace kml
             }
 
         protected:
-            std::string name_;
             int index_;
             int mode_;
             int materialID_;
             std::map<std::string, std::shared_ptr<Accessor> > accessors_;
             std::map<std::string, std::shared_ptr<BufferView> > bufferViews_;
-            std::vector<std::shared_ptr<MorphTarget> > morph_targets;
             mutable std::map<std::string, int> orderInDraco_;
         };
 
+        class Mesh
+        {
+        public:
+            Mesh(const std::string& name, int index)
+                : name_(name), index_(index)
+            {
+            }
+            const std::string& GetName() const
+            {
+                return name_;
+            }
+            int GetIndex() const
+            {
+                return index_;
+            }
+            void AddPrimitive(const std::shared_ptr<Primitive>& primitive)
+            {
+                primitives_.push_back(primitive);
+            }
+            const std::vector<std::shared_ptr<Primitive> >& GetPrimitives() const
+            {
+                return primitives_;
+            }
+            void AddTarget(const std::shared_ptr<MorphTarget>& target)
+            {
+                morph_targets.push_back(target);
+            }
+            const std::vector<std::shared_ptr<MorphTarget> > GetTargets() const
+            {
+                return morph_targets;
+            }
+
+        protected:
+            std::string name_;
+            int index_;
+            std::vector<std::shared_ptr<Primitive> > primitives_;
+            std::vector<std::shared_ptr<MorphTarget> > morph_targets;
+        };
+
         class Skin;
 
         class Joint
@@ -10,13 +10,19 @@
 #include "glTFConstants.h"
 #include "glTFExporter.h"
 
+#include "ExportCache.h"
+#include "GLTF2GLB.h"
 #include "Options.h"
+#include "OutputSink.h"
 #include "SaveToDraco.h"
 #include "Texture.h"
 #include "TriangulateMesh.h"
 
+#include <algorithm>
 #include <climits>
 #include <fstream>
+#include <functional>
+#include <map>
 #include <set>
 #include <vector>
 
@@ -197,6 +203,20 @@ namespace kml
         }
     }
 
+    static void GetCompressedImages(std::vector<std::string>& image_vec, const std::vector<std::shared_ptr<kml::Texture> >& texture_vec)
+    {
+        std::set<std::string> image_set;
+        for (size_t j = 0; j < texture_vec.size(); j++)
+        {
+            std::string path = texture_vec[j]->GetCompressedFilePath();
+            if (!path.empty() && image_set.find(path) == image_set.end())
+            {
+                image_set.insert(path);
+                image_vec.push_back(path);
+            }
+        }
+    }
+
     static std::string GetExt(const std::string& filepath)
     {
         if (filepath.find_last_of(".") != std::string::npos)
@@ -354,14 +374,130 @@ namespace kml
             }
         }
 
+        // Vertex attributes of a mesh as written to the buffers.
+        struct VertexArrays
+        {
+            std::vector<float> positions;
+            std::vector<float> normals;
+            std::vector<float> texcoords;
+            std::vector<float> tangents;
+            std::vector<unsigned short> joints;
+            std::vector<float> weights;
+        };
+
+        // Corner indices grouped by face material in order of first use; group i is [offsets[i], offsets[i + 1]).
+        static void GetPrimitiveIndices(const std::shared_ptr< ::kml::Mesh>& in_mesh, std::vector<int>& materials, std::vector<size_t>& offsets, std::vector<unsigned int>& indices)
+        {
+            size_t nfaces = in_mesh->facenums.size();
+            std::map<int, int> groups;
+            std::vector<int> face_groups(nfaces);
+            std::vector<size_t> counts;
+            for (size_t i = 0; i < nfaces; i++)
+            {
+                int material_id = (i < in_mesh->materials.size()) ? in_mesh->materials[i] : 0;
+                std::map<int, int>::iterator it = groups.find(material_id);
+                if (it == groups.end())
+                {
+                    it = groups.insert(std::make_pair(material_id, (int)materials.size())).first;
+                    materials.push_back(material_id);
+                    counts.push_back(0);
+                }
+                face_groups[i] = it->second;
+                counts[it->second] += in_mesh->facenums[i];
+            }
+            if (materials.empty())
+            {
+                materials.push_back(0);
+                counts.push_back(0);
+            }
+
+            offsets.assign(materials.size() + 1, 0);
+            for (size_t i = 0; i < materials.size(); i++)
+            {
+                offsets[i + 1] = offsets[i] + counts[i];
+            }
+            indices.resize(offsets.back());
+            std::vector<size_t> cursors(offsets.begin(), offsets.end() - 1);
+            size_t offset = 0;
+            for (size_t i = 0; i < nfaces; i++)
+            {
+                size_t& cursor = cursors[face_groups[i]];
+                for (int j = 0; j < in_mesh->facenums[i]; j++)
+                {
+                    indices[cursor++] = (unsigned int)in_mesh->pos_indices[offset + j];
+                }
+                offset += in_mesh->facenums[i];
+            }
+        }
+
+        template <class T>
+        static void GatherVertices(const std::vector<T>& src, const std::vector<unsigned int>& used, int ncomps, std::vector<T>& dst)
+        {
+            if (src.empty())
+            {
+                return;
+            }
+            dst.resize(used.size() * ncomps);
+            for (size_t i = 0; i < used.size(); i++)
+            {
+                for (int k = 0; k < ncomps; k++)
+                {
+                    dst[ncomps * i + k] = src[ncomps * used[i] + k];
+                }
+            }
+        }
+
+        // Keeps only the vertices indices refers to, renumbering indices in place.
+        static void GetPrimitiveArrays(const VertexArrays& arrays, std::vector<unsigned int>& indices, VertexArrays& out)
+        {
+            std::vector<int> remap(arrays.positions.size() / 3, -1);
+            std::vector<unsigned int> used;
+            for (size_t i = 0; i < indices.size(); i++)
+            {
+                int& index = remap[indices[i]];
+                if (index < 0)
+                {
+                    index = (int)used.size();
+                    used.push_back(indices[i]);
+                }
+                indices[i] = (unsigned int)index;
+            }
+            GatherVertices(arrays.positions, used, 3, out.positions);
+            GatherVertices(arrays.normals, used, 3, out.normals);
+            GatherVertices(arrays.texcoords, used, 2, out.texcoords);
+            GatherVertices(arrays.tangents, used, 4, out.tangents);
+            GatherVertices(arrays.joints, used, 4, out.joints);
+            GatherVertices(arrays.weights, used, 4, out.weights);
+        }
+
         class ObjectRegisterer
         {
         public:
             ObjectRegisterer(const std::string& basename)
+                : max_buffer_size_(0)
             {
                 basename_ = basename;
             }
 
+            void SetExportCache(const std::shared_ptr<ExportCache>& cache)
+            {
+                cache_ = cache;
+            }
+
+            typedef std::function<std::shared_ptr<OutputSink>(const std::string& uri)> BufferSinkFactory;
+
+            // Streams buffer bytes to a sink per buffer as meshes are registered instead of holding the whole scene.
+            void SetBufferSinkFactory(const BufferSinkFactory& factory)
+            {
+                buffer_sink_factory_ = factory;
+            }
+
+            // Starts a new buffer when adding a view would make the current one exceed size bytes. 0 keeps one buffer.
+            void SetMaxBufferSize(size_t size)
+            {
+                max_buffer_size_ = size;
+            }
+
             std::shared_ptr<Node> CreateNode(const std::shared_ptr< ::kml::Node>& in_node)
             {
                 int nNode = nodes_.size();
@@ -753,6 +889,175 @@ namespace kml
                 }
             }
 
+            template <class T>
+            std::shared_ptr<Accessor> AddVertexAccessor(const std::vector<T>& values, int ncomps, int componentType, bool isDraco)
+            {
+                int nAcc = accessors_.size();
+                std::string accName = "accessor_" + IToS(nAcc); //
+                std::shared_ptr<Accessor> acc(new Accessor(accName, nAcc));
+                if (!isDraco)
+                {
+                    std::shared_ptr<BufferView> bv = this->AddBufferView(values, GLTF_TARGET_ARRAY_BUFFER);
+                    acc->SetBufferView(bv);
+                }
+                else
+                {
+                    std::shared_ptr<DracoTemporaryBuffer> bv(new DracoTemporaryBuffer((unsigned char*)(&values[0]), sizeof(T) * values.size()));
+                    acc->SetDracoTemporaryBuffer(bv);
+                }
+                acc->SetCount(values.size() / ncomps);
+                acc->SetType((ncomps == 2) ? "VEC2" : ((ncomps == 3) ? "VEC3" : "VEC4"));
+                acc->SetComponentType(componentType);
+                acc->SetByteOffset(0);
+
+                accessors_.push_back(acc);
+                return acc;
+            }
+
+            static void SetMinMax(const std::shared_ptr<Accessor>& acc, const std::vector<float>& values, int n)
+            {
+                std::vector<float> min(n);
+                std::vector<float> max(n);
+                GetMinMax(&min[0], &max[0], values, n);
+                acc->SetMin(min);
+                acc->SetMax(max);
+            }
+
+            void RegisterAttributes(std::shared_ptr<Primitive>& primitive, const VertexArrays& arrays, bool isDraco)
+            {
+                {
+                    //normal
+                    std::shared_ptr<Accessor> acc = this->AddVertexAccessor(arrays.normals, 3, GLTF_COMPONENT_TYPE_FLOAT, isDraco);
+                    SetMinMax(acc, arrays.normals, 3);
+                    primitive->SetAccessor("NORMAL", acc);
+                }
+                {
+                    //position
+                    std::shared_ptr<Accessor> acc = this->AddVertexAccessor(arrays.positions, 3, GLTF_COMPONENT_TYPE_FLOAT, isDraco);
+                    SetMinMax(acc, arrays.positions, 3);
+                    primitive->SetAccessor("POSITION", acc);
+                }
+                if (arrays.texcoords.size() > 0)
+                {
+                    //texcoord
+                    std::shared_ptr<Accessor> acc = this->AddVertexAccessor(arrays.texcoords, 2, GLTF_COMPONENT_TYPE_FLOAT, isDraco);
+                    SetMinMax(acc, arrays.texcoords, 2);
+                    primitive->SetAccessor("TEXCOORD_0", acc);
+                }
+                if (arrays.tangents.size() > 0)
+                {
+                    //tangent
+                    std::shared_ptr<Accessor> acc = this->AddVertexAccessor(arrays.tangents, 4, GLTF_COMPONENT_TYPE_FLOAT, isDraco);
+                    SetMinMax(acc, arrays.tangents, 4);
+                    primitive->SetAccessor("TANGENT", acc);
+                }
+                if (arrays.joints.size() > 0)
+                {
+                    std::shared_ptr<Accessor> acc = this->AddVertexAccessor(arrays.joints, 4, GLTF_COMPONENT_TYPE_UNSIGNED_SHORT, isDraco);
+                    primitive->SetAccessor("JOINTS_0", acc);
+                }
+                if (arrays.weights.size() > 0)
+                {
+                    std::shared_ptr<Accessor> acc = this->AddVertexAccessor(arrays.weights, 4, GLTF_COMPONENT_TYPE_FLOAT, isDraco);
+                    primitive->SetAccessor("WEIGHTS_0", acc);
+                }
+            }
+
+            std::shared_ptr<Accessor> AddIndexAccessor(const std::vector<unsigned int>& indices, size_t begin, size_t end)
+            {
+                int nAcc = accessors_.size();
+                std::string accName = "accessor_" + IToS(nAcc); //
+                std::shared_ptr<Accessor> acc(new Accessor(accName, nAcc));
+                acc->SetCount(end - begin);
+                acc->SetType("SCALAR");
+                acc->SetComponentType(GLTF_COMPONENT_TYPE_UNSIGNED_INT);
+                acc->SetByteOffset(sizeof(unsigned int) * begin);
+
+                unsigned int imin = 0, imax = 0;
+                if (begin < end)
+                {
+                    imin = imax = indices[begin];
+                    for (size_t i = begin + 1; i < end; i++)
+                    {
+                        imin = std::min<unsigned int>(imin, indices[i]);
+                        imax = std::max<unsigned int>(imax, indices[i]);
+                    }
+                }
+                std::vector<float> min = {(float)imin};
+                std::vector<float> max = {(float)imax};
+                acc->SetMin(min);
+                acc->SetMax(max);
+
+                accessors_.push_back(acc);
+                return acc;
+            }
+
+            void GetSkinArrays(const std::shared_ptr< ::kml::SkinWeight>& in_skin, VertexArrays& arrays)
+            {
+                struct WeightSorter
+                {
+                    bool operator()(const std::pair<int, float>& a, const std::pair<int, float>& b) const
+                    {
+                        return a.second > b.second;
+                    }
+                };
+
+                typedef ::kml::SkinWeight::WeightVertex WeightVertex;
+                typedef WeightVertex::const_iterator WeightIterator;
+                std::vector<unsigned short>& joints = arrays.joints;
+                std::vector<float>& weights = arrays.weights;
+                for (int i = 0; i < in_skin->weights.size(); i++)
+                {
+                    std::vector<std::pair<int, float> > ww;
+                    WeightIterator it = in_skin->weights[i].begin();
+                    for (; it != in_skin->weights[i].end(); it++)
+                    {
+                        std::string path = it->first;
+                        float weight = it->second;
+                        auto iter = nodeMap_.find(path);
+                        if (iter != nodeMap_.end())
+                        {
+                            auto nn = iter->second;
+                            auto jj = nn->GetJoint();
+                            if (jj.get())
+                            {
+                                int index = jj->GetIndexInSkin();
+                                if (index >= 0)
+                                {
+                                    ww.push_back(std::make_pair(index, weight));
+                                }
+                            }
+                        }
+                    }
+                    std::sort(ww.begin(), ww.end(), WeightSorter());
+                    unsigned short jx[4] = {};
+                    float wx[4] = {};
+                    int nweights = std::min<int>(4, ww.size());
+                    for (int j = 0; j < nweights; j++)
+                    {
+                        jx[j] = ww[j].first;
+                        wx[j] = ww[j].second;
+                    }
+                    float l = 0.0f;
+                    for (int j = 0; j < 4; j++)
+                    {
+                        l += wx[j];
+                    }
+                    l = 1.0 / std::max<float>(1e-16f, l);
+                    for (int j = 0; j < 4; j++)
+                    {
+                        wx[j] *= l;
+                    }
+                    for (int j = 0; j < 4; j++)
+                    {
+                        joints.push_back(jx[j]);
+                        weights.push_back(wx[j]);
+                    }
+                }
+            }
+
+            // One primitive per material of the faces. Without Draco the primitives share the vertex accessors and
+            // take their index ranges from one index bufferView; with Draco each is compressed with its own vertices.
             void RegisterMesh(std::shared_ptr<Node>& node, const std::shared_ptr< ::kml::Node>& in_node, bool isDraco = false)
             {
                 const std::shared_ptr< ::kml::Mesh>& in_mesh = in_node->GetMesh();
@@ -767,32 +1072,22 @@ namespace kml
                     std::string meshName = in_mesh->name;
                     std::shared_ptr<Mesh> mesh(new Mesh(meshName, nMesh));
 
-                    if (in_mesh->materials.size())
-                    {
-                        int material_id = in_mesh->materials[0];
-                        mesh->SetMaterialID(material_id);
-                    }
-                    else
-                    {
-                        int material_id = 0;
-                        mesh->SetMaterialID(material_id);
-                    }
-
-                    std::vector<unsigned int> indices(in_mesh->pos_indices.size());
-                    for (size_t i = 0; i < indices.size(); i++)
-                    {
-                        indices[i] = (unsigned int)in_mesh->pos_indices[i];
-                    }
+                    std::vector<int> materials;
+                    std::vector<size_t> offsets;
+                    std::vector<unsigned int> indices;
+                    GetPrimitiveIndices(in_mesh, materials, offsets, indices);
 
-                    std::vector<float> positions(in_mesh->positions.size() * 3);
+                    VertexArrays arrays;
+                    arrays.positions.resize(in_mesh->positions.size() * 3);
                     for (size_t i = 0; i < in_mesh->positions.size(); i++)
                     {
-                        positions[3 * i + 0] = (float)in_mesh->positions[i][0];
-                        positions[3 * i + 1] = (float)in_mesh->positions[i][1];
-                        positions[3 * i + 2] = (float)in_mesh->positions[i][2];
+                        arrays.positions[3 * i + 0] = (float)in_mesh->positions[i][0];
+                        arrays.positions[3 * i + 1] = (float)in_mesh->positions[i][1];
+                        arrays.positions[3 * i + 2] = (float)in_mesh->positions[i][2];
                     }
 
-                    std::vector<float> normals(in_mesh->normals.size() * 3);
+                    std::vector<float>& normals = arrays.normals;
+                    normals.resize(in_mesh->normals.size() * 3);
                     for (size_t i = 0; i < in_mesh->normals.size(); i++)
                     {
                         normals[3 * i + 0] = (float)in_mesh->normals[i][0];
@@ -814,288 +1109,132 @@ namespace kml
                         }
                     }
 
-                    std::vector<float> texcoords;
                     if (in_mesh->texcoords.size() > 0)
                     {
-                        texcoords.resize(in_mesh->texcoords.size() * 2);
+                        arrays.texcoords.resize(in_mesh->texcoords.size() * 2);
                         for (size_t i = 0; i < in_mesh->texcoords.size(); i++)
                         {
-                            texcoords[2 * i + 0] = (float)in_mesh->texcoords[i][0];
-                            texcoords[2 * i + 1] = (float)in_mesh->texcoords[i][1];
+                            arrays.texcoords[2 * i + 0] = (float)in_mesh->texcoords[i][0];
+                            arrays.texcoords[2 * i + 1] = (float)in_mesh->texcoords[i][1];
                         }
                     }
 
-                    int nAcc = accessors_.size();
+                    if (in_mesh->tangents.size() == in_mesh->positions.size())
                     {
-                        //indices
-                        std::string accName = "accessor_" + IToS(nAcc); //
-                        std::shared_ptr<Accessor> acc(new Accessor(accName, nAcc));
-                        if (!isDraco)
+                        arrays.tangents.resize(in_mesh->tangents.size() * 4);
+                        for (size_t i = 0; i < in_mesh->tangents.size(); i++)
                         {
-                            std::shared_ptr<BufferView> bv = this->AddBufferView(indices, GLTF_TARGET_ELEMENT_ARRAY_BUFFER);
-                            acc->SetBufferView(bv);
-                        }
-                        else
-                        {
-                            std::shared_ptr<DracoTemporaryBuffer> bv(new DracoTemporaryBuffer((unsigned char*)(&indices[0]), sizeof(unsigned int) * indices.size()));
-                            acc->SetDracoTemporaryBuffer(bv);
+                            arrays.tangents[4 * i + 0] = (float)in_mesh->tangents[i][0];
+                            arrays.tangents[4 * i + 1] = (float)in_mesh->tangents[i][1];
+                            arrays.tangents[4 * i + 2] = (float)in_mesh->tangents[i][2];
+                            arrays.tangents[4 * i + 3] = (float)in_mesh->tangents[i][3];
                         }
-                        acc->SetCount(indices.size());
-                        acc->SetType("SCALAR");
-                        acc->SetComponentType(GLTF_COMPONENT_TYPE_UNSIGNED_INT); //5126
-                        acc->SetByteOffset(0);
-                        //acc->Set("byteStride", picojson::value((double)sizeof(unsigned int)));
-
-                        unsigned int imin, imax;
-                        GetMinMax(imin, imax, indices);
-                        std::vector<float> min = {(float)imin};
-                        std::vector<float> max = {(float)imax};
-                        acc->SetMin(min);
-                        acc->SetMax(max);
-
-                        accessors_.push_back(acc);
-                        mesh->SetAccessor("indices", acc);
-                        nAcc++;
                     }
+
+                    std::shared_ptr<Skin> skin;
+                    std::shared_ptr< ::kml::SkinWeight> in_skin = in_mesh->skin_weight;
+                    if (in_skin.get())
                     {
-                        //normal
-                        std::string accName = "accessor_" + IToS(nAcc); //
-                        std::shared_ptr<Accessor> acc(new Accessor(accName, nAcc));
-                        if (!isDraco)
-                        {
-                            std::shared_ptr<BufferView> bv = this->AddBufferView(normals, GLTF_TARGET_ARRAY_BUFFER);
-                            acc->SetBufferView(bv);
-                        }
-                        else
+                        auto n = nodeMap_[in_skin->GetJointPaths()[0]];
+                        auto joint = n->GetJoint();
+                        skin = joint->GetSkin();
+                        if (skin.get())
                         {
-                            std::shared_ptr<DracoTemporaryBuffer> bv(new DracoTemporaryBuffer((unsigned char*)(&normals[0]), sizeof(float) * normals.size()));
-                            acc->SetDracoTemporaryBuffer(bv);
+                            GetSkinArrays(in_skin, arrays);
                         }
-                        acc->SetCount(normals.size() / 3);
-                        acc->SetType("VEC3");
-                        acc->SetComponentType(GLTF_COMPONENT_TYPE_FLOAT); //5126
-                        acc->SetByteOffset(0);
-                        //acc->Set("byteStride", picojson::value((double)3 * sizeof(float)));
-
-                        std::vector<float> min(3);
-                        std::vector<float> max(3);
-                        GetMinMax(&min[0], &max[0], normals, 3);
-                        acc->SetMin(min);
-                        acc->SetMax(max);
-
-                        accessors_.push_back(acc);
-                        mesh->SetAccessor("NORMAL", acc);
-                        nAcc++;
                     }
+
+                    if (!isDraco)
                     {
-                        //position
-                        std::string accName = "accessor_" + IToS(nAcc); //
-                        std::shared_ptr<Accessor> acc(new Accessor(accName, nAcc));
-                        if (!isDraco)
-                        {
-                            std::shared_ptr<BufferView> bv = this->AddBufferView(positions, GLTF_TARGET_ARRAY_BUFFER);
-                            acc->SetBufferView(bv);
-                        }
-                        else
-                        {
-                            std::shared_ptr<DracoTemporaryBuffer> bv(new DracoTemporaryBuffer((unsigned char*)(&positions[0]), sizeof(float) * positions.size()));
-                            acc->SetDracoTemporaryBuffer(bv);
-                        }
-                        acc->SetCount(positions.size() / 3);
-                        acc->SetType("VEC3");
-                        acc->SetComponentType(GLTF_COMPONENT_TYPE_FLOAT); //5126
-                        acc->SetByteOffset(0);
-                        //acc->Set("byteStride", picojson::value((double)3 * sizeof(float)));
-
-                        std::vector<float> min(3);
-                        std::vector<float> max(3);
-                        GetMinMax(&min[0], &max[0], positions, 3);
-                        acc->SetMin(min);
-                        acc->SetMax(max);
-
-                        accessors_.push_back(acc);
-                        mesh->SetAccessor("POSITION", acc);
-                        nAcc++;
-                    }
-                    if (texcoords.size() > 0)
-                    {
-                        //texcoord
-                        std::string accName = "accessor_" + IToS(nAcc); //
-                        std::shared_ptr<Accessor> acc(new Accessor(accName, nAcc));
-                        if (!isDraco)
+                        //indices of every primitive in one bufferView
+                        std::shared_ptr<BufferView> bv = this->AddBufferView(indices, GLTF_TARGET_ELEMENT_ARRAY_BUFFER);
+                        std::vector<std::shared_ptr<Primitive> > primitives;
+                        for (size_t i = 0; i < materials.size(); i++)
                         {
-                            std::shared_ptr<BufferView> bv = this->AddBufferView(texcoords, GLTF_TARGET_ARRAY_BUFFER);
+                            std::shared_ptr<Primitive> primitive(new Primitive((int)i));
+                            primitive->SetMaterialID(materials[i]);
+                            std::shared_ptr<Accessor> acc = this->AddIndexAccessor(indices, offsets[i], offsets[i + 1]);
                             acc->SetBufferView(bv);
+                            primitive->SetAccessor("indices", acc);
+                            primitives.push_back(primitive);
                         }
-                        else
+                        this->RegisterAttributes(primitives[0], arrays, false);
+                        static const char* ATTRS[] = {
+                            "POSITION", "TEXCOORD_0", "NORMAL", "JOINTS_0", "WEIGHTS_0", "TANGENT", NULL};
+                        for (size_t i = 0; i < primitives.size(); i++)
                         {
-                            std::shared_ptr<DracoTemporaryBuffer> bv(new DracoTemporaryBuffer((unsigned char*)(&texcoords[0]), sizeof(float) * texcoords.size()));
-                            acc->SetDracoTemporaryBuffer(bv);
+                            for (int j = 0; ATTRS[j]; j++)
+                            {
+                                std::shared_ptr<Accessor> acc = primitives[0]->GetAccessor(ATTRS[j]);
+                                if (acc.get())
+                                {
+                                    primitives[i]->SetAccessor(ATTRS[j], acc);
+                                }
+                            }
+                            mesh->AddPrimitive(primitives[i]);
                         }
-                        acc->SetCount(texcoords.size() / 2);
-                        acc->SetType("VEC2");
-                        acc->SetComponentType(GLTF_COMPONENT_TYPE_FLOAT); //5126
-                        acc->SetByteOffset(0);
-                        //acc->Set("byteStride", picojson::value((double)2 * sizeof(float)));
-
-                        std::vector<float> min(2);
-                        std::vector<float> max(2);
-                        GetMinMax(&min[0], &max[0], texcoords, 2);
-                        acc->SetMin(min);
-                        acc->SetMax(max);
-
-                        accessors_.push_back(acc);
-                        mesh->SetAccessor("TEXCOORD_0", acc);
-                        nAcc++;
                     }
-
-                    std::shared_ptr< ::kml::SkinWeight> in_skin = in_mesh->skin_weight;
-                    if (in_skin.get())
+                    else
                     {
-                        auto n = nodeMap_[in_skin->GetJointPaths()[0]];
-                        auto joint = n->GetJoint();
-                        auto skin = joint->GetSkin();
-                        if (skin.get())
+                        for (size_t i = 0; i < materials.size(); i++)
                         {
-                            struct WeightSorter
+                            //draco cannot encode a primitive without faces
+                            if (offsets[i] == offsets[i + 1])
                             {
-                                bool operator()(const std::pair<int, float>& a, const std::pair<int, float>& b) const
-                                {
-                                    return a.second > b.second;
-                                }
-                            };
-
-                            typedef ::kml::SkinWeight::WeightVertex WeightVertex;
-                            typedef WeightVertex::const_iterator WeightIterator;
-                            std::vector<unsigned short> joints;
-                            std::vector<float> weights;
-                            bool Fauire = false;
-                            for (int i = 0; i < in_skin->weights.size(); i++)
-                            {
-                                std::vector<std::pair<int, float> > ww;
-                                WeightIterator it = in_skin->weights[i].begin();
-                                for (; it != in_skin->weights[i].end(); it++)
-                                {
-                                    std::string path = it->first;
-                                    float weight = it->second;
-                                    auto iter = nodeMap_.find(path);
-                                    if (iter != nodeMap_.end())
-                                    {
-                                        auto nn = iter->second;
-                                        auto jj = nn->GetJoint();
-                                        if(jj.get())
-                                        {
-                                            int index = jj->GetIndexInSkin();
-                                            if(index >= 0)
-                                            {
-                                                ww.push_back(std::make_pair(index, weight));
-                                            }
-                                        }
-                                        else
-                                        {
-                                            //std::cout << "XXX:" << path << std::endl;
-                                        }
-                                    }
-                                }
-                                if(Fauire)
-                                {
-                                    typedef std::map<std::string, std::shared_ptr<Node> > MapType;
-                                    typedef MapType::const_iterator Iterator;
-                                    //for(Iterator it = nodeMap_.begin();it != nodeMap_.end();it++)
-                                    //{
-                                    //    std::cout << "???:" << it->first << std::endl;
-                                    //}
-                                }
-                                std::sort(ww.begin(), ww.end(), WeightSorter());
-                                unsigned short jx[4] = {};
-                                float wx[4] = {};
-                                int nweights = std::min<int>(4, ww.size());
-                                for (int j = 0; j < nweights; j++)
-                                {
-                                    jx[j] = ww[j].first;
-                                    wx[j] = ww[j].second;
-                                }
-                                float l = 0.0f;
-                                for (int j = 0; j < 4; j++)
-                                {
-                                    l += wx[j];
-                                }
-                                l = 1.0 / std::max<float>(1e-16f, l);
-                                for (int j = 0; j < 4; j++)
-                                {
-                                    wx[j] *= l;
-                                }
-                                for (int j = 0; j < 4; j++)
-                                {
-                                    joints.push_back(jx[j]);
-                                    weights.push_back(wx[j]);
-                                }
+                                continue;
                             }
+                            std::shared_ptr<Primitive> primitive(new Primitive((int)i));
+                            primitive->SetMaterialID(materials[i]);
 
-                            if (joints.size() > 0)
+                            std::vector<unsigned int> prim_indices(indices.begin() + offsets[i], indices.begin() + offsets[i + 1]);
+                            VertexArrays prim_arrays;
+                            if (materials.size() == 1)
                             {
-                                std::string accName = "accessor_" + IToS(nAcc); //
-                                std::shared_ptr<Accessor> acc(new Accessor(accName, nAcc));
-                                if (!isDraco)
-                                {
-                                    const std::shared_ptr<BufferView> bv = this->AddBufferView(joints, GLTF_TARGET_ARRAY_BUFFER);
-                                    acc->SetBufferView(bv);
-                                }
-                                else
-                                {
-                                    std::shared_ptr<DracoTemporaryBuffer> bv(new DracoTemporaryBuffer((unsigned char*)(&joints[0]), sizeof(unsigned short) * joints.size()));
-                                    acc->SetDracoTemporaryBuffer(bv);
-                                }
-                                acc->SetCount(joints.size() / 4);
-                                acc->SetType("VEC4");
-                                acc->SetComponentType(GLTF_COMPONENT_TYPE_UNSIGNED_SHORT); //5126
-                                acc->SetByteOffset(0);
-                                //acc->Set("byteStride", picojson::value((double)sizeof(unsigned int)));
-                                /*
-                                unsigned short min[4] = {}, max[4] = {};
-                                GetMinMax(min, max, joints, 4);
-                                acc->Set("min", picojson::value(ConvertToArray(min, 4)));
-                                acc->Set("max", picojson::value(ConvertToArray(max, 4)));
-                                */
-                                accessors_.push_back(acc);
-                                mesh->SetAccessor("JOINTS_0", acc);
-                                nAcc++;
+                                std::swap(prim_arrays, arrays);
+                            }
+                            else
+                            {
+                                GetPrimitiveArrays(arrays, prim_indices, prim_arrays);
                             }
 
-                            if (weights.size() > 0)
+                            //indices
+                            std::shared_ptr<Accessor> acc = this->AddIndexAccessor(prim_indices, 0, prim_indices.size());
+                            std::shared_ptr<DracoTemporaryBuffer> bv(new DracoTemporaryBuffer((unsigned char*)(&prim_indices[0]), sizeof(unsigned int) * prim_indices.size()));
+                            acc->SetDracoTemporaryBuffer(bv);
+                            primitive->SetAccessor("indices", acc);
+
+                            this->RegisterAttributes(primitive, prim_arrays, true);
+
+                            std::shared_ptr<BufferView> bufferView = this->AddBufferViewDraco(primitive);
+                            primitive->SetBufferView("draco", bufferView);
                             {
-                                std::string accName = "accessor_" + IToS(nAcc); //
-                                std::shared_ptr<Accessor> acc(new Accessor(accName, nAcc));
-                                if (!isDraco)
-                                {
-                                    const std::shared_ptr<BufferView> bv = this->AddBufferView(weights, GLTF_TARGET_ARRAY_BUFFER);
-                                    acc->SetBufferView(bv);
-                                }
-                                else
+                                //clear temporay
+                                static const char* ATTRS[] = {
+                                    "indices", "POSITION", "TEXCOORD_0", "NORMAL", "JOINTS_0", "WEIGHTS_0", "TANGENT", NULL};
+                                int j = 0;
+                                while (ATTRS[j])
                                 {
-                                    std::shared_ptr<DracoTemporaryBuffer> bv(new DracoTemporaryBuffer((unsigned char*)(&weights[0]), sizeof(float) * weights.size()));
-                                    acc->SetDracoTemporaryBuffer(bv);
+                                    std::shared_ptr<Accessor> acc = primitive->GetAccessor(ATTRS[j]);
+                                    if (acc.get())
+                                    {
+                                        std::shared_ptr<DracoTemporaryBuffer> bv = acc->GetDracoTemporaryBuffer();
+                                        if (bv.get())
+                                        {
+                                            bv->ClearBytes();
+                                        }
+                                    }
+                                    j++;
                                 }
-                                acc->SetCount(weights.size() / 4);
-                                acc->SetType("VEC4");
-                                acc->SetComponentType(GLTF_COMPONENT_TYPE_FLOAT); //5126
-                                acc->SetByteOffset(0);
-                                //acc->Set("byteStride", picojson::value((double)sizeof(unsigned int)));
-                                /*
-                                float min[4] = {}, max[4] = {};
-                                GetMinMax(min, max, weights, 4);
-                                acc->Set("min", picojson::value(ConvertToArray(min, 4)));
-                                acc->Set("max", picojson::value(ConvertToArray(max, 4)));
-                                */
-
-                                accessors_.push_back(acc);
-                                mesh->SetAccessor("WEIGHTS_0", acc);
-                                nAcc++;
                             }
-                            node->SetSkin(skin);
+                            mesh->AddPrimitive(primitive);
                         }
                     }
 
+                    if (skin.get())
+                    {
+                        node->SetSkin(skin);
+                    }
+
                     {
                         std::vector<std::shared_ptr<MorphTarget> > targets = this->RegisterMorphTargets(in_mesh);
                         if (!targets.empty())
@@ -1107,31 +1246,6 @@ namespace kml
                         }
                     }
 
-                    if (isDraco)
-                    {
-                        std::shared_ptr<BufferView> bufferView = this->AddBufferViewDraco(mesh);
-                        mesh->SetBufferView("draco", bufferView);
-                        {
-                            //clear temporay
-                            static const char* ATTRS[] = {
-                                "POSITION", "TEXCOORD_0", "NORMAL", "JOINTS_0", "WEIGHTS_0", NULL};
-                            int i = 0;
-                            while (ATTRS[i])
-                            {
-                                std::shared_ptr<Accessor> acc = mesh->GetAccessor(ATTRS[i]);
-                                if (acc.get())
-                                {
-                                    std::shared_ptr<DracoTemporaryBuffer> bv = acc->GetDracoTemporaryBuffer();
-                                    if (bv.get())
-                                    {
-                                        bv->ClearBytes();
-                                    }
-                                }
-                                i++;
-                            }
-                        }
-                    }
-
                     node->SetMesh(mesh);
                     this->meshes_.push_back(mesh);
                 }
@@ -1182,11 +1296,19 @@ namespace kml
             }
 
         public:
-            std::shared_ptr<Buffer> GetLastBuffer()
+            std::shared_ptr<Buffer> GetBuffer(size_t length)
             {
-                if (buffers_.empty())
+                if (buffers_.empty() ||
+                    (max_buffer_size_ > 0 && buffers_.back()->GetSize() > 0 && buffers_.back()->GetSize() + length > max_buffer_size_))
                 {
-                    buffers_.push_back(std::shared_ptr<Buffer>(new Buffer(basename_, 0)));
+                    int nBuffer = buffers_.size();
+                    std::string name = (nBuffer == 0) ? basename_ : basename_ + "_" + IToS(nBuffer);
+                    std::shared_ptr<Buffer> buffer(new Buffer(name, nBuffer));
+                    if (buffer_sink_factory_)
+                    {
+                        buffer->SetSink(buffer_sink_factory_(buffer->GetURI()));
+                    }
+                    buffers_.push_back(buffer);
                 }
                 return buffers_.back();
             }
@@ -1198,16 +1320,16 @@ namespace kml
 
             const std::shared_ptr<BufferView>& AddBufferView(const std::vector<float>& vec, int target = GLTF_TARGET_ARRAY_BUFFER)
             {
-                std::shared_ptr<Buffer> buffer = this->GetLastBuffer();
+                size_t length = sizeof(float) * vec.size();
+                std::shared_ptr<Buffer> buffer = this->GetBuffer(length);
                 int nBV = bufferViews_.size();
                 std::string name = "bufferView_" + IToS(nBV); //
                 std::shared_ptr<BufferView> bufferView(new BufferView(name, nBV));
                 size_t offset = buffer->GetSize();
-                size_t length = sizeof(float) * vec.size();
                 buffer->AddBytes((unsigned char*)(&vec[0]), length);
                 bufferView->SetByteOffset(offset);
                 bufferView->SetByteLength(length);
-                bufferView->SetBuffer(buffers_[0]);
+                bufferView->SetBuffer(buffer);
                 bufferView->SetTarget(target);
                 bufferViews_.push_back(bufferView);
                 return bufferViews_.back();
@@ -1215,12 +1337,12 @@ namespace kml
 
             const std::shared_ptr<BufferView>& AddBufferView(const std::vector<unsigned int>& vec, int target = GLTF_TARGET_ELEMENT_ARRAY_BUFFER)
             {
-                std::shared_ptr<Buffer> buffer = this->GetLastBuffer();
+                size_t length = sizeof(unsigned int) * vec.size();
+                std::shared_ptr<Buffer> buffer = this->GetBuffer(length);
                 int nBV = bufferViews_.size();
                 std::string name = "bufferView_" + IToS(nBV); //
                 std::shared_ptr<BufferView> bufferView(new BufferView(name, nBV));
                 size_t offset = buffer->GetSize();
-                size_t length = sizeof(unsigned int) * vec.size();
                 buffer->AddBytes((unsigned char*)(&vec[0]), length);
                 bufferView->SetByteOffset(offset);
                 bufferView->SetByteLength(length);
@@ -1232,12 +1354,12 @@ namespace kml
 
             const std::shared_ptr<BufferView>& AddBufferView(const std::vector<unsigned short>& vec, int target = GLTF_TARGET_ARRAY_BUFFER)
             {
-                std::shared_ptr<Buffer> buffer = this->GetLastBuffer();
+                size_t length = sizeof(unsigned short) * vec.size();
+                std::shared_ptr<Buffer> buffer = this->GetBuffer(length);
                 int nBV = bufferViews_.size();
                 std::string name = "bufferView_" + IToS(nBV); //
                 std::shared_ptr<BufferView> bufferView(new BufferView(name, nBV));
                 size_t offset = buffer->GetSize();
-                size_t length = sizeof(unsigned short) * vec.size();
                 buffer->AddBytes((unsigned char*)(&vec[0]), length);
                 bufferView->SetByteOffset(offset);
                 bufferView->SetByteLength(length);
@@ -1247,23 +1369,65 @@ namespace kml
                 return bufferViews_.back();
             }
 
-            std::shared_ptr<BufferView> AddBufferViewDraco(const std::shared_ptr<Mesh>& mesh)
+            static std::string GetDracoCacheKey(const std::shared_ptr<Primitive>& primitive)
+            {
+                static const char* ATTRS[] = {
+                    "POSITION", "TEXCOORD_0", "TEXCOORD_1", "NORMAL", "COLOR_0", "JOINTS_0", "WEIGHTS_0", "TANGENT", NULL};
+                ContentHash hash;
+                hash.Add(EXPORT_CACHE_VERSION);
+                hash.Add(std::string("draco"));
+                hash.AddVector(GetDracoEncoderSettings());
+                std::shared_ptr<Accessor> indices = primitive->GetIndices();
+                if (indices.get() && indices->GetDracoTemporaryBuffer().get())
+                {
+                    hash.Add((int)indices->GetCount());
+                    hash.Add(indices->GetDracoTemporaryBuffer()->GetBytesPtr(), indices->GetDracoTemporaryBuffer()->GetSize());
+                }
+                for (int i = 0; ATTRS[i]; i++)
+                {
+                    std::shared_ptr<Accessor> acc = primitive->GetAccessor(ATTRS[i]);
+                    if (acc.get() && acc->GetDracoTemporaryBuffer().get())
+                    {
+                        hash.Add(std::string(ATTRS[i]));
+                        hash.Add(acc->GetComponentType());
+                        hash.Add(acc->GetType());
+                        hash.Add((int)acc->GetCount());
+                        hash.Add(acc->GetDracoTemporaryBuffer()->GetBytesPtr(), acc->GetDracoTemporaryBuffer()->GetSize());
+                    }
+                }
+                return hash.ToString();
+            }
+
+            std::shared_ptr<BufferView> AddBufferViewDraco(const std::shared_ptr<Primitive>& primitive)
             {
                 std::vector<unsigned char> bytes;
-                if (!SaveToDraco(bytes, mesh))
+                std::string key;
+                if (cache_.get())
                 {
-                    return std::shared_ptr<BufferView>();
+                    key = GetDracoCacheKey(primitive);
+                    cache_->Load(key, bytes);
+                }
+                if (bytes.empty())
+                {
+                    if (!SaveToDraco(bytes, primitive))
+                    {
+                        return std::shared_ptr<BufferView>();
+                    }
+                    if (cache_.get())
+                    {
+                        cache_->Store(key, bytes);
+                    }
                 }
 
-                std::shared_ptr<Buffer> buffer = this->GetLastBuffer();
-                int nBV = bufferViews_.size();
-                std::string name = "bufferView_" + IToS(nBV); //
-                std::shared_ptr<BufferView> bufferView(new BufferView(name, nBV));
-                size_t offset = buffer->GetSize();
                 size_t length = bytes.size();
 
                 //4bytes
                 Pad4BytesAlign(bytes);
+                std::shared_ptr<Buffer> buffer = this->GetBuffer(bytes.size());
+                int nBV = bufferViews_.size();
+                std::string name = "bufferView_" + IToS(nBV); //
+                std::shared_ptr<BufferView> bufferView(new BufferView(name, nBV));
+                size_t offset = buffer->GetSize();
                 buffer->AddBytes(&bytes[0], bytes.size());
 
                 bufferView->SetByteOffset(offset);
@@ -1288,6 +1452,9 @@ namespace kml
             std::vector<std::shared_ptr<TextureSampler> > texture_samplers_;
 
             std::string basename_;
+            std::shared_ptr<ExportCache> cache_;
+            BufferSinkFactory buffer_sink_factory_;
+            size_t max_buffer_size_;
         };
 
         static int FindTextureIndex(const std::vector<std::shared_ptr<kml::Texture> >& texture_vec, const std::shared_ptr<kml::Texture>& tex)
@@ -1828,37 +1995,12 @@ namespace kml
                     picojson::object nd;
                     nd["name"] = picojson::value(mesh->GetName());
 
-                    picojson::object attributes;
-                    {
-                        attributes["NORMAL"] = picojson::value((double)mesh->GetAccessor("NORMAL")->GetIndex()); //picojson::value(mesh->GetAccessor("NORMAL")->GetName());
-                        attributes["POSITION"] = picojson::value((double)mesh->GetAccessor("POSITION")->GetIndex());
-                        std::shared_ptr<Accessor> tex = mesh->GetAccessor("TEXCOORD_0");
-                        if (tex.get())
-                        {
-                            attributes["TEXCOORD_0"] = picojson::value((double)tex->GetIndex());
-                        }
-
-                        std::shared_ptr<Accessor> joints = mesh->GetAccessor("JOINTS_0");
-                        std::shared_ptr<Accessor> weights = mesh->GetAccessor("WEIGHTS_0");
-                        if (joints.get() && weights.get())
-                        {
-                            attributes["JOINTS_0"] = picojson::value((double)joints->GetIndex());
-                            attributes["WEIGHTS_0"] = picojson::value((double)weights->GetIndex());
-                        }
-                    }
-
-                    picojson::object primitive;
-                    primitive["attributes"] = picojson::value(attributes);
-                    primitive["indices"] = picojson::value((double)mesh->GetIndices()->GetIndex());
-                    primitive["mode"] = picojson::value((double)mesh->GetMode());
-                    primitive["material"] = picojson::value((double)mesh->GetMaterialID());
-
                     picojson::object extras;
 
                     std::vector<std::shared_ptr<MorphTarget> > targets = mesh->GetTargets();
+                    picojson::array tar;
                     if (!targets.empty())
                     {
-                        picojson::array tar;
                         picojson::array war;
                         picojson::array nar;
                         for (size_t j = 0; j < targets.size(); j++)
@@ -1870,46 +2012,90 @@ namespace kml
                             war.push_back(picojson::value((double)targets[j]->GetWeight()));
                             nar.push_back(picojson::value(targets[j]->GetName()));
                         }
-                        primitive["targets"] = picojson::value(tar);
                         nd["weights"] = picojson::value(war);
 
                         //nd["targetNames"] = picojson::value(nar);
                         extras["targetNames"] = picojson::value(nar);
                     }
 
-                    std::shared_ptr<BufferView> bufferView = mesh->GetBufferView("draco");
-                    if (bufferView.get())
+                    picojson::array primitives;
+                    const std::vector<std::shared_ptr<Primitive> >& prims = mesh->GetPrimitives();
+                    for (size_t k = 0; k < prims.size(); k++)
                     {
-                        picojson::object KHR_draco_mesh_compression;
-                        KHR_draco_mesh_compression["bufferView"] = picojson::value((double)bufferView->GetIndex());
-
-                        int nOrder = 0;
+                        const std::shared_ptr<Primitive>& prim = prims[k];
                         picojson::object attributes;
-                        attributes["POSITION"] = picojson::value((double)nOrder++);
-                        std::shared_ptr<Accessor> tex = mesh->GetAccessor("TEXCOORD_0");
-                        if (tex.get())
                         {
-                            attributes["TEXCOORD_0"] = picojson::value((double)nOrder++);
+                            attributes["NORMAL"] = picojson::value((double)prim->GetAccessor("NORMAL")->GetIndex()); //picojson::value(mesh->GetAccessor("NORMAL")->GetName());
+                            attributes["POSITION"] = picojson::value((double)prim->GetAccessor("POSITION")->GetIndex());
+                            std::shared_ptr<Accessor> tex = prim->GetAccessor("TEXCOORD_0");
+                            if (tex.get())
+                            {
+                                attributes["TEXCOORD_0"] = picojson::value((double)tex->GetIndex());
+                            }
+
+                            std::shared_ptr<Accessor> joints = prim->GetAccessor("JOINTS_0");
+                            std::shared_ptr<Accessor> weights = prim->GetAccessor("WEIGHTS_0");
+                            if (joints.get() && weights.get())
+                            {
+                                attributes["JOINTS_0"] = picojson::value((double)joints->GetIndex());
+                                attributes["WEIGHTS_0"] = picojson::value((double)weights->GetIndex());
+                            }
+
+                            std::shared_ptr<Accessor> tangent = prim->GetAccessor("TANGENT");
+                            if (tangent.get())
+                            {
+                                attributes["TANGENT"] = picojson::value((double)tangent->GetIndex());
+                            }
                         }
-                        attributes["NORMAL"] = picojson::value((double)nOrder++);
 
-                        std::shared_ptr<Accessor> joints = mesh->GetAccessor("JOINTS_0");
-                        std::shared_ptr<Accessor> weights = mesh->GetAccessor("WEIGHTS_0");
-                        if (joints.get() && weights.get())
+                        picojson::object primitive;
+                        primitive["attributes"] = picojson::value(attributes);
+                        primitive["indices"] = picojson::value((double)prim->GetIndices()->GetIndex());
+                        primitive["mode"] = picojson::value((double)prim->GetMode());
+                        primitive["material"] = picojson::value((double)prim->GetMaterialID());
+                        if (!tar.empty())
                         {
-                            attributes["JOINTS_0"] = picojson::value((double)nOrder++);
-                            attributes["WEIGHTS_0"] = picojson::value((double)nOrder++);
+                            primitive["targets"] = picojson::value(tar);
                         }
 
-                        KHR_draco_mesh_compression["attributes"] = picojson::value(attributes);
+                        std::shared_ptr<BufferView> bufferView = prim->GetBufferView("draco");
+                        if (bufferView.get())
+                        {
+                            picojson::object KHR_draco_mesh_compression;
+                            KHR_draco_mesh_compression["bufferView"] = picojson::value((double)bufferView->GetIndex());
+
+                            int nOrder = 0;
+                            picojson::object attributes;
+                            attributes["POSITION"] = picojson::value((double)nOrder++);
+                            std::shared_ptr<Accessor> tex = prim->GetAccessor("TEXCOORD_0");
+                            if (tex.get())
+                            {
+                                attributes["TEXCOORD_0"] = picojson::value((double)nOrder++);
+                            }
+                            attributes["NORMAL"] = picojson::value((double)nOrder++);
 
-                        picojson::object extensions;
-                        extensions["KHR_draco_mesh_compression"] = picojson::value(KHR_draco_mesh_compression);
-                        primitive["extensions"] = picojson::value(extensions);
-                    }
+                            std::shared_ptr<Accessor> joints = prim->GetAccessor("JOINTS_0");
+                            std::shared_ptr<Accessor> weights = prim->GetAccessor("WEIGHTS_0");
+                            if (joints.get() && weights.get())
+                            {
+                                attributes["JOINTS_0"] = picojson::value((double)nOrder++);
+                                attributes["WEIGHTS_0"] = picojson::value((double)nOrder++);
+                            }
+                            std::shared_ptr<Accessor> tangent = prim->GetAccessor("TANGENT");
+                            if (tangent.get())
+                            {
+                                attributes["TANGENT"] = picojson::value((double)nOrder++);
+                            }
 
-                    picojson::array primitives;
-                    primitives.push_back(picojson::value(primitive));
+                            KHR_draco_mesh_compression["attributes"] = picojson::value(attributes);
+
+                            picojson::object extensions;
+                            extensions["KHR_draco_mesh_compression"] = picojson::value(KHR_draco_mesh_compression);
+                            primitive["extensions"] = picojson::value(extensions);
+                        }
+
+                        primitives.push_back(picojson::value(primitive));
+                    }
 
                     nd["primitives"] = picojson::value(primitives);
 
@@ -2103,6 +2289,8 @@ namespace kml
             GetTextures(texture_vec, node->GetMaterials());
             GetImages(image_vec, texture_vec);
             GetCacheImages(cache_image_vec, texture_vec);
+            std::vector<std::string> compressed_image_vec;
+            GetCompressedImages(compressed_image_vec, texture_vec);
 
             // Textures
             {
@@ -2125,6 +2313,17 @@ namespace kml
                         extras["colorSpace"] = picojson::value(in_tex->GetColorSpace());
                         texture["extras"] = picojson::value(extras);
 
+                        // Block compressed KTX2 image, placed after the regular images. "source" stays as fallback.
+                        int nCompressedIndex = FindImageIndex(compressed_image_vec, in_tex->GetCompressedFilePath());
+                        if (nCompressedIndex >= 0)
+                        {
+                            picojson::object extensions;
+                            picojson::object KSK_texture_bc;
+                            KSK_texture_bc["source"] = picojson::value((double)(image_vec.size() + nCompressedIndex));
+                            extensions["KSK_texture_bc"] = picojson::value(KSK_texture_bc);
+                            texture["extensions"] = picojson::value(extensions);
+                        }
+
                         textures.push_back(picojson::value(texture));
                     }
                 }
@@ -2160,6 +2359,15 @@ namespace kml
 
                     images.push_back(picojson::value(image));
                 }
+                for (size_t i = 0; i < compressed_image_vec.size(); i++)
+                {
+                    std::string imagePath = compressed_image_vec[i];
+                    picojson::object image;
+                    image["name"] = picojson::value(GetImageID(imagePath));
+                    image["uri"] = picojson::value(imagePath);
+                    image["mimeType"] = picojson::value("image/ktx2");
+                    images.push_back(picojson::value(image));
+                }
                 if (!images.empty())
                 {
                     root["images"] = picojson::value(images);
@@ -2245,6 +2453,27 @@ namespace kml
                         }
                     }
 
+                    std::shared_ptr<kml::Texture> ormtex = mat->GetTexture("ORM");
+                    if (ormtex)
+                    {
+                        int nIndex = FindTextureIndex(texture_vec, ormtex);
+                        if (nIndex >= 0)
+                        {
+                            if (mat->GetInteger("ORM.Occlusion"))
+                            {
+                                picojson::object occlusionTexture;
+                                occlusionTexture["index"] = picojson::value((double)nIndex);
+                                nd["occlusionTexture"] = picojson::value(occlusionTexture);
+                            }
+                            if (mat->GetInteger("ORM.MetallicRoughness"))
+                            {
+                                picojson::object metallicRoughnessTexture;
+                                metallicRoughnessTexture["index"] = picojson::value((double)nIndex);
+                                pbrMetallicRoughness["metallicRoughnessTexture"] = picojson::value(metallicRoughnessTexture);
+                            }
+                        }
+                    }
+
                     {
                         picojson::array colorFactor;
                         float R = mat->GetValue("BaseColor.R");
@@ -2276,6 +2505,11 @@ namespace kml
                         }        
                     }
 
+                    if (mat->GetInteger("DoubleSided"))
+                    {
+                        nd["doubleSided"] = picojson::value(true);
+                    }
+
                     picojson::object extensions;
                     {
                         std::string shadingMode = mat->GetString("ShadingMode");
@@ -2868,10 +3102,37 @@ namespace kml
             names.erase(std::unique(names.begin(), names.end()), names.end());
             return names;
         }
+
+        static std::vector<std::string> GetTextureExtensionNames(const picojson::object& root_object)
+        {
+            typedef picojson::object::const_iterator const_iterator;
+            std::vector<std::string> names;
+            const_iterator it = root_object.find("textures");
+            if (it != root_object.end())
+            {
+                const picojson::array& textures = it->second.get<picojson::array>();
+                for (size_t i = 0; i < textures.size(); i++)
+                {
+                    const picojson::object& tex = textures[i].get<picojson::object>();
+                    const_iterator eit = tex.find("extensions");
+                    if (eit != tex.end())
+                    {
+                        const picojson::object& extensions = eit->second.get<picojson::object>();
+                        for (const_iterator mit = extensions.begin(); mit != extensions.end(); mit++)
+                        {
+                            names.push_back(mit->first);
+                        }
+                    }
+                }
+            }
+            std::sort(names.begin(), names.end());
+            names.erase(std::unique(names.begin(), names.end()), names.end());
+            return names;
+        }
     } // namespace gltf
     //-----------------------------------------------------------------------------
 
-    static bool ExportGLTF(const std::string& path, const std::shared_ptr<Node>& node, const std::shared_ptr<Options>& opts, bool prettify = true)
+    static bool BuildGLTF(picojson::object& root_object, gltf::ObjectRegisterer& reg, const std::string& base_dir, const std::shared_ptr<Node>& node, const std::shared_ptr<Options>& opts)
     {
         bool output_bin = true;
         bool output_draco = false;
@@ -2898,10 +3159,7 @@ namespace kml
 
         bool make_preload_texture = opts->GetInt("make_preload_texture") > 0;
 
-        std::string base_dir = GetBaseDir(path);
-        std::string base_name = GetBaseName(path);
-        gltf::ObjectRegisterer reg(base_name);
-        picojson::object root_object;
+        reg.SetExportCache(ExportCache::Open(base_dir, opts));
 
         {
             picojson::object asset;
@@ -2961,6 +3219,12 @@ namespace kml
                 extensionsUsed.push_back(picojson::value(mat_extension_names[j]));
             }
 
+            std::vector<std::string> tex_extension_names = gltf::GetTextureExtensionNames(root_object);
+            for (size_t j = 0; j < tex_extension_names.size(); j++)
+            {
+                extensionsUsed.push_back(picojson::value(tex_extension_names[j]));
+            }
+
             if (!extensionsUsed.empty())
             {
                 root_object["extensionsUsed"] = picojson::value(extensionsUsed);
@@ -2971,6 +3235,51 @@ namespace kml
             }
         }
 
+        return true;
+    }
+
+    static bool IsBuffersGood(const gltf::ObjectRegisterer& reg)
+    {
+        const std::vector<std::shared_ptr<kml::gltf::Buffer> >& buffers = reg.GetBuffers();
+        for (size_t j = 0; j < buffers.size(); j++)
+        {
+            if (!buffers[j]->IsGood())
+            {
+                return false;
+            }
+        }
+        return !buffers.empty();
+    }
+
+    static bool ExportGLTF(const std::string& path, const std::shared_ptr<Node>& node, const std::shared_ptr<Options>& opts, bool prettify = true)
+    {
+        bool stream_buffers = opts->GetInt("stream_buffers") > 0;
+        // Loaders and the GLB container use 32 bit sizes, so large scenes are split into several .bin files.
+        size_t buffer_split_size = (size_t)std::max<int>(0, opts->GetInt("buffer_split_size_mb", 1024)) * 1024 * 1024;
+
+        std::string base_dir = GetBaseDir(path);
+        std::string base_name = GetBaseName(path);
+        gltf::ObjectRegisterer reg(base_name);
+        reg.SetMaxBufferSize(buffer_split_size);
+        if (stream_buffers)
+        {
+            // The buffer files do not depend on the JSON, so geometry goes there while it is registered.
+            reg.SetBufferSinkFactory([&base_dir](const std::string& uri) {
+                std::string binfile = base_dir + uri;
+                std::shared_ptr<FileOutputSink> sink(new FileOutputSink(binfile));
+                if (!sink->IsOpen())
+                {
+                    std::cerr << "Couldn't write bin outputfile :" << binfile << std::endl;
+                }
+                return std::shared_ptr<OutputSink>(sink);
+            });
+        }
+        picojson::object root_object;
+        if (!BuildGLTF(root_object, reg, base_dir, node, opts))
+        {
+            return false;
+        }
+
         {
             std::ofstream ofs(path.c_str());
             if (!ofs)
@@ -2982,32 +3291,105 @@ namespace kml
             picojson::value(root_object).serialize(std::ostream_iterator<char>(ofs), prettify);
         }
 
+        if (stream_buffers)
+        {
+            return IsBuffersGood(reg);
+        }
+
         {
             const std::vector<std::shared_ptr<kml::gltf::Buffer> >& buffers = reg.GetBuffers();
             if (buffers.empty())
             {
                 return false;
             }
-            std::string binfile = base_dir + buffers[0]->GetURI();
-            std::ofstream ofs(binfile.c_str(), std::ofstream::binary);
-            if (!ofs)
-            {
-                std::cerr << "Couldn't write bin outputfile :" << binfile << std::endl;
-                return false;
-            }
             for (size_t j = 0; j < buffers.size(); j++)
             {
                 const std::shared_ptr<kml::gltf::Buffer>& buffer = buffers[j];
+                std::string binfile = base_dir + buffer->GetURI();
+                std::ofstream ofs(binfile.c_str(), std::ofstream::binary);
+                if (!ofs)
+                {
+                    std::cerr << "Couldn't write bin outputfile :" << binfile << std::endl;
+                    return false;
+                }
                 ofs.write((const char*)buffer->GetBytesPtr(), buffer->GetByteLength());
+                if (!ofs)
+                {
+                    return false;
+                }
             }
         }
 
         return true;
     }
 
+    static bool ExportGLB(OutputSink& sink, const std::shared_ptr<Node>& node, const std::shared_ptr<Options>& opts, const std::string& base_dir)
+    {
+        std::string base_name = node->GetName().empty() ? std::string("scene") : node->GetName();
+        gltf::ObjectRegisterer reg(base_name); // one buffer, GLB has a single BIN chunk
+
+        // The BIN chunk follows the JSON, whose size is known only at the end. In streaming mode the
+        // geometry is spooled to a temporary file and copied behind the JSON.
+        FILE* spool = NULL;
+        if (opts->GetInt("stream_buffers") > 0)
+        {
+            spool = tmpfile();
+            if (spool)
+            {
+                std::shared_ptr<OutputSink> spool_sink(new FileOutputSink(spool));
+                reg.SetBufferSinkFactory([spool_sink](const std::string&) { return spool_sink; });
+            }
+        }
+
+        picojson::object root_object;
+        bool bRet = BuildGLTF(root_object, reg, base_dir, node, opts) && IsBuffersGood(reg);
+        if (bRet && spool)
+        {
+            size_t size = reg.GetBuffers()[0]->GetByteLength();
+            picojson::value root(root_object);
+            bRet = fflush(spool) == 0 && fseek(spool, 0, SEEK_SET) == 0;
+            bRet = bRet && GLTF2GLB(root, spool, size, base_dir, sink);
+        }
+        else if (bRet)
+        {
+            const std::vector<std::shared_ptr<kml::gltf::Buffer> >& buffers = reg.GetBuffers();
+            size_t total = 0;
+            for (size_t j = 0; j < buffers.size(); j++)
+            {
+                total += buffers[j]->GetByteLength();
+            }
+            std::vector<unsigned char> bin;
+            bin.reserve(total);
+            for (size_t j = 0; j < buffers.size(); j++)
+            {
+                const unsigned char* p = buffers[j]->GetBytesPtr();
+                bin.insert(bin.end(), p, p + buffers[j]->GetByteLength());
+            }
+
+            picojson::value root(root_object);
+            bRet = GLTF2GLB(root, bin, base_dir, sink);
+        }
+        if (spool)
+        {
+            fclose(spool);
+        }
+        return bRet;
+    }
+
     bool glTFExporter::Export(const std::string& path, const std::shared_ptr<Node>& node, const std::shared_ptr<Options>& opts) const
     {
         return ExportGLTF(path, node, opts);
     }
 
+    bool glTFExporter::Export(OutputSink& sink, const std::shared_ptr<Node>& node, const std::shared_ptr<Options>& opts, const std::string& base_dir) const
+    {
+        return ExportGLB(sink, node, opts, base_dir);
+    }
+
+    bool glTFExporter::Export(std::vector<unsigned char>& bytes, const std::shared_ptr<Node>& node, const std::shared_ptr<Options>& opts, const std::string& base_dir) const
+    {
+        MemoryOutputSink sink(bytes);
+        return ExportGLB(sink, node, opts, base_dir);
+    }
+
 } // namespace kml
@@ -4,6 +4,7 @@
 
 #include "Node.h"
 #include "Options.h"
+#include "OutputSink.h"
 #include <map>
 #include <vector>
 
@@ -12,7 +13,15 @@ namespace kml
     class glTFExporter
     {
     public:
+        // Each mesh is written as one glTF mesh with a primitive per value of Mesh::materials, which index
+        // the materials of the root node. Without Draco the primitives share one set of vertex accessors.
+        // With the "stream_buffers" option, geometry is written out while meshes are registered
+        // instead of being held in memory until the end.
         bool Export(const std::string& path, const std::shared_ptr<Node>& node, const std::shared_ptr<Options>& opts) const;
+        // Writes a GLB to the sink without touching the filesystem, except for reading textures
+        // whose image paths are resolved against base_dir.
+        bool Export(OutputSink& sink, const std::shared_ptr<Node>& node, const std::shared_ptr<Options>& opts, const std::string& base_dir = "") const;
+        bool Export(std::vector<unsigned char>& bytes, const std::shared_ptr<Node>& node, const std::shared_ptr<Options>& opts, const std::string& base_dir = "") const;
     };
 } // namespace kml
 
@@ -0,0 +1,1706 @@
+#ifdef _WIN32
+#define _CRT_SECURE_NO_WARNINGS 1
+#endif
+#define GLM_ENABLE_EXPERIMENTAL 1
+
+#include "glTFImporter.h"
+#include "MappedFile.h"
+#include "glTFConstants.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdio.h>
+#include <string.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <picojson/picojson.h>
+
+#ifdef ENABLE_BUILD_WITH_DRACO
+#include <draco/compression/decode.h>
+#include <draco/mesh/mesh.h>
+#endif
+
+namespace kml
+{
+    typedef std::uint32_t uint32;
+
+    namespace
+    {
+        struct BufferData
+        {
+            const unsigned char* data;
+            size_t size;
+        };
+
+        // Parsed document and the bytes of its buffers. Buffer files and the GLB stay mapped,
+        // accessors are read straight from the mappings.
+        struct Document
+        {
+            picojson::value json;
+            std::string base_dir;
+            std::string base_name;
+            std::vector<std::shared_ptr<MappedFile> > files;
+            std::vector<std::shared_ptr<std::vector<unsigned char> > > decoded;
+            std::vector<BufferData> buffers;
+            BufferData glb_bin;
+        };
+
+        static std::string IToS(int n)
+        {
+            std::stringstream ss;
+            ss << n;
+            return ss.str();
+        }
+
+        static std::string GetBaseDir(const std::string& filepath)
+        {
+            if (filepath.find_last_of("/\\") != std::string::npos)
+                return filepath.substr(0, filepath.find_last_of("/\\") + 1);
+            return "";
+        }
+
+        static std::string GetBaseName(const std::string& filepath)
+        {
+            std::string name = filepath.substr(GetBaseDir(filepath).size());
+            if (name.find_last_of(".") != std::string::npos)
+                return name.substr(0, name.find_last_of("."));
+            return name;
+        }
+
+        // Accessors below never throw, missing or mistyped members give the default.
+        static const picojson::object* GetObject(const picojson::value& v)
+        {
+            return v.is<picojson::object>() ? &v.get<picojson::object>() : NULL;
+        }
+
+        static const picojson::value* GetMember(const picojson::object& obj, const char* key)
+        {
+            picojson::object::const_iterator it = obj.find(key);
+            return (it != obj.end()) ? &it->second : NULL;
+        }
+
+        static const picojson::object* GetObject(const picojson::object& obj, const char* key)
+        {
+            const picojson::value* v = GetMember(obj, key);
+            return v ? GetObject(*v) : NULL;
+        }
+
+        static const picojson::array* GetArray(const picojson::object& obj, const char* key)
+        {
+            const picojson::value* v = GetMember(obj, key);
+            return (v && v->is<picojson::array>()) ? &v->get<picojson::array>() : NULL;
+        }
+
+        static double GetNumber(const picojson::object& obj, const char* key, double def)
+        {
+            const picojson::value* v = GetMember(obj, key);
+            return (v && v->is<double>()) ? v->get<double>() : def;
+        }
+
+        static int GetIndex(const picojson::object& obj, const char* key)
+        {
+            return (int)GetNumber(obj, key, -1);
+        }
+
+        static std::string GetString(const picojson::object& obj, const char* key, const std::string& def = "")
+        {
+            const picojson::value* v = GetMember(obj, key);
+            return (v && v->is<std::string>()) ? v->get<std::string>() : def;
+        }
+
+        static bool GetNumbers(const picojson::object& obj, const char* key, float* out, size_t n)
+        {
+            const picojson::array* ar = GetArray(obj, key);
+            if (!ar || ar->size() != n)
+            {
+                return false;
+            }
+            for (size_t i = 0; i < n; i++)
+            {
+                if (!(*ar)[i].is<double>())
+                {
+                    return false;
+                }
+                out[i] = (float)(*ar)[i].get<double>();
+            }
+            return true;
+        }
+
+        static const picojson::object* GetElement(const picojson::object& root, const char* key, int index)
+        {
+            const picojson::array* ar = GetArray(root, key);
+            if (!ar || index < 0 || index >= (int)ar->size())
+            {
+                return NULL;
+            }
+            return GetObject((*ar)[index]);
+        }
+
+        static std::string DecodeURI(const std::string& uri)
+        {
+            std::string s;
+            for (size_t i = 0; i < uri.size(); i++)
+            {
+                if (uri[i] == '%' && i + 2 < uri.size())
+                {
+                    s += (char)strtol(uri.substr(i + 1, 2).c_str(), NULL, 16);
+                    i += 2;
+                }
+                else
+                {
+                    s += uri[i];
+                }
+            }
+            return s;
+        }
+
+        static bool DecodeDataURI(const std::string& uri, std::vector<unsigned char>& bytes, std::string& mime_type)
+        {
+            size_t comma = uri.find(',');
+            if (uri.compare(0, 5, "data:") != 0 || comma == std::string::npos || uri.rfind(";base64", comma) == std::string::npos)
+            {
+                return false;
+            }
+            mime_type = uri.substr(5, uri.find(';') - 5);
+            static const std::string table = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+            uint32 acc = 0;
+            int bits = 0;
+            for (size_t i = comma + 1; i < uri.size(); i++)
+            {
+                size_t v = table.find(uri[i]);
+                if (v == std::string::npos)
+                {
+                    if (uri[i] == '=')
+                    {
+                        break;
+                    }
+                    continue;
+                }
+                acc = (acc << 6) | (uint32)v;
+                bits += 6;
+                if (bits >= 8)
+                {
+                    bits -= 8;
+                    bytes.push_back((unsigned char)((acc >> bits) & 0xFF));
+                }
+            }
+            return true;
+        }
+
+        static bool LoadDocument(Document& doc, const std::string& path)
+        {
+            std::shared_ptr<MappedFile> file(new MappedFile(path));
+            if (!file->IsOpen() || file->GetSize() < 4)
+            {
+                return false;
+            }
+            doc.files.push_back(file);
+            doc.base_dir = GetBaseDir(path);
+            doc.base_name = GetBaseName(path);
+            doc.glb_bin.data = NULL;
+            doc.glb_bin.size = 0;
+
+            const unsigned char* data = file->GetData();
+            size_t size = file->GetSize();
+            const char* json_begin = (const char*)data;
+            const char* json_end = json_begin + size;
+            if (memcmp(data, "glTF", 4) == 0)
+            {
+                // header, then chunks of (length, type, data)
+                if (size < 20)
+                {
+                    return false;
+                }
+                size_t offset = 12;
+                bool has_json = false;
+                while (offset + 8 <= size)
+                {
+                    uint32 length = 0;
+                    uint32 type = 0;
+                    memcpy(&length, data + offset, 4);
+                    memcpy(&type, data + offset + 4, 4);
+                    offset += 8;
+                    if (length > size - offset)
+                    {
+                        return false;
+                    }
+                    if (type == 0x4E4F534A && !has_json) //JSON
+                    {
+                        json_begin = (const char*)data + offset;
+                        json_end = json_begin + length;
+                        has_json = true;
+                    }
+                    else if (type == 0x004E4942 && doc.glb_bin.data == NULL) //BIN
+                    {
+                        doc.glb_bin.data = data + offset;
+                        doc.glb_bin.size = length;
+                    }
+                    offset += length;
+                }
+                if (!has_json)
+                {
+                    return false;
+                }
+            }
+
+            std::string err;
+            picojson::parse(doc.json, json_begin, json_end, &err);
+            if (!err.empty() || !doc.json.is<picojson::object>())
+            {
+                std::cerr << "glTFImporter : parse error : " << path << " " << err << std::endl;
+                return false;
+            }
+
+            const picojson::object& root = doc.json.get<picojson::object>();
+            const picojson::array* buffers = GetArray(root, "buffers");
+            if (!buffers)
+            {
+                return true;
+            }
+            for (size_t i = 0; i < buffers->size(); i++)
+            {
+                BufferData bd = {NULL, 0};
+                const picojson::object* buffer = GetObject((*buffers)[i]);
+                std::string uri = buffer ? GetString(*buffer, "uri") : std::string();
+                if (uri.empty())
+                {
+                    if (i == 0)
+                    {
+                        bd = doc.glb_bin;
+                    }
+                }
+                else if (uri.compare(0, 5, "data:") == 0)
+                {
+                    std::shared_ptr<std::vector<unsigned char> > bytes(new std::vector<unsigned char>());
+                    std::string mime_type;
+                    if (DecodeDataURI(uri, *bytes, mime_type) && !bytes->empty())
+                    {
+                        doc.decoded.push_back(bytes);
+                        bd.data = &(*bytes)[0];
+                        bd.size = bytes->size();
+                    }
+                }
+                else
+                {
+                    std::shared_ptr<MappedFile> bin(new MappedFile(doc.base_dir + DecodeURI(uri)));
+                    if (!bin->IsOpen())
+                    {
+                        std::cerr << "glTFImporter : couldn't open buffer : " << doc.base_dir + uri << std::endl;
+                        return false;
+                    }
+                    doc.files.push_back(bin);
+                    bd.data = bin->GetData();
+                    bd.size = bin->GetSize();
+                }
+                doc.buffers.push_back(bd);
+            }
+            return true;
+        }
+
+        static bool GetBufferViewData(const Document& doc, int index, const unsigned char*& data, size_t& length, size_t& stride)
+        {
+            const picojson::object& root = doc.json.get<picojson::object>();
+            const picojson::object* bv = GetElement(root, "bufferViews", index);
+            if (!bv)
+            {
+                return false;
+            }
+            int buffer = GetIndex(*bv, "buffer");
+            if (buffer < 0 || buffer >= (int)doc.buffers.size() || doc.buffers[buffer].data == NULL)
+            {
+                return false;
+            }
+            size_t offset = (size_t)GetNumber(*bv, "byteOffset", 0);
+            length = (size_t)GetNumber(*bv, "byteLength", 0);
+            stride = (size_t)GetNumber(*bv, "byteStride", 0);
+            if (offset > doc.buffers[buffer].size || length > doc.buffers[buffer].size - offset)
+            {
+                return false;
+            }
+            data = doc.buffers[buffer].data + offset;
+            return true;
+        }
+
+        static int GetNumComponents(const std::string& type)
+        {
+            if (type == "SCALAR")
+                return 1;
+            if (type == "VEC2")
+                return 2;
+            if (type == "VEC3")
+                return 3;
+            if (type == "VEC4")
+                return 4;
+            if (type == "MAT2")
+                return 4;
+            if (type == "MAT3")
+                return 9;
+            if (type == "MAT4")
+                return 16;
+            return 0;
+        }
+
+        static size_t GetComponentSize(int component_type)
+        {
+            switch (component_type)
+            {
+            case GLTF_COMPONENT_TYPE_BYTE:
+            case GLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+                return 1;
+            case GLTF_COMPONENT_TYPE_SHORT:
+            case GLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+                return 2;
+            case GLTF_COMPONENT_TYPE_UNSIGNED_INT:
+            case GLTF_COMPONENT_TYPE_FLOAT:
+                return 4;
+            }
+            return 0;
+        }
+
+        static float ReadComponent(const unsigned char* p, int component_type, bool normalized)
+        {
+            switch (component_type)
+            {
+            case GLTF_COMPONENT_TYPE_BYTE:
+            {
+                signed char v = (signed char)*p;
+                return normalized ? std::max<float>(v / 127.0f, -1.0f) : (float)v;
+            }
+            case GLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+                return normalized ? *p / 255.0f : (float)*p;
+            case GLTF_COMPONENT_TYPE_SHORT:
+            {
+                short v;
+                memcpy(&v, p, 2);
+                return normalized ? std::max<float>(v / 32767.0f, -1.0f) : (float)v;
+            }
+            case GLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+            {
+                unsigned short v;
+                memcpy(&v, p, 2);
+                return normalized ? v / 65535.0f : (float)v;
+            }
+            case GLTF_COMPONENT_TYPE_UNSIGNED_INT:
+            {
+                uint32 v;
+                memcpy(&v, p, 4);
+                return (float)v;
+            }
+            case GLTF_COMPONENT_TYPE_FLOAT:
+            {
+                float v;
+                memcpy(&v, p, 4);
+                return v;
+            }
+            }
+            return 0.0f;
+        }
+
+        // True if count elements of esize bytes, stride apart, lie within length bytes.
+        static bool FitsElements(size_t length, size_t stride, size_t count, size_t esize)
+        {
+            if (count == 0)
+            {
+                return true;
+            }
+            return stride >= esize && length >= esize && count - 1 <= (length - esize) / stride;
+        }
+
+        // Reads count elements of ncomp components, tightly packed float data is copied in one go.
+        static bool ReadElements(const unsigned char* data, size_t length, size_t stride, size_t count, int ncomp,
+                                 int component_type, bool normalized, float* out)
+        {
+            size_t csize = GetComponentSize(component_type);
+            size_t esize = csize * ncomp;
+            if (csize == 0)
+            {
+                return false;
+            }
+            if (stride == 0)
+            {
+                stride = esize;
+            }
+            if (!FitsElements(length, stride, count, esize))
+            {
+                return false;
+            }
+            if (component_type == GLTF_COMPONENT_TYPE_FLOAT && stride == esize)
+            {
+                memcpy(out, data, esize * count);
+                return true;
+            }
+            for (size_t i = 0; i < count; i++)
+            {
+                const unsigned char* p = data + i * stride;
+                for (int c = 0; c < ncomp; c++)
+                {
+                    out[i * ncomp + c] = ReadComponent(p + c * csize, component_type, normalized);
+                }
+            }
+            return true;
+        }
+
+        // Reads count unsigned integers, as index data and sparse indices are stored, without the round trip through float.
+        static bool ReadIntegers(const unsigned char* data, size_t length, size_t stride, size_t count, int component_type, std::vector<int>& out)
+        {
+            size_t csize = 0;
+            switch (component_type)
+            {
+            case GLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+                csize = 1;
+                break;
+            case GLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+                csize = 2;
+                break;
+            case GLTF_COMPONENT_TYPE_UNSIGNED_INT:
+                csize = 4;
+                break;
+            default:
+                return false;
+            }
+            if (stride == 0)
+            {
+                stride = csize;
+            }
+            if (!FitsElements(length, stride, count, csize))
+            {
+                return false;
+            }
+            out.resize(count);
+            for (size_t i = 0; i < count; i++)
+            {
+                const unsigned char* p = data + i * stride;
+                if (csize == 1)
+                {
+                    out[i] = *p;
+                }
+                else if (csize == 2)
+                {
+                    unsigned short v;
+                    memcpy(&v, p, 2);
+                    out[i] = v;
+                }
+                else
+                {
+                    uint32 v;
+                    memcpy(&v, p, 4);
+                    out[i] = (int)v;
+                }
+            }
+            return true;
+        }
+
+        static bool ReadAccessor(const Document& doc, int index, std::vector<float>& out, int& ncomp)
+        {
+            const picojson::object& root = doc.json.get<picojson::object>();
+            const picojson::object* acc = GetElement(root, "accessors", index);
+            if (!acc)
+            {
+                return false;
+            }
+            ncomp = GetNumComponents(GetString(*acc, "type"));
+            int component_type = GetIndex(*acc, "componentType");
+            bool normalized = false;
+            {
+                const picojson::value* v = GetMember(*acc, "normalized");
+                normalized = v && v->is<bool>() && v->get<bool>();
+            }
+            size_t count = (size_t)GetNumber(*acc, "count", 0);
+            size_t esize = GetComponentSize(component_type) * ncomp;
+            if (esize == 0 || count > out.max_size() / ncomp)
+            {
+                return false;
+            }
+
+            // the range is checked before anything is allocated for it
+            const unsigned char* data = NULL;
+            size_t length = 0;
+            size_t stride = 0;
+            int bv = GetIndex(*acc, "bufferView");
+            if (bv >= 0 && count > 0)
+            {
+                size_t offset = (size_t)GetNumber(*acc, "byteOffset", 0);
+                if (!GetBufferViewData(doc, bv, data, length, stride) || offset > length ||
+                    !FitsElements(length - offset, stride ? stride : esize, count, esize))
+                {
+                    return false;
+                }
+                data += offset;
+                length -= offset;
+            }
+            out.assign(count * ncomp, 0.0f);
+            if (data && !ReadElements(data, length, stride, count, ncomp, component_type, normalized, &out[0]))
+            {
+                return false;
+            }
+
+            const picojson::object* sparse = GetObject(*acc, "sparse");
+            if (sparse)
+            {
+                size_t scount = (size_t)GetNumber(*sparse, "count", 0);
+                const picojson::object* sindices = GetObject(*sparse, "indices");
+                const picojson::object* svalues = GetObject(*sparse, "values");
+                if (!sindices || !svalues)
+                {
+                    return false;
+                }
+                std::vector<int> indices;
+                std::vector<float> values;
+                if (scount > 0)
+                {
+                    size_t offset = (size_t)GetNumber(*sindices, "byteOffset", 0);
+                    if (!GetBufferViewData(doc, GetIndex(*sindices, "bufferView"), data, length, stride) || offset > length ||
+                        !ReadIntegers(data + offset, length - offset, 0, scount, GetIndex(*sindices, "componentType"), indices))
+                    {
+                        return false;
+                    }
+                    offset = (size_t)GetNumber(*svalues, "byteOffset", 0);
+                    if (!GetBufferViewData(doc, GetIndex(*svalues, "bufferView"), data, length, stride) || offset > length ||
+                        !FitsElements(length - offset, esize, scount, esize))
+                    {
+                        return false;
+                    }
+                    values.resize(scount * ncomp);
+                    if (!ReadElements(data + offset, length - offset, 0, scount, ncomp, component_type, normalized, &values[0]))
+                    {
+                        return false;
+                    }
+                }
+                for (size_t i = 0; i < scount; i++)
+                {
+                    size_t e = (size_t)(uint32)indices[i];
+                    if (e < count)
+                    {
+                        memcpy(&out[e * ncomp], &values[i * ncomp], sizeof(float) * ncomp);
+                    }
+                }
+            }
+            return true;
+        }
+
+        // Index accessors hold integers, read them without the round trip through float.
+        static bool ReadIndices(const Document& doc, int index, std::vector<int>& out)
+        {
+            const picojson::object& root = doc.json.get<picojson::object>();
+            const picojson::object* acc = GetElement(root, "accessors", index);
+            if (!acc || GetObject(*acc, "sparse"))
+            {
+                std::vector<float> values;
+                int ncomp = 0;
+                if (!ReadAccessor(doc, index, values, ncomp))
+                {
+                    return false;
+                }
+                out.resize(values.size());
+                for (size_t i = 0; i < values.size(); i++)
+                {
+                    out[i] = (int)values[i];
+                }
+                return true;
+            }
+            size_t count = (size_t)GetNumber(*acc, "count", 0);
+            const unsigned char* data = NULL;
+            size_t length = 0;
+            size_t stride = 0;
+            if (GetString(*acc, "type") != "SCALAR" || !GetBufferViewData(doc, GetIndex(*acc, "bufferView"), data, length, stride))
+            {
+                return false;
+            }
+            size_t offset = (size_t)GetNumber(*acc, "byteOffset", 0);
+            if (offset > length)
+            {
+                return false;
+            }
+            return ReadIntegers(data + offset, length - offset, stride, count, GetIndex(*acc, "componentType"), out);
+        }
+
+        static std::string GetImageExt(const std::string& mime_type)
+        {
+            if (mime_type == "image/png")
+                return ".png";
+            if (mime_type == "image/ktx2")
+                return ".ktx2";
+            if (mime_type == "image/bmp")
+                return ".bmp";
+            return ".jpg";
+        }
+
+        class SceneBuilder
+        {
+        public:
+            SceneBuilder(const Document& doc, const std::shared_ptr<Options>& opts)
+                : doc_(doc), root_(doc.json.get<picojson::object>()), opts_(opts), default_material_(-1)
+            {
+            }
+
+            std::shared_ptr<Node> Build()
+            {
+                scene_.reset(new Node());
+                scene_->SetName(doc_.base_name);
+                scene_->SetPath("|" + doc_.base_name);
+                paths_.insert(scene_->GetPath());
+
+                const picojson::array* nodes = GetArray(root_, "nodes");
+                nodes_.resize(nodes ? nodes->size() : 0);
+
+                std::vector<int> roots;
+                int scene = GetIndex(root_, "scene");
+                const picojson::object* sc = GetElement(root_, "scenes", scene >= 0 ? scene : 0);
+                if (sc)
+                {
+                    const picojson::array* ar = GetArray(*sc, "nodes");
+                    for (size_t i = 0; ar && i < ar->size(); i++)
+                    {
+                        if ((*ar)[i].is<double>())
+                        {
+                            roots.push_back((int)(*ar)[i].get<double>());
+                        }
+                    }
+                }
+                else
+                {
+                    // no scene, every node without a parent is a root
+                    std::vector<int> has_parent(nodes_.size(), 0);
+                    for (size_t i = 0; i < nodes_.size(); i++)
+                    {
+                        const picojson::object* nd = GetObject((*nodes)[i]);
+                        const picojson::array* children = nd ? GetArray(*nd, "children") : NULL;
+                        for (size_t j = 0; children && j < children->size(); j++)
+                        {
+                            int c = (*children)[j].is<double>() ? (int)(*children)[j].get<double>() : -1;
+                            if (c >= 0 && c < (int)has_parent.size())
+                            {
+                                has_parent[c] = 1;
+                            }
+                        }
+                    }
+                    for (size_t i = 0; i < nodes_.size(); i++)
+                    {
+                        if (!has_parent[i])
+                        {
+                            roots.push_back((int)i);
+                        }
+                    }
+                }
+                for (size_t i = 0; i < roots.size(); i++)
+                {
+                    CreateNode(roots[i], scene_);
+                }
+
+                CreateMaterials();
+                CreateSkins();
+                for (size_t i = 0; i < nodes_.size(); i++)
+                {
+                    if (nodes_[i] && !CreateMeshes((int)i))
+                    {
+                        // nothing refers to the images written so far
+                        for (size_t j = 0; j < images_.size(); j++)
+                        {
+                            remove(images_[j].c_str());
+                        }
+                        return std::shared_ptr<Node>();
+                    }
+                }
+                CreateAnimations();
+                return scene_;
+            }
+
+        private:
+            std::string MakeUniquePath(const std::string& path)
+            {
+                std::string p = path;
+                for (int i = 1; paths_.find(p) != paths_.end(); i++)
+                {
+                    p = path + "_" + IToS(i);
+                }
+                paths_.insert(p);
+                return p;
+            }
+
+            void CreateNode(int index, const std::shared_ptr<Node>& parent)
+            {
+                const picojson::object* nd = GetElement(root_, "nodes", index);
+                if (!nd || nodes_[index])
+                {
+                    return; // a node is only placed once, which also stops cycles
+                }
+                std::shared_ptr<Node> node(new Node());
+                std::string name = GetString(*nd, "name", "node_" + IToS(index));
+                node->SetName(name);
+                node->SetPath(MakeUniquePath(parent->GetPath() + "|" + name));
+
+                float m[16];
+                float t[3] = {0, 0, 0};
+                float r[4] = {0, 0, 0, 1};
+                float s[3] = {1, 1, 1};
+                if (GetNumbers(*nd, "matrix", m, 16))
+                {
+                    glm::mat4 mat;
+                    for (int c = 0; c < 4; c++)
+                    {
+                        for (int k = 0; k < 4; k++)
+                        {
+                            mat[c][k] = m[4 * c + k];
+                        }
+                    }
+                    node->GetTransform()->SetMatrix(mat);
+                }
+                else
+                {
+                    GetNumbers(*nd, "translation", t, 3);
+                    GetNumbers(*nd, "rotation", r, 4);
+                    GetNumbers(*nd, "scale", s, 3);
+                    node->GetTransform()->SetTRS(glm::vec3(t[0], t[1], t[2]), glm::quat(r[3], r[0], r[1], r[2]), glm::vec3(s[0], s[1], s[2]));
+                }
+
+                nodes_[index] = node;
+                parent->AddChild(node);
+
+                const picojson::array* children = GetArray(*nd, "children");
+                for (size_t i = 0; children && i < children->size(); i++)
+                {
+                    if ((*children)[i].is<double>())
+                    {
+                        CreateNode((int)(*children)[i].get<double>(), node);
+                    }
+                }
+            }
+
+            std::shared_ptr<Texture> CreateTexture(const picojson::object& info, bool is_srgb)
+            {
+                int index = GetIndex(info, "index");
+                std::map<std::pair<int, bool>, std::shared_ptr<Texture> >::iterator it = textures_.find(std::make_pair(index, is_srgb));
+                if (it != textures_.end())
+                {
+                    return it->second;
+                }
+                const picojson::object* tex = GetElement(root_, "textures", index);
+                if (!tex)
+                {
+                    return std::shared_ptr<Texture>();
+                }
+                const picojson::object* image = GetElement(root_, "images", GetIndex(*tex, "source"));
+                if (!image)
+                {
+                    return std::shared_ptr<Texture>();
+                }
+
+                std::shared_ptr<Texture> texture(new Texture());
+                std::string path;
+                std::string name;
+                if (!GetImagePath(*image, GetIndex(*tex, "source"), path, name))
+                {
+                    texture->SetFileExists(false);
+                }
+                texture->SetFilePath(path);
+                texture->SetCacheFilePath(name);
+                texture->SetColorSpace(is_srgb ? "sRGB" : "Raw");
+
+                const picojson::object* sampler = GetElement(root_, "samplers", GetIndex(*tex, "sampler"));
+                if (sampler)
+                {
+                    int wrap[2] = {GetIndex(*sampler, "wrapS"), GetIndex(*sampler, "wrapT")};
+                    Texture::WrapType types[2] = {Texture::WRAP_REPEAT, Texture::WRAP_REPEAT};
+                    for (int i = 0; i < 2; i++)
+                    {
+                        if (wrap[i] == GLTF_TEXTURE_WRAP_CLAMP_TO_EDGE)
+                            types[i] = Texture::WRAP_CLAMP;
+                        else if (wrap[i] == GLTF_TEXTURE_WRAP_MIRRORED_REPEAT)
+                            types[i] = Texture::WRAP_MIRROR;
+                    }
+                    texture->SetWrapTypeU(types[0]);
+                    texture->SetWrapTypeV(types[1]);
+                    texture->SetFilter(GetIndex(*sampler, "magFilter") == GLTF_TEXTURE_FILTER_NEAREST ? Texture::FILTER_NEAREST : Texture::FILTER_LINEAR);
+                }
+                else
+                {
+                    texture->SetFilter(Texture::FILTER_LINEAR);
+                }
+                textures_[std::make_pair(index, is_srgb)] = texture;
+                return texture;
+            }
+
+            // Resolves the file of an image. Images inside the document are written out when embedded_image_dir is set.
+            bool GetImagePath(const picojson::object& image, int index, std::string& path, std::string& name)
+            {
+                std::string uri = GetString(image, "uri");
+                if (!uri.empty() && uri.compare(0, 5, "data:") != 0)
+                {
+                    name = DecodeURI(uri);
+                    path = doc_.base_dir + name;
+                    return true;
+                }
+
+                std::string dir = opts_->GetString("embedded_image_dir");
+                if (dir.empty())
+                {
+                    return false;
+                }
+                if (dir[dir.size() - 1] != '/' && dir[dir.size() - 1] != '\\')
+                {
+                    dir += "/";
+                }
+
+                std::vector<unsigned char> decoded;
+                std::string mime_type = GetString(image, "mimeType");
+                const unsigned char* data = NULL;
+                size_t length = 0;
+                if (!uri.empty())
+                {
+                    if (!DecodeDataURI(uri, decoded, mime_type) || decoded.empty())
+                    {
+                        return false;
+                    }
+                    data = &decoded[0];
+                    length = decoded.size();
+                }
+                else
+                {
+                    size_t stride = 0;
+                    if (!GetBufferViewData(doc_, GetIndex(image, "bufferView"), data, length, stride))
+                    {
+                        return false;
+                    }
+                }
+
+                name = opts_->GetString("embedded_image_prefix", doc_.base_name + "_image") + IToS(index) + GetImageExt(mime_type);
+                path = dir + name;
+                FILE* fp = fopen(path.c_str(), "wb");
+                if (!fp)
+                {
+                    return false;
+                }
+                images_.push_back(path);
+                bool bRet = fwrite(data, 1, length, fp) == length;
+                fclose(fp);
+                return bRet;
+            }
+
+            void CreateMaterials()
+            {
+                const picojson::array* materials = GetArray(root_, "materials");
+                for (size_t i = 0; materials && i < materials->size(); i++)
+                {
+                    std::shared_ptr<Material> mat(new Material());
+                    const picojson::object* nd = GetObject((*materials)[i]);
+                    static const picojson::object empty;
+                    if (!nd)
+                    {
+                        nd = &empty;
+                    }
+                    mat->SetName(GetString(*nd, "name", "material_" + IToS((int)i)));
+
+                    const picojson::object* pbr = GetObject(*nd, "pbrMetallicRoughness");
+                    if (!pbr)
+                    {
+                        pbr = &empty;
+                    }
+                    float color[4] = {1, 1, 1, 1};
+                    GetNumbers(*pbr, "baseColorFactor", color, 4);
+                    mat->SetFloat("BaseColor.R", color[0]);
+                    mat->SetFloat("BaseColor.G", color[1]);
+                    mat->SetFloat("BaseColor.B", color[2]);
+                    mat->SetFloat("BaseColor.A", color[3]);
+                    mat->SetFloat("metallicFactor", (float)GetNumber(*pbr, "metallicFactor", 1.0));
+                    mat->SetFloat("roughnessFactor", (float)GetNumber(*pbr, "roughnessFactor", 1.0));
+
+                    float emission[3] = {0, 0, 0};
+                    GetNumbers(*nd, "emissiveFactor", emission, 3);
+                    mat->SetFloat("Emission.R", emission[0]);
+                    mat->SetFloat("Emission.G", emission[1]);
+                    mat->SetFloat("Emission.B", emission[2]);
+
+                    mat->SetString("AlphaMode", GetString(*nd, "alphaMode", "OPAQUE"));
+                    mat->SetFloat("AlphaCutoff", (float)GetNumber(*nd, "alphaCutoff", 0.5));
+                    const picojson::value* doubleSided = GetMember(*nd, "doubleSided");
+                    if (doubleSided && doubleSided->is<bool>() && doubleSided->get<bool>())
+                    {
+                        mat->SetInteger("DoubleSided", 1);
+                    }
+                    const picojson::object* extensions = GetObject(*nd, "extensions");
+                    if (extensions && GetMember(*extensions, "KHR_materials_unlit"))
+                    {
+                        mat->SetString("ShadingMode", "UNLIT");
+                    }
+
+                    const picojson::object* info = GetObject(*pbr, "baseColorTexture");
+                    std::shared_ptr<Texture> tex = info ? CreateTexture(*info, true) : std::shared_ptr<Texture>();
+                    if (tex)
+                    {
+                        mat->SetTexture("BaseColor", tex);
+                    }
+                    info = GetObject(*nd, "emissiveTexture");
+                    tex = info ? CreateTexture(*info, true) : std::shared_ptr<Texture>();
+                    if (tex)
+                    {
+                        mat->SetTexture("Emission", tex);
+                    }
+                    info = GetObject(*nd, "normalTexture");
+                    tex = info ? CreateTexture(*info, false) : std::shared_ptr<Texture>();
+                    if (tex)
+                    {
+                        mat->SetTexture("Normal", tex);
+                    }
+
+                    // occlusion and metallic/roughness map to the packed ORM texture the exporter writes
+                    const picojson::object* mr_info = GetObject(*pbr, "metallicRoughnessTexture");
+                    const picojson::object* occ_info = GetObject(*nd, "occlusionTexture");
+                    std::shared_ptr<Texture> mr = mr_info ? CreateTexture(*mr_info, false) : std::shared_ptr<Texture>();
+                    std::shared_ptr<Texture> occ = occ_info ? CreateTexture(*occ_info, false) : std::shared_ptr<Texture>();
+                    if (mr)
+                    {
+                        mat->SetTexture("ORM", mr);
+                        mat->SetInteger("ORM.MetallicRoughness", 1);
+                        if (occ == mr)
+                        {
+                            mat->SetInteger("ORM.Occlusion", 1);
+                        }
+                        else if (occ)
+                        {
+                            mat->SetTexture("Occlusion", occ);
+                        }
+                    }
+                    else if (occ)
+                    {
+                        mat->SetTexture("ORM", occ);
+                        mat->SetInteger("ORM.Occlusion", 1);
+                    }
+
+                    scene_->AddMaterial(mat);
+                }
+            }
+
+            int GetDefaultMaterial()
+            {
+                if (default_material_ < 0)
+                {
+                    std::shared_ptr<Material> mat(new Material());
+                    mat->SetName("default");
+                    mat->SetFloat("BaseColor.R", 1.0f);
+                    mat->SetFloat("BaseColor.G", 1.0f);
+                    mat->SetFloat("BaseColor.B", 1.0f);
+                    mat->SetFloat("BaseColor.A", 1.0f);
+                    mat->SetFloat("metallicFactor", 1.0f);
+                    mat->SetFloat("roughnessFactor", 1.0f);
+                    default_material_ = (int)scene_->GetMaterials().size();
+                    scene_->AddMaterial(mat);
+                }
+                return default_material_;
+            }
+
+            void CreateSkins()
+            {
+                const picojson::array* skins = GetArray(root_, "skins");
+                skins_.resize(skins ? skins->size() : 0);
+                for (size_t i = 0; i < skins_.size(); i++)
+                {
+                    const picojson::object* nd = GetObject((*skins)[i]);
+                    if (!nd)
+                    {
+                        continue;
+                    }
+                    std::shared_ptr<Skin> skin(new Skin());
+                    skin->SetName(GetString(*nd, "name", "skin_" + IToS((int)i)));
+
+                    std::vector<float> matrices;
+                    int ncomp = 0;
+                    int ibm = GetIndex(*nd, "inverseBindMatrices");
+                    if (ibm >= 0 && (!ReadAccessor(doc_, ibm, matrices, ncomp) || ncomp != 16))
+                    {
+                        matrices.clear();
+                    }
+
+                    std::vector<glm::mat4> binds;
+                    const picojson::array* joints = GetArray(*nd, "joints");
+                    for (size_t j = 0; joints && j < joints->size(); j++)
+                    {
+                        int index = (*joints)[j].is<double>() ? (int)(*joints)[j].get<double>() : -1;
+                        std::shared_ptr<Node> joint = (index >= 0 && index < (int)nodes_.size()) ? nodes_[index] : std::shared_ptr<Node>();
+                        if (!joint)
+                        {
+                            std::cerr << "glTFImporter : skin joint is not in the scene : " << index << std::endl;
+                            skins_[i].reset();
+                            break;
+                        }
+                        glm::mat4 mat(1.0f);
+                        if ((j + 1) * 16 <= matrices.size())
+                        {
+                            for (int c = 0; c < 4; c++)
+                            {
+                                for (int k = 0; k < 4; k++)
+                                {
+                                    mat[c][k] = matrices[16 * j + 4 * c + k];
+                                }
+                            }
+                        }
+                        skin->AddJoint(joint);
+                        binds.push_back(mat);
+                        skins_[i] = skin;
+                    }
+                    if (skins_[i])
+                    {
+                        skin->SetJointBindMatrices(binds);
+                        scene_->AddSkin(skin);
+                    }
+                }
+            }
+
+            static bool ConvertToTriangles(int mode, std::vector<int>& indices)
+            {
+                if (mode == GLTF_MODE_TRIANGLES)
+                {
+                    indices.resize(indices.size() / 3 * 3);
+                    return true;
+                }
+                std::vector<int> tris;
+                if (mode == GLTF_MODE_TRIANGLE_STRIP)
+                {
+                    for (size_t i = 2; i < indices.size(); i++)
+                    {
+                        bool odd = (i % 2) != 0;
+                        tris.push_back(indices[i - 2]);
+                        tris.push_back(odd ? indices[i] : indices[i - 1]);
+                        tris.push_back(odd ? indices[i - 1] : indices[i]);
+                    }
+                }
+                else if (mode == GLTF_MODE_TRIANGLE_FAN)
+                {
+                    for (size_t i = 2; i < indices.size(); i++)
+                    {
+                        tris.push_back(indices[0]);
+                        tris.push_back(indices[i - 1]);
+                        tris.push_back(indices[i]);
+                    }
+                }
+                else
+                {
+                    return false; // points and lines are not meshes in kml
+                }
+                indices.swap(tris);
+                return true;
+            }
+
+            // A mesh read for one node, reused by the other nodes instancing the same glTF mesh and skin.
+            // primitive is -1 for the mesh of the node itself, else the primitive its child node was made for.
+            struct MeshPart
+            {
+                int primitive;
+                std::shared_ptr<Mesh> mesh;
+                std::vector<std::shared_ptr<Material> > materials;
+            };
+
+            std::shared_ptr<Node> CreatePrimitiveNode(const std::shared_ptr<Node>& node, int primitive)
+            {
+                std::shared_ptr<Node> owner(new Node());
+                owner->SetName(node->GetName() + "_" + IToS(primitive));
+                owner->SetPath(MakeUniquePath(node->GetPath() + "|" + owner->GetName()));
+                owner->SetOriginalPath(node->GetPath());
+                node->AddChild(owner);
+                return owner;
+            }
+
+            struct PrimitiveData
+            {
+                std::map<std::string, std::vector<float> > attributes;
+                std::map<std::string, int> ncomps;
+                std::vector<int> indices;
+                bool has_indices;
+            };
+
+            bool ReadPrimitive(const picojson::object& primitive, PrimitiveData& prim)
+            {
+                prim.has_indices = false;
+                const picojson::object* extensions = GetObject(primitive, "extensions");
+                const picojson::object* draco = extensions ? GetObject(*extensions, "KHR_draco_mesh_compression") : NULL;
+                if (draco)
+                {
+                    return DecodeDraco(*draco, prim);
+                }
+
+                const picojson::object* attributes = GetObject(primitive, "attributes");
+                if (!attributes)
+                {
+                    return false;
+                }
+                for (picojson::object::const_iterator it = attributes->begin(); it != attributes->end(); ++it)
+                {
+                    if (!it->second.is<double>())
+                    {
+                        continue;
+                    }
+                    std::vector<float>& values = prim.attributes[it->first];
+                    if (!ReadAccessor(doc_, (int)it->second.get<double>(), values, prim.ncomps[it->first]))
+                    {
+                        std::cerr << "glTFImporter : invalid accessor : " << it->first << std::endl;
+                        return false;
+                    }
+                }
+                int indices = GetIndex(primitive, "indices");
+                if (indices >= 0)
+                {
+                    if (!ReadIndices(doc_, indices, prim.indices))
+                    {
+                        std::cerr << "glTFImporter : invalid indices" << std::endl;
+                        return false;
+                    }
+                    prim.has_indices = true;
+                }
+                return true;
+            }
+
+            bool DecodeDraco(const picojson::object& ext, PrimitiveData& prim)
+            {
+#ifdef ENABLE_BUILD_WITH_DRACO
+                const unsigned char* data = NULL;
+                size_t length = 0;
+                size_t stride = 0;
+                if (!GetBufferViewData(doc_, GetIndex(ext, "bufferView"), data, length, stride))
+                {
+                    return false;
+                }
+                draco::DecoderBuffer buffer;
+                buffer.Init((const char*)data, length);
+                draco::Decoder decoder;
+                auto status_or = decoder.DecodeMeshFromBuffer(&buffer);
+                if (!status_or.ok())
+                {
+                    std::cerr << "glTFImporter : draco decode failed : " << status_or.status().error_msg() << std::endl;
+                    return false;
+                }
+                std::unique_ptr<draco::Mesh> mesh = std::move(status_or).value();
+
+                prim.indices.resize(mesh->num_faces() * 3);
+                for (draco::FaceIndex f(0); f < mesh->num_faces(); ++f)
+                {
+                    const draco::Mesh::Face& face = mesh->face(f);
+                    for (int k = 0; k < 3; k++)
+                    {
+                        prim.indices[3 * f.value() + k] = (int)face[k].value();
+                    }
+                }
+                prim.has_indices = true;
+
+                const picojson::object* attributes = GetObject(ext, "attributes");
+                for (picojson::object::const_iterator it = attributes ? attributes->begin() : picojson::object::const_iterator();
+                     attributes && it != attributes->end(); ++it)
+                {
+                    if (!it->second.is<double>())
+                    {
+                        continue;
+                    }
+                    const draco::PointAttribute* attr = mesh->GetAttributeByUniqueId((uint32)it->second.get<double>());
+                    if (!attr)
+                    {
+                        return false;
+                    }
+                    int ncomp = attr->num_components();
+                    std::vector<float>& values = prim.attributes[it->first];
+                    values.resize((size_t)mesh->num_points() * ncomp);
+                    for (draco::PointIndex p(0); p < mesh->num_points(); ++p)
+                    {
+                        attr->ConvertValue<float>(attr->mapped_index(p), (int8_t)ncomp, &values[(size_t)p.value() * ncomp]);
+                    }
+                    prim.ncomps[it->first] = ncomp;
+                }
+                return true;
+#else
+                (void)ext;
+                (void)prim;
+                std::cerr << "glTFImporter : KHR_draco_mesh_compression needs a build with Draco" << std::endl;
+                return false;
+#endif
+            }
+
+            bool CreateMeshes(int index)
+            {
+                const picojson::object* nd = GetElement(root_, "nodes", index);
+                const picojson::object* mesh = nd ? GetElement(root_, "meshes", GetIndex(*nd, "mesh")) : NULL;
+                if (!mesh)
+                {
+                    return true;
+                }
+                const picojson::array* primitives = GetArray(*mesh, "primitives");
+                if (!primitives)
+                {
+                    return true;
+                }
+                std::string mesh_name = GetString(*mesh, "name", "mesh_" + IToS(GetIndex(*nd, "mesh")));
+                int skin_index = GetIndex(*nd, "skin");
+                std::shared_ptr<Skin> skin = (skin_index >= 0 && skin_index < (int)skins_.size()) ? skins_[skin_index] : std::shared_ptr<Skin>();
+                std::shared_ptr<Node> node = nodes_[index];
+
+                std::pair<int, int> key(GetIndex(*nd, "mesh"), skin ? skin_index : -1);
+                std::map<std::pair<int, int>, std::vector<MeshPart> >::const_iterator cached = meshes_.find(key);
+                if (cached != meshes_.end())
+                {
+                    for (size_t i = 0; i < cached->second.size(); i++)
+                    {
+                        const MeshPart& part = cached->second[i];
+                        std::shared_ptr<Node> owner = (part.primitive < 0) ? node : CreatePrimitiveNode(node, part.primitive);
+                        owner->SetMesh(part.mesh);
+                        for (size_t j = 0; j < part.materials.size(); j++)
+                        {
+                            owner->AddMaterial(part.materials[j]);
+                        }
+                    }
+                    return true;
+                }
+
+                float weights[256];
+                std::vector<float> default_weights;
+                const picojson::array* war = GetArray(*mesh, "weights");
+                if (war && war->size() <= 256 && GetNumbers(*mesh, "weights", weights, war->size()))
+                {
+                    default_weights.assign(weights, weights + war->size());
+                }
+                std::vector<std::string> target_names;
+                const picojson::object* extras = GetObject(*mesh, "extras");
+                const picojson::array* nar = extras ? GetArray(*extras, "targetNames") : NULL;
+                for (size_t i = 0; nar && i < nar->size(); i++)
+                {
+                    target_names.push_back((*nar)[i].is<std::string>() ? (*nar)[i].get<std::string>() : std::string());
+                }
+
+                bool shared = SharesVertices(*primitives);
+                std::shared_ptr<Mesh> shared_mesh;
+                std::vector<std::pair<int, std::shared_ptr<Node> > > owners;
+                for (size_t i = 0; i < primitives->size(); i++)
+                {
+                    const picojson::object* primitive = GetObject((*primitives)[i]);
+                    if (!primitive)
+                    {
+                        continue;
+                    }
+                    if (shared_mesh.get())
+                    {
+                        if (!AppendFaces(shared_mesh, node, *primitive))
+                        {
+                            std::cerr << "glTFImporter : invalid indices : " << mesh_name << std::endl;
+                            return false;
+                        }
+                        continue;
+                    }
+                    PrimitiveData prim;
+                    if (!ReadPrimitive(*primitive, prim))
+                    {
+                        return false;
+                    }
+                    std::map<std::string, std::vector<float> >::iterator pos = prim.attributes.find("POSITION");
+                    if (pos == prim.attributes.end() || prim.ncomps["POSITION"] != 3)
+                    {
+                        continue;
+                    }
+                    size_t nverts = pos->second.size() / 3;
+                    if (!prim.has_indices)
+                    {
+                        prim.indices.resize(nverts);
+                        for (size_t v = 0; v < nverts; v++)
+                        {
+                            prim.indices[v] = (int)v;
+                        }
+                    }
+                    if (!ConvertToTriangles((int)GetNumber(*primitive, "mode", GLTF_MODE_TRIANGLES), prim.indices))
+                    {
+                        continue;
+                    }
+                    bool bValid = true;
+                    for (size_t v = 0; v < prim.indices.size(); v++)
+                    {
+                        bValid &= prim.indices[v] >= 0 && prim.indices[v] < (int)nverts;
+                    }
+                    if (!bValid)
+                    {
+                        std::cerr << "glTFImporter : index out of range : " << mesh_name << std::endl;
+                        return false;
+                    }
+
+                    std::shared_ptr<Mesh> m(new Mesh());
+                    m->name = mesh_name;
+                    m->positions.resize(nverts);
+                    for (size_t v = 0; v < nverts; v++)
+                    {
+                        m->positions[v] = glm::vec3(pos->second[3 * v + 0], pos->second[3 * v + 1], pos->second[3 * v + 2]);
+                    }
+                    const std::vector<float>& normals = prim.attributes["NORMAL"];
+                    if (prim.ncomps["NORMAL"] == 3 && normals.size() == nverts * 3)
+                    {
+                        m->normals.resize(nverts);
+                        for (size_t v = 0; v < nverts; v++)
+                        {
+                            m->normals[v] = glm::vec3(normals[3 * v + 0], normals[3 * v + 1], normals[3 * v + 2]);
+                        }
+                    }
+                    const std::vector<float>& texcoords = prim.attributes["TEXCOORD_0"];
+                    if (prim.ncomps["TEXCOORD_0"] == 2 && texcoords.size() == nverts * 2)
+                    {
+                        m->texcoords.resize(nverts);
+                        for (size_t v = 0; v < nverts; v++)
+                        {
+                            m->texcoords[v] = glm::vec2(texcoords[2 * v + 0], texcoords[2 * v + 1]);
+                        }
+                    }
+                    const std::vector<float>& tangents = prim.attributes["TANGENT"];
+                    if (prim.ncomps["TANGENT"] == 4 && tangents.size() == nverts * 4)
+                    {
+                        m->tangents.resize(nverts);
+                        for (size_t v = 0; v < nverts; v++)
+                        {
+                            m->tangents[v] = glm::vec4(tangents[4 * v + 0], tangents[4 * v + 1], tangents[4 * v + 2], tangents[4 * v + 3]);
+                        }
+                    }
+
+                    size_t nfaces = prim.indices.size() / 3;
+                    int material = GetIndex(*primitive, "material");
+                    if (material < 0 || material >= (int)scene_->GetMaterials().size())
+                    {
+                        material = GetDefaultMaterial();
+                    }
+                    m->facenums.assign(nfaces, 3);
+                    m->materials.assign(nfaces, material);
+                    m->pos_indices = prim.indices;
+                    m->nor_indices = prim.indices;
+                    if (m->texcoords.empty())
+                    {
+                        m->tex_indices.assign(prim.indices.size(), -1);
+                    }
+                    else
+                    {
+                        m->tex_indices = prim.indices;
+                    }
+
+                    if (skin)
+                    {
+                        CreateSkinWeight(m, skin, prim);
+                    }
+                    CreateMorphTargets(m, *primitive, default_weights, target_names);
+
+                    std::shared_ptr<Node> owner = node;
+                    if (shared)
+                    {
+                        shared_mesh = m;
+                    }
+                    else if (primitives->size() > 1)
+                    {
+                        // primitives with vertices of their own become child nodes
+                        owner = CreatePrimitiveNode(node, (int)i);
+                    }
+                    owner->SetMesh(m);
+                    owner->AddMaterial(scene_->GetMaterials()[material]);
+                    owners.push_back(std::make_pair((owner == node) ? -1 : (int)i, owner));
+                }
+
+                std::vector<MeshPart>& parts = meshes_[key];
+                for (size_t i = 0; i < owners.size(); i++)
+                {
+                    MeshPart part;
+                    part.primitive = owners[i].first;
+                    part.mesh = owners[i].second->GetMesh();
+                    part.materials = owners[i].second->GetMaterials();
+                    parts.push_back(part);
+                }
+                return true;
+            }
+
+            // True when every primitive draws from the same vertex accessors, as glTFExporter writes meshes with
+            // several materials. Those are read once into one Mesh with a material per face.
+            static bool SharesVertices(const picojson::array& primitives)
+            {
+                if (primitives.size() < 2)
+                {
+                    return false;
+                }
+                const picojson::object* first = GetObject(primitives[0]);
+                for (size_t i = 0; i < primitives.size(); i++)
+                {
+                    const picojson::object* primitive = GetObject(primitives[i]);
+                    if (!primitive || !GetObject(*primitive, "attributes") || GetMember(*primitive, "extensions"))
+                    {
+                        return false;
+                    }
+                    static const char* KEYS[] = {"attributes", "targets", NULL};
+                    for (int k = 0; KEYS[k]; k++)
+                    {
+                        const picojson::value* a = GetMember(*first, KEYS[k]);
+                        const picojson::value* b = GetMember(*primitive, KEYS[k]);
+                        if ((a == NULL) != (b == NULL) || (a && *a != *b))
+                        {
+                            return false;
+                        }
+                    }
+                }
+                return true;
+            }
+
+            // Adds the faces of a primitive drawing from the vertices already in mesh.
+            bool AppendFaces(std::shared_ptr<Mesh>& mesh, const std::shared_ptr<Node>& node, const picojson::object& primitive)
+            {
+                size_t nverts = mesh->positions.size();
+                std::vector<int> indices;
+                int accessor = GetIndex(primitive, "indices");
+                if (accessor >= 0)
+                {
+                    if (!ReadIndices(doc_, accessor, indices))
+                    {
+                        return false;
+                    }
+                }
+                else
+                {
+                    indices.resize(nverts);
+                    for (size_t v = 0; v < nverts; v++)
+                    {
+                        indices[v] = (int)v;
+                    }
+                }
+                if (!ConvertToTriangles((int)GetNumber(primitive, "mode", GLTF_MODE_TRIANGLES), indices))
+                {
+                    return true;
+                }
+                for (size_t v = 0; v < indices.size(); v++)
+                {
+                    if (indices[v] < 0 || indices[v] >= (int)nverts)
+                    {
+                        return false;
+                    }
+                }
+
+                size_t nfaces = indices.size() / 3;
+                int material = GetIndex(primitive, "material");
+                if (material < 0 || material >= (int)scene_->GetMaterials().size())
+                {
+                    material = GetDefaultMaterial();
+                }
+                mesh->facenums.insert(mesh->facenums.end(), nfaces, 3);
+                mesh->materials.insert(mesh->materials.end(), nfaces, material);
+                mesh->pos_indices.insert(mesh->pos_indices.end(), indices.begin(), indices.end());
+                mesh->nor_indices.insert(mesh->nor_indices.end(), indices.begin(), indices.end());
+                if (mesh->texcoords.empty())
+                {
+                    mesh->tex_indices.insert(mesh->tex_indices.end(), indices.size(), -1);
+                }
+                else
+                {
+                    mesh->tex_indices.insert(mesh->tex_indices.end(), indices.begin(), indices.end());
+                }
+
+                const std::shared_ptr<Material>& mat = scene_->GetMaterials()[material];
+                const std::vector<std::shared_ptr<Material> >& materials = node->GetMaterials();
+                if (std::find(materials.begin(), materials.end(), mat) == materials.end())
+                {
+                    node->AddMaterial(mat);
+                }
+                return true;
+            }
+
+            void CreateSkinWeight(std::shared_ptr<Mesh>& mesh, const std::shared_ptr<Skin>& skin, PrimitiveData& prim)
+            {
+                const std::vector<float>& joints = prim.attributes["JOINTS_0"];
+                const std::vector<float>& weights = prim.attributes["WEIGHTS_0"];
+                size_t nverts = mesh->positions.size();
+                if (prim.ncomps["JOINTS_0"] != 4 || prim.ncomps["WEIGHTS_0"] != 4 || joints.size() != nverts * 4 || weights.size() != nverts * 4)
+                {
+                    return;
+                }
+                const std::vector<std::shared_ptr<Node> >& skin_joints = skin->GetJoints();
+                std::shared_ptr<SkinWeight> sw(new SkinWeight());
+                sw->name = mesh->name;
+                for (size_t j = 0; j < skin_joints.size(); j++)
+                {
+                    sw->joint_paths.push_back(skin_joints[j]->GetPath());
+                }
+                sw->joint_bind_matrices = skin->GetJointBindMatrices();
+                sw->weights.resize(nverts);
+                for (size_t v = 0; v < nverts; v++)
+                {
+                    for (int k = 0; k < 4; k++)
+                    {
+                        int joint = (int)(joints[4 * v + k] + 0.5f);
+                        float w = weights[4 * v + k];
+                        if (w > 0.0f && joint >= 0 && joint < (int)skin_joints.size())
+                        {
+                            sw->weights[v][sw->joint_paths[joint]] += w;
+                        }
+                    }
+                }
+                mesh->skin_weight = sw;
+                skin->AddSkinWeight(sw);
+            }
+
+            void CreateMorphTargets(std::shared_ptr<Mesh>& mesh, const picojson::object& primitive, const std::vector<float>& weights,
+                                    const std::vector<std::string>& names)
+            {
+                const picojson::array* targets = GetArray(primitive, "targets");
+                if (!targets || targets->empty())
+                {
+                    return;
+                }
+                size_t nverts = mesh->positions.size();
+                std::shared_ptr<MorphTargets> morph(new MorphTargets());
+                for (size_t i = 0; i < targets->size(); i++)
+                {
+                    std::shared_ptr<MorphTarget> target(new MorphTarget());
+                    const picojson::object* nd = GetObject((*targets)[i]);
+                    const char* keys[2] = {"POSITION", "NORMAL"};
+                    std::vector<glm::vec3>* dst[2] = {&target->positions, &target->normals};
+                    for (int k = 0; nd && k < 2; k++)
+                    {
+                        std::vector<float> values;
+                        int ncomp = 0;
+                        int acc = GetIndex(*nd, keys[k]);
+                        if (acc >= 0 && ReadAccessor(doc_, acc, values, ncomp) && ncomp == 3 && values.size() == nverts * 3)
+                        {
+                            dst[k]->resize(nverts);
+                            for (size_t v = 0; v < nverts; v++)
+                            {
+                                (*dst[k])[v] = glm::vec3(values[3 * v + 0], values[3 * v + 1], values[3 * v + 2]);
+                            }
+                        }
+                    }
+                    if (target->normals.empty())
+                    {
+                        target->normals.assign(nverts, glm::vec3(0, 0, 0));
+                    }
+                    if (target->positions.empty())
+                    {
+                        target->positions.assign(nverts, glm::vec3(0, 0, 0));
+                    }
+                    morph->targets.push_back(target);
+                    morph->weights.push_back(i < weights.size() ? weights[i] : 0.0f);
+                    morph->names.push_back(i < names.size() ? names[i] : "target_" + IToS((int)i));
+                }
+                mesh->morph_targets = morph;
+            }
+
+            void CreateAnimations()
+            {
+                const picojson::array* animations = GetArray(root_, "animations");
+                for (size_t i = 0; animations && i < animations->size(); i++)
+                {
+                    const picojson::object* nd = GetObject((*animations)[i]);
+                    const picojson::array* channels = nd ? GetArray(*nd, "channels") : NULL;
+                    const picojson::array* samplers = nd ? GetArray(*nd, "samplers") : NULL;
+                    if (!channels || !samplers)
+                    {
+                        continue;
+                    }
+                    std::shared_ptr<Animation> anim(new Animation());
+                    anim->SetName(GetString(*nd, "name", "animation_" + IToS((int)i)));
+                    for (size_t j = 0; j < channels->size(); j++)
+                    {
+                        const picojson::object* channel = GetObject((*channels)[j]);
+                        const picojson::object* target = channel ? GetObject(*channel, "target") : NULL;
+                        int s = channel ? GetIndex(*channel, "sampler") : -1;
+                        const picojson::object* sampler = (s >= 0 && s < (int)samplers->size()) ? GetObject((*samplers)[s]) : NULL;
+                        if (!target || !sampler)
+                        {
+                            continue;
+                        }
+                        int node = GetIndex(*target, "node");
+                        if (node < 0 || node >= (int)nodes_.size() || !nodes_[node])
+                        {
+                            continue;
+                        }
+                        std::string path_type = GetString(*target, "path");
+                        const char* components = NULL;
+                        int ncomp_expected = 0;
+                        if (path_type == "translation" || path_type == "scale")
+                        {
+                            components = "xyz";
+                            ncomp_expected = 3;
+                        }
+                        else if (path_type == "rotation")
+                        {
+                            components = "xyzw";
+                            ncomp_expected = 4;
+                        }
+                        else if (path_type == "weights")
+                        {
+                            components = "w";
+                            ncomp_expected = 1;
+                        }
+                        else
+                        {
+                            continue;
+                        }
+
+                        std::vector<float> input;
+                        std::vector<float> output;
+                        int ncomp_in = 0;
+                        int ncomp_out = 0;
+                        if (!ReadAccessor(doc_, GetIndex(*sampler, "input"), input, ncomp_in) ||
+                            !ReadAccessor(doc_, GetIndex(*sampler, "output"), output, ncomp_out) || ncomp_out != ncomp_expected)
+                        {
+                            continue;
+                        }
+
+                        AnimationInterporationType interpolation = LINEAR;
+                        std::string interp = GetString(*sampler, "interpolation", "LINEAR");
+                        if (interp == "STEP")
+                            interpolation = STEP;
+                        else if (interp == "CUBICSPLINE")
+                            interpolation = CUBICSPLINE;
+
+                        std::shared_ptr<AnimationPath> path(new AnimationPath());
+                        path->SetPathType(path_type);
+                        std::shared_ptr<AnimationCurve> keys(new AnimationCurve());
+                        keys->SetInterpolationType(interpolation);
+                        keys->SetValues(input);
+                        path->SetKeys(keys);
+                        for (int c = 0; c < ncomp_out; c++)
+                        {
+                            std::shared_ptr<AnimationCurve> curve(new AnimationCurve());
+                            curve->SetInterpolationType(interpolation);
+                            std::vector<float>& values = curve->GetValues();
+                            values.resize(output.size() / ncomp_out);
+                            for (size_t k = 0; k < values.size(); k++)
+                            {
+                                values[k] = output[k * ncomp_out + c];
+                            }
+                            path->SetCurve(std::string(1, components[c]), curve);
+                        }
+
+                        std::shared_ptr<AnimationInstruction> ins(new AnimationInstruction());
+                        ins->AddPath(path);
+                        ins->SetTarget(nodes_[node]);
+                        anim->AddInstruction(ins);
+                    }
+                    if (!anim->GetInstructions().empty())
+                    {
+                        scene_->AddAnimation(anim);
+                    }
+                }
+            }
+
+        private:
+            const Document& doc_;
+            const picojson::object& root_;
+            std::shared_ptr<Options> opts_;
+            std::shared_ptr<Node> scene_;
+            std::vector<std::shared_ptr<Node> > nodes_;
+            std::vector<std::shared_ptr<Skin> > skins_;
+            std::map<std::pair<int, bool>, std::shared_ptr<Texture> > textures_;
+            std::map<std::pair<int, int>, std::vector<MeshPart> > meshes_; // by glTF mesh and skin index
+            std::set<std::string> paths_;
+            std::vector<std::string> images_;
+            int default_material_;
+        };
+    } // namespace
+
+    std::shared_ptr<Node> glTFImporter::Import(const std::string& path, const std::shared_ptr<Options>& opts) const
+    {
+        Document doc;
+        if (!LoadDocument(doc, path))
+        {
+            return std::shared_ptr<Node>();
+        }
+        SceneBuilder builder(doc, opts ? opts : Options::GetGlobalOptions());
+        return builder.Build();
+    }
+} // namespace kml
@@ -0,0 +1,27 @@
+#pragma once
+#ifndef _KML_GLTF_IMPORTER_H_
+#define _KML_GLTF_IMPORTER_H_
+
+#include "Node.h"
+#include "Options.h"
+#include <memory>
+#include <string>
+
+namespace kml
+{
+    class glTFImporter
+    {
+    public:
+        // Loads a .gltf or .glb, decoding KHR_draco_mesh_compression when built with Draco.
+        // The tree has the shape glTFExporter takes: the root holds every material, skin and animation,
+        // and Mesh::materials index the root's materials. Primitives sharing their vertices make one Mesh,
+        // other primitives of a mesh become child nodes.
+        // Returns NULL on failure.
+        // Options:
+        //   embedded_image_dir    : directory to write images stored in buffers or data uris to ("", skipped)
+        //   embedded_image_prefix : file name prefix of those images (<file name>_image)
+        std::shared_ptr<Node> Import(const std::string& path, const std::shared_ptr<Options>& opts) const;
+    };
+} // namespace kml
+
+#endif
@@ -0,0 +1,689 @@
+#ifdef _WIN32
+#define _CRT_SECURE_NO_WARNINGS 1
+#endif
+
+// kml_convert : packs many .gltf, .glb and .kmlb scenes into .glb files in parallel.
+//
+//   kml_convert [options] input.gltf|input.glb|input.kmlb...
+//     -j N                   : worker threads (hardware concurrency)
+//     -o DIR                 : output directory (next to each input)
+//     --draco                : recompress meshes with Draco (off, builds with Draco only)
+//     --max-texture-size N   : resize embedded textures larger than N (0, keep)
+//     --texture-format EXT   : convert embedded textures, e.g. jpg or png (keep)
+//     --texture-quality Q    : jpeg quality 0-100 (90)
+//     --report PATH          : write a JSON report, "-" for stdout
+//
+// Files are handed to workers one at a time from a shared counter, so a large scene does not hold up
+// the rest. A failing file is reported and the output it started removed, the others are not affected.
+// Outputs that would overwrite an input are reported without touching either.
+//
+// A .gltf is packed as it is. With --draco, and for .glb and .kmlb inputs, the scene is loaded into a
+// Node tree and written again by glTFExporter; images stored inside a .glb are written out next to the
+// output for the exporter to read back, and removed afterwards.
+// Outputs and the order of the report do not depend on the number of threads.
+
+#include <kil/ParallelFor.h>
+#include <kil/TextureJob.h>
+#include <kml/GLTF2GLB.h>
+#include <kml/KMLBFile.h>
+#include <kml/MappedFile.h>
+#include <kml/Options.h>
+#include <kml/OutputSink.h>
+#include <kml/glTFExporter.h>
+#include <kml/glTFImporter.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <picojson/picojson.h>
+
+namespace
+{
+    struct ConvertOptions
+    {
+        ConvertOptions()
+            : threads(0), draco(false), max_texture_size(0), texture_quality(90)
+        {
+        }
+
+        int threads;
+        std::string output_dir;
+        bool draco;
+        int max_texture_size;
+        std::string texture_format;
+        int texture_quality;
+        std::string report_path;
+    };
+
+    struct ConvertResult
+    {
+        ConvertResult()
+            : ok(false), created(false), input_bytes(0), output_bytes(0), seconds(0)
+        {
+        }
+
+        std::string input;
+        std::string output;
+        bool ok;
+        bool created; // output was opened for writing by this run
+        std::string error;
+        double input_bytes; // input and every file it references
+        double output_bytes;
+        double seconds;
+    };
+
+    static std::string GetDirectoryPath(const std::string& path)
+    {
+        size_t pos = path.find_last_of("/\\");
+        if (pos == std::string::npos)
+        {
+            return "";
+        }
+        return path.substr(0, pos + 1);
+    }
+
+    static std::string GetFileName(const std::string& path)
+    {
+        size_t pos = path.find_last_of("/\\");
+        if (pos == std::string::npos)
+        {
+            return path;
+        }
+        return path.substr(pos + 1);
+    }
+
+    static std::string RemoveExt(const std::string& path)
+    {
+        size_t pos = path.find_last_of(".");
+        if (pos == std::string::npos || pos < GetDirectoryPath(path).size())
+        {
+            return path;
+        }
+        return path.substr(0, pos);
+    }
+
+    static std::string GetExt(const std::string& filepath)
+    {
+        if (filepath.find_last_of(".") != std::string::npos)
+            return filepath.substr(filepath.find_last_of("."));
+        return "";
+    }
+
+    static std::string ToLower(std::string s)
+    {
+        for (size_t i = 0; i < s.size(); i++)
+        {
+            s[i] = (char)tolower((unsigned char)s[i]);
+        }
+        return s;
+    }
+
+    // Key that is the same for two paths of one file, "" when the file does not exist.
+    static std::string GetFileID(const std::string& path)
+    {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0)
+        {
+            return "";
+        }
+#ifdef _WIN32
+        char full[_MAX_PATH];
+        return _fullpath(full, path.c_str(), _MAX_PATH) ? ToLower(full) : ToLower(path);
+#else
+        char buffer[64];
+        sprintf(buffer, "%llu:%llu", (unsigned long long)st.st_dev, (unsigned long long)st.st_ino);
+        return buffer;
+#endif
+    }
+
+    static double GetFileSize(const std::string& path)
+    {
+        kml::MappedFile file(path);
+        return file.IsOpen() ? (double)file.GetSize() : 0.0;
+    }
+
+    static std::string MakeOutputPath(const std::string& input, const ConvertOptions& opts)
+    {
+        std::string base = RemoveExt(GetFileName(input));
+        std::string dir = opts.output_dir.empty() ? GetDirectoryPath(input) : opts.output_dir;
+        if (!dir.empty() && dir[dir.size() - 1] != '/' && dir[dir.size() - 1] != '\\')
+        {
+            dir += "/";
+        }
+        return dir + base + ".glb";
+    }
+
+    static bool IsEmbeddedURI(const std::string& uri)
+    {
+        return uri.compare(0, 5, "data:") == 0;
+    }
+
+    static bool IsTextureConversion(const ConvertOptions& opts)
+    {
+        return opts.max_texture_size > 0 || !opts.texture_format.empty();
+    }
+
+    // Files removed when it goes out of scope, whichever way the conversion ends.
+    struct TemporaryFiles
+    {
+        std::vector<std::string> paths;
+
+        ~TemporaryFiles()
+        {
+            for (size_t i = 0; i < paths.size(); i++)
+            {
+                remove(paths[i].c_str());
+            }
+        }
+    };
+
+    // Converts each image into a temporary file next to the output, replacing its path by the temporary.
+    static bool ConvertTextures(std::vector<std::string>& paths, const std::string& output, const ConvertOptions& opts,
+                                ConvertResult& result, std::vector<std::string>& temporaries)
+    {
+        std::vector<kil::TextureJob> jobs;
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            std::string ext = opts.texture_format.empty() ? GetExt(paths[i]) : "." + opts.texture_format;
+            char buffer[32];
+            sprintf(buffer, ".texture%d", (int)i);
+
+            kil::TextureJob job;
+            job.type = (opts.max_texture_size > 0) ? kil::TEXTURE_JOB_RESIZE : kil::TEXTURE_JOB_COPY;
+            job.src_path = paths[i];
+            job.dst_path = RemoveExt(output) + buffer + ext;
+            job.maximum_size = opts.max_texture_size;
+            job.resize_size = opts.max_texture_size;
+            job.quality = opts.texture_quality / 100.0f;
+            jobs.push_back(job);
+            temporaries.push_back(job.dst_path);
+        }
+
+        // Worker threads are marked as ParallelFor threads, so the jobs of one file run serially here.
+        bool bRet = kil::RunTextureJobs(jobs);
+        for (size_t j = 0; j < jobs.size(); j++)
+        {
+            if (jobs[j].result)
+            {
+                paths[j] = jobs[j].dst_path;
+            }
+            else if (result.error.empty())
+            {
+                result.error = "texture conversion failed : " + jobs[j].src_path;
+            }
+        }
+        return bRet;
+    }
+
+    // Makes every buffer and image uri a path, so the document no longer depends on its directory.
+    // Textures are converted into temporary files next to the output when requested.
+    static bool ResolveURIs(picojson::object& root, const std::string& dir, const std::string& output, const ConvertOptions& opts,
+                            ConvertResult& result, std::vector<std::string>& temporaries)
+    {
+        const char* keys[] = {"buffers", "images"};
+        for (int k = 0; k < 2; k++)
+        {
+            if (root.find(keys[k]) == root.end())
+            {
+                continue;
+            }
+            if (!root[keys[k]].is<picojson::array>())
+            {
+                result.error = std::string("invalid ") + keys[k];
+                return false;
+            }
+            picojson::array& items = root[keys[k]].get<picojson::array>();
+            for (size_t i = 0; i < items.size(); i++)
+            {
+                if (!items[i].is<picojson::object>())
+                {
+                    result.error = std::string("invalid ") + keys[k];
+                    return false;
+                }
+                picojson::object& item = items[i].get<picojson::object>();
+                if (item.find("uri") == item.end() || !item["uri"].is<std::string>())
+                {
+                    continue;
+                }
+                std::string uri = item["uri"].get<std::string>();
+                if (IsEmbeddedURI(uri))
+                {
+                    result.error = std::string("data uris are not supported : ") + keys[k];
+                    return false;
+                }
+                std::string path = dir + uri;
+                result.input_bytes += GetFileSize(path);
+                item["uri"] = picojson::value(path);
+            }
+        }
+
+        if (!IsTextureConversion(opts) || root.find("images") == root.end())
+        {
+            return true;
+        }
+
+        std::vector<std::string> paths;
+        std::vector<size_t> indices;
+        picojson::array& images = root["images"].get<picojson::array>();
+        for (size_t i = 0; i < images.size(); i++)
+        {
+            picojson::object& image = images[i].get<picojson::object>();
+            if (image.find("uri") == image.end() || !image["uri"].is<std::string>())
+            {
+                continue;
+            }
+            paths.push_back(image["uri"].get<std::string>());
+            indices.push_back(i);
+        }
+        bool bRet = ConvertTextures(paths, output, opts, result, temporaries);
+        for (size_t j = 0; j < paths.size(); j++)
+        {
+            images[indices[j]].get<picojson::object>()["uri"] = picojson::value(paths[j]);
+        }
+        return bRet;
+    }
+
+    static void GetTextures(const std::shared_ptr<kml::Node>& node, std::map<std::string, std::vector<std::shared_ptr<kml::Texture> > >& textures)
+    {
+        const std::vector<std::shared_ptr<kml::Material> >& materials = node->GetMaterials();
+        for (size_t i = 0; i < materials.size(); i++)
+        {
+            std::vector<std::string> keys = materials[i]->GetTextureKeys();
+            for (size_t k = 0; k < keys.size(); k++)
+            {
+                std::shared_ptr<kml::Texture> texture = materials[i]->GetTexture(keys[k]);
+                if (texture.get() && !texture->GetFilePath().empty())
+                {
+                    textures[texture->GetFilePath()].push_back(texture);
+                }
+            }
+        }
+        const std::vector<std::shared_ptr<kml::Node> >& children = node->GetChildren();
+        for (size_t i = 0; i < children.size(); i++)
+        {
+            GetTextures(children[i], textures);
+        }
+    }
+
+    // Loads a .glb or .kmlb, or a .gltf to recompress, and writes it again with glTFExporter.
+    static bool ConvertScene(const std::string& input, const std::string& output, const ConvertOptions& opts, ConvertResult& result)
+    {
+        std::shared_ptr<kml::Options> kml_opts(new kml::Options());
+        kml_opts->SetInt("output_buffer", opts.draco ? 1 : 0);
+        std::string image_dir = GetDirectoryPath(output).empty() ? std::string("./") : GetDirectoryPath(output);
+        std::string image_prefix = GetFileName(RemoveExt(output)) + ".image";
+        kml_opts->SetString("embedded_image_dir", image_dir);
+        kml_opts->SetString("embedded_image_prefix", image_prefix);
+
+        std::shared_ptr<kml::Node> node;
+        if (ToLower(GetExt(GetFileName(input))) == ".kmlb")
+        {
+            node = kml::LoadKMLB(input);
+        }
+        else
+        {
+            kml::glTFImporter importer;
+            node = importer.Import(input, kml_opts);
+        }
+        result.input_bytes += GetFileSize(input);
+
+        TemporaryFiles temporaries;
+        std::map<std::string, std::vector<std::shared_ptr<kml::Texture> > > textures;
+        if (node.get())
+        {
+            GetTextures(node, textures);
+        }
+        std::vector<std::string> paths;
+        for (std::map<std::string, std::vector<std::shared_ptr<kml::Texture> > >::iterator it = textures.begin(); it != textures.end(); ++it)
+        {
+            if (it->first.compare(0, image_dir.size() + image_prefix.size(), image_dir + image_prefix) == 0)
+            {
+                temporaries.paths.push_back(it->first);
+            }
+            else
+            {
+                result.input_bytes += GetFileSize(it->first);
+            }
+            paths.push_back(it->first);
+        }
+
+        bool bRet = node.get() != NULL;
+        if (!bRet)
+        {
+            result.error = "couldn't load input";
+        }
+        if (bRet && IsTextureConversion(opts))
+        {
+            bRet = ConvertTextures(paths, output, opts, result, temporaries.paths);
+            size_t j = 0;
+            for (std::map<std::string, std::vector<std::shared_ptr<kml::Texture> > >::iterator it = textures.begin(); it != textures.end(); ++it, ++j)
+            {
+                for (size_t k = 0; k < it->second.size(); k++)
+                {
+                    it->second[k]->SetFilePath(paths[j]);
+                }
+            }
+        }
+        if (bRet)
+        {
+            kml::FileOutputSink sink(output);
+            result.created = sink.IsOpen();
+            kml::glTFExporter exporter;
+            if (!sink.IsOpen())
+            {
+                result.error = "couldn't open output";
+                bRet = false;
+            }
+            else if (!exporter.Export(sink, node, kml_opts))
+            {
+                result.error = "export failed";
+                bRet = false;
+            }
+        }
+        if (bRet)
+        {
+            result.output_bytes = GetFileSize(output);
+        }
+        return bRet;
+    }
+
+    static bool ConvertFile(const std::string& input, const std::string& output, const ConvertOptions& opts, ConvertResult& result)
+    {
+        if (opts.draco || ToLower(GetExt(GetFileName(input))) != ".gltf")
+        {
+            return ConvertScene(input, output, opts, result);
+        }
+
+        picojson::value root;
+        {
+            kml::MappedFile json(input);
+            if (!json.IsOpen())
+            {
+                result.error = "couldn't open input";
+                return false;
+            }
+            result.input_bytes += (double)json.GetSize();
+
+            std::string err;
+            const char* begin = (const char*)json.GetData();
+            picojson::parse(root, begin, begin + json.GetSize(), &err);
+            if (!err.empty())
+            {
+                result.error = "parse error : " + err;
+                return false;
+            }
+        }
+        if (!root.is<picojson::object>())
+        {
+            result.error = "not a glTF document";
+            return false;
+        }
+
+        TemporaryFiles temporaries;
+        bool bRet = ResolveURIs(root.get<picojson::object>(), GetDirectoryPath(input), output, opts, result, temporaries.paths);
+        if (bRet)
+        {
+            kml::FileOutputSink sink(output);
+            result.created = sink.IsOpen();
+            if (!sink.IsOpen())
+            {
+                result.error = "couldn't open output";
+                bRet = false;
+            }
+            else if (!kml::GLTF2GLB(root, "", sink))
+            {
+                result.error = "GLB packing failed";
+                bRet = false;
+            }
+        }
+        if (bRet)
+        {
+            result.output_bytes = GetFileSize(output);
+        }
+        return bRet;
+    }
+
+    static void WriteReport(std::ostream& os, const std::vector<ConvertResult>& results, int threads, double seconds)
+    {
+        picojson::array files;
+        double input_bytes = 0;
+        double output_bytes = 0;
+        int succeeded = 0;
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const ConvertResult& r = results[i];
+            picojson::object file;
+            file["input"] = picojson::value(r.input);
+            file["output"] = picojson::value(r.output);
+            file["ok"] = picojson::value(r.ok);
+            if (!r.ok)
+            {
+                file["error"] = picojson::value(r.error);
+            }
+            file["input_bytes"] = picojson::value(r.input_bytes);
+            file["output_bytes"] = picojson::value(r.output_bytes);
+            file["seconds"] = picojson::value(r.seconds);
+            files.push_back(picojson::value(file));
+
+            input_bytes += r.input_bytes;
+            output_bytes += r.output_bytes;
+            succeeded += r.ok ? 1 : 0;
+        }
+
+        picojson::object total;
+        total["files"] = picojson::value((double)results.size());
+        total["succeeded"] = picojson::value((double)succeeded);
+        total["failed"] = picojson::value((double)(results.size() - succeeded));
+        total["threads"] = picojson::value((double)threads);
+        total["input_bytes"] = picojson::value(input_bytes);
+        total["output_bytes"] = picojson::value(output_bytes);
+        total["seconds"] = picojson::value(seconds);
+        total["files_per_second"] = picojson::value(seconds > 0 ? results.size() / seconds : 0.0);
+        total["input_mb_per_second"] = picojson::value(seconds > 0 ? input_bytes / (1024.0 * 1024.0) / seconds : 0.0);
+
+        picojson::object report;
+        report["files"] = picojson::value(files);
+        report["total"] = picojson::value(total);
+        os << picojson::value(report).serialize(true);
+    }
+
+    static void PrintUsage()
+    {
+        std::cerr << "usage: kml_convert [-j N] [-o DIR] [--draco] [--max-texture-size N] [--texture-format EXT]" << std::endl;
+        std::cerr << "                   [--texture-quality Q] [--report PATH] input.gltf|input.glb|input.kmlb..." << std::endl;
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    ConvertOptions opts;
+    std::vector<std::string> inputs;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "-j" && has_value)
+        {
+            opts.threads = atoi(argv[++i]);
+        }
+        else if (arg == "-o" && has_value)
+        {
+            opts.output_dir = argv[++i];
+        }
+        else if (arg == "--draco")
+        {
+#ifdef ENABLE_BUILD_WITH_DRACO
+            opts.draco = true;
+#else
+            std::cerr << "kml_convert : --draco needs a build with Draco" << std::endl;
+            return 2;
+#endif
+        }
+        else if (arg == "--max-texture-size" && has_value)
+        {
+            opts.max_texture_size = atoi(argv[++i]);
+        }
+        else if (arg == "--texture-format" && has_value)
+        {
+            opts.texture_format = argv[++i];
+        }
+        else if (arg == "--texture-quality" && has_value)
+        {
+            opts.texture_quality = atoi(argv[++i]);
+        }
+        else if (arg == "--report" && has_value)
+        {
+            opts.report_path = argv[++i];
+        }
+        else if (arg == "-h" || arg == "--help" || (!arg.empty() && arg[0] == '-'))
+        {
+            PrintUsage();
+            return 2;
+        }
+        else
+        {
+            inputs.push_back(arg);
+        }
+    }
+    if (inputs.empty())
+    {
+        PrintUsage();
+        return 2;
+    }
+
+    std::vector<ConvertResult> results(inputs.size());
+    std::set<std::string> input_ids;
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        std::string id = GetFileID(inputs[i]);
+        if (!id.empty())
+        {
+            input_ids.insert(id);
+        }
+    }
+    std::set<std::string> outputs;
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        results[i].input = inputs[i];
+        results[i].output = MakeOutputPath(inputs[i], opts);
+        std::string ext = ToLower(GetExt(GetFileName(inputs[i])));
+        if (ext != ".gltf" && ext != ".glb" && ext != ".kmlb")
+        {
+            results[i].error = "unsupported input, expected .gltf, .glb or .kmlb";
+        }
+        else if (input_ids.count(GetFileID(results[i].output)))
+        {
+            results[i].error = "output would overwrite an input";
+        }
+        else if (!outputs.insert(results[i].output).second)
+        {
+            results[i].error = "duplicate output path"; // the first input keeps it
+        }
+    }
+
+    int nthreads = opts.threads > 0 ? opts.threads : kil::GetNumberOfThreads();
+    nthreads = std::max<int>(1, std::min<int>(nthreads, (int)inputs.size()));
+
+    std::atomic<int> next(0);
+    std::atomic<int> finished(0);
+    std::mutex print_mutex;
+    auto worker = [&]() {
+        kil::IsInParallelFor() = true;
+        while (true)
+        {
+            int i = next.fetch_add(1);
+            if (i >= (int)inputs.size())
+            {
+                break;
+            }
+            ConvertResult& r = results[i];
+            std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+            if (r.error.empty())
+            {
+                // picojson reports type mismatches by throwing, keep them from taking down the batch
+                try
+                {
+                    r.ok = ConvertFile(r.input, r.output, opts, r);
+                }
+                catch (const std::exception& e)
+                {
+                    r.ok = false;
+                    r.error = std::string("exception : ") + e.what();
+                }
+                if (!r.ok && r.created)
+                {
+                    remove(r.output.c_str());
+                }
+            }
+            r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+            std::lock_guard<std::mutex> lock(print_mutex);
+            int n = ++finished;
+            std::cerr << "[" << n << "/" << inputs.size() << "] " << (r.ok ? "ok    " : "failed") << " " << r.input;
+            if (r.ok)
+            {
+                std::cerr << " -> " << r.output << " (" << (size_t)r.output_bytes << " bytes, " << r.seconds << " s)";
+            }
+            else
+            {
+                std::cerr << " : " << r.error;
+            }
+            std::cerr << std::endl;
+        }
+    };
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int t = 1; t < nthreads; t++)
+    {
+        threads.push_back(std::thread(worker));
+    }
+    worker();
+    for (size_t t = 0; t < threads.size(); t++)
+    {
+        threads[t].join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (opts.report_path == "-")
+    {
+        WriteReport(std::cout, results, nthreads, seconds);
+        std::cout << std::endl;
+    }
+    else if (!opts.report_path.empty())
+    {
+        std::ofstream ofs(opts.report_path.c_str());
+        if (!ofs)
+        {
+            std::cerr << "Couldn't write report : " << opts.report_path << std::endl;
+            return 1;
+        }
+        WriteReport(ofs, results, nthreads, seconds);
+    }
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        if (!results[i].ok)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
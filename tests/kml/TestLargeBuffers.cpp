@@ -0,0 +1,284 @@
+#include <kml/GLTF2GLB.h>
+#include <kml/Node.h>
+#include <kml/Options.h>
+#include <kml/glTFExporter.h>
+
+#include <picojson/picojson.h>
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+#define CHECK(cond)                                                                         \
+    if (!(cond))                                                                            \
+    {                                                                                       \
+        std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed" << std::endl; \
+        return false;                                                                       \
+    }
+
+static const size_t MB = 1024 * 1024;
+
+static long long GetFileSize(const std::string& path)
+{
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (!fp)
+    {
+        return -1;
+    }
+#ifdef _WIN32
+    _fseeki64(fp, 0, SEEK_END);
+    long long size = _ftelli64(fp);
+#else
+    fseeko(fp, 0, SEEK_END);
+    long long size = (long long)ftello(fp);
+#endif
+    fclose(fp);
+    return size;
+}
+
+static bool ReadJSON(const std::string& path, picojson::value& v)
+{
+    std::ifstream ifs(path.c_str(), std::ifstream::binary);
+    if (!ifs)
+    {
+        return false;
+    }
+    std::string json((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    std::string err;
+    picojson::parse(v, json.begin(), json.end(), &err);
+    return err.empty() && v.is<picojson::object>();
+}
+
+// Every bufferView has to lie inside its buffer.
+static bool CheckBufferViews(const picojson::object& root, std::vector<double>& buffer_lengths)
+{
+    const picojson::array& buffers = root.at("buffers").get<picojson::array>();
+    buffer_lengths.clear();
+    for (size_t i = 0; i < buffers.size(); i++)
+    {
+        buffer_lengths.push_back(buffers[i].get<picojson::object>().at("byteLength").get<double>());
+    }
+    const picojson::array& views = root.at("bufferViews").get<picojson::array>();
+    CHECK(!views.empty());
+    for (size_t i = 0; i < views.size(); i++)
+    {
+        const picojson::object& view = views[i].get<picojson::object>();
+        size_t buffer = (size_t)view.at("buffer").get<double>();
+        CHECK(buffer < buffer_lengths.size());
+        double offset = view.count("byteOffset") ? view.at("byteOffset").get<double>() : 0.0;
+        CHECK(offset + view.at("byteLength").get<double>() <= buffer_lengths[buffer]);
+    }
+    return true;
+}
+
+// Meshes of nquads quads each, every vertex with a normal and a texcoord: 32 bytes a vertex.
+static std::shared_ptr<kml::Node> CreateScene(int nmeshes, int nquads)
+{
+    std::shared_ptr<kml::Node> root(new kml::Node());
+    root->SetName("root");
+    root->SetPath("/root");
+    root->AddMaterial(std::shared_ptr<kml::Material>(new kml::Material()));
+    for (int m = 0; m < nmeshes; m++)
+    {
+        std::shared_ptr<kml::Mesh> mesh(new kml::Mesh());
+        for (int q = 0; q < nquads; q++)
+        {
+            static const float CORNERS[4][2] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
+            static const int TRIANGLES[6] = {0, 1, 2, 0, 2, 3};
+            int base = (int)mesh->positions.size();
+            for (int k = 0; k < 4; k++)
+            {
+                mesh->positions.push_back(glm::vec3(q + CORNERS[k][0], m + CORNERS[k][1], 0.0f));
+                mesh->normals.push_back(glm::vec3(0, 0, 1));
+                mesh->texcoords.push_back(glm::vec2(CORNERS[k][0], CORNERS[k][1]));
+            }
+            for (int t = 0; t < 2; t++)
+            {
+                mesh->facenums.push_back(3);
+                mesh->materials.push_back(0);
+                for (int k = 0; k < 3; k++)
+                {
+                    mesh->pos_indices.push_back(base + TRIANGLES[3 * t + k]);
+                }
+            }
+        }
+        mesh->nor_indices = mesh->pos_indices;
+        mesh->tex_indices = mesh->pos_indices;
+
+        char name[32];
+        sprintf(name, "mesh_%d", m);
+        std::shared_ptr<kml::Node> node(new kml::Node());
+        node->SetName(name);
+        node->SetPath(std::string("/root/") + name);
+        node->SetMesh(mesh);
+        root->AddChild(node);
+    }
+    return root;
+}
+
+// A scene of about 2.5MB exported with buffer_split_size_mb = 1 is spread over several .bin files,
+// none over the limit, and GLTF2GLB joins them back into one BIN chunk.
+static bool TestSplitBuffers()
+{
+    const std::string path = "./large_buffers_split.gltf";
+    const std::string glb_path = "./large_buffers_split.glb";
+    std::shared_ptr<kml::Options> opts(new kml::Options());
+    opts->SetInt("buffer_split_size_mb", 1);
+    kml::glTFExporter exporter;
+    CHECK(exporter.Export(path, CreateScene(4, 4096), opts));
+
+    picojson::value v;
+    CHECK(ReadJSON(path, v));
+    const picojson::object& root = v.get<picojson::object>();
+    std::vector<double> lengths;
+    CHECK(CheckBufferViews(root, lengths));
+    CHECK(lengths.size() > 1);
+    const picojson::array& buffers = root.at("buffers").get<picojson::array>();
+    double total = 0;
+    for (size_t i = 0; i < buffers.size(); i++)
+    {
+        std::string uri = buffers[i].get<picojson::object>().at("uri").get<std::string>();
+        CHECK(lengths[i] <= 1 * MB);
+        CHECK(GetFileSize("./" + uri) == (long long)lengths[i]);
+        total += lengths[i];
+    }
+
+    CHECK(kml::GLTF2GLB(path, glb_path));
+    std::vector<unsigned char> glb;
+    {
+        std::ifstream ifs(glb_path.c_str(), std::ifstream::binary);
+        glb.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    }
+    CHECK(glb.size() > 20);
+    uint32_t header[5];
+    memcpy(header, &glb[0], sizeof(header));
+    CHECK(header[0] == 0x46546C67);
+    CHECK(header[2] == glb.size());
+    picojson::value glb_json;
+    std::string err;
+    const char* json_begin = (const char*)&glb[20];
+    picojson::parse(glb_json, json_begin, json_begin + header[3], &err);
+    CHECK(err.empty());
+    CHECK(CheckBufferViews(glb_json.get<picojson::object>(), lengths));
+    CHECK(lengths.size() == 1);
+    CHECK(lengths[0] >= total);
+
+    for (size_t i = 0; i < buffers.size(); i++)
+    {
+        remove(("./" + buffers[i].get<picojson::object>().at("uri").get<std::string>()).c_str());
+    }
+    remove(path.c_str());
+    remove(glb_path.c_str());
+    return true;
+}
+
+static bool ReadAt(const std::string& path, double offset, size_t size, std::vector<unsigned char>& bytes)
+{
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (!fp)
+    {
+        return false;
+    }
+    bytes.resize(size);
+#ifdef _WIN32
+    bool ok = _fseeki64(fp, (long long)offset, SEEK_SET) == 0;
+#else
+    bool ok = fseeko(fp, (off_t)offset, SEEK_SET) == 0;
+#endif
+    ok = ok && fread(&bytes[0], 1, size, fp) == size;
+    fclose(fp);
+    return ok;
+}
+
+// Byte range of the POSITION data of the first primitive of mesh m.
+static bool GetPositionRange(const picojson::object& root, size_t m, double& offset, double& length)
+{
+    const picojson::object& mesh = root.at("meshes").get<picojson::array>()[m].get<picojson::object>();
+    const picojson::object& prim = mesh.at("primitives").get<picojson::array>()[0].get<picojson::object>();
+    size_t a = (size_t)prim.at("attributes").get<picojson::object>().at("POSITION").get<double>();
+    const picojson::object& acc = root.at("accessors").get<picojson::array>()[a].get<picojson::object>();
+    size_t v = (size_t)acc.at("bufferView").get<double>();
+    const picojson::object& view = root.at("bufferViews").get<picojson::array>()[v].get<picojson::object>();
+    offset = (view.count("byteOffset") ? view.at("byteOffset").get<double>() : 0.0) +
+             (acc.count("byteOffset") ? acc.at("byteOffset").get<double>() : 0.0);
+    length = acc.at("count").get<double>() * 12;
+    CHECK(offset + length <= view.at("byteLength").get<double>() + (view.count("byteOffset") ? view.at("byteOffset").get<double>() : 0.0));
+    return true;
+}
+
+// About 4.4GB of geometry streamed into one unsplit buffer: offsets past 4GB have to reach the JSON and
+// the file exactly, and GLTF2GLB has to refuse the scene since a GLB cannot hold it.
+static bool TestLargeExport()
+{
+    if (sizeof(size_t) < 8)
+    {
+        return true;
+    }
+    const std::string path = "./large_buffers_4gb.gltf";
+    const std::string bin_path = "./large_buffers_4gb.bin";
+    const std::string glb_path = "./large_buffers_4gb.glb";
+    const double GB4 = 4294967296.0;
+
+    // one mesh of 76MB written once per node
+    std::shared_ptr<kml::Node> root = CreateScene(1, 1 << 19);
+    std::shared_ptr<kml::Node> first = root->GetChildren()[0];
+    for (int m = 1; m < 58; m++)
+    {
+        char name[32];
+        sprintf(name, "mesh_%d", m);
+        std::shared_ptr<kml::Node> node(new kml::Node());
+        node->SetName(name);
+        node->SetPath(std::string("/root/") + name);
+        node->SetMesh(first->GetMesh());
+        root->AddChild(node);
+    }
+    std::shared_ptr<kml::Options> opts(new kml::Options());
+    opts->SetInt("stream_buffers", 1);
+    opts->SetInt("buffer_split_size_mb", 0);
+    kml::glTFExporter exporter;
+    bool exported = exporter.Export(path, root, opts);
+    root.reset();
+    first.reset();
+
+    bool ok = exported;
+    picojson::value v;
+    ok = ok && ReadJSON(path, v);
+    std::vector<double> lengths;
+    ok = ok && CheckBufferViews(v.get<picojson::object>(), lengths);
+    ok = ok && lengths.size() == 1 && lengths[0] > GB4;
+    ok = ok && GetFileSize(bin_path) == (long long)lengths[0];
+
+    // the last mesh lies past 4GB and holds the same positions as the first
+    double offset0 = 0, offset1 = 0, length0 = 0, length1 = 0;
+    ok = ok && GetPositionRange(v.get<picojson::object>(), 0, offset0, length0);
+    ok = ok && GetPositionRange(v.get<picojson::object>(), 57, offset1, length1);
+    ok = ok && offset1 > GB4 && length0 == length1;
+    std::vector<unsigned char> bytes0;
+    std::vector<unsigned char> bytes1;
+    ok = ok && ReadAt(bin_path, offset0, 4096, bytes0) && ReadAt(bin_path, offset1, 4096, bytes1) && bytes0 == bytes1;
+
+    ok = ok && !kml::GLTF2GLB(path, glb_path);
+    ok = ok && GetFileSize(glb_path) <= 0;
+
+    remove(path.c_str());
+    remove(bin_path.c_str());
+    remove(glb_path.c_str());
+    CHECK(ok);
+    return true;
+}
+
+int main()
+{
+    bool ok = true;
+    ok = TestSplitBuffers() && ok;
+    ok = TestLargeExport() && ok;
+    return ok ? 0 : 1;
+}
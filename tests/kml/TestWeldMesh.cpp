@@ -0,0 +1,86 @@
+#include <kml/WeldMesh.h>
+
+#include <glm/glm.hpp>
+
+#include <iostream>
+#include <memory>
+
+#define CHECK(cond)                                                                         \
+    if (!(cond))                                                                            \
+    {                                                                                       \
+        std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed" << std::endl; \
+        return false;                                                                       \
+    }
+
+// A strip of triangles over points spaced just under the tolerance: welding must not chain
+// the merges along the strip, every point has to stay within the tolerance of where it goes.
+static bool TestChainedPoints()
+{
+    static const int NPOINTS = 100;
+    static const float SPACING = 0.009f;
+    static const float TOLERANCE = 0.01f;
+
+    std::shared_ptr<kml::Mesh> mesh(new kml::Mesh());
+    for (int i = 0; i < NPOINTS; i++)
+    {
+        mesh->positions.push_back(glm::vec3(i * SPACING, 0.0f, 0.0f));
+    }
+    for (int i = 0; i + 2 < NPOINTS; i++)
+    {
+        mesh->facenums.push_back(3);
+        mesh->materials.push_back(0);
+        for (int j = 0; j < 3; j++)
+        {
+            mesh->pos_indices.push_back(i + j);
+        }
+    }
+    std::vector<glm::vec3> original = mesh->positions;
+    std::vector<int> original_indices = mesh->pos_indices;
+
+    CHECK(kml::WeldMesh(mesh, TOLERANCE, 0.0f, 0.0f));
+    CHECK(mesh->positions.size() == NPOINTS / 2);
+    CHECK(mesh->pos_indices.size() == original_indices.size());
+    for (size_t i = 0; i < original_indices.size(); i++)
+    {
+        glm::vec3 d = mesh->positions[mesh->pos_indices[i]] - original[original_indices[i]];
+        CHECK(glm::dot(d, d) <= TOLERANCE * TOLERANCE);
+    }
+    return true;
+}
+
+// Coincident corners of two faces with different texcoords: the positions merge, the UV seam stays.
+static bool TestSeams()
+{
+    std::shared_ptr<kml::Mesh> mesh(new kml::Mesh());
+    static const float P[6][2] = {{0, 0}, {1, 0}, {0, 1}, {1, 0.000001f}, {2, 0}, {0.000001f, 1}};
+    static const float T[6][2] = {{0, 0}, {0.5f, 0}, {0, 1}, {0.6f, 0}, {1, 0}, {0.1f, 1}};
+    for (int i = 0; i < 6; i++)
+    {
+        mesh->positions.push_back(glm::vec3(P[i][0], P[i][1], 0.0f));
+        mesh->texcoords.push_back(glm::vec2(T[i][0], T[i][1]));
+        mesh->normals.push_back(glm::vec3(0, 0, 1));
+        mesh->pos_indices.push_back(i);
+        mesh->tex_indices.push_back(i);
+        mesh->nor_indices.push_back(i);
+    }
+    mesh->facenums.push_back(3);
+    mesh->facenums.push_back(3);
+    mesh->materials.push_back(0);
+    mesh->materials.push_back(0);
+
+    CHECK(kml::WeldMesh(mesh, 0.001f, 0.001f, 0.00001f));
+    CHECK(mesh->positions.size() == 4);
+    CHECK(mesh->normals.size() == 1);
+    CHECK(mesh->texcoords.size() == 6);
+    CHECK(mesh->pos_indices[3] == mesh->pos_indices[1]);
+    CHECK(mesh->pos_indices[5] == mesh->pos_indices[2]);
+    return true;
+}
+
+int main()
+{
+    bool ok = true;
+    ok = TestChainedPoints() && ok;
+    ok = TestSeams() && ok;
+    return ok ? 0 : 1;
+}